@@ -0,0 +1,169 @@
+/**
+ * Helpers shared by the benchmarks.
+ *
+ * @author Claudio Sousa, Gonzalez David
+ * @file
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include "bench.h"
+
+/**
+ * Syscall marking the end of a phase, which the code measured does not issue otherwise
+ */
+#define BENCH_PHASE_SYSCALL SYS_getppid
+
+double bench_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+uint64_t bench_random(uint64_t *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+void bench_timings_add(bench_timings_t *timings, double duration) {
+    if (timings->count < BENCH_MAX_ITERATIONS) {
+        timings->durations[timings->count++] = duration;
+    }
+}
+
+double bench_timings_total(bench_timings_t *timings) {
+    double total = 0;
+    for (int i = 0; i < timings->count; i++) {
+        total += timings->durations[i];
+    }
+    return total;
+}
+
+/**
+ * Compare two durations, for qsort().
+ */
+static int bench_compare(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Get a percentile of sorted durations, by the nearest rank method.
+ * @param timings The durations, sorted
+ * @param percentile The percentile, between 0 and 100
+ * @return The duration, in seconds
+ */
+static double bench_percentile(bench_timings_t *timings, int percentile) {
+    int rank = (percentile * timings->count + 99) / 100;
+    return timings->durations[rank > 0 ? rank - 1 : 0];
+}
+
+void bench_write_percentiles(FILE *output, bench_timings_t *timings) {
+    qsort(timings->durations, timings->count, sizeof(double), bench_compare);
+    fprintf(output, "\"min_ms\":%.3f,\"p50_ms\":%.3f,\"p90_ms\":%.3f,\"p99_ms\":%.3f,\"max_ms\":%.3f",
+            timings->durations[0] * 1e3, bench_percentile(timings, 50) * 1e3, bench_percentile(timings, 90) * 1e3,
+            bench_percentile(timings, 99) * 1e3, timings->durations[timings->count - 1] * 1e3);
+}
+
+void bench_write_string(FILE *output, char *text) {
+    fputc('"', output);
+    for (unsigned char *c = (unsigned char *)text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(output, "\\%c", *c);
+        } else if (*c < 0x20) {
+            fprintf(output, "\\u%04x", *c);
+        } else {
+            fputc(*c, output);
+        }
+    }
+    fputc('"', output);
+}
+
+int bench_drop_caches(void) {
+    sync();
+    FILE *file = fopen("/proc/sys/vm/drop_caches", "w");
+    if (file == NULL) {
+        return 1;
+    }
+    int error = fputs("3\n", file) < 0;
+    return fclose(file) != 0 || error;
+}
+
+int bench_count_syscalls(bench_run_t run, void *data, unsigned long *phases, int count) {
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0) {
+        return -1;
+    }
+    if (pid == 0) {
+        if (ptrace(PTRACE_TRACEME, 0, NULL, NULL) != 0) {
+            _exit(1);
+        }
+        raise(SIGSTOP);
+        run(data);
+        _exit(0);
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) != pid || !WIFSTOPPED(status)) {
+        return -1;
+    }
+    ptrace(PTRACE_SETOPTIONS, pid, NULL,
+           (void *)(PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL));
+
+    memset(phases, 0, count * sizeof(unsigned long));
+    int phase = 0, signal = 0;
+    pid_t tid = pid;
+    bool resume = true;
+    for (;;) {
+        if (resume) {
+            ptrace(PTRACE_SYSCALL, tid, NULL, (void *)(long)signal);
+        }
+        tid = waitpid(-1, &status, __WALL);
+        if (tid < 0) {
+            return -1;
+        }
+        // The exit of the main thread is reported once all the others exited
+        resume = WIFSTOPPED(status);
+        if (!resume) {
+            if (tid == pid) {
+                break;
+            }
+            continue;
+        }
+
+        signal = 0;
+        if (WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+            struct __ptrace_syscall_info info;
+            if (ptrace(PTRACE_GET_SYSCALL_INFO, tid, (void *)sizeof(info), &info) > 0 &&
+                info.op == PTRACE_SYSCALL_INFO_ENTRY) {
+                if (tid == pid && info.entry.nr == BENCH_PHASE_SYSCALL) {
+                    phase++;
+                } else if (info.entry.nr != SYS_exit_group) {
+                    phases[phase < count ? phase : count - 1]++;
+                }
+            }
+        } else if (WSTOPSIG(status) != SIGTRAP && WSTOPSIG(status) != SIGSTOP) {
+            // Signals other than the stops of the tracing are delivered
+            signal = WSTOPSIG(status);
+        }
+    }
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        return -1;
+    }
+    return phase + 1 < count ? phase + 1 : count;
+}
+
+void bench_phase(void) {
+    syscall(BENCH_PHASE_SYSCALL);
+}
@@ -0,0 +1,119 @@
+/**
+ * Helpers shared by the benchmarks: timings and their percentiles, JSON output, cold caches,
+ * deterministic random numbers, syscall counting and the format of the corpus of files.
+ *
+ * The syscalls are counted by running the code measured in a child process traced by ptrace(), every
+ * syscall entry of each of its threads being counted. The code can split its run into phases by calling
+ * bench_phase(), each phase getting its own count. Tracing slows the child down a lot, so the syscalls are
+ * counted by a run apart from the timed ones.
+ *
+ * @author Claudio Sousa, Gonzalez David
+ * @file
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/**
+ * Maximum number of durations of timings
+ */
+#define BENCH_MAX_ITERATIONS 1000
+
+/**
+ * Magic number beginning a corpus of files, recorded by statdump
+ */
+#define BENCH_CORPUS_MAGIC "SFCORPUS"
+
+/**
+ * Header of a corpus of files, followed by the files
+ */
+typedef struct bench_corpus_header_t {
+    char magic[8];      /**< BENCH_CORPUS_MAGIC, without terminating null byte */
+    uint32_t stat_size; /**< Size of the struct stat of the files, to catch a corpus of another machine */
+    int64_t captured;   /**< When the corpus was recorded, in seconds since the Epoch */
+    uint64_t count;     /**< Number of files */
+} bench_corpus_header_t;
+
+/**
+ * Durations of timed runs
+ */
+typedef struct bench_timings_t {
+    double durations[BENCH_MAX_ITERATIONS]; /**< Durations, in seconds */
+    int count;                              /**< Number of durations */
+} bench_timings_t;
+
+/**
+ * Code whose syscalls are counted
+ * @param data Data given to bench_count_syscalls()
+ */
+typedef void (*bench_run_t)(void *data);
+
+/**
+ * Get the current time of the monotonic clock.
+ * @return The time, in seconds
+ */
+double bench_now(void);
+
+/**
+ * Get the next deterministic random number (xorshift64*).
+ * @param state State of the generator, never 0
+ * @return The number
+ */
+uint64_t bench_random(uint64_t *state);
+
+/**
+ * Add a duration to timings, ignored past BENCH_MAX_ITERATIONS.
+ * @param timings The timings
+ * @param duration The duration, in seconds
+ */
+void bench_timings_add(bench_timings_t *timings, double duration);
+
+/**
+ * Get the total of the durations of timings.
+ * @param timings The timings
+ * @return The total, in seconds
+ */
+double bench_timings_total(bench_timings_t *timings);
+
+/**
+ * Write the minimum, percentiles (nearest rank) and maximum of timings as JSON members, in milliseconds:
+ * `"min_ms":…,"p50_ms":…,"p90_ms":…,"p99_ms":…,"max_ms":…`.
+ * @param output Where to write
+ * @param timings The timings, at least one, sorted in place
+ */
+void bench_write_percentiles(FILE *output, bench_timings_t *timings);
+
+/**
+ * Write a string escaped for JSON, with its quotes.
+ * @param output Where to write
+ * @param text The string
+ */
+void bench_write_string(FILE *output, char *text);
+
+/**
+ * Write the dirty pages and drop the page, dentry and inode caches, which requires to be root.
+ * @return Error indicator: 0 for OK, 1 if they cannot be dropped
+ */
+int bench_drop_caches(void);
+
+/**
+ * Count the syscalls of code run in a child process traced by ptrace().
+ * The final exit of the child and the calls to bench_phase() are not counted.
+ * @param run The code, which may call bench_phase() to begin a new phase
+ * @param data Data given to `run`
+ * @param phases Receives the number of syscalls of each phase
+ * @param count Maximum number of phases, the syscalls of the following ones being added to the last one
+ * @return Number of phases run, -1 if the child cannot be traced or fails
+ */
+int bench_count_syscalls(bench_run_t run, void *data, unsigned long *phases, int count);
+
+/**
+ * End the current phase of the code whose syscalls are counted, and begin the next one.
+ * Does nothing outside bench_count_syscalls(), but a syscall.
+ */
+void bench_phase(void);
+
+#endif
@@ -0,0 +1,249 @@
+/**
+ * Benchmarks the traversals of the finder over representative expressions.
+ *
+ * For each expression, the search path is traversed by finder_find_stream(), first with warm caches: a
+ * first traversal is discarded, then `iterations` traversals are timed. With `-c`, `iterations` more
+ * traversals are timed with cold caches, the page, dentry and inode caches being dropped before each of
+ * them, which requires to be root.
+ *
+ * The syscalls of one traversal are counted in a child process traced by ptrace(), outside the timed
+ * traversals. If the child cannot be traced, they are estimated from the counters of the finder.
+ *
+ * With `-m depth,fanout,files`, the search path is a synthetic tree generated in an in-memory file system
+ * (memfs.h) rather than a directory of the disk, to measure the finder alone. With `-L microseconds` too, each
+ * opening, entry read and stat of the in-memory file system waits this latency, as a slow or remote file system.
+ *
+ * The results are written as JSON, to compare them between builds:
+ * the entries read per second, syscalls per entry, peak RSS and percentiles of the durations.
+ *
+ * @author Claudio Sousa, Gonzalez David
+ * @file
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <sys/resource.h>
+#include "bench.h"
+#include "../src/finder.h"
+#include "../src/memfs.h"
+#include "../src/parser.h"
+
+/**
+ * An expression benchmarked
+ */
+typedef struct bench_expression_t {
+    char *name;    /**< Name of the expression in the results */
+    char *argv[8]; /**< Arguments of the expression, terminated by NULL, none for all the files */
+} bench_expression_t;
+
+/**
+ * The expressions benchmarked, covering each kind of criteria and the boolean operators
+ */
+static bench_expression_t BENCH_EXPRESSIONS[] = {
+    {"all", {NULL}},
+    {"name_exact", {"-name", "main.c", NULL}},
+    {"name_substring", {"-name", "-.c", NULL}},
+    {"size", {"-size", "+4k", NULL}},
+    {"mtime", {"-mtime", "-7d", NULL}},
+    {"or_perm", {"-name", "-.log", "-or", "-perm", "644", NULL}},
+    {"not_and", {"-not", "-name", "-.o", "-and", "-size", "-1k", NULL}},
+};
+
+/**
+ * Receives the found files, only freed.
+ */
+static void bench_found(size_t expression, char *filename, void *data) {
+    (void)expression;
+    (void)data;
+    free(filename);
+}
+
+/**
+ * Traverse the search path once.
+ * @param search_path Where to look for the files
+ * @param expression The expression, NULL for all the files
+ * @param stats Receives the counters of the traversal
+ * @return Duration of the traversal, in seconds
+ */
+static double bench_traverse(char *search_path, parser_t *expression, finder_stats_t *stats) {
+    memset(stats, 0, sizeof(finder_stats_t));
+    double begin = bench_now();
+    finder_find_stream(search_path, &expression, NULL, NULL, NULL, 1, bench_found, NULL, stats);
+    return bench_now() - begin;
+}
+
+/**
+ * A traversal whose syscalls are counted
+ */
+typedef struct bench_traversal_t {
+    char *search_path;    /**< Where to look for the files */
+    parser_t *expression; /**< The expression, NULL for all the files */
+} bench_traversal_t;
+
+/**
+ * Traverse the search path once, for bench_count_syscalls().
+ * @param data The traversal
+ */
+static void bench_run(void *data) {
+    bench_traversal_t *traversal = data;
+    finder_find_stream(traversal->search_path, &traversal->expression, NULL, NULL, NULL, 1, bench_found, NULL, NULL);
+}
+
+/**
+ * Write the durations of timed traversals as a JSON object.
+ * @param output Where to write
+ * @param timings The durations, sorted in place
+ * @param entries Entries read by each traversal
+ */
+static void bench_write_timings(FILE *output, bench_timings_t *timings, unsigned long entries) {
+    double total = bench_timings_total(timings);
+    fprintf(output, "{\"runs\":%d,\"entries_per_sec\":%.0f,", timings->count,
+            total > 0 ? entries * timings->count / total : 0);
+    bench_write_percentiles(output, timings);
+    fprintf(output, "}");
+}
+
+/**
+ * Print the usage.
+ * @param program Name of the program
+ */
+static void bench_usage(char *program) {
+    fprintf(stderr, "Usage: %s [-i iterations] [-c] [-m depth,fanout,files [-L microseconds]] [-o output.json] "
+                    "search_path\n", program);
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = 5, cold = 0, option;
+    long latency = 0;
+    char *output_path = NULL;
+    memfs_tree_t tree = {0, 0, 0, 1, 65536};
+    io_backend_t *memfs = NULL;
+    while ((option = getopt(argc, argv, "i:cm:L:o:")) != -1) {
+        switch (option) {
+            case 'i':
+                iterations = atoi(optarg);
+                break;
+            case 'c':
+                cold = 1;
+                break;
+            case 'm':
+                if (sscanf(optarg, "%u,%u,%u", &tree.depth, &tree.fanout, &tree.files) != 3) {
+                    bench_usage(argv[0]);
+                    return 1;
+                }
+                memfs = memfs_create();
+                break;
+            case 'L':
+                latency = atol(optarg);
+                break;
+            case 'o':
+                output_path = optarg;
+                break;
+            default:
+                bench_usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc - 1 || iterations < 1 || iterations > BENCH_MAX_ITERATIONS) {
+        bench_usage(argv[0]);
+        return 1;
+    }
+    char *search_path = argv[optind];
+
+    if (memfs) {
+        if (memfs_generate(memfs, search_path, &tree) < 0) {
+            fprintf(stderr, "finder_bench: cannot generate the tree %s\n", search_path);
+            return 1;
+        }
+        memfs_set_latency(memfs, MEMFS_OP_OPEN, latency * 1000);
+        memfs_set_latency(memfs, MEMFS_OP_READDIR, latency * 1000);
+        memfs_set_latency(memfs, MEMFS_OP_STAT, latency * 1000);
+        io_backend_set(memfs);
+        cold = 0;  // no cache to drop
+    }
+
+    FILE *output = output_path ? fopen(output_path, "w") : stdout;
+    if (output == NULL) {
+        perror("finder_bench: cannot create the output");
+        return 1;
+    }
+    if (cold && bench_drop_caches() != 0) {
+        fprintf(stderr, "finder_bench: cannot drop the caches, cold runs skipped\n");
+        cold = 0;
+    }
+
+    fprintf(output, "{\"search_path\":");
+    bench_write_string(output, search_path);
+    fprintf(output, ",\"backend\":\"%s\",\"latency_us\":%ld,\"iterations\":%d,\"expressions\":[",
+            io_backend_get()->name, memfs ? latency : 0, iterations);
+
+    size_t count = sizeof(BENCH_EXPRESSIONS) / sizeof(BENCH_EXPRESSIONS[0]);
+    static bench_timings_t warm, cold_timings;
+    for (size_t i = 0; i < count; i++) {
+        bench_expression_t *bench = &BENCH_EXPRESSIONS[i];
+        size_t size = 0;
+        while (bench->argv[size]) {
+            size++;
+        }
+        parser_t *expression = size ? parser_parse(bench->argv, size) : NULL;
+        if (size && expression == NULL) {
+            fprintf(stderr, "finder_bench: invalid expression %s\n", bench->name);
+            return 1;
+        }
+        finder_stats_t stats;
+
+        bench_traverse(search_path, expression, &stats);
+        warm.count = 0;
+        for (int j = 0; j < iterations; j++) {
+            bench_timings_add(&warm, bench_traverse(search_path, expression, &stats));
+        }
+        cold_timings.count = 0;
+        for (int j = 0; cold && j < iterations; j++) {
+            bench_drop_caches();
+            bench_timings_add(&cold_timings, bench_traverse(search_path, expression, &stats));
+        }
+
+        bench_traversal_t traversal = {search_path, expression};
+        unsigned long syscalls;
+        char *source = "ptrace";
+        if (bench_count_syscalls(bench_run, &traversal, &syscalls, 1) < 0) {
+            // opendir(), getdents64() until the end and closedir() per directory, and the stat() calls
+            syscalls = stats.directories * 4 + stats.stats;
+            source = "estimate";
+        }
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+
+        fprintf(output, "%s\n{\"name\":\"%s\",\"expression\":\"", i ? "," : "", bench->name);
+        for (size_t j = 0; j < size; j++) {
+            fprintf(output, "%s%s", j ? " " : "", bench->argv[j]);
+        }
+        fprintf(output,
+                "\",\"directories\":%lu,\"entries\":%lu,\"stats\":%lu,\"matches\":%lu,\"allocated\":%lu,"
+                "\"syscalls\":%lu,\"syscalls_source\":\"%s\",\"syscalls_per_entry\":%.3f,\"peak_rss_kb\":%ld,"
+                "\"warm\":",
+                stats.directories, stats.entries, stats.stats, stats.matches, stats.allocated, syscalls, source,
+                stats.entries ? (double)syscalls / stats.entries : 0, usage.ru_maxrss);
+        bench_write_timings(output, &warm, stats.entries);
+        fprintf(output, ",\"cold\":");
+        if (cold) {
+            bench_write_timings(output, &cold_timings, stats.entries);
+        } else {
+            fprintf(output, "null");
+        }
+        fprintf(output, "}");
+        parser_free(expression);
+    }
+    fprintf(output, "\n]}\n");
+
+    if (output != stdout) {
+        fclose(output);
+    }
+    if (memfs) {
+        io_backend_set(NULL);
+        memfs_free(memfs);
+    }
+    return 0;
+}
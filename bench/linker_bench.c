@@ -0,0 +1,403 @@
+/**
+ * Benchmarks the updates of the destination folders by the linker, at scale and under churn.
+ *
+ * Each case links a synthetic result set of `entries` files, a given ratio of which share their basename
+ * with another file, and then runs steady state cycles: before each cycle, a small ratio of the files
+ * is replaced by new ones, and linker_update() is given the whole result set, as after a search.
+ * The files do not need to exist, the links are created dangling.
+ *
+ * For the initial update and each cycle are measured: the wall time of linker_update(), the link
+ * operations issued (symbolic links created, links deleted and hard linked to a new generation), the churn
+ * of the destination folder (links created and deleted) and the syscalls. The syscalls are counted by
+ * replaying the same case in a child process traced by ptrace(), apart from the timed run.
+ *
+ * The cases are every combination of the sizes and duplicate ratios requested, and the results are
+ * written as JSON, to compare them between builds.
+ *
+ * @author Claudio Sousa, Gonzalez David
+ * @file
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <getopt.h>
+#include "bench.h"
+#include "../src/linker.h"
+#include "../src/io.h"
+
+/**
+ * Maximum number of values of the sizes and of the duplicate ratios
+ */
+#define BENCH_MAX_VALUES 16
+
+/**
+ * Options of the benchmark
+ */
+typedef struct bench_options_t {
+    long sizes[BENCH_MAX_VALUES];      /**< Numbers of files of the cases */
+    int size_count;                    /**< Number of sizes */
+    long duplicates[BENCH_MAX_VALUES]; /**< Percents of files sharing their basename with another */
+    int duplicate_count;               /**< Number of duplicate ratios */
+    int cycles;                        /**< Steady state cycles after the initial update */
+    double churn;                      /**< Percent of the files replaced before each cycle */
+    uint64_t seed;                     /**< Seed of the random generator */
+    char *dst_path;                    /**< Destination folder, created and deleted by each case */
+    linker_options_t linker;           /**< Options of the linker */
+} bench_options_t;
+
+/**
+ * A case: the result set and its evolution over the cycles
+ */
+typedef struct bench_case_t {
+    bench_options_t *options; /**< Options of the benchmark */
+    long size;                /**< Number of files */
+    long duplicates;          /**< Percent of files sharing their basename with another */
+    long *files;              /**< Ids of the files of the current result set */
+    long next;                /**< Id of the next new file */
+    long *names;              /**< Id of the basename of each file id, grown with the new files */
+    long name_size;           /**< Allocated size of `names` */
+    uint64_t random;          /**< State of the random generator */
+} bench_case_t;
+
+/**
+ * Measures of an update
+ */
+typedef struct bench_measure_t {
+    double duration;        /**< Wall time of linker_update(), in seconds */
+    unsigned long ops;      /**< Link operations issued */
+    unsigned long churn;    /**< Links created and deleted in the destination folder */
+    unsigned long failed;   /**< Operations that failed */
+    unsigned long syscalls; /**< Syscalls issued */
+} bench_measure_t;
+
+/**
+ * Get the id of the basename of a file, giving one to new files.
+ * A file shares the basename of a random older file with a probability of the duplicate ratio.
+ * @param bench The case
+ * @param id Id of the file
+ * @return Id of its basename
+ */
+static long bench_name(bench_case_t *bench, long id) {
+    while (id >= bench->name_size) {
+        long from = bench->name_size;
+        bench->name_size *= 2;
+        bench->names = realloc(bench->names, bench->name_size * sizeof(long));
+        for (long i = from; i < bench->name_size; i++) {
+            bench->names[i] = -1;
+        }
+    }
+    if (bench->names[id] == -1) {
+        bool duplicate = id > 0 && (long)(bench_random(&bench->random) % 100) < bench->duplicates;
+        bench->names[id] = duplicate ? bench->names[bench_random(&bench->random) % id] : id;
+    }
+    return bench->names[id];
+}
+
+/**
+ * Start a case, with its initial result set.
+ * @param bench Receives the case
+ * @param options Options of the benchmark
+ * @param size Number of files
+ * @param duplicates Percent of files sharing their basename with another
+ */
+static void bench_case_init(bench_case_t *bench, bench_options_t *options, long size, long duplicates) {
+    bench->options = options;
+    bench->size = size;
+    bench->duplicates = duplicates;
+    bench->random = options->seed * 0x9E3779B97F4A7C15ULL + size * 101 + duplicates + 1;
+    bench->files = malloc(size * sizeof(long));
+    bench->name_size = size + 1;
+    bench->names = malloc(bench->name_size * sizeof(long));
+    for (long i = 0; i < bench->name_size; i++) {
+        bench->names[i] = -1;
+    }
+    for (long i = 0; i < size; i++) {
+        bench->files[i] = i;
+        bench_name(bench, i);
+    }
+    bench->next = size;
+}
+
+/**
+ * Replace a ratio of the files of a case by new ones, at least one.
+ * @param bench The case
+ */
+static void bench_case_churn(bench_case_t *bench) {
+    long replaced = bench->size * bench->options->churn / 100;
+    for (long i = 0; i < (replaced > 0 ? replaced : 1); i++) {
+        long id = bench->next++;
+        bench->files[bench_random(&bench->random) % bench->size] = id;
+        bench_name(bench, id);
+    }
+}
+
+/**
+ * Build the result set of a case, in a random order as the finder would.
+ * @param bench The case
+ * @return The list of files, to free by finder_free()
+ */
+static finder_t *bench_case_files(bench_case_t *bench) {
+    finder_t *files = NULL;
+    char path[64];
+    for (long i = 0; i < bench->size; i++) {
+        long id = bench->files[i];
+        snprintf(path, sizeof(path), "/bench/%ld/file_%ld.dat", id, bench->names[id]);
+        finder_t *file = malloc(sizeof(finder_t));
+        file->filename = strdup(path);
+        file->next = files;
+        files = file;
+    }
+    return files;
+}
+
+/**
+ * Free a case.
+ * @param bench The case
+ */
+static void bench_case_free(bench_case_t *bench) {
+    free(bench->files);
+    free(bench->names);
+}
+
+/**
+ * Run a case: the initial update and the cycles.
+ * @param bench The case, started
+ * @param measures Receives the measures of the initial update and of each cycle, NULL if not needed
+ */
+static void bench_case_run(bench_case_t *bench, bench_measure_t *measures) {
+    linker_stats_t before, after;
+    io_directory_create(bench->options->dst_path);
+    linker_t *linker = linker_create(bench->options->dst_path, &bench->options->linker);
+
+    for (int cycle = 0; cycle <= bench->options->cycles; cycle++) {
+        if (cycle > 0) {
+            bench_case_churn(bench);
+        }
+        finder_t *files = bench_case_files(bench);
+
+        linker_stats(linker, &before);
+        bench_phase();
+        double begin = bench_now();
+        linker_update(linker, files);
+        double duration = bench_now() - begin;
+        bench_phase();
+        linker_stats(linker, &after);
+
+        if (measures) {
+            bench_measure_t *measure = &measures[cycle];
+            measure->duration = duration;
+            measure->churn = (after.created - before.created) + (after.deleted - before.deleted);
+            measure->ops = measure->churn + (after.hard_linked - before.hard_linked);
+            measure->failed = after.failed - before.failed;
+        }
+        finder_free(files);
+    }
+
+    linker_free(linker);
+    io_directory_delete(bench->options->dst_path);
+}
+
+/**
+ * Run a case whose syscalls are counted, for bench_count_syscalls().
+ * @param data The case, started
+ */
+static void bench_case_trace(void *data) {
+    bench_case_run(data, NULL);
+}
+
+/**
+ * Write the measures of an update as a JSON object.
+ * @param output Where to write
+ * @param measure The measures
+ * @param traced If the syscalls were counted
+ */
+static void bench_write_measure(FILE *output, bench_measure_t *measure, bool traced) {
+    fprintf(output, "{\"ms\":%.3f,\"ops\":%lu,\"churn\":%lu,\"failed\":%lu,\"syscalls\":", measure->duration * 1e3,
+            measure->ops, measure->churn, measure->failed);
+    fprintf(output, traced ? "%lu}" : "null}", measure->syscalls);
+}
+
+/**
+ * Parse a list of numbers separated by commas.
+ * @param text The list
+ * @param values Receives the numbers
+ * @return Number of numbers, 0 if the list is invalid
+ */
+static int bench_parse_list(char *text, long *values) {
+    int count = 0;
+    for (char *end = text; *end && count < BENCH_MAX_VALUES; text = end + 1) {
+        values[count] = strtol(text, &end, 10);
+        if (end == text || values[count] < 0 || (*end != ',' && *end != '\0')) {
+            return 0;
+        }
+        count++;
+        if (*end == '\0') {
+            break;
+        }
+    }
+    return count;
+}
+
+/**
+ * Print the usage.
+ * @param program Name of the program
+ */
+static void bench_usage(char *program) {
+    fprintf(stderr,
+            "Usage: %s [-n sizes] [-u duplicate_percents] [-c cycles] [-r churn_percent] [-s seed]\n"
+            "          [-p inplace|swap] [-l flat|hash] [-o output.json] dst_path\n",
+            program);
+}
+
+/**
+ * Parse the options.
+ * @param argc Number of arguments
+ * @param argv The arguments
+ * @param options Receives the options
+ * @param output_path Receives the file where to write the results, NULL for the standard output
+ * @return Error indicator: 0 for OK, 1 for invalid options
+ */
+static int bench_parse(int argc, char *argv[], bench_options_t *options, char **output_path) {
+    options->size_count = bench_parse_list("1000,10000,100000", options->sizes);
+    options->duplicate_count = bench_parse_list("0,10,50", options->duplicates);
+    options->cycles = 10;
+    options->churn = 1;
+    options->seed = 1;
+    linker_options_init(&options->linker);
+    *output_path = NULL;
+
+    int option;
+    while ((option = getopt(argc, argv, "n:u:c:r:s:p:l:o:")) != -1) {
+        switch (option) {
+            case 'n':
+                options->size_count = bench_parse_list(optarg, options->sizes);
+                break;
+            case 'u':
+                options->duplicate_count = bench_parse_list(optarg, options->duplicates);
+                break;
+            case 'c':
+                options->cycles = atoi(optarg);
+                break;
+            case 'r':
+                options->churn = atof(optarg);
+                break;
+            case 's':
+                options->seed = strtoull(optarg, NULL, 10);
+                break;
+            case 'p':
+                if (strcmp(optarg, "swap") != 0 && strcmp(optarg, "inplace") != 0) {
+                    return 1;
+                }
+                options->linker.publish = strcmp(optarg, "swap") == 0 ? LINKER_PUBLISH_SWAP : LINKER_PUBLISH_INPLACE;
+                break;
+            case 'l':
+                if (strcmp(optarg, "hash") != 0 && strcmp(optarg, "flat") != 0) {
+                    return 1;
+                }
+                options->linker.layout = strcmp(optarg, "hash") == 0 ? LINKER_LAYOUT_HASH : LINKER_LAYOUT_FLAT;
+                break;
+            case 'o':
+                *output_path = optarg;
+                break;
+            default:
+                return 1;
+        }
+    }
+    for (int i = 0; i < options->size_count; i++) {
+        if (options->sizes[i] < 1) {
+            return 1;
+        }
+    }
+    for (int i = 0; i < options->duplicate_count; i++) {
+        if (options->duplicates[i] > 100) {
+            return 1;
+        }
+    }
+    if (optind != argc - 1 || options->size_count == 0 || options->duplicate_count == 0 || options->cycles < 0 ||
+        options->cycles >= BENCH_MAX_ITERATIONS || options->churn < 0 || options->churn > 100) {
+        return 1;
+    }
+    options->dst_path = argv[optind];
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    bench_options_t options;
+    char *output_path;
+    if (bench_parse(argc, argv, &options, &output_path) != 0) {
+        bench_usage(argv[0]);
+        return 1;
+    }
+    if (io_directory_exists(options.dst_path)) {
+        fprintf(stderr, "linker_bench: %s already exists\n", options.dst_path);
+        return 1;
+    }
+    FILE *output = output_path ? fopen(output_path, "w") : stdout;
+    if (output == NULL) {
+        perror("linker_bench: cannot create the output");
+        return 1;
+    }
+
+    fprintf(output, "{\"dst_path\":");
+    bench_write_string(output, options.dst_path);
+    fprintf(output, ",\"publish\":\"%s\",\"layout\":\"%s\",\"cycles\":%d,\"churn_percent\":%g,\"cases\":[",
+            options.linker.publish == LINKER_PUBLISH_SWAP ? "swap" : "inplace",
+            options.linker.layout == LINKER_LAYOUT_HASH ? "hash" : "flat", options.cycles, options.churn);
+
+    int phase_count = 2 * (options.cycles + 1) + 1;
+    bench_measure_t *measures = malloc((options.cycles + 1) * sizeof(bench_measure_t));
+    unsigned long *phases = malloc(phase_count * sizeof(unsigned long));
+    static bench_timings_t timings;
+    for (int i = 0; i < options.size_count; i++) {
+        for (int j = 0; j < options.duplicate_count; j++) {
+            bench_case_t bench;
+
+            // The same case is replayed traced, the updates being the odd phases
+            bench_case_init(&bench, &options, options.sizes[i], options.duplicates[j]);
+            bool traced = bench_count_syscalls(bench_case_trace, &bench, phases, phase_count) == phase_count;
+            bench_case_run(&bench, measures);
+            bench_case_free(&bench);
+
+            timings.count = 0;
+            unsigned long ops = 0, churn = 0, syscalls = 0;
+            for (int cycle = 0; cycle <= options.cycles; cycle++) {
+                measures[cycle].syscalls = traced ? phases[2 * cycle + 1] : 0;
+                if (cycle > 0) {
+                    bench_timings_add(&timings, measures[cycle].duration);
+                    ops += measures[cycle].ops;
+                    churn += measures[cycle].churn;
+                    syscalls += measures[cycle].syscalls;
+                }
+            }
+
+            fprintf(output, "%s\n{\"entries\":%ld,\"duplicate_percent\":%ld,\"initial\":", i || j ? "," : "",
+                    options.sizes[i], options.duplicates[j]);
+            bench_write_measure(output, &measures[0], traced);
+            if (options.cycles > 0) {
+                int cycles = options.cycles;
+                fprintf(output, ",\"steady\":{\"ops_per_cycle\":%.1f,\"churn_per_cycle\":%.1f,\"syscalls_per_cycle\":",
+                        (double)ops / cycles, (double)churn / cycles);
+                fprintf(output, traced ? "%.1f," : "null,", (double)syscalls / cycles);
+                bench_write_percentiles(output, &timings);
+                fprintf(output, "}");
+            }
+            fprintf(output, ",\"cycles\":[");
+            for (int cycle = 1; cycle <= options.cycles; cycle++) {
+                fprintf(output, "%s", cycle > 1 ? "," : "");
+                bench_write_measure(output, &measures[cycle], traced);
+            }
+            fprintf(output, "]}");
+            fflush(output);
+        }
+    }
+    fprintf(output, "\n]}\n");
+
+    free(measures);
+    free(phases);
+    if (output != stdout) {
+        fclose(output);
+    }
+    return 0;
+}
@@ -0,0 +1,104 @@
+/**
+ * Records the files of a tree as a corpus of (name, struct stat) tuples, replayed by the validator benchmark.
+ *
+ * The tree is walked without following the symbolic links, and each file is stated as the finder does
+ * (stat(), following a symbolic link to a file). Only the files are recorded, the finder validating
+ * only them, with their name in their directory.
+ *
+ * The corpus is a binary file, only meant to be read back on the same kind of machine: a header
+ * (bench_corpus_header_t, see bench.h) and then, for each file, the length of its name (uint16_t), its name
+ * without terminating null byte and its struct stat.
+ *
+ * @author Claudio Sousa, Gonzalez David
+ * @file
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ftw.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "bench.h"
+
+/**
+ * Where the corpus is written
+ */
+static FILE *g_output;
+/**
+ * Number of files recorded
+ */
+static unsigned long g_count = 0;
+
+/**
+ * Record a file of the tree, called by nftw().
+ * @param path Path of the entry
+ * @param entry_stat Attributes of the entry, not following symbolic links
+ * @param type Type of the entry
+ * @param ftw Offset of the name of the entry in the path
+ * @return 0 to go on, 1 if the corpus cannot be written
+ */
+static int statdump_entry(const char *path, const struct stat *entry_stat, int type, struct FTW *ftw) {
+    (void)entry_stat;
+    struct stat file_stat;
+    if ((type != FTW_F && type != FTW_SL) || stat(path, &file_stat) != 0 || !S_ISREG(file_stat.st_mode)) {
+        return 0;
+    }
+
+    const char *name = path + ftw->base;
+    uint16_t length = strlen(name);
+    if (fwrite(&length, sizeof(length), 1, g_output) != 1 || fwrite(name, 1, length, g_output) != length ||
+        fwrite(&file_stat, sizeof(file_stat), 1, g_output) != 1) {
+        return 1;
+    }
+    g_count++;
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    char *output_path = NULL;
+    int option;
+    while ((option = getopt(argc, argv, "o:")) != -1) {
+        if (option != 'o') {
+            fprintf(stderr, "Usage: %s -o corpus root\n", argv[0]);
+            return 1;
+        }
+        output_path = optarg;
+    }
+    if (output_path == NULL || optind != argc - 1) {
+        fprintf(stderr, "Usage: %s -o corpus root\n", argv[0]);
+        return 1;
+    }
+
+    g_output = fopen(output_path, "w");
+    if (g_output == NULL) {
+        fprintf(stderr, "statdump: cannot create %s: %s\n", output_path, strerror(errno));
+        return 1;
+    }
+    // The count is written once known
+    bench_corpus_header_t header;
+    memcpy(header.magic, BENCH_CORPUS_MAGIC, sizeof(header.magic));
+    header.stat_size = sizeof(struct stat);
+    header.captured = time(NULL);
+    header.count = 0;
+    if (fwrite(&header, sizeof(header), 1, g_output) != 1 ||
+        nftw(argv[optind], statdump_entry, 64, FTW_PHYS) != 0) {
+        fprintf(stderr, "statdump: cannot record %s\n", argv[optind]);
+        return 1;
+    }
+    header.count = g_count;
+    if (fseek(g_output, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, g_output) != 1 ||
+        fclose(g_output) != 0) {
+        fprintf(stderr, "statdump: cannot write %s: %s\n", output_path, strerror(errno));
+        return 1;
+    }
+
+    printf("{\"root\":");
+    bench_write_string(stdout, argv[optind]);
+    printf(",\"corpus\":");
+    bench_write_string(stdout, output_path);
+    printf(",\"files\":%lu}\n", g_count);
+    return 0;
+}
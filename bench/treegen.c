@@ -0,0 +1,303 @@
+/**
+ * Generates a deterministic tree of files to benchmark the traversals on.
+ *
+ * The same options and seed always produce the same tree: the directories, names, extensions, permissions,
+ * sizes and modification times (relative to the generation) of the files, the symbolic links looping to
+ * an ancestor directory and the hard links to already generated files.
+ *
+ * The directories form a complete tree of `depth` levels below the root, each directory having `fanout`
+ * sub-directories. The files are spread randomly over all the directories, root included. The sizes are
+ * allocated sparsely, so that large trees stay cheap on disk.
+ *
+ * A summary of the generated tree is written as JSON on the standard output.
+ *
+ * @author Claudio Sousa, Gonzalez David
+ * @file
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/**
+ * Maximum number of directories generated, to catch a depth and fanout out of proportion
+ */
+#define TREEGEN_MAX_DIRECTORIES 1000000
+/**
+ * Maximum length of a generated path
+ */
+#define TREEGEN_PATH_MAX 4096
+/**
+ * Age of the oldest generated modification times, in seconds (30 days)
+ */
+#define TREEGEN_MAX_AGE (30 * 24 * 3600)
+
+/**
+ * Extensions of the generated files, from the most to the least frequent with the zipf distribution
+ */
+static char *TREEGEN_EXTENSIONS[] = {".c",   ".h",   ".txt", ".log", ".md", ".json", ".png",
+                                     ".jpg", ".o",   ".so",  ".py",  ".sh", ""};
+/**
+ * Number of extensions
+ */
+#define TREEGEN_EXTENSION_COUNT (sizeof(TREEGEN_EXTENSIONS) / sizeof(TREEGEN_EXTENSIONS[0]))
+/**
+ * Permissions of the generated files, picked uniformly
+ */
+static mode_t TREEGEN_MODES[] = {0644, 0644, 0600, 0755, 0444};
+
+/**
+ * Options of the generation
+ */
+typedef struct treegen_options_t {
+    char *root;     /**< Directory to create, must not exist */
+    int depth;      /**< Levels of directories below the root */
+    int fanout;     /**< Sub-directories of each directory above the last level */
+    long files;     /**< Files to generate */
+    uint64_t seed;  /**< Seed of the random generator */
+    int zipf;       /**< If the extensions follow a zipf distribution rather than a uniform one */
+    long loops;     /**< Symbolic links to an ancestor directory */
+    long hardlinks; /**< Hard links to generated files */
+    long max_size;  /**< Maximum size of the files, in bytes */
+} treegen_options_t;
+
+/**
+ * State of the random generator (xorshift64*)
+ */
+static uint64_t g_random;
+
+/**
+ * Get the next random number.
+ * @return The number
+ */
+static uint64_t treegen_random(void) {
+    g_random ^= g_random >> 12;
+    g_random ^= g_random << 25;
+    g_random ^= g_random >> 27;
+    return g_random * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * Pick an extension.
+ * @param zipf If the extension follows a zipf distribution (weight 1/rank) rather than a uniform one
+ * @return The extension, a constant string
+ */
+static char *treegen_extension(int zipf) {
+    if (!zipf) {
+        return TREEGEN_EXTENSIONS[treegen_random() % TREEGEN_EXTENSION_COUNT];
+    }
+
+    double total = 0;
+    for (size_t i = 0; i < TREEGEN_EXTENSION_COUNT; i++) {
+        total += 1.0 / (i + 1);
+    }
+    double pick = (treegen_random() >> 11) * (1.0 / 9007199254740992.0) * total;
+    for (size_t i = 0; i < TREEGEN_EXTENSION_COUNT; i++) {
+        pick -= 1.0 / (i + 1);
+        if (pick < 0) {
+            return TREEGEN_EXTENSIONS[i];
+        }
+    }
+    return TREEGEN_EXTENSIONS[TREEGEN_EXTENSION_COUNT - 1];
+}
+
+/**
+ * Generate a random name of lowercase letters.
+ * @param name Receives the name
+ * @param min Minimum length
+ * @param max Maximum length
+ */
+static void treegen_name(char *name, int min, int max) {
+    int length = min + treegen_random() % (max - min + 1);
+    for (int i = 0; i < length; i++) {
+        name[i] = 'a' + treegen_random() % 26;
+    }
+    name[length] = '\0';
+}
+
+/**
+ * Print the usage.
+ * @param program Name of the program
+ */
+static void treegen_usage(char *program) {
+    fprintf(stderr,
+            "Usage: %s [-d depth] [-f fanout] [-n files] [-s seed] [-x uniform|zipf] [-l loops] [-k hardlinks]\n"
+            "          [-z max_size] root\n",
+            program);
+}
+
+/**
+ * Parse the options.
+ * @param argc Number of arguments
+ * @param argv The arguments
+ * @param options Receives the options
+ * @return Error indicator: 0 for OK, 1 for invalid options
+ */
+static int treegen_parse(int argc, char *argv[], treegen_options_t *options) {
+    *options = (treegen_options_t){NULL, 3, 8, 10000, 1, 1, 0, 0, 16384};
+
+    int option;
+    while ((option = getopt(argc, argv, "d:f:n:s:x:l:k:z:")) != -1) {
+        switch (option) {
+            case 'd':
+                options->depth = atoi(optarg);
+                break;
+            case 'f':
+                options->fanout = atoi(optarg);
+                break;
+            case 'n':
+                options->files = atol(optarg);
+                break;
+            case 's':
+                options->seed = strtoull(optarg, NULL, 10);
+                break;
+            case 'x':
+                if (strcmp(optarg, "zipf") != 0 && strcmp(optarg, "uniform") != 0) {
+                    return 1;
+                }
+                options->zipf = strcmp(optarg, "zipf") == 0;
+                break;
+            case 'l':
+                options->loops = atol(optarg);
+                break;
+            case 'k':
+                options->hardlinks = atol(optarg);
+                break;
+            case 'z':
+                options->max_size = atol(optarg);
+                break;
+            default:
+                return 1;
+        }
+    }
+    if (optind != argc - 1 || options->depth < 0 || options->fanout < 1 || options->files < 0 || options->loops < 0 ||
+        options->hardlinks < 0 || options->max_size < 0) {
+        return 1;
+    }
+    options->root = argv[optind];
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    treegen_options_t options;
+    if (treegen_parse(argc, argv, &options) != 0) {
+        treegen_usage(argv[0]);
+        return 1;
+    }
+    // 0 would make xorshift produce only zeros
+    g_random = options.seed * 0x9E3779B97F4A7C15ULL + 1;
+
+    // Directories, level by level: the parent of the directory i is (i - 1) / fanout
+    long count = 1, level = 1;
+    for (int i = 0; i < options.depth; i++) {
+        level *= options.fanout;
+        count += level;
+        if (count > TREEGEN_MAX_DIRECTORIES) {
+            fprintf(stderr, "treegen: more than %d directories requested\n", TREEGEN_MAX_DIRECTORIES);
+            return 1;
+        }
+    }
+    char **directories = malloc(count * sizeof(char *));
+    int *depths = malloc(count * sizeof(int));
+    char path[TREEGEN_PATH_MAX], name[16];
+
+    if (mkdir(options.root, 0755) != 0) {
+        fprintf(stderr, "treegen: cannot create %s: %s\n", options.root, strerror(errno));
+        return 1;
+    }
+    directories[0] = strdup(options.root);
+    depths[0] = 0;
+    for (long i = 1; i < count; i++) {
+        long parent = (i - 1) / options.fanout;
+        treegen_name(name, 3, 10);
+        snprintf(path, sizeof(path), "%s/%s_%ld", directories[parent], name, i);
+        if (mkdir(path, 0755) != 0) {
+            fprintf(stderr, "treegen: cannot create %s: %s\n", path, strerror(errno));
+            return 1;
+        }
+        directories[i] = strdup(path);
+        depths[i] = depths[parent] + 1;
+    }
+
+    // Files, spread over all the directories
+    char **files = malloc((options.files ? options.files : 1) * sizeof(char *));
+    time_t now = time(NULL);
+    long long bytes = 0;
+    for (long i = 0; i < options.files; i++) {
+        char *directory = directories[treegen_random() % count];
+        treegen_name(name, 3, 12);
+        snprintf(path, sizeof(path), "%s/%s_%ld%s", directory, name, i, treegen_extension(options.zipf));
+
+        int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0600);
+        if (fd < 0) {
+            fprintf(stderr, "treegen: cannot create %s: %s\n", path, strerror(errno));
+            return 1;
+        }
+        long size = treegen_random() % (options.max_size + 1);
+        struct timespec times[2];
+        times[0].tv_sec = times[1].tv_sec = now - (time_t)(treegen_random() % TREEGEN_MAX_AGE);
+        times[0].tv_nsec = times[1].tv_nsec = 0;
+        if (ftruncate(fd, size) != 0 ||
+            fchmod(fd, TREEGEN_MODES[treegen_random() % (sizeof(TREEGEN_MODES) / sizeof(TREEGEN_MODES[0]))]) != 0 ||
+            futimens(fd, times) != 0) {
+            fprintf(stderr, "treegen: cannot set up %s: %s\n", path, strerror(errno));
+            close(fd);
+            return 1;
+        }
+        close(fd);
+        files[i] = strdup(path);
+        bytes += size;
+    }
+
+    // Symbolic links to an ancestor, looping back into the tree
+    long loops = 0;
+    for (long i = 0; i < options.loops && count > 1; i++) {
+        long directory = 1 + treegen_random() % (count - 1);
+        int up = 1 + treegen_random() % depths[directory];
+        char target[TREEGEN_PATH_MAX] = "..";
+        for (int j = 1; j < up; j++) {
+            strcat(target, "/..");
+        }
+        snprintf(path, sizeof(path), "%s/loop_%ld", directories[directory], i);
+        if (symlink(target, path) != 0) {
+            fprintf(stderr, "treegen: cannot create %s: %s\n", path, strerror(errno));
+            return 1;
+        }
+        loops++;
+    }
+
+    // Hard links to the files, in another directory
+    long hardlinks = 0;
+    for (long i = 0; i < options.hardlinks && options.files > 0; i++) {
+        char *file = files[treegen_random() % options.files];
+        snprintf(path, sizeof(path), "%s/hard_%ld", directories[treegen_random() % count], i);
+        if (link(file, path) != 0) {
+            fprintf(stderr, "treegen: cannot create %s: %s\n", path, strerror(errno));
+            return 1;
+        }
+        hardlinks++;
+    }
+
+    printf("{\"root\":\"%s\",\"seed\":%llu,\"depth\":%d,\"fanout\":%d,\"distribution\":\"%s\",\"directories\":%ld,"
+           "\"files\":%ld,\"symlink_loops\":%ld,\"hardlinks\":%ld,\"bytes\":%lld}\n",
+           options.root, (unsigned long long)options.seed, options.depth, options.fanout,
+           options.zipf ? "zipf" : "uniform", count, options.files, loops, hardlinks, bytes);
+
+    for (long i = 0; i < count; i++) {
+        free(directories[i]);
+    }
+    for (long i = 0; i < options.files; i++) {
+        free(files[i]);
+    }
+    free(directories);
+    free(depths);
+    free(files);
+    return 0;
+}
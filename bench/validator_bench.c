@@ -0,0 +1,352 @@
+/**
+ * Benchmarks the evaluation of expressions by the validator, apart from any I/O.
+ *
+ * A corpus of files, recorded from a real tree by statdump, is loaded in memory and replayed against each
+ * expression of a corpus of expressions, one per line of a text file (empty lines and lines beginning
+ * with `#` are ignored). The times of the files are shifted by the age of the corpus, so that the time
+ * criteria match the same files as when it was recorded. Each expression is evaluated `iterations` times
+ * against all the files, and the fastest pass gives the time per evaluation. All the expressions are then
+ * evaluated together by a validator set, as the finder does, to measure the criteria it shares.
+ *
+ * The branches and branch misses of the passes are counted by perf_event_open(), when the hardware
+ * counters can be read: the JSON tells why they cannot be otherwise.
+ *
+ * @author Claudio Sousa, Gonzalez David
+ * @file
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "bench.h"
+#include "../src/validator.h"
+// After parser.h, whose CTIME criteria it would define as a macro
+#include <sys/ioctl.h>
+
+/**
+ * Maximum number of expressions of the corpus
+ */
+#define BENCH_MAX_EXPRESSIONS 256
+/**
+ * Maximum number of arguments of an expression
+ */
+#define BENCH_MAX_ARGUMENTS 256
+
+/**
+ * A file of the corpus
+ */
+typedef struct bench_file_t {
+    char *name;            /**< Name of the file */
+    struct stat file_stat; /**< Attributes of the file */
+} bench_file_t;
+
+/**
+ * An expression of the corpus
+ */
+typedef struct bench_expression_t {
+    char *text;           /**< The expression, as written in the corpus */
+    parser_t *expression; /**< The parsed expression */
+} bench_expression_t;
+
+/**
+ * Hardware counters of the passes
+ */
+typedef struct bench_counters_t {
+    int branches;      /**< Counter of the branches, -1 if not available */
+    int misses;        /**< Counter of the branch misses, -1 if not available */
+    char *unavailable; /**< Why they are not available, NULL if they are */
+} bench_counters_t;
+
+/**
+ * Load a corpus of files recorded by statdump.
+ * @param path Path of the corpus
+ * @param count Receives the number of files
+ * @return The files, NULL if the corpus cannot be read
+ */
+static bench_file_t *bench_load_files(char *path, size_t *count) {
+    FILE *input = fopen(path, "r");
+    bench_corpus_header_t header;
+    if (input == NULL || fread(&header, sizeof(header), 1, input) != 1 ||
+        memcmp(header.magic, BENCH_CORPUS_MAGIC, sizeof(header.magic)) != 0 ||
+        header.stat_size != sizeof(struct stat)) {
+        fprintf(stderr, "validator_bench: %s is not a corpus of this machine\n", path);
+        return NULL;
+    }
+
+    time_t age = time(NULL) - header.captured;
+    bench_file_t *files = malloc((header.count ? header.count : 1) * sizeof(bench_file_t));
+    for (*count = 0; *count < header.count; (*count)++) {
+        bench_file_t *file = &files[*count];
+        uint16_t length;
+        if (fread(&length, sizeof(length), 1, input) != 1) {
+            break;
+        }
+        file->name = malloc(length + 1);
+        if (fread(file->name, 1, length, input) != length ||
+            fread(&file->file_stat, sizeof(struct stat), 1, input) != 1) {
+            free(file->name);
+            break;
+        }
+        file->name[length] = '\0';
+        file->file_stat.st_atime += age;
+        file->file_stat.st_mtime += age;
+        file->file_stat.st_ctime += age;
+    }
+    fclose(input);
+
+    if (*count != header.count) {
+        fprintf(stderr, "validator_bench: %s is truncated\n", path);
+        return NULL;
+    }
+    return files;
+}
+
+/**
+ * Load a corpus of expressions, one per line, the arguments separated by spaces.
+ * @param path Path of the corpus
+ * @param expressions Receives the expressions
+ * @return Number of expressions, -1 if the corpus cannot be read or an expression is invalid
+ */
+static int bench_load_expressions(char *path, bench_expression_t *expressions) {
+    FILE *input = fopen(path, "r");
+    if (input == NULL) {
+        fprintf(stderr, "validator_bench: cannot read %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    char *line = NULL, *arguments[BENCH_MAX_ARGUMENTS];
+    size_t size = 0;
+    int count = 0;
+    while (getline(&line, &size, input) != -1 && count < BENCH_MAX_EXPRESSIONS) {
+        line[strcspn(line, "\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#') {
+            continue;
+        }
+
+        // The parsed expression keeps references to the arguments
+        char *text = strdup(line), *copy = strdup(line), *save;
+        size_t argument_count = 0;
+        for (char *argument = strtok_r(copy, " ", &save); argument && argument_count < BENCH_MAX_ARGUMENTS;
+             argument = strtok_r(NULL, " ", &save)) {
+            arguments[argument_count++] = argument;
+        }
+        parser_t *expression = parser_parse(arguments, argument_count);
+        if (expression == NULL) {
+            fprintf(stderr, "validator_bench: invalid expression: %s\n", text);
+            free(line);
+            fclose(input);
+            return -1;
+        }
+        expressions[count++] = (bench_expression_t){text, expression};
+    }
+    free(line);
+    fclose(input);
+    return count;
+}
+
+/**
+ * Open a hardware counter of the calling thread, in user space only, disabled.
+ * @param config The counter, PERF_COUNT_HW_*
+ * @param group Leader of the group of the counter, -1 to lead a new group
+ * @return The counter, -1 with errno set if it cannot be opened
+ */
+static int bench_counter_open(uint64_t config, int group) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = group == -1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+/**
+ * Open the counters of the branches and branch misses.
+ * @param counters Receives the counters, or why they are not available
+ */
+static void bench_counters_open(bench_counters_t *counters) {
+    counters->misses = counters->branches = -1;
+    counters->unavailable = NULL;
+    counters->branches = bench_counter_open(PERF_COUNT_HW_BRANCH_INSTRUCTIONS, -1);
+    if (counters->branches != -1) {
+        counters->misses = bench_counter_open(PERF_COUNT_HW_BRANCH_MISSES, counters->branches);
+    }
+    if (counters->misses == -1) {
+        counters->unavailable = strdup(strerror(errno));
+        if (counters->branches != -1) {
+            close(counters->branches);
+            counters->branches = -1;
+        }
+    }
+}
+
+/**
+ * Start counting, from 0.
+ * @param counters The counters
+ */
+static void bench_counters_start(bench_counters_t *counters) {
+    if (counters->unavailable == NULL) {
+        ioctl(counters->branches, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(counters->branches, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+/**
+ * Stop counting and read the counters.
+ * @param counters The counters
+ * @param branches Receives the number of branches, 0 if not available
+ * @param misses Receives the number of branch misses, 0 if not available
+ */
+static void bench_counters_stop(bench_counters_t *counters, uint64_t *branches, uint64_t *misses) {
+    *branches = *misses = 0;
+    if (counters->unavailable == NULL) {
+        ioctl(counters->branches, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        if (read(counters->branches, branches, sizeof(uint64_t)) != sizeof(uint64_t) ||
+            read(counters->misses, misses, sizeof(uint64_t)) != sizeof(uint64_t)) {
+            *branches = *misses = 0;
+        }
+    }
+}
+
+/**
+ * Write the measures of an expression as a JSON object.
+ * @param output Where to write
+ * @param text The expression
+ * @param matches Number of matches of a pass
+ * @param best Duration of the fastest pass, in seconds
+ * @param evaluations Evaluations of a pass
+ * @param counters The counters
+ * @param branches Branches of all the passes
+ * @param misses Branch misses of all the passes
+ * @param iterations Number of passes
+ */
+static void bench_write_expression(FILE *output, char *text, unsigned long matches, double best,
+                                   unsigned long evaluations, bench_counters_t *counters, uint64_t branches,
+                                   uint64_t misses, int iterations) {
+    fprintf(output, "{\"expression\":");
+    bench_write_string(output, text);
+    fprintf(output, ",\"matches\":%lu,\"ns_per_evaluation\":%.2f", matches, best * 1e9 / evaluations);
+    if (counters->unavailable == NULL) {
+        double total = (double)evaluations * iterations;
+        fprintf(output, ",\"branches_per_evaluation\":%.2f,\"branch_misses_per_evaluation\":%.3f", branches / total,
+                misses / total);
+    } else {
+        fprintf(output, ",\"branches_per_evaluation\":null,\"branch_misses_per_evaluation\":null");
+    }
+    fprintf(output, "}");
+}
+
+int main(int argc, char *argv[]) {
+    int iterations = 10, option;
+    char *output_path = NULL;
+    while ((option = getopt(argc, argv, "i:o:")) != -1) {
+        switch (option) {
+            case 'i':
+                iterations = atoi(optarg);
+                break;
+            case 'o':
+                output_path = optarg;
+                break;
+            default:
+                iterations = 0;
+        }
+    }
+    if (optind != argc - 2 || iterations < 1) {
+        fprintf(stderr, "Usage: %s [-i iterations] [-o output.json] files_corpus expressions_corpus\n", argv[0]);
+        return 1;
+    }
+
+    size_t file_count;
+    static bench_expression_t expressions[BENCH_MAX_EXPRESSIONS];
+    bench_file_t *files = bench_load_files(argv[optind], &file_count);
+    int expression_count = bench_load_expressions(argv[optind + 1], expressions);
+    if (files == NULL || expression_count < 0) {
+        return 1;
+    }
+    if (file_count == 0) {
+        fprintf(stderr, "validator_bench: %s has no files\n", argv[optind]);
+        return 1;
+    }
+    FILE *output = output_path ? fopen(output_path, "w") : stdout;
+    if (output == NULL) {
+        perror("validator_bench: cannot create the output");
+        return 1;
+    }
+
+    bench_counters_t counters;
+    bench_counters_open(&counters);
+    fprintf(output, "{\"files\":%zu,\"iterations\":%d,\"counters\":", file_count, iterations);
+    bench_write_string(output, counters.unavailable ? counters.unavailable : "available");
+    fprintf(output, ",\"expressions\":[");
+
+    uint64_t branches, misses;
+    for (int i = 0; i < expression_count; i++) {
+        unsigned long matches = 0;
+        double best = 0;
+        uint64_t total_branches = 0, total_misses = 0;
+        for (int j = 0; j < iterations; j++) {
+            matches = 0;
+            bench_counters_start(&counters);
+            double begin = bench_now();
+            for (size_t k = 0; k < file_count; k++) {
+                matches += validator_validate(files[k].name, &files[k].file_stat, expressions[i].expression);
+            }
+            double duration = bench_now() - begin;
+            bench_counters_stop(&counters, &branches, &misses);
+            total_branches += branches;
+            total_misses += misses;
+            best = j == 0 || duration < best ? duration : best;
+        }
+        fprintf(output, "%s\n", i ? "," : "");
+        bench_write_expression(output, expressions[i].text, matches, best, file_count, &counters, total_branches,
+                               total_misses, iterations);
+    }
+
+    // All the expressions together, an evaluation being the validation of a file against all of them
+    parser_t *set_expressions[BENCH_MAX_EXPRESSIONS];
+    for (int i = 0; i < expression_count; i++) {
+        set_expressions[i] = expressions[i].expression;
+    }
+    validator_set_t *set = validator_set_create(set_expressions, expression_count);
+    bool results[BENCH_MAX_EXPRESSIONS];
+    unsigned long matches = 0;
+    double best = 0;
+    uint64_t total_branches = 0, total_misses = 0;
+    for (int j = 0; j < iterations; j++) {
+        matches = 0;
+        bench_counters_start(&counters);
+        double begin = bench_now();
+        for (size_t k = 0; k < file_count; k++) {
+            validator_set_validate(set, files[k].name, &files[k].file_stat, results, NULL);
+            for (int i = 0; i < expression_count; i++) {
+                matches += results[i];
+            }
+        }
+        double duration = bench_now() - begin;
+        bench_counters_stop(&counters, &branches, &misses);
+        total_branches += branches;
+        total_misses += misses;
+        best = j == 0 || duration < best ? duration : best;
+    }
+    unsigned long evaluated, reused;
+    validator_set_counts(set, &evaluated, &reused);
+    fprintf(output, "],\n\"set\":");
+    bench_write_expression(output, "(all the expressions)", matches, best, file_count, &counters, total_branches,
+                           total_misses, iterations);
+    fprintf(output, ",\n\"set_criteria\":{\"evaluated_per_file\":%.2f,\"reused_per_file\":%.2f}}\n",
+            (double)evaluated / (file_count * iterations), (double)reused / (file_count * iterations));
+    validator_set_free(set);
+
+    if (output != stdout) {
+        fclose(output);
+    }
+    return 0;
+}
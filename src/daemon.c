@@ -0,0 +1,751 @@
+/**
+ * Hosts many destination folders in a single long-lived process.
+ *
+ * The daemon listens on a Unix domain socket (see ipc_get_socket_path()) for requests,
+ * each being a list of arguments whose first one is the command:
+ *   - `add [options] <dst_path> <search_path> [expression]`: hosts a destination folder,
+ *     the paths being absolute and the options those of searchfolder_options_parse();
+ *   - `remove <dst_path>`: deletes a hosted destination folder;
+ *   - `list`: writes a line per hosted destination folder, with its search path;
+ *   - `status`: same as `list`, with the number of links and the state of the executions;
+ *   - `query <dst_path> [generation]`: sends the result set of a hosted destination folder,
+ *     or its changes since the generation given, encoded as described in results.h;
+ *   - `log <debug|info|error>`: changes the level of the messages logged by the daemon;
+ *   - `metrics`: writes the metrics of the daemon and of its searches, in the Prometheus text format.
+ * The reply is made of lines of text, the last one being `OK` or `ERROR`, except for `query`.
+ *
+ * The destination folders sharing the same search path and options are grouped in a single
+ * searchfolder, so the tree is traversed once for all of them. The executions of the groups
+ * are spread over a pool of worker threads, the most overdue group running first.
+ * The daemon stops, deleting its destination folders, when the last one is removed or
+ * when it receives SIGTERM or SIGINT. Its messages are written by the background thread of the logger,
+ * and the phases of the executions are traced if requested (see trace.h).
+ *
+ * Each connection is served by its own thread. A group is only modified while none of the
+ * workers executes it: a request adding or removing a destination folder of a group being
+ * executed waits for the end of the execution. A query does not: it is served the result set
+ * of the last update of the destination folder.
+ *
+ * @author Claudio Sousa, Gonzalez David
+ * @file
+ */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include "daemon.h"
+#include "searchfolder.h"
+#include "parser.h"
+#include "ipc.h"
+#include "io.h"
+#include "logger.h"
+#include "trace.h"
+
+/**
+ * Number of worker threads executing the searches
+ */
+#define DAEMON_WORKERS 4
+/**
+ * Time between two checks of the stop flag, in milliseconds
+ */
+#define DAEMON_POLL_MS 500
+/**
+ * Number of connection attempts while waiting for a spawned daemon
+ */
+#define DAEMON_CONNECT_RETRIES 100
+/**
+ * Time between two connection attempts, in milliseconds
+ */
+#define DAEMON_CONNECT_DELAY_MS 20
+/**
+ * Time given to a client to send its request, in milliseconds, so that an idle connection does not delay the stop
+ */
+#define DAEMON_RECV_TIMEOUT_MS 1000
+/**
+ * Size of the chunks used to read a reply
+ */
+#define DAEMON_REPLY_CHUNK 4096
+
+/**
+ * Destination folders sharing the same search path and options, updated by a single searchfolder
+ */
+typedef struct daemon_group_t {
+    searchfolder_t *searchfolder;   /**< Updates the destination folders */
+    char *search_path;              /**< The search folder */
+    searchfolder_options_t options; /**< The options of the searchfolder */
+    bool busy;                      /**< If a worker is executing the searchfolder */
+    struct timespec due;            /**< When the next execution is due (monotonic clock) */
+    struct daemon_group_t *next;    /**< Next in the chain */
+} daemon_group_t;
+
+/**
+ * A hosted destination folder
+ */
+typedef struct daemon_folder_t {
+    char *dst_path;               /**< The destination folder */
+    parser_t *expression;         /**< Its expression, NULL to match all the files */
+    char **args;                  /**< The request that added it, referenced by the expression */
+    daemon_group_t *group;        /**< The group updating it */
+    struct daemon_folder_t *next; /**< Next in the chain */
+} daemon_folder_t;
+
+/**
+ * State of the daemon
+ */
+typedef struct daemon_t {
+    pthread_mutex_t lock;     /**< Protects the state */
+    pthread_cond_t changed;   /**< Signaled when a group or the number of clients changes */
+    daemon_group_t *groups;   /**< The groups of destination folders */
+    daemon_folder_t *folders; /**< The hosted destination folders */
+    unsigned int clients;     /**< Number of connections being served */
+    int listen_fd;            /**< The listening socket */
+} daemon_t;
+
+/**
+ * The daemon of this process
+ */
+static daemon_t g_daemon = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL, 0, -1};
+/**
+ * Set when the daemon must stop, by a signal or when the last folder is removed
+ */
+static volatile sig_atomic_t g_stopping = 0;
+
+/**
+ * Signal handler for SIGTERM|SIGINT that stops the daemon
+ */
+static void daemon_sig_handler() {
+    g_stopping = 1;
+}
+
+/**
+ * Get a time of the monotonic clock some milliseconds from now.
+ * @param ms Milliseconds from now
+ * @param time Receives the time
+ */
+static void daemon_time_in(unsigned int ms, struct timespec *time) {
+    clock_gettime(CLOCK_MONOTONIC, time);
+    time->tv_sec += ms / 1000;
+    time->tv_nsec += (ms % 1000) * 1000000L;
+    if (time->tv_nsec >= 1000000000L) {
+        time->tv_sec++;
+        time->tv_nsec -= 1000000000L;
+    }
+}
+
+/**
+ * Compare two times.
+ * @return Negative if a is before b, positive if after, 0 if equal
+ */
+static int daemon_time_cmp(struct timespec *a, struct timespec *b) {
+    if (a->tv_sec != b->tv_sec) {
+        return a->tv_sec < b->tv_sec ? -1 : 1;
+    }
+    return a->tv_nsec < b->tv_nsec ? -1 : a->tv_nsec > b->tv_nsec;
+}
+
+/**
+ * Worker thread: executes the most overdue group, until the daemon stops.
+ * @param arg Unused
+ * @return NULL
+ */
+static void *daemon_worker(void *arg) {
+    (void)arg;
+    struct timespec now, wake;
+    trace_thread("worker");
+
+    pthread_mutex_lock(&g_daemon.lock);
+    while (!g_stopping) {
+        daemon_group_t *next = NULL;
+        for (daemon_group_t *group = g_daemon.groups; group; group = group->next) {
+            if (!group->busy && (next == NULL || daemon_time_cmp(&group->due, &next->due) < 0)) {
+                next = group;
+            }
+        }
+
+        daemon_time_in(DAEMON_POLL_MS, &wake);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (next == NULL || daemon_time_cmp(&next->due, &now) > 0) {
+            if (next != NULL && daemon_time_cmp(&next->due, &wake) < 0) {
+                wake = next->due;
+            }
+            pthread_cond_timedwait(&g_daemon.changed, &g_daemon.lock, &wake);
+            continue;
+        }
+
+        next->busy = true;
+        pthread_mutex_unlock(&g_daemon.lock);
+
+        unsigned int interval = searchfolder_run(next->searchfolder);
+
+        pthread_mutex_lock(&g_daemon.lock);
+        next->busy = false;
+        daemon_time_in(interval, &next->due);
+        pthread_cond_broadcast(&g_daemon.changed);
+    }
+    pthread_mutex_unlock(&g_daemon.lock);
+
+    return NULL;
+}
+
+/**
+ * Find a hosted destination folder. The lock must be held.
+ * @param dst_path The destination folder
+ * @return The folder, NULL if not hosted
+ */
+static daemon_folder_t *daemon_find_folder(char *dst_path) {
+    for (daemon_folder_t *folder = g_daemon.folders; folder; folder = folder->next) {
+        if (strncmp(folder->dst_path, dst_path, IO_PATH_MAX_SIZE) == 0) {
+            return folder;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Find the group of the destination folders sharing a search path and options. The lock must be held.
+ * @param search_path The search folder
+ * @param options The options of the searchfolder
+ * @return The group, NULL if none
+ */
+static daemon_group_t *daemon_find_group(char *search_path, searchfolder_options_t *options) {
+    for (daemon_group_t *group = g_daemon.groups; group; group = group->next) {
+        if (strcmp(group->search_path, search_path) == 0 && searchfolder_options_equal(&group->options, options)) {
+            return group;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Find a hosted destination folder once no worker executes its group. The lock must be held.
+ * The lock is released while waiting, so the folder is searched again after each wait, as it may have been
+ * removed meanwhile.
+ * @param dst_path The destination folder
+ * @return The folder, whose group is idle, NULL if not hosted
+ */
+static daemon_folder_t *daemon_find_idle_folder(char *dst_path) {
+    daemon_folder_t *folder;
+    while ((folder = daemon_find_folder(dst_path)) != NULL && folder->group->busy) {
+        pthread_cond_wait(&g_daemon.changed, &g_daemon.lock);
+    }
+    return folder;
+}
+
+/**
+ * Remove a group from the daemon and free it. The lock must be held and the group must be idle.
+ * @param group The group, without destination folders
+ */
+static void daemon_group_free(daemon_group_t *group) {
+    for (daemon_group_t **g = &g_daemon.groups; *g; g = &(*g)->next) {
+        if (*g == group) {
+            *g = group->next;
+            break;
+        }
+    }
+    searchfolder_free(group->searchfolder);
+    free(group->search_path);
+    free(group);
+}
+
+/**
+ * Free a destination folder, once removed from its group.
+ * @param folder The folder
+ */
+static void daemon_folder_free(daemon_folder_t *folder) {
+    if (folder->expression != NULL) {
+        parser_free(folder->expression);
+    }
+    free(folder->dst_path);
+    free(folder->args);
+    free(folder);
+}
+
+/**
+ * Handle the `add` command. The lock must be held.
+ * @param fd Where to write the reply
+ * @param request The request, kept by the destination folder on success
+ * @param args Arguments of the command
+ * @param count Number of arguments
+ * @return Error indicator: 0 for OK, 1 for an error
+ */
+static int daemon_add(int fd, char **request, char **args, int count) {
+    searchfolder_options_t options;
+    int first_arg = searchfolder_options_parse(count, args, &options);
+    if (first_arg == -1 || count - first_arg < 2) {
+        dprintf(fd, "Invalid arguments\n");
+        return 1;
+    }
+    char *dst_path = args[first_arg];
+    char *search_path = args[first_arg + 1];
+
+    parser_t *expression = NULL;
+    parser_limit_t limit;
+    size_t expression_size = count - first_arg - 2;
+    if (parser_parse_limit(args + first_arg + 2, &expression_size, &limit)) {
+        dprintf(fd, "Invalid limit\n");
+        return 1;
+    }
+    if (expression_size > 0) {
+        expression = parser_parse(args + first_arg + 2, expression_size);
+        if (expression == NULL) {
+            dprintf(fd, "Invalid expression\n");
+            return 1;
+        }
+    }
+
+    // The lock is released while waiting for the group, which may be freed and the destination added meanwhile:
+    // both are searched again after each wait
+    daemon_group_t *group;
+    for (;;) {
+        if (daemon_find_folder(dst_path) != NULL) {
+            dprintf(fd, "Destination '%s' is already updated\n", dst_path);
+            if (expression != NULL) {
+                parser_free(expression);
+            }
+            return 1;
+        }
+        group = daemon_find_group(search_path, &options);
+        if (group == NULL || !group->busy) {
+            break;
+        }
+        pthread_cond_wait(&g_daemon.changed, &g_daemon.lock);
+    }
+
+    daemon_folder_t *folder = malloc(sizeof(daemon_folder_t));
+    folder->dst_path = strdup(dst_path);
+    folder->expression = expression;
+    folder->args = NULL;
+    folder->group = group;
+
+    int error = 0;
+    if (folder->group != NULL) {
+        error = searchfolder_add(folder->group->searchfolder, folder->dst_path, expression, &limit);
+    } else {
+        group = malloc(sizeof(daemon_group_t));
+        group->search_path = strdup(search_path);
+        group->options = options;
+        group->busy = false;
+        group->searchfolder = searchfolder_create(folder->dst_path, group->search_path, expression, &limit, &options);
+        if (group->searchfolder == NULL) {
+            free(group->search_path);
+            free(group);
+            error = 1;
+        } else {
+            group->next = g_daemon.groups;
+            g_daemon.groups = group;
+            folder->group = group;
+        }
+    }
+
+    if (!error && searchfolder_prepare(folder->group->searchfolder) != 0) {
+        searchfolder_remove(folder->group->searchfolder, folder->dst_path);
+        bool group_used = false;
+        for (daemon_folder_t *other = g_daemon.folders; other; other = other->next) {
+            group_used |= other->group == folder->group;
+        }
+        if (!group_used) {
+            daemon_group_free(folder->group);
+        }
+        error = 1;
+    }
+    if (error) {
+        dprintf(fd, "Cannot update destination '%s'\n", dst_path);
+        daemon_folder_free(folder);
+        return 1;
+    }
+    folder->args = request;
+
+    // Executed as soon as possible
+    daemon_time_in(0, &folder->group->due);
+    folder->next = g_daemon.folders;
+    g_daemon.folders = folder;
+    pthread_cond_broadcast(&g_daemon.changed);
+    return 0;
+}
+
+/**
+ * Handle the `remove` command. The lock must be held.
+ * @param fd Where to write the reply
+ * @param args Arguments of the command
+ * @param count Number of arguments
+ * @return Error indicator: 0 for OK, 1 for an error
+ */
+static int daemon_remove(int fd, char **args, int count) {
+    daemon_folder_t *folder = count == 1 ? daemon_find_idle_folder(args[0]) : NULL;
+    if (folder == NULL) {
+        dprintf(fd, "Destination is not updated by the daemon\n");
+        return 1;
+    }
+
+    daemon_group_t *group = folder->group;
+    searchfolder_remove(group->searchfolder, folder->dst_path);
+
+    bool group_used = false;
+    for (daemon_folder_t **f = &g_daemon.folders; *f;) {
+        if (*f == folder) {
+            *f = folder->next;
+            continue;
+        }
+        group_used |= (*f)->group == group;
+        f = &(*f)->next;
+    }
+    if (!group_used) {
+        daemon_group_free(group);
+    }
+    daemon_folder_free(folder);
+
+    if (g_daemon.folders == NULL) {
+        g_stopping = 1;  // nothing left to update
+    }
+    pthread_cond_broadcast(&g_daemon.changed);
+    return 0;
+}
+
+/**
+ * Handle the `list` and `status` commands. The lock must be held.
+ * @param fd Where to write the reply
+ * @param status If the status of the executions is written
+ * @return Error indicator: 0 for OK
+ */
+static int daemon_list(int fd, bool status) {
+    for (daemon_group_t *group = g_daemon.groups; group; group = group->next) {
+        if (group->busy && status) {
+            for (daemon_folder_t *folder = g_daemon.folders; folder; folder = folder->next) {
+                if (folder->group == group) {
+                    dprintf(fd, "%s\t%s\trunning\n", folder->dst_path, group->search_path);
+                }
+            }
+            continue;
+        }
+        searchfolder_print(group->searchfolder, fd, status);
+    }
+    return 0;
+}
+
+/**
+ * Handle the `query` command, replying with the encoded result set.
+ * The result set of the last update is encoded while the lock is held, without waiting for the execution of the
+ * group, and sent once the lock is released.
+ * @param fd Where to write the reply
+ * @param args Arguments of the command
+ * @param count Number of arguments
+ */
+static void daemon_query_reply(int fd, char **args, int count) {
+    uint64_t since = 0;
+    if (count < 1 || count > 2 || (count == 2 && sscanf(args[1], "%" SCNu64, &since) != 1)) {
+        results_send_error(fd);
+        return;
+    }
+
+    pthread_mutex_lock(&g_daemon.lock);
+    daemon_folder_t *folder = daemon_find_folder(args[0]);
+    if (folder == NULL) {
+        pthread_mutex_unlock(&g_daemon.lock);
+        results_send_error(fd);
+        return;
+    }
+    linker_t *linker = searchfolder_linker(folder->group->searchfolder, folder->dst_path);
+    results_writer_t *writer = results_writer_create();
+    unsigned long generation;
+    bool delta = linker_results(linker, since, results_writer_add, writer, &generation);
+    pthread_mutex_unlock(&g_daemon.lock);
+
+    results_writer_send(writer, fd, generation, delta);
+    results_writer_free(writer);
+}
+
+/**
+ * Handle the `metrics` command.
+ * The metrics are collected while the lock is held, and written once it is released.
+ * @param fd Where to write the reply
+ */
+static void daemon_metrics_reply(int fd) {
+    metrics_writer_t *writer = metrics_writer_create();
+    unsigned int folders = 0, groups = 0, busy = 0;
+
+    pthread_mutex_lock(&g_daemon.lock);
+    for (daemon_folder_t *folder = g_daemon.folders; folder; folder = folder->next) {
+        folders++;
+    }
+    for (daemon_group_t *group = g_daemon.groups; group; group = group->next) {
+        groups++;
+        busy += group->busy;
+        searchfolder_metrics(group->searchfolder, writer);
+    }
+    pthread_mutex_unlock(&g_daemon.lock);
+
+    struct mallinfo2 heap = mallinfo2();
+    metrics_writer_value(writer, METRICS_GAUGE, "searchfolder_daemon_folders", "Destination folders hosted.", NULL,
+                         folders);
+    metrics_writer_value(writer, METRICS_GAUGE, "searchfolder_daemon_searches",
+                         "Searches updating the destination folders.", NULL, groups);
+    metrics_writer_value(writer, METRICS_GAUGE, "searchfolder_daemon_searches_running", "Searches being executed.",
+                         NULL, busy);
+    metrics_writer_value(writer, METRICS_GAUGE, "searchfolder_daemon_heap_bytes", "Bytes of heap in use.", NULL,
+                         heap.uordblks + heap.hblkhd);
+
+    int error = metrics_writer_send(writer, fd);
+    metrics_writer_free(writer);
+    dprintf(fd, error ? "ERROR\n" : "OK\n");
+}
+
+/**
+ * Serve a connection: receive a request, handle it and reply.
+ * @param arg The connected socket
+ * @return NULL
+ */
+static void *daemon_client(void *arg) {
+    int fd = (int)(intptr_t)arg;
+    int count, error = 1;
+    char **args = ipc_recv_args(fd, &count);
+
+    if (args != NULL && count > 0 && strcmp(args[0], "query") == 0) {
+        daemon_query_reply(fd, args + 1, count - 1);
+    } else if (args != NULL && count == 1 && strcmp(args[0], "metrics") == 0) {
+        daemon_metrics_reply(fd);
+    } else if (args != NULL && count > 0) {
+        pthread_mutex_lock(&g_daemon.lock);
+        if (strcmp(args[0], "add") == 0) {
+            error = daemon_add(fd, args, args + 1, count - 1);
+            if (!error) {
+                args = NULL;  // kept by the destination folder
+            }
+        } else if (strcmp(args[0], "remove") == 0) {
+            error = daemon_remove(fd, args + 1, count - 1);
+        } else if (strcmp(args[0], "list") == 0) {
+            error = daemon_list(fd, false);
+        } else if (strcmp(args[0], "status") == 0) {
+            error = daemon_list(fd, true);
+        } else if (strcmp(args[0], "log") == 0) {
+            logger_level_t level;
+            error = count != 2 || logger_parse_level(args[1], &level) != 0;
+            if (!error) {
+                logger_set_level(level);
+            }
+        } else {
+            dprintf(fd, "Unknown command '%s'\n", args[0]);
+        }
+        pthread_mutex_unlock(&g_daemon.lock);
+        dprintf(fd, error ? "ERROR\n" : "OK\n");
+    } else {
+        dprintf(fd, "ERROR\n");
+    }
+    free(args);
+    close(fd);
+
+    pthread_mutex_lock(&g_daemon.lock);
+    g_daemon.clients--;
+    pthread_cond_broadcast(&g_daemon.changed);
+    pthread_mutex_unlock(&g_daemon.lock);
+    return NULL;
+}
+
+/**
+ * Listen on the socket of the daemon, replacing a socket left by a daemon that did not stop properly.
+ * @param socket_path Path of the socket
+ * @return The listening socket, -1 if another daemon is running or for an error
+ */
+static int daemon_listen(char *socket_path) {
+    int fd = ipc_connect(socket_path);
+    if (fd != -1) {
+        close(fd);
+        logger_error("Daemon: error: another daemon is running\n");
+        return -1;
+    }
+    unlink(socket_path);  // left by a daemon that did not stop properly, if any
+
+    mode_t mask = umask(S_IRWXG | S_IRWXO);  // only the user can connect
+    fd = ipc_listen(socket_path);
+    umask(mask);
+    return fd;
+}
+
+int daemon_serve(void) {
+    char socket_path[IO_PATH_MAX_SIZE];
+    if (ipc_get_socket_path(socket_path) != 0 || (g_daemon.listen_fd = daemon_listen(socket_path)) == -1) {
+        return 1;
+    }
+
+    struct sigaction act;
+    act.sa_handler = daemon_sig_handler;
+    act.sa_flags = 0;
+    sigemptyset(&act.sa_mask);
+    sigaction(SIGINT, &act, NULL);
+    sigaction(SIGTERM, &act, NULL);
+    signal(SIGPIPE, SIG_IGN);  // clients leaving before the reply
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&g_daemon.changed, &attr);
+    pthread_condattr_destroy(&attr);
+
+    logger_start();
+    trace_start();
+
+    pthread_t workers[DAEMON_WORKERS];
+    int worker_count = 0;
+    for (; worker_count < DAEMON_WORKERS; worker_count++) {
+        if (pthread_create(&workers[worker_count], NULL, daemon_worker, NULL) != 0) {
+            break;
+        }
+    }
+
+    struct pollfd pfd = {g_daemon.listen_fd, POLLIN, 0};
+    while (!g_stopping) {
+        if (poll(&pfd, 1, DAEMON_POLL_MS) <= 0) {
+            continue;
+        }
+        int client_fd = accept4(g_daemon.listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (client_fd == -1) {
+            continue;
+        }
+        struct timeval timeout = {DAEMON_RECV_TIMEOUT_MS / 1000, (DAEMON_RECV_TIMEOUT_MS % 1000) * 1000};
+        setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        pthread_t client;
+        pthread_attr_t client_attr;
+        pthread_attr_init(&client_attr);
+        pthread_attr_setdetachstate(&client_attr, PTHREAD_CREATE_DETACHED);
+        pthread_mutex_lock(&g_daemon.lock);
+        g_daemon.clients++;
+        if (pthread_create(&client, &client_attr, daemon_client, (void *)(intptr_t)client_fd) != 0) {
+            g_daemon.clients--;
+            close(client_fd);
+        }
+        pthread_mutex_unlock(&g_daemon.lock);
+        pthread_attr_destroy(&client_attr);
+    }
+
+    close(g_daemon.listen_fd);
+    unlink(socket_path);
+
+    pthread_mutex_lock(&g_daemon.lock);
+    pthread_cond_broadcast(&g_daemon.changed);
+    while (g_daemon.clients > 0) {
+        pthread_cond_wait(&g_daemon.changed, &g_daemon.lock);
+    }
+    pthread_mutex_unlock(&g_daemon.lock);
+    for (int i = 0; i < worker_count; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    while (g_daemon.groups) {
+        daemon_group_free(g_daemon.groups);
+    }
+    while (g_daemon.folders) {
+        daemon_folder_t *folder = g_daemon.folders;
+        g_daemon.folders = folder->next;
+        daemon_folder_free(folder);
+    }
+    io_directory_delete_wait();
+
+    trace_stop();
+    logger_stop();
+    return 0;
+}
+
+int daemon_spawn(void) {
+    char socket_path[IO_PATH_MAX_SIZE];
+    if (ipc_get_socket_path(socket_path) != 0) {
+        return 1;
+    }
+
+    pid_t child_pid = fork();
+    if (child_pid == -1) {
+        logger_perror("Fork failed");
+        return 1;
+    } else if (child_pid == 0) {
+        setsid();
+        exit(daemon_serve() == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    struct timespec delay = {0, DAEMON_CONNECT_DELAY_MS * 1000000L};
+    for (int i = 0; i < DAEMON_CONNECT_RETRIES; i++) {
+        int fd = ipc_connect(socket_path);
+        if (fd != -1) {
+            close(fd);
+            return 0;
+        }
+        nanosleep(&delay, NULL);
+    }
+
+    logger_error("Daemon: error: the daemon did not start\n");
+    return 1;
+}
+
+daemon_result_t daemon_request(char **args, int count, int out_fd) {
+    char socket_path[IO_PATH_MAX_SIZE];
+    if (ipc_get_socket_path(socket_path) != 0) {
+        return DAEMON_UNREACHABLE;
+    }
+    int fd = ipc_connect(socket_path);
+    if (fd == -1) {
+        return DAEMON_UNREACHABLE;
+    }
+
+    if (ipc_send_args(fd, args, count) != 0) {
+        close(fd);
+        return DAEMON_UNREACHABLE;
+    }
+
+    size_t size = 0, allocated = DAEMON_REPLY_CHUNK;
+    char *reply = malloc(allocated);
+    ssize_t received;
+    while ((received = read(fd, reply + size, allocated - size - 1)) > 0) {
+        size += received;
+        if (allocated - size - 1 == 0) {
+            allocated *= 2;
+            reply = realloc(reply, allocated);
+        }
+    }
+    close(fd);
+    reply[size] = '\0';
+
+    // The last line is the status
+    daemon_result_t result = DAEMON_UNREACHABLE;
+    if (size > 0 && reply[size - 1] == '\n') {
+        reply[size - 1] = '\0';
+        char *status = strrchr(reply, '\n');
+        status = status ? status + 1 : reply;
+        result = strcmp(status, "OK") == 0 ? DAEMON_OK : DAEMON_REFUSED;
+        if (out_fd != -1) {
+            ipc_write_all(out_fd, reply, status - reply);
+        }
+    }
+
+    free(reply);
+    return result;
+}
+
+daemon_result_t daemon_query(char *dst_path, uint64_t since, results_header_t *header, results_callback_t callback,
+                             void *data) {
+    char socket_path[IO_PATH_MAX_SIZE];
+    if (ipc_get_socket_path(socket_path) != 0) {
+        return DAEMON_UNREACHABLE;
+    }
+    int fd = ipc_connect(socket_path);
+    if (fd == -1) {
+        return DAEMON_UNREACHABLE;
+    }
+
+    char since_str[24];
+    snprintf(since_str, sizeof(since_str), "%" PRIu64, since);
+    char *args[] = {"query", dst_path, since_str};
+    daemon_result_t result = DAEMON_UNREACHABLE;
+    if (ipc_send_args(fd, args, 3) == 0) {
+        result = results_receive(fd, header, callback, data) == 0 ? DAEMON_OK : DAEMON_REFUSED;
+    }
+
+    close(fd);
+    return result;
+}
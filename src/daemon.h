@@ -0,0 +1,73 @@
+/**
+ * Hosts many destination folders in a single long-lived process.
+ *
+ * The daemon listens on a Unix domain socket (see ipc_get_socket_path()) for requests,
+ * each being a list of arguments whose first one is the command:
+ *   - `add [options] <dst_path> <search_path> [expression]`: hosts a destination folder,
+ *     the paths being absolute and the options those of searchfolder_options_parse();
+ *   - `remove <dst_path>`: deletes a hosted destination folder;
+ *   - `list`: writes a line per hosted destination folder, with its search path;
+ *   - `status`: same as `list`, with the number of links and the state of the executions;
+ *   - `query <dst_path> [generation]`: sends the result set of a hosted destination folder,
+ *     or its changes since the generation given, encoded as described in results.h;
+ *   - `log <debug|info|error>`: changes the level of the messages logged by the daemon.
+ * The reply is made of lines of text, the last one being `OK` or `ERROR`, except for `query`.
+ *
+ * The destination folders sharing the same search path and options are grouped in a single
+ * searchfolder, so the tree is traversed once for all of them. The executions of the groups
+ * are spread over a pool of worker threads, the most overdue group running first.
+ * The daemon stops, deleting its destination folders, when the last one is removed or
+ * when it receives SIGTERM or SIGINT.
+ *
+ * @author Claudio Sousa, Gonzalez David
+ * @file
+ */
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include "results.h"
+
+/**
+ * Result of a request sent to the daemon
+ */
+typedef enum {
+    DAEMON_UNREACHABLE = -1, /**< The daemon is not running */
+    DAEMON_OK = 0,           /**< The request succeeded */
+    DAEMON_REFUSED = 1       /**< The request failed */
+} daemon_result_t;
+
+/**
+ * Run the daemon until it is stopped. Fails if another daemon is running.
+ * @return Error indicator: 0 for OK, 1 for an error
+ */
+int daemon_serve(void);
+
+/**
+ * Start the daemon in a new process, and wait until it accepts requests.
+ * @return Error indicator: 0 for OK, 1 for an error
+ */
+int daemon_spawn(void);
+
+/**
+ * Send a request to the daemon and write its reply, without the final status line.
+ * @param args The arguments of the request, the first one being the command
+ * @param count Number of arguments
+ * @param out_fd Where to write the reply, -1 to discard it
+ * @return Result of the request
+ */
+daemon_result_t daemon_request(char **args, int count, int out_fd);
+
+/**
+ * Query the result set of a destination folder hosted by the daemon.
+ * @param dst_path The destination folder
+ * @param since Generation known by the caller, 0 for the whole result set
+ * @param header Receives the header of the reply
+ * @param callback Receives each link added or removed since the generation
+ * @param data Data given to the callback
+ * @return Result of the request
+ */
+daemon_result_t daemon_query(char *dst_path, uint64_t since, results_header_t *header, results_callback_t callback,
+                             void *data);
+
+#endif
@@ -0,0 +1,122 @@
+/**
+ * Deadlines of the results of an expression that flip as time passes, ordered in a heap.
+ *
+ * @author Claudio Sousa, Gonzalez David
+ * @file
+ */
+
+#include <string.h>
+#include "expiry.h"
+#include "heap.h"
+#include "validator.h"
+
+/**
+ * A file whose result flips at a deadline
+ */
+typedef struct expiry_file_t {
+    time_t deadline;            /**< When the result of the file flips */
+    bool matched;               /**< If the file matches the expression until the deadline */
+    char *name;                 /**< Name of the file, as validated */
+    char *path;                 /**< Real path of the file */
+    struct stat filestat;       /**< Attributes of the file */
+    struct expiry_file_t *next; /**< Next file validated again by the same run */
+} expiry_file_t;
+
+/**
+ * Contains the deadlines of the results of an expression
+ */
+struct expiry_t {
+    parser_t *expression;       /**< The expression */
+    validator_set_t *validator; /**< Validates the files against the expression */
+    heap_t *files;              /**< The files, the earliest deadline at the top */
+};
+
+/**
+ * Order the files by deadline, used as the order of the heap.
+ * @param a The first file
+ * @param b The second file
+ * @return Negative if `a` flips before `b`, positive if after, 0 if at the same time
+ */
+static int expiry_compare(void *a, void *b) {
+    expiry_file_t *x = a, *y = b;
+    return (x->deadline > y->deadline) - (x->deadline < y->deadline);
+}
+
+/**
+ * Free a file.
+ * @param file The file
+ */
+static void expiry_file_free(expiry_file_t *file) {
+    free(file->name);
+    free(file->path);
+    free(file);
+}
+
+expiry_t *expiry_create(parser_t *expression) {
+    expiry_t *expiry = malloc(sizeof(expiry_t));
+    expiry->expression = expression;
+    expiry->validator = validator_set_create(&expiry->expression, 1);
+    expiry->files = heap_create(expiry_compare, 0);
+    return expiry;
+}
+
+void expiry_add(expiry_t *expiry, char *name, char *path, struct stat *filestat, bool matched, time_t deadline) {
+    expiry_file_t *file = malloc(sizeof(expiry_file_t));
+    file->deadline = deadline;
+    file->matched = matched;
+    file->name = strdup(name);
+    file->path = strdup(path);
+    file->filestat = *filestat;
+    file->next = NULL;
+    heap_push(expiry->files, file);
+}
+
+time_t expiry_next(expiry_t *expiry) {
+    expiry_file_t *file = heap_top(expiry->files);
+    return file ? file->deadline : 0;
+}
+
+unsigned int expiry_run(expiry_t *expiry, time_t now, expiry_callback_t callback, void *data) {
+    unsigned int flipped = 0;
+    expiry_file_t *pending = NULL;
+
+    while (heap_count(expiry->files) > 0 && expiry_next(expiry) <= now) {
+        expiry_file_t *file = heap_pop(expiry->files);
+        bool matched;
+        validator_set_validate(expiry->validator, file->name, &file->filestat, &matched, &file->deadline);
+        if (matched != file->matched) {
+            file->matched = matched;
+            callback(matched, file->path, data);
+            flipped++;
+        }
+
+        if (file->deadline == 0) {
+            expiry_file_free(file);
+        } else {
+            // pushed back once the run is done, not to be validated twice by it
+            file->next = pending;
+            pending = file;
+        }
+    }
+
+    while (pending) {
+        expiry_file_t *file = pending;
+        pending = file->next;
+        heap_push(expiry->files, file);
+    }
+    return flipped;
+}
+
+size_t expiry_count(expiry_t *expiry) {
+    return heap_count(expiry->files);
+}
+
+void expiry_free(expiry_t *expiry) {
+    expiry_file_t *file;
+    while ((file = heap_pop(expiry->files)) != NULL) {
+        expiry_file_free(file);
+    }
+    heap_free(expiry->files);
+    validator_set_free(expiry->validator);
+    free(expiry);
+}
@@ -0,0 +1,87 @@
+/**
+ * Deadlines of the results of an expression that flip as time passes.
+ *
+ * With time criteria (e.g. `-mtime -1d`), a file can enter or leave the result set of an expression only because
+ * it gets older. The files whose result flips at a known moment are recorded with their name and attributes,
+ * ordered by their deadline in a heap: once a deadline is reached, the file is validated again against its
+ * recorded attributes, without accessing the file system, and the files whose result flipped are reported.
+ *
+ * The records are only valid until the next traversal of the search path, which rebuilds them.
+ *
+ * @author Claudio Sousa, Gonzalez David
+ * @file
+ */
+
+#ifndef EXPIRY_H
+#define EXPIRY_H
+
+#include <stdbool.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "parser.h"
+
+/**
+ * Receives a file whose result flipped
+ * @param matched If the file now matches the expression, false if it does not anymore
+ * @param path Real path of the file
+ * @param data Data given along with the callback
+ */
+typedef void (*expiry_callback_t)(bool matched, char *path, void *data);
+
+struct expiry_t;
+/**
+ * Contains the deadlines of the results of an expression.
+ * Can only be created by expiry_create()
+ */
+typedef struct expiry_t expiry_t;
+
+/**
+ * Create the deadlines of the results of an expression, without any file.
+ * @param expression The expression, kept by reference
+ * @return The created deadlines
+ */
+expiry_t *expiry_create(parser_t *expression);
+
+/**
+ * Record a file whose result flips at a deadline.
+ * @param expiry The deadlines of the expression
+ * @param name Name of the file, as validated (copied)
+ * @param path Real path of the file (copied)
+ * @param filestat Attributes of the file (copied)
+ * @param matched If the file matches the expression until the deadline
+ * @param deadline When the result of the file flips
+ */
+void expiry_add(expiry_t *expiry, char *name, char *path, struct stat *filestat, bool matched, time_t deadline);
+
+/**
+ * Get the earliest deadline.
+ * @param expiry The deadlines of the expression
+ * @return The earliest deadline, 0 if no file is recorded
+ */
+time_t expiry_next(expiry_t *expiry);
+
+/**
+ * Validate again the files whose deadline is reached, and report those whose result flipped.
+ * The files whose result flips again later are kept with their next deadline, the others are dropped.
+ * @param expiry The deadlines of the expression
+ * @param now The current time
+ * @param callback Receives the files whose result flipped
+ * @param data Data given to the callback
+ * @return Number of files whose result flipped
+ */
+unsigned int expiry_run(expiry_t *expiry, time_t now, expiry_callback_t callback, void *data);
+
+/**
+ * Get the number of files recorded.
+ * @param expiry The deadlines of the expression
+ * @return The number of files
+ */
+size_t expiry_count(expiry_t *expiry);
+
+/**
+ * Free the deadlines of an expression, with the files recorded.
+ * @param expiry The deadlines to free
+ */
+void expiry_free(expiry_t *expiry);
+
+#endif
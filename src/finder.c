@@ -6,176 +6,802 @@
    Symbolic links are followed, and an hashtable is kept with the id's (inode id) of the processed paths to avoid
    processing the same paths twice and avoid infinte loops.
 
+   Several expressions can be searched for in a single traversal: each entry is stated once and validated against
+   all of them, the criteria they have in common being evaluated only once.
+
+   The found files can be received as they are found, see `finder_find_stream`.
+
+   The traversal is iterative: the directories being read are kept in a stack, along with the number of entries
+   read from each of them. This frontier can be saved periodically to a checkpoint file, with the processed paths
+   and the files found so far, so that an interrupted traversal is resumed from its last checkpoint instead of
+   starting over: the directories of the stack are opened again and their entries already read are skipped.
+
+   With time criteria, the result of a file can flip as time passes. The files whose result flips at a known
+   deadline are recorded in the deadlines of their expression when given (see expiry.h), so that they can enter or
+   leave the result set at that moment without a new traversal. Otherwise, the earliest deadline is reported.
+
+   The result set of an expression can be limited to the first files in the order of a key (e.g. the newest ones).
+   The files kept so far are held in a heap bounded to the limit, whose top is the file that would be dropped first,
+   so that the memory stays bounded by the limit. The real paths are resolved only for the files kept, once the
+   traversal is done, and they are then passed to the callback, the first one in the order first.
+
    @file
  */
 
 #include <dirent.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <limits.h>
+#include <stdio.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include "expiry.h"
 #include "finder.h"
+#include "heap.h"
 #include "io.h"
 #include "logger.h"
+#include "trace.h"
 #include "vendor/uthash.h"
 
-/** Hashtable containing the processed files.
-    Used to avoid processing same paths twice.
-    @see file_t
- */
-static struct file_t *files = NULL;
-
-/** Hashtable entry type used in `files`.
-    Each instance contains the inode id of a path already processed
-    @see files
+/** Initial number of nested directories of the stack of a traversal */
+#define FINDER_STACK_SIZE 64
+/** Seconds between two checkpoints of a traversal */
+#define FINDER_CHECKPOINT_PERIOD 30
+/** Number of entries read between two checks of the time of the next checkpoint */
+#define FINDER_CHECKPOINT_ENTRIES 1024
+/** Identifies the checkpoint files, and their version */
+#define FINDER_CHECKPOINT_MAGIC "SFSCAN2"
+/** Suffix of the temporary file used to write a checkpoint atomically */
+#define FINDER_CHECKPOINT_TMP_SUFFIX ".tmp"
+
+/** Hashtable entry type used in `finder_ctx_t.files`.
+    Each instance contains the inode id of a path already processed.
+    For files, it also records which expressions already matched it.
+    @see finder_ctx_t
  */
 typedef struct file_t {
-    long unsigned int id; /**< Inode id */
-    UT_hash_handle hh;    /**< Makes this structure hashable */
+    long unsigned int id;   /**< Inode id */
+    bool *matched;          /**< Expressions that already matched the file, *NULL* for directories */
+    size_t pending;         /**< Number of expressions that did not match the file yet */
+    UT_hash_handle hh;      /**< Makes this structure hashable */
 } file_t;
 
-/** Adds the found valid file to the list of found files
-    @param filename Found file's name
-    @param currentfile Chained list of found files
-    @returns New pointer to the found files chained list
+/** A file kept in the result set of an expression with a limit */
+typedef struct finder_ranked_t {
+    parser_limit_t *limit; /**< Limit of the result set, giving the order of the files */
+    long unsigned int id;  /**< Inode id, ordering the files of the same key */
+    long key;              /**< Time or size the files are ordered by */
+    char *name;            /**< File's name, when the files are ordered by name */
+    char *path;            /**< File's path as found, resolved once the traversal is done */
+} finder_ranked_t;
+
+/** A directory being read by a traversal */
+typedef struct finder_frame_t {
+    char *path;              /**< Directory's full path */
+    void *dir;               /**< Directory stream */
+    unsigned long position;  /**< Number of entries read */
+    char last[NAME_MAX + 1]; /**< Name of the last entry read, when the state of the traversal is saved */
+    uint64_t span;           /**< Beginning of the trace span of the directory */
+} finder_frame_t;
+
+/** State of a single traversal, shared by all the expressions searched for */
+typedef struct finder_ctx_t {
+    char *search_path;           /**< Where to look for the files */
+    file_t *files;               /**< Hashtable of the processed paths, to avoid processing same paths twice */
+    finder_frame_t *frames;      /**< Stack of the directories being read, the innermost last */
+    size_t depth;                /**< Number of directories being read */
+    size_t capacity;             /**< Size of the stack */
+    validator_set_t *validators; /**< Expressions evaluated against each file */
+    parser_limit_t *limits;      /**< Limits of the result sets, one per expression, *NULL* for none */
+    heap_t **ranked;             /**< Files kept for each expression with a limit, *NULL* for the others */
+    expiry_t **expiries;         /**< Deadlines of the results of the expressions, *NULL* if not recorded */
+    size_t count;                /**< Number of expressions */
+    bool *valid;                 /**< Validation results of the current file, one per expression */
+    time_t *deadlines;           /**< When the results of the current file flip, one per expression, 0 never */
+    finder_callback_t callback;  /**< Receives the found files */
+    void *data;                  /**< Data passed to `callback` */
+    char *checkpoint;            /**< Where the state of the traversal is saved, *NULL* if not saved */
+    uint64_t fingerprint;        /**< Fingerprint of the expressions and their limits */
+    FILE *results;               /**< Receives the found files, when the state of the traversal is saved */
+    time_t checkpoint_at;        /**< When to save the state of the traversal next */
+    unsigned int unchecked;      /**< Entries read since the last check of `checkpoint_at` */
+    finder_stats_t stats;        /**< Counters of the traversal */
+} finder_ctx_t;
+
+/** Adds the found valid file to a list of found files, used as the callback of `finder_find_multi`
+    @param expression Index of the expression matched
+    @param filename Found file's real path
+    @param data The found files, one chained list per expression
  */
-static finder_t *finder_add_found_file(char *filename, finder_t *currentfile) {
+static void finder_add_found_file(size_t expression, char *filename, void *data) {
+    finder_t **results = data;
     finder_t *newfile = (finder_t *)malloc(sizeof(finder_t));
-    char *filename_cpy = malloc(sizeof(char) * IO_PATH_MAX_SIZE);
-    realpath(filename, filename_cpy);
-    newfile->filename = filename_cpy;
-    newfile->next = currentfile;
-    return newfile;
+    newfile->filename = filename;
+    newfile->next = results[expression];
+    results[expression] = newfile;
 }
 
-/** Verifies if an inode id has already been processed */
-static bool finder_hash_exist(long unsigned int inode) {
+/** Retrieves the hashtable entry of an already processed inode id, *NULL* if not processed yet */
+static file_t *finder_hash_find(finder_ctx_t *ctx, long unsigned int inode) {
     file_t *f;
-    HASH_FIND_INT(files, &inode, f);
-    return f != NULL;
+    HASH_FIND(hh, ctx->files, &inode, sizeof(inode), f);
+    return f;
 }
 
-/** Adds an inode id to the hashtable of processed files */
-static void finder_hash_add(long unsigned int inode) {
+/** Verifies if an inode id has already been completely processed (directory, or file matched by all expressions) */
+static bool finder_hash_exist(finder_ctx_t *ctx, long unsigned int inode) {
+    file_t *f = finder_hash_find(ctx, inode);
+    return f != NULL && f->pending == 0;
+}
+
+/** Adds an inode id to the hashtable of processed paths
+    @param ctx Traversal state
+    @param inode Inode id
+    @param is_file If the inode is a file, and the expressions matching it must be tracked
+    @returns The added entry
+ */
+static file_t *finder_hash_add(finder_ctx_t *ctx, long unsigned int inode, bool is_file) {
     file_t *file = malloc(sizeof(file_t));
+    ctx->stats.allocated += sizeof(file_t) + (is_file ? ctx->count * sizeof(bool) : 0);
     file->id = inode;
-    HASH_ADD_INT(files, id, file); /* id: name of key field */
+    file->matched = is_file ? calloc(ctx->count, sizeof(bool)) : NULL;
+    file->pending = is_file ? ctx->count : 0;
+    HASH_ADD(hh, ctx->files, id, sizeof(file->id), file);
+    return file;
 }
 
 /** Clears (frees) the processed files hashtable  */
-static void finder_hash_clear() {
+static void finder_hash_clear(finder_ctx_t *ctx) {
     file_t *current_file, *tmp;
 
-    HASH_ITER(hh, files, current_file, tmp) {
-        HASH_DEL(files, current_file);
+    HASH_ITER(hh, ctx->files, current_file, tmp) {
+        HASH_DEL(ctx->files, current_file);
+        free(current_file->matched);
         free(current_file);
     }
 
-    files = NULL;
+    ctx->files = NULL;
 }
 
-static finder_t *finder_find_in_dir(char *dir, finder_t *filelist, parser_t *expression);
+/** Compares two files kept for an expression with a limit, used as the order of the heap: the file coming first
+    is the last one in the order of the limit, the first to be dropped */
+static int finder_ranked_compare(void *a, void *b) {
+    finder_ranked_t *x = a, *y = b;
+    int order = x->limit->sort == SORT_NAME ? strcmp(x->name, y->name) : (x->key > y->key) - (x->key < y->key);
+    if (order == 0)
+        order = (x->id > y->id) - (x->id < y->id);
+    return x->limit->descending ? order : -order;
+}
+
+/** Frees a file kept for an expression with a limit, *NULL* being ignored */
+static void finder_ranked_free(finder_ranked_t *ranked) {
+    if (ranked) {
+        free(ranked->name);
+        free(ranked->path);
+        free(ranked);
+    }
+}
+
+/** Keeps a file matching an expression with a limit, if it is among the first ones found so far.
+    The file dropped to make room for it, if any, is freed.
+    @param ctx Traversal state
+    @param expression Index of the expression
+    @param filename File's name
+    @param filepath File's full path
+    @param file_stat File's attributes
+ */
+static void finder_rank_file(finder_ctx_t *ctx, size_t expression, char *filename, char *filepath,
+                             struct stat *file_stat) {
+    parser_limit_t *limit = &ctx->limits[expression];
+    heap_t *heap = ctx->ranked[expression];
+    finder_ranked_t file = {limit, file_stat->st_ino, 0, filename, filepath};
+    switch (limit->sort) {
+        case SORT_SIZE:
+            file.key = file_stat->st_size;
+            break;
+        case SORT_ATIME:
+            file.key = file_stat->st_atime;
+            break;
+        default:
+            file.key = file_stat->st_mtime;
+    }
+    if (heap_count(heap) == limit->count && finder_ranked_compare(&file, heap_top(heap)) <= 0)
+        return;  // not among the first ones
+
+    finder_ranked_t *ranked = malloc(sizeof(finder_ranked_t));
+    *ranked = file;
+    ranked->name = limit->sort == SORT_NAME ? strdup(filename) : NULL;
+    ranked->path = strdup(filepath);
+    ctx->stats.allocated += sizeof(finder_ranked_t) + strlen(filepath) + 1;
+    finder_ranked_free(heap_offer(heap, ranked));
+}
+
+/** Passes the files kept for an expression with a limit to the callback, the first one in the order first,
+    and frees them.
+    @param ctx Traversal state
+    @param expression Index of the expression
+ */
+static void finder_emit_ranked(finder_ctx_t *ctx, size_t expression) {
+    heap_t *heap = ctx->ranked[expression];
+    size_t count = heap_count(heap);
+    finder_ranked_t **files = malloc(sizeof(finder_ranked_t *) * count);
+    for (size_t i = count; i > 0; i--)
+        files[i - 1] = heap_pop(heap);
+
+    char resolved[IO_PATH_MAX_SIZE];
+    for (size_t i = 0; i < count; i++) {
+        if (io_realpath(files[i]->path, resolved) != NULL) {  // otherwise vanished during the traversal
+            ctx->stats.allocated += strlen(resolved) + 1;
+            ctx->stats.matches++;
+            ctx->callback(expression, strdup(resolved), ctx->data);
+        }
+        finder_ranked_free(files[i]);
+    }
+    free(files);
+}
+
+/** Records when the result of a file flips as time passes: in the deadlines of the expression if they are
+    recorded, otherwise in the earliest deadline of the traversal.
+    @param ctx Traversal state
+    @param expression Index of the expression
+    @param filename File's name
+    @param filepath File's full path
+    @param realfile File's real path, *NULL* to resolve it
+    @param file_stat File's attributes
+ */
+static void finder_track_flip(finder_ctx_t *ctx, size_t expression, char *filename, char *filepath, char *realfile,
+                              struct stat *file_stat) {
+    time_t deadline = ctx->deadlines[expression];
+    expiry_t *expiry = ctx->expiries && !ctx->ranked[expression] ? ctx->expiries[expression] : NULL;
+    if (!expiry) {
+        if (!ctx->stats.deadline || deadline < ctx->stats.deadline)
+            ctx->stats.deadline = deadline;
+        return;
+    }
+
+    if (realfile) {
+        expiry_add(expiry, filename, realfile, file_stat, true, deadline);
+        return;
+    }
+    char resolved[IO_PATH_MAX_SIZE];
+    if (io_realpath(filepath, resolved) != NULL)
+        expiry_add(expiry, filename, resolved, file_stat, false, deadline);
+}
+
+/** Processes a found file (regular file or symbolic link target).
+
+   The file is validated once against all the expressions.
+   It is added to the list of found files of each expression it matches, unless already found for this expression.
+
+   @param ctx Traversal state
+   @param filename File's name
+   @param filepath File's full path
+   @param file_stat File's attributes
+ */
+static void finder_process_file(finder_ctx_t *ctx, char *filename, char *filepath, struct stat *file_stat) {
+    file_t *file = finder_hash_find(ctx, file_stat->st_ino);
+    if (file && file->pending == 0)
+        return;
+
+    validator_set_validate(ctx->validators, filename, file_stat, ctx->valid, ctx->deadlines);
+    ctx->stats.files++;
+
+    for (size_t i = 0; i < ctx->count; i++) {
+        if (file && file->matched[i])
+            continue;
+        if (!ctx->valid[i]) {
+            if (ctx->deadlines[i])
+                finder_track_flip(ctx, i, filename, filepath, NULL, file_stat);
+            continue;
+        }
+
+        if (!file)
+            file = finder_hash_add(ctx, file_stat->st_ino, true);
+        file->matched[i] = true;
+        file->pending--;
+
+        if (ctx->ranked[i]) {
+            if (ctx->deadlines[i])
+                finder_track_flip(ctx, i, filename, filepath, NULL, file_stat);
+            finder_rank_file(ctx, i, filename, filepath, file_stat);
+            continue;
+        }
+
+        // sized to the path, as the found files are kept until they are linked
+        char resolved[IO_PATH_MAX_SIZE] = "";
+        io_realpath(filepath, resolved);
+        char *realfile = strdup(resolved);
+        ctx->stats.allocated += strlen(realfile) + 1;
+        if (ctx->deadlines[i])
+            finder_track_flip(ctx, i, filename, filepath, realfile, file_stat);
+        ctx->stats.matches++;
+        if (ctx->results) {
+            fwrite(&i, sizeof(size_t), 1, ctx->results);
+            fwrite(realfile, sizeof(char), strlen(realfile) + 1, ctx->results);
+        }
+        ctx->callback(i, realfile, ctx->data);
+    }
+}
+
+static void finder_enter_dir(finder_ctx_t *ctx, char *dir);
 
 /** Processes a found directory entity.
 
    If it is a *directory*:
-    - we use `finder_find_in_dir` to analyze the content
+    - we use `finder_enter_dir` to analyze the content
 
-   If it is a *regular file*:
-     - we check that if has not been processed yet
-     - we check if is valid file against the expression
+   If it is a *regular file*, we use `finder_process_file`:
+     - we check that if has not been processed yet for each expression
+     - we check if is valid file against the expressions
      - if the two previous conditions are met:
        + it is added to the hashtable of processed files
-       + it is added to the list of valid files found
+       + it is added to the list of valid files found of the expression
 
    If it is a *symbolic link*, we retrieve the target and check the target type:
     - if it is a *directory, we proceed with the above conditions for directories
     - otherwise we proceed with above conditions for regular files
 
+   @param ctx Traversal state
    @param dent Directory entity to process
    @param dirpath Directory entity full path
-   @param filelist Pointer to the found files chained list
-   @param expression Filtering expression
-   @returns New pointer to the found files chained list
  */
-static finder_t *finder_process_dent(struct dirent *dent, char *dirpath, finder_t *filelist, parser_t *expression) {
+static void finder_process_dent(finder_ctx_t *ctx, io_dirent_t *dent, char *dirpath) {
     struct stat file_stat;
 
-    switch (dent->d_type) {
+    switch (dent->type) {
         case DT_DIR:
-            if (strcmp(dent->d_name, ".") != 0 && strcmp(dent->d_name, "..") != 0)
-                filelist = finder_find_in_dir(dirpath, filelist, expression);
+            if (strcmp(dent->name, ".") != 0 && strcmp(dent->name, "..") != 0)
+                finder_enter_dir(ctx, dirpath);
             break;
         case DT_LNK:
-            stat(dirpath, &file_stat);
+            ctx->stats.stats++;
+            if (io_stat(AT_FDCWD, dirpath, &file_stat, true) != 0)
+                break;  // dangling link
             if (S_ISDIR(file_stat.st_mode))
-                filelist = finder_find_in_dir(dirpath, filelist, expression);
-            else if (validator_validate(dent->d_name, &file_stat, expression)) {
-                if (!finder_hash_exist(file_stat.st_ino)) {
-                    finder_hash_add(file_stat.st_ino);
-                    filelist = finder_add_found_file(dirpath, filelist);
-                }
-            }
+                finder_enter_dir(ctx, dirpath);
+            else
+                finder_process_file(ctx, dent->name, dirpath, &file_stat);
             break;
         case DT_REG:
-            stat(dirpath, &file_stat);
-            if (!finder_hash_exist(file_stat.st_ino) && validator_validate(dent->d_name, &file_stat, expression)) {
-                finder_hash_add(dent->d_ino);
-                filelist = finder_add_found_file(dirpath, filelist);
-            }
+            ctx->stats.stats++;
+            if (io_stat(AT_FDCWD, dirpath, &file_stat, true) == 0)
+                finder_process_file(ctx, dent->name, dirpath, &file_stat);
     }
+}
+
+/** Pushes a directory on the stack of the directories being read
+    @param ctx Traversal state
+    @param dir Directory full path
+    @param d Directory stream
+    @param position Number of entries already read
+    @param span Beginning of the trace span of the directory
+ */
+static void finder_push_dir(finder_ctx_t *ctx, char *dir, void *d, unsigned long position, uint64_t span) {
+    if (ctx->depth == ctx->capacity) {
+        ctx->capacity *= 2;
+        ctx->frames = realloc(ctx->frames, sizeof(finder_frame_t) * ctx->capacity);
+    }
+    finder_frame_t *frame = &ctx->frames[ctx->depth++];
+    frame->path = strdup(dir);
+    frame->dir = d;
+    frame->position = position;
+    frame->last[0] = '\0';
+    frame->span = span;
+}
 
-    return filelist;
+/** Pops the innermost directory being read, once all its entries are read
+    @param ctx Traversal state
+ */
+static void finder_leave_dir(finder_ctx_t *ctx) {
+    finder_frame_t *frame = &ctx->frames[--ctx->depth];
+    io_closedir(frame->dir);
+    trace_end("finder", "readdir", frame->span, frame->path);
+    free(frame->path);
 }
 
-/** Searches a directory recursively for files matching the expression
+/** Opens a directory to search it for files matching the expressions, unless already processed
 
-    Iterates over the directory entities and delegates their processing to `finder_process_dent`.
-    Directories are added to the hastable of processed paths.
+    Directories are added to the hastable of processed paths, and pushed on the stack of the directories being
+    read, whose entries are processed by `finder_traverse`.
+    @param ctx Traversal state
     @param dir Directory full path
-    @param filelist Pointer to the found files chained list
-    @param expression Filtering expression
-    @returns New pointer to the found files chained list
 */
-static finder_t *finder_find_in_dir(char *dir, finder_t *filelist, parser_t *expression) {
-    DIR *d = opendir(dir);
+static void finder_enter_dir(finder_ctx_t *ctx, char *dir) {
+    uint64_t span = trace_begin();
+    void *d = io_opendir(AT_FDCWD, dir);
     if (d == NULL) {
         logger_perror("Finder: error: failed to open directory");
-        return filelist;
+        return;
     }
 
     struct stat file_stat;
-    stat(dir, &file_stat);
+    io_stat(AT_FDCWD, dir, &file_stat, true);
+    ctx->stats.directories++;
+    ctx->stats.stats++;
+
+    if (finder_hash_find(ctx, file_stat.st_ino)) {
+        io_closedir(d);
+        return;
+    }
+
+    finder_hash_add(ctx, file_stat.st_ino, false);
+    finder_push_dir(ctx, dir, d, 0, span);
+}
+
+/** Starts a traversal at its search path: a directory is searched, a single file is only validated
+    @param ctx Traversal state
+    @param path The search path
+*/
+static void finder_enter_root(finder_ctx_t *ctx, char *path) {
+    struct stat file_stat;
+    if (io_stat(AT_FDCWD, path, &file_stat, true) == 0 && !S_ISDIR(file_stat.st_mode)) {
+        ctx->stats.stats++;
+        char *name = strrchr(path, '/');
+        if (S_ISREG(file_stat.st_mode))
+            finder_process_file(ctx, name ? name + 1 : path, path, &file_stat);
+        return;
+    }
+    finder_enter_dir(ctx, path);
+}
+
+/** Builds the path of a file of a checkpoint
+    @param ctx Traversal state
+    @param suffix Suffix of the file, appended to the path of the checkpoint
+    @param path Receives the path, of IO_PATH_MAX_SIZE bytes
+ */
+static void finder_checkpoint_path(finder_ctx_t *ctx, char *suffix, char *path) {
+    snprintf(path, IO_PATH_MAX_SIZE, "%s%s", ctx->checkpoint, suffix);
+}
+
+/** Writes a string to a checkpoint, terminated by a '\0' */
+static void finder_write_string(FILE *file, char *string) {
+    fwrite(string, sizeof(char), strlen(string) + 1, file);
+}
 
-    if (finder_hash_exist(file_stat.st_ino)) {
-        closedir(d);
-        return filelist;
+/** Reads a string terminated by a '\0' from a checkpoint
+    @returns The string, to be freed, *NULL* at the end of the file
+ */
+static char *finder_read_string(FILE *file) {
+    char *string = NULL;
+    size_t size = 0;
+    if (getdelim(&string, &size, '\0', file) <= 0) {
+        free(string);
+        return NULL;
     }
+    return string;
+}
 
-    finder_hash_add(file_stat.st_ino);
+/** Saves the state of a traversal to its checkpoint, atomically replacing it.
+
+    The checkpoint contains the search path, the fingerprint of the expressions, the processed paths, the directories
+    being read with the number of their entries read and the name of the last one, the files kept for the expressions
+    with a limit, and the size of the file of the found files at that point.
+    @param ctx Traversal state
+ */
+static void finder_checkpoint_save(finder_ctx_t *ctx) {
+    uint64_t span = trace_begin();
+    ctx->checkpoint_at = time(NULL) + FINDER_CHECKPOINT_PERIOD;
+
+    char tmp_path[IO_PATH_MAX_SIZE];
+    finder_checkpoint_path(ctx, FINDER_CHECKPOINT_TMP_SUFFIX, tmp_path);
+    FILE *file = fopen(tmp_path, "w");
+    if (file == NULL || fflush(ctx->results) != 0) {
+        logger_perror("Finder: error: cannot write checkpoint");
+        if (file != NULL)
+            fclose(file);
+        return;
+    }
+
+    long offset = ftell(ctx->results);
+    fwrite(FINDER_CHECKPOINT_MAGIC, sizeof(char), sizeof(FINDER_CHECKPOINT_MAGIC), file);
+    finder_write_string(file, ctx->search_path);
+    fwrite(&ctx->count, sizeof(size_t), 1, file);
+    fwrite(&ctx->fingerprint, sizeof(uint64_t), 1, file);
+    fwrite(&offset, sizeof(long), 1, file);
+
+    size_t processed = HASH_COUNT(ctx->files);
+    fwrite(&processed, sizeof(size_t), 1, file);
+    file_t *processed_file, *tmp;
+    HASH_ITER(hh, ctx->files, processed_file, tmp) {
+        bool is_file = processed_file->matched != NULL;
+        fwrite(&processed_file->id, sizeof(processed_file->id), 1, file);
+        fwrite(&is_file, sizeof(bool), 1, file);
+        if (is_file)
+            fwrite(processed_file->matched, sizeof(bool), ctx->count, file);
+    }
+
+    fwrite(&ctx->depth, sizeof(size_t), 1, file);
+    for (size_t i = 0; i < ctx->depth; i++) {
+        fwrite(&ctx->frames[i].position, sizeof(unsigned long), 1, file);
+        finder_write_string(file, ctx->frames[i].path);
+        finder_write_string(file, ctx->frames[i].last);
+    }
+
+    for (size_t i = 0; i < ctx->count; i++) {
+        size_t kept = ctx->ranked[i] ? heap_count(ctx->ranked[i]) : 0;
+        fwrite(&kept, sizeof(size_t), 1, file);
+        if (kept == 0)
+            continue;
+        // the heap has no iterator: emptied, then filled again
+        finder_ranked_t **files = malloc(sizeof(finder_ranked_t *) * kept);
+        for (size_t k = 0; k < kept; k++) {
+            files[k] = heap_pop(ctx->ranked[i]);
+            finder_write_string(file, files[k]->path);
+        }
+        for (size_t k = 0; k < kept; k++)
+            heap_push(ctx->ranked[i], files[k]);
+        free(files);
+    }
+
+    bool failed = ferror(file);
+    if (fclose(file) != 0 || failed || rename(tmp_path, ctx->checkpoint) != 0) {
+        logger_perror("Finder: error: cannot write checkpoint");
+        unlink(tmp_path);
+    }
+    trace_end("finder", "checkpoint", span, ctx->checkpoint);
+}
+
+/** Drops the state of a traversal restored partially from a checkpoint
+    @param ctx Traversal state
+ */
+static void finder_checkpoint_drop(finder_ctx_t *ctx) {
+    finder_hash_clear(ctx);
+    while (ctx->depth > 0)
+        finder_leave_dir(ctx);
+    for (size_t i = 0; i < ctx->count; i++)
+        while (ctx->ranked[i] && heap_count(ctx->ranked[i]) > 0)
+            finder_ranked_free(heap_pop(ctx->ranked[i]));
+}
+
+/** Restores the state of a traversal from a checkpoint, except its found files
+    @param ctx Traversal state
+    @param file The checkpoint
+    @param offset Receives the size of the file of the found files at the checkpoint
+    @returns If the state was restored, false if the checkpoint is not valid for this traversal
+ */
+static bool finder_checkpoint_read(finder_ctx_t *ctx, FILE *file, long *offset) {
+    char magic[sizeof(FINDER_CHECKPOINT_MAGIC)];
+    if (fread(magic, sizeof(char), sizeof(magic), file) != sizeof(magic) ||
+        memcmp(magic, FINDER_CHECKPOINT_MAGIC, sizeof(magic)) != 0)
+        return false;
+
+    char *search_path = finder_read_string(file);
+    bool same = search_path != NULL && strcmp(search_path, ctx->search_path) == 0;
+    free(search_path);
+    size_t count;
+    uint64_t fingerprint;
+    if (!same || fread(&count, sizeof(size_t), 1, file) != 1 || count != ctx->count ||
+        fread(&fingerprint, sizeof(uint64_t), 1, file) != 1 || fingerprint != ctx->fingerprint ||
+        fread(offset, sizeof(long), 1, file) != 1)
+        return false;
+
+    size_t processed;
+    if (fread(&processed, sizeof(size_t), 1, file) != 1)
+        return false;
+    for (size_t i = 0; i < processed; i++) {
+        long unsigned int id;
+        bool is_file;
+        if (fread(&id, sizeof(id), 1, file) != 1 || fread(&is_file, sizeof(bool), 1, file) != 1)
+            return false;
+        file_t *processed_file = finder_hash_add(ctx, id, is_file);
+        if (is_file && fread(processed_file->matched, sizeof(bool), ctx->count, file) != ctx->count)
+            return false;
+        for (size_t k = 0; is_file && k < ctx->count; k++)
+            processed_file->pending -= processed_file->matched[k];
+    }
 
-    struct dirent *dent;
+    size_t depth;
+    if (fread(&depth, sizeof(size_t), 1, file) != 1)
+        return false;
+    for (size_t i = 0; i < depth; i++) {
+        unsigned long position;
+        char *path = NULL, *last = NULL;
+        if (fread(&position, sizeof(unsigned long), 1, file) != 1 || (path = finder_read_string(file)) == NULL ||
+            (last = finder_read_string(file)) == NULL) {
+            free(path);
+            return false;
+        }
+
+        uint64_t span = trace_begin();
+        void *d = io_opendir(AT_FDCWD, path);
+        if (d == NULL) {
+            logger_perror("Finder: error: failed to open directory");  // removed since, its entries are lost
+            free(path);
+            free(last);
+            continue;
+        }
+        io_dirent_t dent;
+        unsigned long k = 0;
+        bool changed = position > 0;
+        for (; k < position && io_readdir(d, &dent) == 1; k++)
+            changed = k + 1 == position && strcmp(dent.name, last) != 0;
+        if (changed || k < position) {
+            // entries added or removed before the position: read again, the processed ones are skipped
+            logger_debug("Finder: '%s' changed since the checkpoint, read again\n", path);
+            io_closedir(d);
+            d = io_opendir(AT_FDCWD, path);
+            position = 0;
+        }
+        if (d != NULL)
+            finder_push_dir(ctx, path, d, position, span);
+        free(path);
+        free(last);
+    }
+
+    for (size_t i = 0; i < ctx->count; i++) {
+        size_t kept;
+        if (fread(&kept, sizeof(size_t), 1, file) != 1 || (kept > 0 && !ctx->ranked[i]))
+            return false;
+        for (size_t k = 0; k < kept; k++) {
+            char *path = finder_read_string(file);
+            if (path == NULL)
+                return false;
+            // ordered again by their current attributes
+            struct stat file_stat;
+            ctx->stats.stats++;
+            if (io_stat(AT_FDCWD, path, &file_stat, true) == 0)
+                finder_rank_file(ctx, i, basename(path), path, &file_stat);
+            free(path);
+        }
+    }
+    return true;
+}
+
+/** Resumes a traversal from its checkpoint: restores its state, and passes the files found before the checkpoint
+    to the callback again
+    @param ctx Traversal state
+    @returns If the traversal was resumed, false if it must start over
+ */
+static bool finder_checkpoint_resume(finder_ctx_t *ctx) {
+    FILE *file = fopen(ctx->checkpoint, "r");
+    if (file == NULL)
+        return false;
+
+    long offset = 0;
+    char results_path[IO_PATH_MAX_SIZE];
+    finder_checkpoint_path(ctx, FINDER_RESULTS_SUFFIX, results_path);
+    struct stat results_stat;
+    bool valid = finder_checkpoint_read(ctx, file, &offset) && stat(results_path, &results_stat) == 0 &&
+                 results_stat.st_size >= offset && truncate(results_path, offset) == 0;
+    fclose(file);
+    if (!valid || (ctx->results = fopen(results_path, "r+")) == NULL) {
+        logger_info("Finder: the checkpoint of '%s' is not valid, starting over\n", ctx->search_path);
+        finder_checkpoint_drop(ctx);
+        return false;
+    }
+
+    size_t expression;
+    char *realfile;
+    while (fread(&expression, sizeof(size_t), 1, ctx->results) == 1 && expression < ctx->count &&
+           (realfile = finder_read_string(ctx->results)) != NULL) {
+        ctx->stats.matches++;
+        ctx->callback(expression, realfile, ctx->data);
+    }
+    fseek(ctx->results, 0, SEEK_END);
+
+    logger_info("Finder: resuming the search of '%s' from its checkpoint, %zu directories deep\n",
+                ctx->search_path, ctx->depth);
+    return true;
+}
+
+/** Searches the directories of the stack for files matching the expressions, until the stack is empty
+
+    Iterates over the entities of the innermost directory and delegates their processing to `finder_process_dent`,
+    which pushes the sub-directories on the stack. The state of the traversal is saved periodically to its
+    checkpoint, if any, between two entities.
+    @param ctx Traversal state
+*/
+static void finder_traverse(finder_ctx_t *ctx) {
+    io_dirent_t dent;
     char full_path[IO_PATH_MAX_SIZE];
-    while ((dent = readdir(d)) != NULL) {
-        if (finder_hash_exist(dent->d_ino))
+    while (ctx->depth > 0) {
+        if (ctx->results && ++ctx->unchecked >= FINDER_CHECKPOINT_ENTRIES) {
+            ctx->unchecked = 0;
+            if (time(NULL) >= ctx->checkpoint_at)
+                finder_checkpoint_save(ctx);
+        }
+
+        finder_frame_t *frame = &ctx->frames[ctx->depth - 1];
+        if (io_readdir(frame->dir, &dent) != 1) {
+            finder_leave_dir(ctx);
+            continue;
+        }
+        frame->position++;
+        if (ctx->results)
+            snprintf(frame->last, sizeof(frame->last), "%s", dent.name);
+        ctx->stats.entries++;
+        if (finder_hash_exist(ctx, dent.ino))
             continue;
 
-        strcpy(full_path, dir);
+        strcpy(full_path, frame->path);
         strcat(full_path, "/");
-        strcat(full_path, dent->d_name);
+        strcat(full_path, dent.name);
 
-        filelist = finder_process_dent(dent, full_path, filelist, expression);
+        finder_process_dent(ctx, &dent, full_path);
     }
+}
+
+finder_t *finder_find(char *search_path, parser_t *expression) {
+    finder_t *foundfiles = NULL;
+    finder_find_multi(search_path, &expression, NULL, 1, &foundfiles);
+    return foundfiles;
+}
 
-    closedir(d);
+void finder_find_multi(char *search_path, parser_t **expressions, parser_limit_t *limits, size_t count,
+                       finder_t **results) {
+    for (size_t i = 0; i < count; i++)
+        results[i] = NULL;
 
-    return filelist;
+    finder_find_stream(search_path, expressions, limits, NULL, NULL, count, finder_add_found_file, results, NULL);
 }
 
-finder_t *finder_find(char *search_path, parser_t *expression) {
-    finder_t *foundfiles = finder_find_in_dir(search_path, NULL, expression);
+void finder_find_stream(char *search_path, parser_t **expressions, parser_limit_t *limits, expiry_t **expiries,
+                        char *checkpoint, size_t count, finder_callback_t callback, void *data,
+                        finder_stats_t *stats) {
+    finder_ctx_t ctx;
+    ctx.search_path = search_path;
+    ctx.files = NULL;
+    ctx.capacity = FINDER_STACK_SIZE;
+    ctx.frames = malloc(sizeof(finder_frame_t) * ctx.capacity);
+    ctx.depth = 0;
+    ctx.validators = validator_set_create(expressions, count);
+    ctx.limits = limits;
+    ctx.ranked = malloc(sizeof(heap_t *) * count);
+    for (size_t i = 0; i < count; i++)
+        ctx.ranked[i] = limits && limits[i].count ? heap_create(finder_ranked_compare, limits[i].count) : NULL;
+    ctx.expiries = expiries;
+    ctx.count = count;
+    ctx.valid = malloc(sizeof(bool) * count);
+    ctx.deadlines = malloc(sizeof(time_t) * count);
+    ctx.callback = callback;
+    ctx.data = data;
+    ctx.checkpoint = checkpoint;
+    ctx.fingerprint = 0;
+    for (size_t i = 0; checkpoint && i < count; i++)
+        ctx.fingerprint = ctx.fingerprint * 31 + parser_fingerprint(expressions[i], limits ? &limits[i] : NULL);
+    ctx.results = NULL;
+    ctx.checkpoint_at = time(NULL) + FINDER_CHECKPOINT_PERIOD;
+    ctx.unchecked = 0;
+    memset(&ctx.stats, 0, sizeof(finder_stats_t));
+
+    char results_path[IO_PATH_MAX_SIZE];
+    bool resumed = checkpoint && finder_checkpoint_resume(&ctx);
+    if (checkpoint && !resumed) {
+        finder_checkpoint_path(&ctx, FINDER_RESULTS_SUFFIX, results_path);
+        if ((ctx.results = fopen(results_path, "w")) == NULL)
+            logger_perror("Finder: error: cannot write checkpoint");
+    }
+    if (!resumed)
+        finder_enter_root(&ctx, search_path);
+    finder_traverse(&ctx);
+    free(ctx.frames);
+
+    for (size_t i = 0; i < count; i++) {
+        if (ctx.ranked[i]) {
+            finder_emit_ranked(&ctx, i);
+            heap_free(ctx.ranked[i]);
+        }
+    }
+    free(ctx.ranked);
+
+    if (ctx.results) {
+        // complete, the next traversal starts over
+        fclose(ctx.results);
+        finder_checkpoint_path(&ctx, FINDER_RESULTS_SUFFIX, results_path);
+        unlink(results_path);
+        unlink(checkpoint);
+    }
 
-    finder_hash_clear();
-    return foundfiles;
+    if (stats) {
+        *stats = ctx.stats;
+        validator_set_counts(ctx.validators, &stats->evaluations, &stats->reused);
+    }
+
+    finder_hash_clear(&ctx);
+    validator_set_free(ctx.validators);
+    free(ctx.valid);
+    free(ctx.deadlines);
 }
 
 void finder_free(finder_t *finder) {
@@ -6,6 +6,10 @@
    Symbolic links are followed, and an hashtable is kept with the id's (inode id) of the found files to avoid
    processing the same paths twice and avoid infinte loops.
 
+   Several expressions can be searched for in a single traversal, see `finder_find_multi`.
+
+   The found files can be received as they are found, see `finder_find_stream`.
+
    @file
  */
 
@@ -13,8 +17,12 @@
 #define FINDER_H
 
 #include <stdlib.h>
+#include "expiry.h"
 #include "validator.h"
 
+/** Suffix of the file receiving the found files of a traversal, appended to the path of its checkpoint */
+#define FINDER_RESULTS_SUFFIX ".results"
+
 /** A chained list of found file names */
 typedef struct finder_t {
     char *filename; /**< Found file name */
@@ -31,6 +39,73 @@ typedef struct finder_t {
  */
 finder_t *finder_find(char *search_path, parser_t *expression);
 
+/** Finds the files in the `search_path` matching each of the `expressions`, in a single traversal
+
+    Each file is stated once and validated against all the expressions.
+
+    @param search_path Where to look for the files
+    @param expressions Filter expressions used against found files
+    @param limits Limits of the result sets of the expressions, *NULL* for none
+    @param count Number of expressions
+    @param results Receives the list of found files of each expression
+ */
+void finder_find_multi(char *search_path, parser_t **expressions, parser_limit_t *limits, size_t count,
+                       finder_t **results);
+
+/** Receives a file found by `finder_find_stream`
+    @param expression Index of the expression matched by the file
+    @param filename Real path of the file, to be freed by the callback
+    @param data Data given to `finder_find_stream`
+ */
+typedef void (*finder_callback_t)(size_t expression, char *filename, void *data);
+
+/** Counters of a traversal, filled by `finder_find_stream` */
+typedef struct finder_stats_t {
+    unsigned long directories; /**< Directories opened */
+    unsigned long entries;     /**< Directory entries read */
+    unsigned long stats;       /**< Calls to stat */
+    unsigned long files;       /**< Files validated against the expressions */
+    unsigned long evaluations; /**< Criteria evaluated */
+    unsigned long reused;      /**< Criteria results reused from another expression */
+    unsigned long matches;     /**< Found files passed to the callback */
+    unsigned long allocated;   /**< Bytes allocated by the traversal, including the found files */
+    time_t deadline;           /**< Earliest flip of a result not recorded in the deadlines of its expression, 0 none */
+} finder_stats_t;
+
+/** Finds the files in the `search_path` matching each of the `expressions`, in a single traversal,
+    passing each found file to a callback as soon as it is found
+
+    The search path can also be a single file, which is then only validated against the expressions.
+    A file matching several expressions is passed once for each of them.
+    The files of an expression with a limit are only passed once the traversal is done, the first one in the
+    order of the limit first.
+
+    The files whose result flips as time passes, matching or not, are recorded in the deadlines of their
+    expression, except for the expressions with a limit, whose result sets cannot be updated file by file:
+    their earliest flip is given in the counters of the traversal instead.
+
+    With a `checkpoint`, the state of the traversal is saved periodically to that file, and the files found are
+    recorded next to it. A traversal interrupted, by a crash or a kill, is resumed by the next call with the same
+    checkpoint, search path, expressions and limits: the files found before the checkpoint are passed to the callback
+    again, then the traversal goes on where the checkpoint left it. A directory that changed since it was partially
+    read is read again from its beginning, its entries already processed being skipped. The files removed meanwhile
+    are still passed, and a file created meanwhile with the inode of a processed one is missed: the next traversal,
+    a full one, repairs them. Both files are removed once the traversal is done.
+
+    @param search_path Where to look for the files
+    @param expressions Filter expressions used against found files
+    @param limits Limits of the result sets of the expressions, *NULL* for none
+    @param expiries Receives the files whose result flips at a deadline, per expression, *NULL* for none
+    @param checkpoint Where the state of the traversal is saved, *NULL* if not saved
+    @param count Number of expressions
+    @param callback Receives the found files
+    @param data Data passed to `callback`
+    @param stats Receives the counters of the traversal, *NULL* if not needed
+ */
+void finder_find_stream(char *search_path, parser_t **expressions, parser_limit_t *limits, expiry_t **expiries,
+                        char *checkpoint, size_t count, finder_callback_t callback, void *data,
+                        finder_stats_t *stats);
+
 /** Frees the memory allocated by `finder`
     @param  finder The instance to be freed
  */
@@ -0,0 +1,124 @@
+/**
+ * Binary heap of items ordered by a comparison function, stored in an array growing as needed.
+ *
+ * @author Claudio Sousa, Gonzalez David
+ * @file
+ */
+
+#include "heap.h"
+
+/**
+ * Initial capacity of a heap
+ */
+#define HEAP_INITIAL_CAPACITY 16
+
+/**
+ * Contains a binary heap
+ */
+struct heap_t {
+    void **items;           /**< The items, the children of items[i] being items[2i+1] and items[2i+2] */
+    size_t count;           /**< Number of items */
+    size_t capacity;        /**< Size of the array of the items */
+    size_t limit;           /**< Maximum number of items kept by heap_offer(), 0 for no maximum */
+    heap_compare_t compare; /**< Order of the items */
+};
+
+heap_t *heap_create(heap_compare_t compare, size_t limit) {
+    heap_t *heap = malloc(sizeof(heap_t));
+    heap->capacity = limit > 0 && limit < HEAP_INITIAL_CAPACITY ? limit : HEAP_INITIAL_CAPACITY;
+    heap->items = malloc(sizeof(void *) * heap->capacity);
+    heap->count = 0;
+    heap->limit = limit;
+    heap->compare = compare;
+    return heap;
+}
+
+/**
+ * Move an item up the heap, to its place.
+ * @param heap The heap
+ * @param index Index of the item
+ */
+static void heap_sift_up(heap_t *heap, size_t index) {
+    void *item = heap->items[index];
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        if (heap->compare(item, heap->items[parent]) >= 0) {
+            break;
+        }
+        heap->items[index] = heap->items[parent];
+        index = parent;
+    }
+    heap->items[index] = item;
+}
+
+/**
+ * Move an item down the heap, to its place.
+ * @param heap The heap
+ * @param index Index of the item
+ */
+static void heap_sift_down(heap_t *heap, size_t index) {
+    void *item = heap->items[index];
+    for (;;) {
+        size_t child = 2 * index + 1;
+        if (child >= heap->count) {
+            break;
+        }
+        if (child + 1 < heap->count && heap->compare(heap->items[child + 1], heap->items[child]) < 0) {
+            child++;
+        }
+        if (heap->compare(heap->items[child], item) >= 0) {
+            break;
+        }
+        heap->items[index] = heap->items[child];
+        index = child;
+    }
+    heap->items[index] = item;
+}
+
+void heap_push(heap_t *heap, void *item) {
+    if (heap->count == heap->capacity) {
+        heap->capacity *= 2;
+        heap->items = realloc(heap->items, sizeof(void *) * heap->capacity);
+    }
+    heap->items[heap->count++] = item;
+    heap_sift_up(heap, heap->count - 1);
+}
+
+void *heap_offer(heap_t *heap, void *item) {
+    if (heap->limit == 0 || heap->count < heap->limit) {
+        heap_push(heap, item);
+        return NULL;
+    }
+    void *top = heap->items[0];
+    if (heap->compare(item, top) <= 0) {
+        return item;
+    }
+    heap->items[0] = item;
+    heap_sift_down(heap, 0);
+    return top;
+}
+
+void *heap_top(heap_t *heap) {
+    return heap->count ? heap->items[0] : NULL;
+}
+
+void *heap_pop(heap_t *heap) {
+    if (heap->count == 0) {
+        return NULL;
+    }
+    void *top = heap->items[0];
+    heap->items[0] = heap->items[--heap->count];
+    if (heap->count > 0) {
+        heap_sift_down(heap, 0);
+    }
+    return top;
+}
+
+size_t heap_count(heap_t *heap) {
+    return heap->count;
+}
+
+void heap_free(heap_t *heap) {
+    free(heap->items);
+    free(heap);
+}
@@ -0,0 +1,87 @@
+/**
+ * Binary heap of items ordered by a comparison function.
+ *
+ * The top of the heap is the item that comes first in the order of the comparison: with a comparison sorting
+ * in ascending order, the top is the smallest item. Adding and removing an item take O(log n), reading the top
+ * takes O(1).
+ *
+ * A heap bounded to K items keeps the K items coming last in its order by replacing its top when a later item
+ * comes, see heap_offer().
+ *
+ * @author Claudio Sousa, Gonzalez David
+ * @file
+ */
+
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <stdlib.h>
+
+/**
+ * Compare two items of a heap
+ * @param a The first item
+ * @param b The second item
+ * @return Negative if `a` comes before `b`, positive if it comes after, 0 if they are equal
+ */
+typedef int (*heap_compare_t)(void *a, void *b);
+
+struct heap_t;
+/**
+ * Contains a binary heap.
+ * Can only be created by heap_create()
+ */
+typedef struct heap_t heap_t;
+
+/**
+ * Create a heap.
+ * @param compare Order of the items
+ * @param limit Maximum number of items kept by heap_offer(), 0 for no maximum
+ * @return The created heap
+ */
+heap_t *heap_create(heap_compare_t compare, size_t limit);
+
+/**
+ * Add an item to a heap.
+ * @param heap The heap
+ * @param item The item
+ */
+void heap_push(heap_t *heap, void *item);
+
+/**
+ * Add an item to a heap bounded to a number of items: while the heap is full, the item replaces the top
+ * if it comes after it, and is rejected otherwise.
+ * @param heap The heap
+ * @param item The item
+ * @return The item left out: the top replaced or the item rejected, NULL if the item was added without
+ * replacing anything
+ */
+void *heap_offer(heap_t *heap, void *item);
+
+/**
+ * Get the top of a heap, the item coming first.
+ * @param heap The heap
+ * @return The top item, NULL if the heap is empty
+ */
+void *heap_top(heap_t *heap);
+
+/**
+ * Remove the top of a heap.
+ * @param heap The heap
+ * @return The removed item, NULL if the heap is empty
+ */
+void *heap_pop(heap_t *heap);
+
+/**
+ * Get the number of items of a heap.
+ * @param heap The heap
+ * @return The number of items
+ */
+size_t heap_count(heap_t *heap);
+
+/**
+ * Free a heap, without its items.
+ * @param heap The heap
+ */
+void heap_free(heap_t *heap);
+
+#endif
@@ -4,15 +4,35 @@
  * @file
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE  // getdents64() and struct dirent64, also when built without the flags of the makefile
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
 #include "io.h"
 #include "logger.h"
 
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>) && __has_include(<linux/version.h>)
+#include <linux/version.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 15, 0)
+/**
+ * io_uring with symlinkat/unlinkat/linkat operations is available at build time
+ */
+#define IO_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+#endif
+#endif
+
 /**
  * Buffer size for file content read
  */
@@ -25,6 +45,283 @@
  * Default file/directory persmission on creation
  */
 #define IO_DEFAULT_MODE S_IRWXU | S_IRWXG
+/**
+ * Number of entries of the io_uring, the maximum number of operations submitted at once
+ */
+#define IO_BATCH_ENTRIES 1024
+/**
+ * Size of the buffer receiving the entries of a directory being deleted
+ */
+#define IO_DENTS_SIZE (64 * 1024)
+/**
+ * Maximum number of threads deleting the sub-folders of a directory
+ */
+#define IO_DELETE_THREADS 4
+/**
+ * Inserted in the hidden name of a directory deleted in the background
+ */
+#define IO_DELETE_SUFFIX ".deleting."
+
+/**
+ * Sub-folders of a directory being deleted, shared by the threads deleting them
+ */
+typedef struct io_delete_t {
+    int dir_fd;              /**< The directory */
+    io_file_list_t *subdirs; /**< Sub-folders not deleted yet */
+    pthread_mutex_t lock;    /**< Protects `subdirs` and `error` */
+    int error;               /**< 1 if an entry could not be deleted */
+} io_delete_t;
+
+/**
+ * A directory deleted in the background
+ */
+typedef struct io_delete_job_t {
+    pthread_t thread;             /**< The thread deleting it */
+    char *path;                   /**< Its hidden path */
+    bool done;                    /**< If the thread ended */
+    struct io_delete_job_t *next; /**< Next in the chain */
+} io_delete_job_t;
+
+/**
+ * Protects g_delete_jobs and g_delete_count
+ */
+static pthread_mutex_t g_delete_lock = PTHREAD_MUTEX_INITIALIZER;
+/**
+ * The directories deleted in the background
+ */
+static io_delete_job_t *g_delete_jobs = NULL;
+/**
+ * Number of directories deleted in the background so far, making their hidden names unique
+ */
+static unsigned int g_delete_count = 0;
+
+#ifdef IO_URING
+/**
+ * Submission queue of an io_uring, pointers into its mapped ring
+ */
+typedef struct io_uring_sq_t {
+    unsigned int *head;         /**< Consumed by the kernel up to there */
+    unsigned int *tail;         /**< Produced by us up to there */
+    unsigned int *mask;         /**< Ring index mask */
+    unsigned int *array;        /**< Indices of the entries */
+    struct io_uring_sqe *sqes;  /**< Submission entries */
+} io_uring_sq_t;
+
+/**
+ * Completion queue of an io_uring, pointers into its mapped ring
+ */
+typedef struct io_uring_cq_t {
+    unsigned int *head;         /**< Consumed by us up to there */
+    unsigned int *tail;         /**< Produced by the kernel up to there */
+    unsigned int *mask;         /**< Ring index mask */
+    struct io_uring_cqe *cqes;  /**< Completion entries */
+} io_uring_cq_t;
+#endif
+
+/**
+ * Applies link operations by batches
+ */
+struct io_batch_t {
+    int ring_fd;       /**< The io_uring, -1 if not available */
+#ifdef IO_URING
+    io_uring_sq_t sq;  /**< Submission queue */
+    io_uring_cq_t cq;  /**< Completion queue */
+    void *ring;        /**< Mapped rings */
+    size_t ring_size;  /**< Size of the mapped rings */
+    size_t sqes_size;  /**< Size of the mapped submission entries */
+#endif
+};
+
+/**
+ * Open a directory, for the POSIX backend.
+ */
+static int io_posix_open(io_backend_t *backend, int dir_fd, char *path) {
+    (void)backend;
+    return openat(dir_fd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+
+/**
+ * Close a directory, for the POSIX backend.
+ */
+static int io_posix_close(io_backend_t *backend, int fd) {
+    (void)backend;
+    return close(fd);
+}
+
+/**
+ * Open a directory to read its entries, for the POSIX backend.
+ */
+static void *io_posix_opendir(io_backend_t *backend, int dir_fd, char *path) {
+    (void)backend;
+    int fd = openat(dir_fd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR *dir = fd == -1 ? NULL : fdopendir(fd);
+    if (fd != -1 && dir == NULL) {
+        close(fd);
+    }
+    return dir;
+}
+
+/**
+ * Read the next entry of a directory, for the POSIX backend.
+ */
+static int io_posix_readdir(io_backend_t *backend, void *dir, io_dirent_t *entry) {
+    (void)backend;
+    errno = 0;
+    struct dirent *dent = readdir(dir);
+    if (dent == NULL) {
+        return errno == 0 ? 0 : -1;
+    }
+    entry->ino = dent->d_ino;
+    entry->type = dent->d_type;
+    entry->name = dent->d_name;
+    return 1;
+}
+
+/**
+ * Close a directory opened to read its entries, for the POSIX backend.
+ */
+static void io_posix_closedir(io_backend_t *backend, void *dir) {
+    (void)backend;
+    closedir(dir);
+}
+
+/**
+ * Get the attributes of an entry, for the POSIX backend.
+ */
+static int io_posix_stat(io_backend_t *backend, int dir_fd, char *path, struct stat *entry_stat, bool follow) {
+    (void)backend;
+    return fstatat(dir_fd, path, entry_stat, follow ? 0 : AT_SYMLINK_NOFOLLOW);
+}
+
+/**
+ * Resolve a path, for the POSIX backend.
+ */
+static char *io_posix_realpath(io_backend_t *backend, char *path, char *resolved) {
+    (void)backend;
+    return realpath(path, resolved);
+}
+
+/**
+ * Read the target of a symbolic link, for the POSIX backend.
+ */
+static ssize_t io_posix_readlink(io_backend_t *backend, int dir_fd, char *path, char *buffer, size_t size) {
+    (void)backend;
+    return readlinkat(dir_fd, path, buffer, size);
+}
+
+/**
+ * Create a symbolic link, for the POSIX backend.
+ */
+static int io_posix_symlink(io_backend_t *backend, char *target, int dir_fd, char *name) {
+    (void)backend;
+    return symlinkat(target, dir_fd, name);
+}
+
+/**
+ * Create a hard link, for the POSIX backend.
+ */
+static int io_posix_link(io_backend_t *backend, int src_dir_fd, char *src, int dir_fd, char *name) {
+    (void)backend;
+    return linkat(src_dir_fd, src, dir_fd, name, 0);
+}
+
+/**
+ * Delete an entry, for the POSIX backend.
+ */
+static int io_posix_unlink(io_backend_t *backend, int dir_fd, char *path, bool directory) {
+    (void)backend;
+    return unlinkat(dir_fd, path, directory ? AT_REMOVEDIR : 0);
+}
+
+/**
+ * Create a directory, for the POSIX backend.
+ */
+static int io_posix_mkdir(io_backend_t *backend, int dir_fd, char *path, mode_t mode) {
+    (void)backend;
+    return mkdirat(dir_fd, path, mode);
+}
+
+/**
+ * Rename or exchange entries, for the POSIX backend.
+ */
+static int io_posix_rename(io_backend_t *backend, char *from, char *to, bool exchange) {
+    (void)backend;
+    return exchange ? renameat2(AT_FDCWD, from, AT_FDCWD, to, RENAME_EXCHANGE) : rename(from, to);
+}
+
+/**
+ * The POSIX backend, calling the system
+ */
+static io_backend_t g_posix_backend = {"posix",           io_posix_open,     io_posix_close,    io_posix_opendir,
+                                       io_posix_readdir,  io_posix_closedir, io_posix_stat,     io_posix_realpath,
+                                       io_posix_readlink, io_posix_symlink,  io_posix_link,     io_posix_unlink,
+                                       io_posix_mkdir,    io_posix_rename};
+/**
+ * The backend of the file system operations
+ */
+static io_backend_t *g_backend = &g_posix_backend;
+
+io_backend_t *io_backend_set(io_backend_t *backend) {
+    io_backend_t *previous = g_backend;
+    g_backend = backend ? backend : &g_posix_backend;
+    return previous;
+}
+
+io_backend_t *io_backend_get(void) {
+    return g_backend;
+}
+
+int io_open(int dir_fd, char *path) {
+    return g_backend->open(g_backend, dir_fd, path);
+}
+
+int io_close(int fd) {
+    return g_backend->close(g_backend, fd);
+}
+
+void *io_opendir(int dir_fd, char *path) {
+    return g_backend->opendir(g_backend, dir_fd, path);
+}
+
+int io_readdir(void *dir, io_dirent_t *entry) {
+    return g_backend->readdir(g_backend, dir, entry);
+}
+
+void io_closedir(void *dir) {
+    g_backend->closedir(g_backend, dir);
+}
+
+int io_stat(int dir_fd, char *path, struct stat *entry_stat, bool follow) {
+    return g_backend->stat(g_backend, dir_fd, path, entry_stat, follow);
+}
+
+char *io_realpath(char *path, char *resolved) {
+    return g_backend->realpath(g_backend, path, resolved);
+}
+
+ssize_t io_readlink(int dir_fd, char *path, char *buffer, size_t size) {
+    return g_backend->readlink(g_backend, dir_fd, path, buffer, size);
+}
+
+int io_symlink(char *target, int dir_fd, char *name) {
+    return g_backend->symlink(g_backend, target, dir_fd, name);
+}
+
+int io_link(int src_dir_fd, char *src, int dir_fd, char *name) {
+    return g_backend->link(g_backend, src_dir_fd, src, dir_fd, name);
+}
+
+int io_unlink(int dir_fd, char *path, bool directory) {
+    return g_backend->unlink(g_backend, dir_fd, path, directory);
+}
+
+int io_mkdir(int dir_fd, char *path, mode_t mode) {
+    return g_backend->mkdir(g_backend, dir_fd, path, mode);
+}
+
+int io_rename(char *from, char *to, bool exchange) {
+    return g_backend->rename(g_backend, from, to, exchange);
+}
 
 bool io_file_exists(char *path) {
     struct stat buffer;
@@ -90,7 +387,7 @@ int io_file_delete(char *path) {
 
 bool io_directory_exists(char *path) {
     struct stat buffer;
-    return (stat(path, &buffer) == 0) && S_ISDIR(buffer.st_mode);
+    return (io_stat(AT_FDCWD, path, &buffer, true) == 0) && S_ISDIR(buffer.st_mode);
 }
 
 io_file_list_t *io_directory_get_all(char *path) {
@@ -130,7 +427,7 @@ void io_directory_get_all_free(io_file_list_t *filelist) {
 }
 
 int io_directory_create(char *path) {
-    if (mkdir(path, IO_DEFAULT_MODE) != 0) {
+    if (io_mkdir(AT_FDCWD, path, IO_DEFAULT_MODE) != 0) {
         logger_perror("IO: error: mkdir failed");
         return 1;
     }
@@ -157,26 +454,549 @@ int io_directory_create_parent(char *path) {
     return 0;
 }
 
+static int io_directory_delete_at(int parent_fd, char *name);
+
+/**
+ * Delete the entries of a directory, read by batches, relative to the directory.
+ * As some file systems skip entries when they are deleted during the reading, the directory is read again from its
+ * start until a reading deletes nothing.
+ * @param dir_fd The directory
+ * @param subdirs Receives the sub-folders found by the first reading instead of deleting them, NULL to delete them
+ * @return 0 if deleted, 1 if an entry could not be deleted
+ */
+static int io_directory_empty(int dir_fd, io_file_list_t **subdirs) {
+    char *buffer = malloc(IO_DENTS_SIZE);
+    ssize_t size = 0;
+    int error = 0;
+
+    for (size_t removed = 1, pass = 0; removed > 0 && size >= 0; pass++) {
+        removed = 0;
+        error = 0;
+        if (pass > 0 && lseek(dir_fd, 0, SEEK_SET) != 0) {
+            size = -1;
+            break;
+        }
+
+        // The entries already read stay valid while they are deleted
+        while ((size = getdents64(dir_fd, buffer, IO_DENTS_SIZE)) > 0) {
+            for (ssize_t offset = 0; offset < size;) {
+                struct dirent64 *entry = (struct dirent64 *)(buffer + offset);
+                offset += entry->d_reclen;
+                if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+                    continue;
+                }
+
+                bool is_dir = entry->d_type == DT_DIR;
+                if (entry->d_type == DT_UNKNOWN) {
+                    struct stat entry_stat;
+                    is_dir = fstatat(dir_fd, entry->d_name, &entry_stat, AT_SYMLINK_NOFOLLOW) == 0 &&
+                             S_ISDIR(entry_stat.st_mode);
+                }
+
+                if (!is_dir) {
+                    if (unlinkat(dir_fd, entry->d_name, 0) == 0) {
+                        removed++;
+                    } else if (errno != ENOENT) {
+                        error = 1;
+                    }
+                } else if (subdirs != NULL) {
+                    // The sub-folders are deleted by the caller, which empties the directory again afterwards
+                    if (pass == 0) {
+                        io_file_list_t *subdir = malloc(sizeof(io_file_list_t));
+                        subdir->file = strdup(entry->d_name);
+                        subdir->next = *subdirs;
+                        *subdirs = subdir;
+                    }
+                } else if (io_directory_delete_at(dir_fd, entry->d_name) == 0) {
+                    removed++;
+                } else {
+                    error = 1;
+                }
+            }
+        }
+    }
+
+    free(buffer);
+    return error || size < 0;
+}
+
+/**
+ * Delete a directory and all childrens, relative to its parent.
+ * @param parent_fd The parent directory
+ * @param name Name of the directory in its parent
+ * @return 0 if deleted, 1 if error
+ */
+static int io_directory_delete_at(int parent_fd, char *name) {
+    int dir_fd = openat(parent_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (dir_fd == -1) {
+        return 1;
+    }
+    int error = io_directory_empty(dir_fd, NULL);
+    close(dir_fd);
+
+    return unlinkat(parent_fd, name, AT_REMOVEDIR) != 0 || error;
+}
+
+/**
+ * Delete the sub-folders of a directory until there is none left, run by each of the deleting threads.
+ * @param delete The sub-folders
+ * @return NULL
+ */
+static void *io_directory_delete_worker(void *delete) {
+    io_delete_t *d = delete;
+
+    for (;;) {
+        pthread_mutex_lock(&d->lock);
+        io_file_list_t *subdir = d->subdirs;
+        if (subdir != NULL) {
+            d->subdirs = subdir->next;
+        }
+        pthread_mutex_unlock(&d->lock);
+        if (subdir == NULL) {
+            return NULL;
+        }
+
+        if (io_directory_delete_at(d->dir_fd, subdir->file) != 0) {
+            pthread_mutex_lock(&d->lock);
+            d->error = 1;
+            pthread_mutex_unlock(&d->lock);
+        }
+        free(subdir->file);
+        free(subdir);
+    }
+}
+
+/**
+ * Delete a directory and all childrens through a backend other than the POSIX one, by their paths.
+ * The entries of each directory are listed before being deleted.
+ * @param path Directory path to delete
+ * @return 0 if deleted, 1 if error
+ */
+static int io_directory_delete_paths(char *path) {
+    void *dir = io_opendir(AT_FDCWD, path);
+    if (dir == NULL) {
+        logger_perror("IO: error: open dir failed");
+        return 1;
+    }
+
+    io_file_list_t *entries = NULL;
+    io_dirent_t entry;
+    while (io_readdir(dir, &entry) == 1) {
+        if (strcmp(entry.name, ".") != 0 && strcmp(entry.name, "..") != 0) {
+            io_file_list_t *file = malloc(sizeof(io_file_list_t));
+            file->file = malloc(IO_PATH_MAX_SIZE);
+            snprintf(file->file, IO_PATH_MAX_SIZE, "%s%c%s", path, IO_PATH_SEP, entry.name);
+            file->next = entries;
+            entries = file;
+        }
+    }
+    io_closedir(dir);
+
+    int error = 0;
+    struct stat entry_stat;
+    for (io_file_list_t *file = entries; file; file = file->next) {
+        if (io_stat(AT_FDCWD, file->file, &entry_stat, false) == 0 && S_ISDIR(entry_stat.st_mode)) {
+            error |= io_directory_delete_paths(file->file);
+        } else if (io_unlink(AT_FDCWD, file->file, false) != 0) {
+            error = 1;
+        }
+    }
+    io_directory_get_all_free(entries);
+
+    return io_unlink(AT_FDCWD, path, true) != 0 || error;
+}
+
 int io_directory_delete(char *path) {
-    char file_del[IO_PATH_MAX_SIZE] = "";
-    io_file_list_t *files = io_directory_get_all(path);
-    io_file_list_t *workingfile = files;
-    while (workingfile) {
-        sprintf(file_del, "%s%c%s", path, IO_PATH_SEP, workingfile->file);
-        io_file_delete(file_del);
-        workingfile = workingfile->next;
+    if (g_backend != &g_posix_backend) {
+        return io_directory_delete_paths(path);
+    }
+
+    int dir_fd = open(path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (dir_fd == -1) {
+        logger_perror("IO: error: open dir failed");
+        return 1;
     }
-    io_directory_get_all_free(files);
+
+    // The links are deleted right away, the sub-folders are spread over the threads
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int thread_count = cpus < IO_DELETE_THREADS ? (int)cpus : IO_DELETE_THREADS;
+    io_delete_t delete = {dir_fd, NULL, PTHREAD_MUTEX_INITIALIZER, 0};
+    delete.error = io_directory_empty(dir_fd, thread_count > 1 ? &delete.subdirs : NULL);
+
+    pthread_t threads[IO_DELETE_THREADS];
+    int started = 0;
+    while (delete.subdirs != NULL && started < thread_count - 1 &&
+           pthread_create(&threads[started], NULL, io_directory_delete_worker, &delete) == 0) {
+        started++;
+    }
+    io_directory_delete_worker(&delete);  // the calling thread is one of them
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    if (thread_count > 1) {
+        // The sub-folders skipped by the first reading, if any
+        delete.error |= io_directory_empty(dir_fd, NULL);
+    }
+    close(dir_fd);
 
     if (rmdir(path) != 0) {
         logger_perror("IO: error: rmdir failed");
         return 1;
     }
 
+    return delete.error;
+}
+
+/**
+ * Delete a directory, run in a background thread.
+ * @param job The deletion
+ * @return NULL
+ */
+static void *io_directory_delete_job(void *job) {
+    io_delete_job_t *j = job;
+    if (io_directory_delete(j->path) != 0) {
+        logger_error("IO: error: cannot delete '%s'\n", j->path);
+    }
+    __atomic_store_n(&j->done, true, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/**
+ * Wait for the end of deletions in the background, and free them.
+ * @param jobs The deletions, removed from g_delete_jobs
+ */
+static void io_directory_delete_join(io_delete_job_t *jobs) {
+    while (jobs) {
+        io_delete_job_t *next = jobs->next;
+        pthread_join(jobs->thread, NULL);
+        free(jobs->path);
+        free(jobs);
+        jobs = next;
+    }
+}
+
+int io_directory_delete_async(char *path) {
+    if (g_backend != &g_posix_backend) {
+        return io_directory_delete(path);
+    }
+
+    io_delete_job_t *job = malloc(sizeof(io_delete_job_t)), *ended = NULL;
+    job->path = malloc(sizeof(char) * IO_PATH_MAX_SIZE);
+    job->done = false;
+
+    // The hidden sibling stays on the same file system
+    char *name = strrchr(path, IO_PATH_SEP);
+    int dir_len = name ? name - path + 1 : 0;
+    pthread_mutex_lock(&g_delete_lock);
+    snprintf(job->path, IO_PATH_MAX_SIZE, "%.*s.%s%s%d.%u", dir_len, path, path + dir_len, IO_DELETE_SUFFIX,
+             (int)getpid(), g_delete_count++);
+
+    // The deletions that ended are freed
+    for (io_delete_job_t **j = &g_delete_jobs; *j;) {
+        if (__atomic_load_n(&(*j)->done, __ATOMIC_ACQUIRE)) {
+            io_delete_job_t *done = *j;
+            *j = done->next;
+            done->next = ended;
+            ended = done;
+        } else {
+            j = &(*j)->next;
+        }
+    }
+    pthread_mutex_unlock(&g_delete_lock);
+    io_directory_delete_join(ended);
+
+    if (rename(path, job->path) != 0) {
+        free(job->path);
+        free(job);
+        return io_directory_delete(path);
+    }
+    if (pthread_create(&job->thread, NULL, io_directory_delete_job, job) != 0) {
+        int error = io_directory_delete(job->path);
+        free(job->path);
+        free(job);
+        return error;
+    }
+
+    pthread_mutex_lock(&g_delete_lock);
+    job->next = g_delete_jobs;
+    g_delete_jobs = job;
+    pthread_mutex_unlock(&g_delete_lock);
     return 0;
 }
 
+void io_directory_delete_wait(void) {
+    pthread_mutex_lock(&g_delete_lock);
+    io_delete_job_t *jobs = g_delete_jobs;
+    g_delete_jobs = NULL;
+    pthread_mutex_unlock(&g_delete_lock);
+    io_directory_delete_join(jobs);
+}
+
 bool io_link_exists(char *path) {
     struct stat buffer;
-    return (lstat(path, &buffer) == 0) && S_ISLNK(buffer.st_mode);
+    return (io_stat(AT_FDCWD, path, &buffer, false) == 0) && S_ISLNK(buffer.st_mode);
+}
+
+/**
+ * Apply a link operation synchronously, through the backend.
+ * @param dir_fd Directory where to apply the operation
+ * @param op Operation to apply, receiving its result
+ */
+static void io_batch_apply_sync(int dir_fd, io_batch_op_t *op) {
+    int res;
+    switch (op->type) {
+        case IO_BATCH_SYMLINK:
+            res = io_symlink(op->target, dir_fd, op->name);
+            break;
+        case IO_BATCH_LINK:
+            res = io_link(op->src_dir_fd, op->target, dir_fd, op->name);
+            break;
+        default:
+            res = io_unlink(dir_fd, op->name, false);
+    }
+    op->result = res == 0 ? 0 : errno;
+}
+
+#ifdef IO_URING
+/**
+ * Tear down the io_uring of a batch, the next operations being applied synchronously.
+ * @param batch The batch
+ */
+static void io_batch_ring_close(io_batch_t *batch) {
+    if (batch->ring_fd != -1) {
+        munmap(batch->ring, batch->ring_size);
+        munmap(batch->sq.sqes, batch->sqes_size);
+        close(batch->ring_fd);
+        batch->ring_fd = -1;
+    }
+}
+
+/**
+ * Check that the kernel supports the operations of the batches with an io_uring: symlinkat, linkat and unlinkat.
+ * @param batch The batch, with its io_uring
+ * @return If all the operations are supported
+ */
+static bool io_batch_ring_supported(io_batch_t *batch) {
+    size_t size = sizeof(struct io_uring_probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, size);
+    bool supported = false;
+
+    if (syscall(__NR_io_uring_register, batch->ring_fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) == 0) {
+        int opcodes[] = {IORING_OP_SYMLINKAT, IORING_OP_LINKAT, IORING_OP_UNLINKAT};
+        supported = true;
+        for (size_t i = 0; i < sizeof(opcodes) / sizeof(opcodes[0]); i++) {
+            supported = supported && opcodes[i] <= probe->last_op &&
+                        (probe->ops[opcodes[i]].flags & IO_URING_OP_SUPPORTED);
+        }
+    }
+
+    free(probe);
+    return supported;
+}
+
+/**
+ * Set up the io_uring of a batch.
+ * @param batch The batch
+ * @return 0 if set up, 1 if io_uring is not usable
+ */
+static int io_batch_ring_setup(io_batch_t *batch) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    batch->ring_fd = syscall(__NR_io_uring_setup, IO_BATCH_ENTRIES, &params);
+    if (batch->ring_fd < 0) {
+        batch->ring_fd = -1;
+        return 1;
+    }
+
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        close(batch->ring_fd);
+        batch->ring_fd = -1;
+        return 1;
+    }
+
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    batch->ring_size = sq_size > cq_size ? sq_size : cq_size;
+    batch->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    batch->ring = mmap(NULL, batch->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, batch->ring_fd,
+                       IORING_OFF_SQ_RING);
+    void *sqes = mmap(NULL, batch->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, batch->ring_fd,
+                      IORING_OFF_SQES);
+    if (batch->ring == MAP_FAILED || sqes == MAP_FAILED) {
+        if (batch->ring != MAP_FAILED) {
+            munmap(batch->ring, batch->ring_size);
+        }
+        if (sqes != MAP_FAILED) {
+            munmap(sqes, batch->sqes_size);
+        }
+        close(batch->ring_fd);
+        batch->ring_fd = -1;
+        return 1;
+    }
+
+    char *ring = batch->ring;
+    batch->sq.head = (unsigned int *)(ring + params.sq_off.head);
+    batch->sq.tail = (unsigned int *)(ring + params.sq_off.tail);
+    batch->sq.mask = (unsigned int *)(ring + params.sq_off.ring_mask);
+    batch->sq.array = (unsigned int *)(ring + params.sq_off.array);
+    batch->sq.sqes = sqes;
+    batch->cq.head = (unsigned int *)(ring + params.cq_off.head);
+    batch->cq.tail = (unsigned int *)(ring + params.cq_off.tail);
+    batch->cq.mask = (unsigned int *)(ring + params.cq_off.ring_mask);
+    batch->cq.cqes = (struct io_uring_cqe *)(ring + params.cq_off.cqes);
+
+    if (!io_batch_ring_supported(batch)) {
+        io_batch_ring_close(batch);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Apply up to IO_BATCH_ENTRIES link operations with the io_uring and wait for their completion.
+ * The operations are submitted in order: if the io_uring fails, the operations submitted are never applied again,
+ * only the ones after them. A submitted operation whose completion cannot be waited for gets the error.
+ * @param batch The batch
+ * @param dir_fd Directory where to apply the operations
+ * @param ops Operations to apply, receiving their result
+ * @param count Number of operations, at most IO_BATCH_ENTRIES
+ * @param submitted Receives the number of operations submitted, from the first one, which have their result
+ * @return 0 if applied, 1 if the io_uring failed
+ */
+static int io_batch_ring_apply(io_batch_t *batch, int dir_fd, io_batch_op_t *ops, size_t count, size_t *submitted) {
+    unsigned int first = *batch->sq.tail;
+    unsigned int tail = first;
+    unsigned int mask = *batch->sq.mask;
+
+    for (size_t i = 0; i < count; i++, tail++) {
+        unsigned int index = tail & mask;
+        struct io_uring_sqe *sqe = &batch->sq.sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->fd = dir_fd;
+        sqe->user_data = i;
+        switch (ops[i].type) {
+            case IO_BATCH_SYMLINK:
+                sqe->opcode = IORING_OP_SYMLINKAT;
+                sqe->addr = (unsigned long)ops[i].target;
+                sqe->addr2 = (unsigned long)ops[i].name;
+                break;
+            case IO_BATCH_LINK:
+                sqe->opcode = IORING_OP_LINKAT;
+                sqe->fd = ops[i].src_dir_fd;
+                sqe->addr = (unsigned long)ops[i].target;
+                sqe->len = dir_fd;
+                sqe->addr2 = (unsigned long)ops[i].name;
+                break;
+            default:
+                sqe->opcode = IORING_OP_UNLINKAT;
+                sqe->addr = (unsigned long)ops[i].name;
+        }
+        batch->sq.array[index] = index;
+    }
+    __atomic_store_n(batch->sq.tail, tail, __ATOMIC_RELEASE);
+
+    // Submitted and waited for at once, unless the kernel takes fewer entries
+    int error = 0;
+    *submitted = 0;
+    while (*submitted < count) {
+        size_t left = count - *submitted;
+        int res = syscall(__NR_io_uring_enter, batch->ring_fd, left, left, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (res < 0 && errno == EINTR) {
+            continue;
+        }
+        if (res <= 0) {
+            error = res < 0 ? errno : EAGAIN;
+            break;
+        }
+        *submitted += res;
+    }
+    if (*submitted < count) {
+        __atomic_store_n(batch->sq.tail, first + (unsigned int)*submitted, __ATOMIC_RELEASE);  // never submitted
+    }
+
+    bool completed[IO_BATCH_ENTRIES] = {false};
+    size_t completed_count = 0;
+    while (completed_count < *submitted) {
+        unsigned int head = *batch->cq.head;
+        unsigned int cq_tail = __atomic_load_n(batch->cq.tail, __ATOMIC_ACQUIRE);
+
+        if (head == cq_tail) {
+            if (syscall(__NR_io_uring_enter, batch->ring_fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+                errno != EINTR) {
+                error = errno;
+                break;
+            }
+            continue;
+        }
+
+        for (; head != cq_tail; head++, completed_count++) {
+            struct io_uring_cqe *cqe = &batch->cq.cqes[head & *batch->cq.mask];
+            ops[cqe->user_data].result = cqe->res < 0 ? -cqe->res : 0;
+            completed[cqe->user_data] = true;
+        }
+        __atomic_store_n(batch->cq.head, head, __ATOMIC_RELEASE);
+    }
+
+    // In flight: reported as failed rather than applied again, the callers verify the results later
+    for (size_t i = 0; completed_count < *submitted && i < *submitted; i++) {
+        if (!completed[i]) {
+            ops[i].result = error;
+        }
+    }
+
+    return error != 0;
+}
+#endif
+
+io_batch_t *io_batch_create() {
+    io_batch_t *batch = malloc(sizeof(io_batch_t));
+    batch->ring_fd = -1;
+#ifdef IO_URING
+    if (io_batch_ring_setup(batch) != 0) {
+        logger_debug("IO: io_uring not available, using synchronous link operations\n");
+    }
+#endif
+    return batch;
+}
+
+size_t io_batch_apply(io_batch_t *batch, int dir_fd, io_batch_op_t *ops, size_t count) {
+    size_t done = 0, failed = 0;
+
+#ifdef IO_URING
+    // The io_uring applies the operations through the system only
+    while (batch->ring_fd != -1 && g_backend == &g_posix_backend && done < count) {
+        size_t chunk = count - done < IO_BATCH_ENTRIES ? count - done : IO_BATCH_ENTRIES;
+        size_t submitted = 0;
+        int error = io_batch_ring_apply(batch, dir_fd, ops + done, chunk, &submitted);
+        done += submitted;
+        if (error != 0) {
+            logger_perror("IO: error: io_uring failed, using synchronous link operations");
+            io_batch_ring_close(batch);
+            break;
+        }
+    }
+#else
+    (void)batch;
+#endif
+
+    for (; done < count; done++) {
+        io_batch_apply_sync(dir_fd, &ops[done]);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (ops[i].result != 0) {
+            failed++;
+        }
+    }
+
+    return failed;
+}
+
+void io_batch_free(io_batch_t *batch) {
+#ifdef IO_URING
+    io_batch_ring_close(batch);
+#endif
+    free(batch);
 }
@@ -1,5 +1,12 @@
 /**
  * Helpers function around system calls for IO purpose.
+ *
+ * The operations on the directories and the links of the traversals and of the destination folders go through
+ * a backend (io_backend_t): the POSIX one by default, calling the system, or another one, such as the in-memory
+ * file system of memfs.h, set by io_backend_set() before anything else runs. The directories are opened as
+ * descriptors of the backend, the paths being relative to them as for the `*at` system calls (AT_FDCWD for
+ * the current directory). The contents of the files (io_file_*) are always read and written through the system.
+ *
  * @author Claudio Sousa, Gonzalez David
  * @file
  */
@@ -9,6 +16,7 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <sys/types.h>
 #include <sys/stat.h>
 
 /**
@@ -35,6 +43,202 @@ typedef struct io_file_list_t {
     struct io_file_list_t *next;
 } io_file_list_t;
 
+/**
+ * An entry of a directory read by io_readdir()
+ */
+typedef struct io_dirent_t {
+    ino_t ino;          /**< Inode id */
+    unsigned char type; /**< Type of the entry, as the d_type of a struct dirent (DT_DIR, DT_LNK, DT_REG...) */
+    char *name;         /**< Name of the entry, valid until the next read of the directory */
+} io_dirent_t;
+
+/**
+ * Operations of a file system backend, each one behaving as the system call it is named after,
+ * setting errno on failure. The backend is given to each of them, as the first member of its state.
+ */
+typedef struct io_backend_t {
+    /**
+     * Name of the backend
+     */
+    char *name;
+    /**
+     * Open a directory (openat, O_DIRECTORY)
+     */
+    int (*open)(struct io_backend_t *backend, int dir_fd, char *path);
+    /**
+     * Close a directory opened by `open` (close)
+     */
+    int (*close)(struct io_backend_t *backend, int fd);
+    /**
+     * Open a directory to read its entries (opendir), NULL on failure
+     */
+    void *(*opendir)(struct io_backend_t *backend, int dir_fd, char *path);
+    /**
+     * Read the next entry of a directory (readdir): 1 if read, 0 at the end, -1 on failure
+     */
+    int (*readdir)(struct io_backend_t *backend, void *dir, io_dirent_t *entry);
+    /**
+     * Close a directory opened by `opendir` (closedir)
+     */
+    void (*closedir)(struct io_backend_t *backend, void *dir);
+    /**
+     * Get the attributes of an entry (fstatat), following a symbolic link if `follow`
+     */
+    int (*stat)(struct io_backend_t *backend, int dir_fd, char *path, struct stat *entry_stat, bool follow);
+    /**
+     * Resolve a path (realpath) into `resolved`, of IO_PATH_MAX_SIZE bytes, NULL on failure
+     */
+    char *(*realpath)(struct io_backend_t *backend, char *path, char *resolved);
+    /**
+     * Read the target of a symbolic link (readlinkat), not null terminated
+     */
+    ssize_t (*readlink)(struct io_backend_t *backend, int dir_fd, char *path, char *buffer, size_t size);
+    /**
+     * Create a symbolic link (symlinkat)
+     */
+    int (*symlink)(struct io_backend_t *backend, char *target, int dir_fd, char *name);
+    /**
+     * Create a hard link, not following symbolic links (linkat)
+     */
+    int (*link)(struct io_backend_t *backend, int src_dir_fd, char *src, int dir_fd, char *name);
+    /**
+     * Delete an entry (unlinkat), an empty directory if `directory` (AT_REMOVEDIR)
+     */
+    int (*unlink)(struct io_backend_t *backend, int dir_fd, char *path, bool directory);
+    /**
+     * Create a directory (mkdirat)
+     */
+    int (*mkdir)(struct io_backend_t *backend, int dir_fd, char *path, mode_t mode);
+    /**
+     * Rename an entry (rename), or exchange two entries if `exchange` (renameat2, RENAME_EXCHANGE)
+     */
+    int (*rename)(struct io_backend_t *backend, char *from, char *to, bool exchange);
+} io_backend_t;
+
+/**
+ * Set the backend of the file system operations, for the whole process.
+ * @param backend The backend, NULL for the POSIX one
+ * @return The previous backend
+ */
+io_backend_t *io_backend_set(io_backend_t *backend);
+
+/**
+ * Get the backend of the file system operations.
+ * @return The backend
+ */
+io_backend_t *io_backend_get(void);
+
+/**
+ * Open a directory through the backend.
+ * @param dir_fd Directory the path is relative to, AT_FDCWD for the current directory
+ * @param path Path of the directory
+ * @return Descriptor of the directory, -1 if error
+ */
+int io_open(int dir_fd, char *path);
+
+/**
+ * Close a directory opened by io_open().
+ * @param fd Descriptor of the directory
+ * @return 0 if closed, -1 if error
+ */
+int io_close(int fd);
+
+/**
+ * Open a directory to read its entries through the backend.
+ * @param dir_fd Directory the path is relative to, AT_FDCWD for the current directory
+ * @param path Path of the directory
+ * @return The opened directory, NULL if error
+ */
+void *io_opendir(int dir_fd, char *path);
+
+/**
+ * Read the next entry of a directory opened by io_opendir().
+ * @param dir The directory
+ * @param entry Receives the entry
+ * @return 1 if an entry was read, 0 at the end of the directory, -1 if error
+ */
+int io_readdir(void *dir, io_dirent_t *entry);
+
+/**
+ * Close a directory opened by io_opendir().
+ * @param dir The directory
+ */
+void io_closedir(void *dir);
+
+/**
+ * Get the attributes of an entry through the backend.
+ * @param dir_fd Directory the path is relative to, AT_FDCWD for the current directory
+ * @param path Path of the entry
+ * @param entry_stat Receives the attributes
+ * @param follow If a symbolic link is followed
+ * @return 0 if found, -1 if error
+ */
+int io_stat(int dir_fd, char *path, struct stat *entry_stat, bool follow);
+
+/**
+ * Resolve a path through the backend, following the symbolic links.
+ * @param path The path
+ * @param resolved Receives the resolved path, of IO_PATH_MAX_SIZE bytes
+ * @return `resolved`, NULL if error
+ */
+char *io_realpath(char *path, char *resolved);
+
+/**
+ * Read the target of a symbolic link through the backend.
+ * @param dir_fd Directory the path is relative to, AT_FDCWD for the current directory
+ * @param path Path of the link
+ * @param buffer Receives the target, not null terminated
+ * @param size Size of the buffer
+ * @return Length of the target, -1 if error
+ */
+ssize_t io_readlink(int dir_fd, char *path, char *buffer, size_t size);
+
+/**
+ * Create a symbolic link through the backend.
+ * @param target Target of the link
+ * @param dir_fd Directory the name is relative to, AT_FDCWD for the current directory
+ * @param name Path of the link
+ * @return 0 if created, -1 if error
+ */
+int io_symlink(char *target, int dir_fd, char *name);
+
+/**
+ * Create a hard link through the backend, not following symbolic links.
+ * @param src_dir_fd Directory the source is relative to
+ * @param src Path of the entry to link
+ * @param dir_fd Directory the name is relative to
+ * @param name Path of the link
+ * @return 0 if created, -1 if error
+ */
+int io_link(int src_dir_fd, char *src, int dir_fd, char *name);
+
+/**
+ * Delete an entry through the backend.
+ * @param dir_fd Directory the path is relative to, AT_FDCWD for the current directory
+ * @param path Path of the entry
+ * @param directory If the entry is an empty directory
+ * @return 0 if deleted, -1 if error
+ */
+int io_unlink(int dir_fd, char *path, bool directory);
+
+/**
+ * Create a directory through the backend.
+ * @param dir_fd Directory the path is relative to, AT_FDCWD for the current directory
+ * @param path Path of the directory
+ * @param mode Permissions of the directory
+ * @return 0 if created, -1 if error
+ */
+int io_mkdir(int dir_fd, char *path, mode_t mode);
+
+/**
+ * Rename an entry through the backend, or exchange two entries atomically.
+ * @param from Path of the entry
+ * @param to New path of the entry, replaced if it exists, unless exchanged with it
+ * @param exchange If the two entries are exchanged, both existing
+ * @return 0 if renamed, -1 if error
+ */
+int io_rename(char *from, char *to, bool exchange);
+
 /**
  * Determine if a file in the specified path exists
  * @param path File path to check
@@ -110,12 +314,28 @@ int io_directory_create(char *path);
 int io_directory_create_parent(char *path);
 
 /**
- * Delete a directory and all childrens
+ * Delete a directory and all childrens.
+ * The entries are read by large batches (getdents64) and deleted relative to their directory (unlinkat),
+ * without building their path nor stating them. The sub-folders of the directory are deleted by a few threads.
  * @param path Directory path to delete
  * @return 0 if deleted, 1 if error
  */
 int io_directory_delete(char *path);
 
+/**
+ * Delete a directory and all childrens in the background.
+ * The directory is first renamed to a hidden sibling, so its path is free when the function returns,
+ * then deleted by a thread.
+ * @param path Directory path to delete
+ * @return 0 if renamed, or deleted if it could not be renamed, 1 if error
+ */
+int io_directory_delete_async(char *path);
+
+/**
+ * Wait for the end of the deletions started by io_directory_delete_async()
+ */
+void io_directory_delete_wait(void);
+
 /**
  * Determine if a link in the specified path exists
  * @param path Link path to check
@@ -123,4 +343,75 @@ int io_directory_delete(char *path);
  */
 bool io_link_exists(char *path);
 
+/**
+ * Types of link operations
+ */
+typedef enum {
+    IO_BATCH_SYMLINK, /**< Create a symbolic link (symlinkat) */
+    IO_BATCH_UNLINK,  /**< Delete a link (unlinkat) */
+    IO_BATCH_LINK     /**< Create a hard link to an entry of another directory, not following symbolic links (linkat) */
+} io_batch_type_t;
+
+/**
+ * A link operation to apply in a directory with io_batch_apply().
+ */
+typedef struct io_batch_op_t {
+    /**
+     * Type of the operation
+     */
+    io_batch_type_t type;
+    /**
+     * Symbolic link: target of the link to create.
+     * Hard link: name of the entry to link in `src_dir_fd`
+     */
+    char *target;
+    /**
+     * Hard link: directory containing `target`
+     */
+    int src_dir_fd;
+    /**
+     * Name of the link in the directory
+     */
+    char *name;
+    /**
+     * Caller data associated to the operation
+     */
+    void *data;
+    /**
+     * Result of the operation once applied: 0 if successful, the error number otherwise
+     */
+    int result;
+} io_batch_op_t;
+
+struct io_batch_t;
+/**
+ * Applies link operations by batches.
+ * Uses io_uring when the system supports it, and synchronous system calls otherwise.
+ * Can only be created by io_batch_create()
+ */
+typedef struct io_batch_t io_batch_t;
+
+/**
+ * Create a batch to apply link operations
+ * @return The created batch
+ */
+io_batch_t *io_batch_create();
+
+/**
+ * Apply link operations in a directory (symlinkat, unlinkat or linkat), all submitted together.
+ * The operations are independent: their order of execution is not specified.
+ * @param batch The batch
+ * @param dir_fd Directory where to apply the operations
+ * @param ops Operations to apply, receiving their result
+ * @param count Number of operations
+ * @return Number of failed operations
+ */
+size_t io_batch_apply(io_batch_t *batch, int dir_fd, io_batch_op_t *ops, size_t count);
+
+/**
+ * Free a batch
+ * @param batch The batch to free
+ */
+void io_batch_free(io_batch_t *batch);
+
 #endif
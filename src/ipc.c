@@ -19,6 +19,9 @@
  * When a signal is received, the signal handler will first remove the file
  * and call the callback if any.
  *
+ * An instance updating several destination folders (see ipc_add_watch) has one file
+ * per destination path, all containing its PID: stopping any of them stops the instance.
+ *
  * @author Claudio Sousa, Gonzalez David
  * @file
  */
@@ -28,6 +31,8 @@
 #include <unistd.h>
 #include <signal.h>
 #include <inttypes.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include "ipc.h"
 #include "io.h"
 #include "logger.h"
@@ -48,11 +53,43 @@
  * Complete path from user home directory where to store the PID files
  */
 #define IPC_HOME_RUN_PATH IPC_HOME_PATH IPC_RUN_PATH
+/**
+ * Folder where to store the state files
+ */
+#define IPC_STATE_PATH "/state/"
+/**
+ * Complete path from user home directory where to store the state files
+ */
+#define IPC_HOME_STATE_PATH IPC_HOME_PATH IPC_STATE_PATH
+/**
+ * Folder of the shared memory files
+ */
+#define IPC_SHM_PATH "/dev/shm"
+/**
+ * Prefix of the shared memory files, followed by the user id
+ */
+#define IPC_SHM_PREFIX "/searchfolder."
+/**
+ * Folder where to store the snapshot files when there is no shared memory folder
+ */
+#define IPC_HOME_SNAPSHOT_PATH IPC_HOME_PATH "/snapshot/"
+/**
+ * Name of the socket of the daemon, in the root folder
+ */
+#define IPC_SOCKET_NAME "daemon.sock"
+/**
+ * Number of connections waiting to be accepted by the daemon
+ */
+#define IPC_BACKLOG 16
+/**
+ * Maximum size of a list of arguments received
+ */
+#define IPC_MAX_ARGS_SIZE 65536
 
 /**
- * Destination path on which this instance operates on.
+ * Destination paths on which this instance operates on.
  */
-static char g_watch_dst_path[IO_PATH_MAX_SIZE] = "";
+static io_file_list_t *g_watch_dst_paths = NULL;
 /**
  * Provided callback when a signal is received
  */
@@ -63,39 +100,60 @@ static ipc_stop_callback g_watch_cb = NULL;
 static void * g_watch_cb_arg = NULL;
 
 /**
- * Return the pid file path for the watch constructed from the folder.
- * The pid filename is constructed by simply replacing the '/' character by '_'
+ * Return the path of a file related to the folder, in a folder of the user home directory.
+ * The filename is constructed by simply replacing the '/' character by '_'
  * @param dst_path The destination path to construct the filename from
- * @param pid_path String to store the resulting pid filename
+ * @param home_sub_path Folder from the user home directory where the file is
+ * @param path String to store the resulting filename
  */
-static int ipc_get_pid_file_path(char *dst_path, char *pid_path) {
+static int ipc_get_file_path(char *dst_path, char *home_sub_path, char *path) {
     // Get user home directory root
     char *home_dir = getenv("HOME");
     if (home_dir == NULL) {
         logger_perror("IPC: Error: Invalid user home directory");
         return 1;
     }
-    strncpy(pid_path, home_dir, IO_PATH_MAX_SIZE);
-    strncat(pid_path, IPC_HOME_RUN_PATH, IO_PATH_MAX_SIZE);
+    strncpy(path, home_dir, IO_PATH_MAX_SIZE);
+    strncat(path, home_sub_path, IO_PATH_MAX_SIZE);
 
-    // Store the PID to a file named after the destination path
-    int folder_length = strlen(pid_path);
-    strncat(pid_path, dst_path, IO_PATH_MAX_SIZE);
-    for (int i = folder_length; pid_path[i]; ++i) {
-        if (pid_path[i] == '/') {
-            pid_path[i] = '_';
+    // Name the file after the destination path
+    int folder_length = strlen(path);
+    strncat(path, dst_path, IO_PATH_MAX_SIZE);
+    for (int i = folder_length; path[i]; ++i) {
+        if (path[i] == '/') {
+            path[i] = '_';
         }
     }
 
     return 0;
 }
 
+/**
+ * Return the pid file path for the watch constructed from the folder.
+ * @param dst_path The destination path to construct the filename from
+ * @param pid_path String to store the resulting pid filename
+ */
+static int ipc_get_pid_file_path(char *dst_path, char *pid_path) {
+    return ipc_get_file_path(dst_path, IPC_HOME_RUN_PATH, pid_path);
+}
+
+int ipc_get_state_file_path(char *dst_path, char *state_path) {
+    if (ipc_get_file_path(dst_path, IPC_HOME_STATE_PATH, state_path) != 0) {
+        return 1;
+    }
+
+    // Create our state directory
+    return io_directory_create_parent(state_path);
+}
+
 /**
  * IPC signal handler for SIGTERM|SIGINT that remove the watch
  * and optionally call a callback.
  */
 void ipc_sig_handler() {
-    ipc_remove_watch(g_watch_dst_path);
+    for (io_file_list_t *watch = g_watch_dst_paths; watch; watch = watch->next) {
+        ipc_remove_watch(watch->file);
+    }
     if (g_watch_cb != NULL) {
         g_watch_cb(g_watch_cb_arg);
     }
@@ -111,10 +169,13 @@ int ipc_set_watch(char *dst_path, ipc_stop_callback cb, void * cb_arg) {
         logger_perror("IPC: ERROR: failed to register signal");
         return 1;
     }
-    strncpy(g_watch_dst_path, dst_path, IO_PATH_MAX_SIZE);
     g_watch_cb = cb;
     g_watch_cb_arg = cb_arg;
 
+    return ipc_add_watch(dst_path);
+}
+
+int ipc_add_watch(char *dst_path) {
     // Get file where to write our PID
     char pid_path[IO_PATH_MAX_SIZE];
     if (ipc_get_pid_file_path(dst_path, pid_path) == 1) {
@@ -138,6 +199,12 @@ int ipc_set_watch(char *dst_path, ipc_stop_callback cb, void * cb_arg) {
         return 1;
     }
 
+    io_file_list_t *watch = malloc(sizeof(io_file_list_t));
+    watch->file = malloc(sizeof(char) * (1 + strlen(dst_path)));
+    strcpy(watch->file, dst_path);
+    watch->next = g_watch_dst_paths;
+    g_watch_dst_paths = watch;
+
     return 0;
 }
 
@@ -161,7 +228,7 @@ int ipc_stop_watch(char *dst_path) {
         return 1;
     }
 
-    char pid_str[IPC_MAX_PID_SIZE];
+    char pid_str[IPC_MAX_PID_SIZE] = "";
     if (io_file_read_content(pid_path, pid_str, IPC_MAX_PID_SIZE) != 0) {
         logger_error("IPC: Error: cannot get pid of instance for this path '%s'\n", dst_path);
         return 1;
@@ -185,3 +252,162 @@ int ipc_stop_watch(char *dst_path) {
 
     return 0;
 }
+
+int ipc_get_snapshot_path(char *dst_path, char *snapshot_path) {
+    if (!io_directory_exists(IPC_SHM_PATH)) {
+        if (ipc_get_file_path(dst_path, IPC_HOME_SNAPSHOT_PATH, snapshot_path) != 0) {
+            return 1;
+        }
+        return io_directory_create_parent(snapshot_path);
+    }
+
+    // Named after the destination path, like the other files
+    int prefix_length = snprintf(snapshot_path, IO_PATH_MAX_SIZE, "%s%s%u", IPC_SHM_PATH, IPC_SHM_PREFIX, getuid());
+    strncat(snapshot_path, dst_path, IO_PATH_MAX_SIZE - prefix_length - 1);
+    for (int i = prefix_length; snapshot_path[i]; ++i) {
+        if (snapshot_path[i] == '/') {
+            snapshot_path[i] = '_';
+        }
+    }
+    return 0;
+}
+
+int ipc_get_socket_path(char *socket_path) {
+    char *home_dir = getenv("HOME");
+    if (home_dir == NULL) {
+        logger_perror("IPC: Error: Invalid user home directory");
+        return 1;
+    }
+    snprintf(socket_path, IO_PATH_MAX_SIZE, "%s%s%s", home_dir, IPC_HOME_PATH, IPC_SOCKET_NAME);
+
+    return io_directory_create_parent(socket_path);
+}
+
+/**
+ * Fill the address of a socket.
+ * @param socket_path Path of the socket
+ * @param addr Address to fill
+ * @return Error indicator: 0 for OK, 1 if the path is too long
+ */
+static int ipc_socket_addr(char *socket_path, struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(struct sockaddr_un));
+    addr->sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr->sun_path)) {
+        logger_error("IPC: Error: socket path too long '%s'\n", socket_path);
+        return 1;
+    }
+    strcpy(addr->sun_path, socket_path);
+    return 0;
+}
+
+int ipc_listen(char *socket_path) {
+    struct sockaddr_un addr;
+    if (ipc_socket_addr(socket_path, &addr) != 0) {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        logger_perror("IPC: Error: cannot create socket");
+        return -1;
+    }
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, IPC_BACKLOG) != 0) {
+        logger_perror("IPC: Error: cannot listen on socket");
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+int ipc_connect(char *socket_path) {
+    struct sockaddr_un addr;
+    if (ipc_socket_addr(socket_path, &addr) != 0) {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+int ipc_write_all(int fd, void *data, size_t size) {
+    char *bytes = data;
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+        if (written <= 0) {
+            return 1;
+        }
+        bytes += written;
+        size -= written;
+    }
+
+    return 0;
+}
+
+int ipc_send_args(int fd, char **args, int count) {
+    // The number of arguments comes first, so that an argument may be empty
+    uint32_t header = count;
+    if (ipc_write_all(fd, &header, sizeof(uint32_t)) != 0) {
+        return 1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (ipc_write_all(fd, args[i], strlen(args[i]) + 1) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+char **ipc_recv_args(int fd, int *count) {
+    char *buffer = malloc(IPC_MAX_ARGS_SIZE);
+    size_t size = 0, scanned = sizeof(uint32_t);
+    uint32_t expected = 0, ended = 0;
+
+    // Read until the number of arguments announced are terminated
+    while (size < IPC_MAX_ARGS_SIZE) {
+        ssize_t received = read(fd, buffer + size, IPC_MAX_ARGS_SIZE - size);
+        if (received <= 0) {
+            break;
+        }
+        size += received;
+        if (size < sizeof(uint32_t)) {
+            continue;
+        }
+        memcpy(&expected, buffer, sizeof(uint32_t));
+        for (; scanned < size && ended < expected; scanned++) {
+            ended += buffer[scanned] == '\0';
+        }
+        if (ended == expected) {
+            break;
+        }
+    }
+    if (size < sizeof(uint32_t) || ended != expected || expected > IPC_MAX_ARGS_SIZE) {
+        free(buffer);
+        return NULL;
+    }
+    *count = expected;
+
+    // The pointers and the arguments are allocated together, freed at once
+    size_t strings_size = scanned - sizeof(uint32_t);
+    char **args = malloc(sizeof(char *) * (*count + 1) + strings_size);
+    char *strings = (char *)(args + *count + 1);
+    memcpy(strings, buffer + sizeof(uint32_t), strings_size);
+    for (int i = 0; i < *count; i++) {
+        args[i] = strings;
+        strings += strlen(strings) + 1;
+    }
+    args[*count] = NULL;
+
+    free(buffer);
+    return args;
+}
@@ -19,6 +19,12 @@
  * When a signal is received, the signal handler will first remove the file
  * and call the callback if any.
  *
+ * An instance updating several destination folders (see ipc_add_watch) has one file
+ * per destination path, all containing its PID: stopping any of them stops the instance.
+ *
+ * The daemon hosting many destination folders is instead reached through a Unix domain socket
+ * (see ipc_get_socket_path), the requests being lists of arguments (see ipc_send_args).
+ *
  * @author Claudio Sousa, Gonzalez David
  * @file
  */
@@ -26,6 +32,8 @@
 #ifndef IPC_H
 #define IPC_H
 
+#include <stdlib.h>
+
 /**
  * Callback signed used in the signal handler
  */
@@ -41,6 +49,14 @@ typedef void (*ipc_stop_callback)(void*);
  */
 int ipc_set_watch(char *dst_path, ipc_stop_callback cb, void * cb_arg);
 
+/**
+ * Create the instance run file for another destination path of this instance.
+ * Must be called after ipc_set_watch(), all the watches share its callback.
+ * @param dst_path Another destination path this instance operates on
+ * @return Error indicator: 0 for OK, 1 for an error
+ */
+int ipc_add_watch(char *dst_path);
+
 /**
  * Removes the watch file for the given search path.
  * @param dst_path The destination path that designate the instance
@@ -55,4 +71,73 @@ int ipc_remove_watch(char *dst_path);
  */
 int ipc_stop_watch(char *dst_path);
 
+/**
+ * Return the path of the file where the state of the instance operating on
+ * the given destination path is kept, creating its parent directory if needed.
+ * The file is in the user home directory and named like the PID file.
+ * @param dst_path The destination path that designate the instance
+ * @param state_path String to store the resulting state filename
+ * @return Error indicator: 0 for OK, 1 for an error
+ */
+int ipc_get_state_file_path(char *dst_path, char *state_path);
+
+/**
+ * Return the path of the shared memory file where the result set of a destination folder is published.
+ * The file is in /dev/shm, or in the user home directory if there is no /dev/shm, named like the PID file
+ * and prefixed by the user id.
+ * @param dst_path The destination path that designate the folder
+ * @param snapshot_path String to store the resulting filename
+ * @return Error indicator: 0 for OK, 1 for an error
+ */
+int ipc_get_snapshot_path(char *dst_path, char *snapshot_path);
+
+/**
+ * Return the path of the socket of the daemon hosting the destination folders,
+ * creating its parent directory if needed. The socket is in the user home directory.
+ * @param socket_path String to store the socket path
+ * @return Error indicator: 0 for OK, 1 for an error
+ */
+int ipc_get_socket_path(char *socket_path);
+
+/**
+ * Listen for connections on a Unix domain socket.
+ * @param socket_path Path of the socket, which must not exist
+ * @return The listening socket, -1 for an error
+ */
+int ipc_listen(char *socket_path);
+
+/**
+ * Connect to a Unix domain socket, without reporting errors.
+ * @param socket_path Path of the socket
+ * @return The connected socket, -1 if nobody is listening
+ */
+int ipc_connect(char *socket_path);
+
+/**
+ * Write data entirely to a socket or a file.
+ * @param fd Where to write
+ * @param data Data to write
+ * @param size Size of the data
+ * @return Error indicator: 0 for OK, 1 for an error
+ */
+int ipc_write_all(int fd, void *data, size_t size);
+
+/**
+ * Send a list of arguments: their number, as a 32 bits integer in the byte order of the host, then each argument
+ * with its terminating null character.
+ * @param fd The connected socket
+ * @param args The arguments, possibly empty
+ * @param count Number of arguments
+ * @return Error indicator: 0 for OK, 1 for an error
+ */
+int ipc_send_args(int fd, char **args, int count);
+
+/**
+ * Receive a list of arguments sent by ipc_send_args().
+ * @param fd The connected socket
+ * @param count Receives the number of arguments
+ * @return The arguments, followed by NULL, to be freed with a single free(); NULL for an error
+ */
+char **ipc_recv_args(int fd, int *count);
+
 #endif
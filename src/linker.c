@@ -7,12 +7,60 @@
  *
  * In order to create the links, it simply take the base name of the target file
  * and create the link with this name in the destination folder.
- * But to manage duplicate, it count the number of files that has the same basename
- * in the list before the current one and if it is not 0, append the number to the name.
+ * But to manage duplicate, it appends to the name the lowest number not used by
+ * another link with the same basename. Once linked, a file keeps the name of its link
+ * as long as it is found, whatever the duplicates appearing or disappearing, and the
+ * new files are named in the order of their path: the names do not depend on the order
+ * of the list. The expected links are kept in a hashtable indexed by target path.
  *
- * To purge the destination folder, it gets all the links in it. Then, for each link,
- * it determines whether a file is no longer here by searching the target of the link in the list.
- * If it is not found, the linker deletes the link in the destination folder.
+ * The target paths are interned in a table of paths (see pathtab.h), the links holding their ids: the files of
+ * a folder share the nodes of its path, and the target of a link is compared with the files of an update as an
+ * integer. The full paths are only rebuilt to create the links, persist them and list them. As the table keeps
+ * the paths of the files gone, it is rebuilt from the targets still used once it has doubled.
+ *
+ * The linker keeps the set of links it applied on the last update. An update compares
+ * the expected links with this set, and only creates and deletes the links that differ:
+ * when nothing changed, the destination folder is not touched at all.
+ * The set can be persisted to a state file, so that it survives the instance.
+ *
+ * Every few updates, and on the first one, the destination folder itself is verified in order to
+ * catch outside changes: it reads the target of each link in it (readlinkat) and
+ * searches it in the expected links. If it is not found, or is expected under another name,
+ * the linker deletes the link in the destination folder.
+ * The links expected but not found are then created, so an update is linear in the number
+ * of files plus the number of links.
+ *
+ * The links are created and deleted relative to the destination folder, kept opened, and the
+ * operations are submitted by large batches (io_uring when available, see io_batch_apply()).
+ *
+ * In the swap publication mode, the destination folder is not modified in place: the next generation
+ * is built in a hidden sibling staging folder, reusing the unchanged links by hard linking them,
+ * and then atomically exchanged with the destination folder (renameat2 RENAME_EXCHANGE).
+ * Readers always see a complete generation, and the previous one is deleted in the background.
+ *
+ * The links can be spread in sub-folders of the destination folder, so that no folder holds
+ * millions of entries: the hash layout puts each link in one of N sub-folders chosen by the hash
+ * of its basename, and the mirror layout reproduces the folders of the target relative to the
+ * search path. Duplicate names are then resolved per sub-folder, and the sub-folders left empty
+ * are deleted when the destination folder is verified.
+ *
+ * The files can also be given one by one while they are found (linker_begin(), linker_add(), linker_commit()).
+ * The link of a new file whose name is not wanted by any other file so far is then created right away,
+ * overlapping the search; if a file found later sorts before it for the same name, the link is replaced
+ * when the update is committed, so the names do not depend on the order of the files.
+ *
+ * An update can also only give the files that changed (linker_begin_delta(), linker_add(), linker_remove()): the
+ * links of the other files are kept, and in the in place publication mode only the links of the files given are
+ * deleted or created, without going through the applied links. The applied links are kept indexed by name too, so
+ * that the new files are named without clashing with them.
+ *
+ * Each update changing the applied links starts a new generation of the result set. The applied links
+ * remember the generation in which they appeared, and the removed ones are journaled with the generation
+ * that removed them, so the changes since a given generation can be listed (linker_results()).
+ * The journal is bounded: past its size, or when the links applied differ from the ones intended,
+ * it restarts from the current generation, the older generations getting the whole result set.
+ * The result set can be listed by another thread during an update: only the commit and the paths added to the
+ * table of paths hold the lock of the result set, the search itself does not.
  *
  * @author Claudio Sousa, Gonzalez David
  * @file
@@ -21,128 +69,1432 @@
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
-#include <inttypes.h>
-#include <libgen.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
 #include "linker.h"
 #include "io.h"
 #include "logger.h"
+#include "pathtab.h"
+#include "trace.h"
+#include "vendor/uthash.h"
 
 /**
- * Count the number of times the current file appear in the list before itself.
- * @param current_file Current treated file in the below list
- * @param files List of files to link
- * @return Number of times it appears
+ * Number of updates between two verifications of the destination folder
+ */
+#define LINKER_VERIFY_INTERVAL 12
+/**
+ * Suffix of the temporary file used to write the state file atomically
+ */
+#define LINKER_STATE_TMP_SUFFIX ".tmp"
+/**
+ * Prefix of the staging folder, a hidden sibling of the destination folder
+ */
+#define LINKER_STAGING_PREFIX "."
+/**
+ * Suffix of the staging folder
+ */
+#define LINKER_STAGING_SUFFIX ".next"
+/**
+ * Suffix appended to the staging folder path for a previous generation being deleted
+ */
+#define LINKER_OLD_SUFFIX ".old."
+/**
+ * Folder of the mirror layout containing the files outside of the search path
+ */
+#define LINKER_MIRROR_OUTSIDE "_"
+/**
+ * Number of eager link creations applied at once
  */
-unsigned int linker_get_count(finder_t *current_file, finder_t *files) {
-    unsigned int dup_count = 0;
+#define LINKER_EAGER_BATCH 256
+/**
+ * Maximum number of removals kept in the journal
+ */
+#define LINKER_JOURNAL_SIZE 65536
+/**
+ * Minimum number of nodes of the table of paths before it is rebuilt
+ */
+#define LINKER_PATHS_MIN 65536
 
-    while (files != current_file) {
-        if (strncmp(basename(files->filename), basename(current_file->filename), IO_PATH_MAX_SIZE) == 0) {
-            dup_count++;
-        }
-        files = files->next;
+/**
+ * Hashtable entry keeping, for a basename in a folder of the layout, the next duplicate number to try.
+ */
+typedef struct linker_basename_t {
+    char *basename;         /**< Folder and basename of the target files (key) */
+    unsigned int dup_count; /**< Next duplicate number to try for this basename */
+    UT_hash_handle hh;      /**< Makes this structure hashable */
+} linker_basename_t;
+
+/**
+ * Hashtable entry of a link, indexed by its target path and, for the expected links, by its name.
+ */
+typedef struct linker_link_t {
+    pathtab_id_t target;      /**< Path of the target file, in the table of paths (key) */
+    char *name;               /**< Name of the link in the destination folder (key of `hh_name`) */
+    bool present;             /**< If the link already exists in the destination folder */
+    unsigned long generation; /**< Generation in which the link appeared, 0 for a new link */
+    UT_hash_handle hh;        /**< Makes this structure hashable by target */
+    UT_hash_handle hh_name;   /**< Makes this structure hashable by name */
+} linker_link_t;
+
+/**
+ * Hashtable entry of a sub-folder of the destination folder.
+ */
+typedef struct linker_dir_t {
+    char *path;        /**< Path relative to the destination folder (key) */
+    UT_hash_handle hh; /**< Makes this structure hashable */
+} linker_dir_t;
+
+/**
+ * A growable list of link operations, applied by batches.
+ */
+typedef struct linker_ops_t {
+    io_batch_op_t *ops; /**< Operations */
+    size_t count;       /**< Number of operations */
+    size_t size;        /**< Allocated number of operations */
+} linker_ops_t;
+
+/**
+ * A link removed from the result set, kept in the journal.
+ */
+typedef struct linker_removal_t {
+    pathtab_id_t target;      /**< Path of the target file, in the table of paths */
+    char *name;               /**< Name of the link */
+    unsigned long generation; /**< Generation that removed the link */
+} linker_removal_t;
+
+/**
+ * Contains the links applied to a destination folder
+ */
+struct linker_t {
+    char *dst_path;               /**< Where to put the links */
+    char *state_path;             /**< Where to persist the applied links, NULL if not persisted */
+    linker_link_t *applied;       /**< Links applied on the last update, owning their name */
+    pathtab_t *paths;             /**< Paths of the targets of the links */
+    size_t paths_base;            /**< Number of nodes of `paths` when it was last rebuilt */
+    unsigned int update_count;    /**< Number of updates done, used to verify the destination folder periodically */
+    int dir_fd;                   /**< The opened destination folder, -1 until the first update */
+    io_batch_t *batch;            /**< Applies the link operations by batches */
+    linker_publish_t publish;     /**< How the updates are published */
+    char *staging_path;           /**< Where the next generation is built, in the swap publication mode */
+    pthread_t teardown;           /**< Thread deleting the previous generation */
+    bool tearing_down;            /**< If `teardown` is running */
+    linker_layout_t layout;       /**< How the links are organized in the destination folder */
+    unsigned int shards;          /**< Number of sub-folders of the hash layout */
+    char *search_path;            /**< Root of the files, mirrored by the mirror layout */
+    linker_dir_t *dirs;           /**< Sub-folders known to exist in the destination folder */
+    linker_link_t *expected;      /**< Links expected by the update in progress, by target */
+    linker_link_t *names;         /**< Links expected by the update in progress, by name */
+    linker_link_t *applied_names; /**< Applied links by name */
+    pathtab_id_t *new_files;      /**< Files of the update in progress not linked yet */
+    size_t new_count;             /**< Number of `new_files` */
+    size_t new_size;              /**< Allocated number of `new_files` */
+    bool delta;                   /**< If the update in progress only gives the files that changed */
+    pathtab_id_t *dropped;        /**< Files whose link is removed by the update in progress, in a delta update */
+    size_t dropped_count;         /**< Number of `dropped` */
+    size_t dropped_size;          /**< Allocated number of `dropped` */
+    linker_basename_t *wanted;    /**< Names wanted by the `new_files` */
+    linker_link_t *eager;         /**< Links created by the update in progress before their name is final */
+    linker_ops_t eager_ops;       /**< Creations of `eager` links not applied yet */
+    bool streaming;               /**< If the links of new files are created before the update is committed */
+    unsigned long generation;     /**< Generation of the applied links, incremented by each update changing them */
+    unsigned long journal_base;   /**< Generation since which all the removals are journaled */
+    linker_removal_t *removed;    /**< Journal of the removed links, by increasing generation */
+    size_t removed_count;         /**< Number of `removed` */
+    size_t removed_size;          /**< Allocated number of `removed` */
+    size_t added;                 /**< Number of links added by the update in progress */
+    unsigned int eager_count;     /**< Number of `eager` links created */
+    linker_stats_t stats;         /**< Counters of the operations applied */
+    pthread_mutex_t lock;         /**< Protects the result set listed by linker_results() from the updates */
+};
+
+/**
+ * Get the basename of a file path, without modifying the path.
+ * @param filename File path
+ * @return Pointer to the basename inside the file path
+ */
+static char *linker_basename(char *filename) {
+    char *sep = strrchr(filename, IO_PATH_SEP);
+    return sep ? sep + 1 : filename;
+}
+
+/**
+ * Create a link entry and add it to a hashtable.
+ * @param links Hashtable where to add the link
+ * @param target Path of the target file, in the table of paths
+ * @param name Name of the link, used as is
+ * @return The added link
+ */
+static linker_link_t *linker_link_add(linker_link_t **links, pathtab_id_t target, char *name) {
+    linker_link_t *link = malloc(sizeof(linker_link_t));
+    link->target = target;
+    link->name = name;
+    link->present = false;
+    link->generation = 0;
+    HASH_ADD(hh, *links, target, sizeof(pathtab_id_t), link);
+    return link;
+}
+
+/**
+ * Find a link by its target in a hashtable.
+ * @param links Hashtable of links
+ * @param target Path of the target file, in the table of paths
+ * @return The link, NULL if not found
+ */
+static linker_link_t *linker_link_find(linker_link_t *links, pathtab_id_t target) {
+    linker_link_t *link;
+    HASH_FIND(hh, links, &target, sizeof(pathtab_id_t), link);
+    return link;
+}
+
+/**
+ * Free a hashtable of links.
+ * @param links Hashtable of links
+ */
+static void linker_links_free(linker_link_t *links) {
+    linker_link_t *link, *tmp;
+    HASH_ITER(hh, links, link, tmp) {
+        HASH_DEL(links, link);
+        free(link->name);
+        free(link);
     }
+}
 
-    return dup_count;
+/**
+ * Rebuild the path of the target of a link.
+ * @param linker The linker
+ * @param target Path of the target file, in the table of paths
+ * @return The path, to be freed
+ */
+static char *linker_target_path(linker_t *linker, pathtab_id_t target) {
+    size_t length = pathtab_path(linker->paths, target, NULL, 0);
+    char *path = malloc(sizeof(char) * (length + 1));
+    pathtab_path(linker->paths, target, path, length + 1);
+    return path;
 }
 
 /**
- * Retreive the duplicate number from the filename
- * @param link_filename Filename of the link
- * @return Appending duplicate counter
+ * Get the folder of the link of a file in the destination folder, according to the layout.
+ *   - flat: the destination folder itself;
+ *   - hash: a sub-folder named after the hash of the basename, modulo the number of shards;
+ *   - mirror: the folder of the file relative to the search path (under LINKER_MIRROR_OUTSIDE if outside).
+ * @param linker The linker
+ * @param filename Path of the file
+ * @param dir String to store the folder, relative to the destination folder and ending with a separator,
+ *            empty for the destination folder itself
  */
-unsigned int linker_get_count_from_filename(char *link_filename) {
-    unsigned int dup_count = 0;
+static void linker_link_dir(linker_t *linker, char *filename, char *dir) {
+    char *name = linker_basename(filename);
+    dir[0] = '\0';
 
-    const char *dot = strrchr(link_filename, '.');
-    if ((dot != NULL) && (dot != link_filename)) {
-        const char *ext = dot + 1;
-        dup_count = strtoimax(ext, NULL, 10);
+    if (linker->layout == LINKER_LAYOUT_HASH) {
+        unsigned int hash = 2166136261u;  // FNV-1a
+        for (char *c = name; *c; c++) {
+            hash = (hash ^ (unsigned char)*c) * 16777619u;
+        }
+        // Hexadecimal bucket, padded to the digits of the last one: at most 8 digits
+        int width = 1;
+        for (unsigned int max = linker->shards - 1; max > 0xf; max >>= 4) {
+            width++;
+        }
+        unsigned int bucket = hash % linker->shards;
+        for (int i = width - 1; i >= 0; i--, bucket >>= 4) {
+            dir[i] = "0123456789abcdef"[bucket & 0xf];
+        }
+        dir[width] = IO_PATH_SEP;
+        dir[width + 1] = '\0';
+    } else if (linker->layout == LINKER_LAYOUT_MIRROR && name > filename + 1) {
+        size_t root_len = strlen(linker->search_path);
+        char *relative = filename + 1;
+        char *prefix = LINKER_MIRROR_OUTSIDE "/";
+        if (strncmp(filename, linker->search_path, root_len) == 0 && filename[root_len] == IO_PATH_SEP) {
+            relative = filename + root_len + 1;
+            prefix = "";
+        }
+        if (name > relative &&
+            snprintf(dir, IO_PATH_MAX_SIZE, "%s%.*s", prefix, (int)(name - relative), relative) >= IO_PATH_MAX_SIZE) {
+            logger_error("Linker error: folder of '%s' too long, linked at the root\n", filename);
+            dir[0] = '\0';
+        }
     }
+}
+
+/**
+ * A new file to name, with its path rebuilt to sort the files.
+ */
+typedef struct linker_new_file_t {
+    char *path;          /**< Path of the file */
+    pathtab_id_t target; /**< Path of the file, in the table of paths */
+} linker_new_file_t;
+
+/**
+ * Compare two new files by path, used to sort the files to name.
+ */
+static int linker_compare_files(const void *a, const void *b) {
+    return strcmp(((linker_new_file_t *)a)->path, ((linker_new_file_t *)b)->path);
+}
+
+/**
+ * Add an expected link, indexed by both its target and its name.
+ * @param links Hashtable of the expected links, by target
+ * @param names Hashtable of the expected links, by name
+ * @param target Path of the target file, in the table of paths
+ * @param name Name of the link, used as is
+ * @return The added link
+ */
+static linker_link_t *linker_expected_add(linker_link_t **links, linker_link_t **names, pathtab_id_t target,
+                                          char *name) {
+    linker_link_t *link = linker_link_add(links, target, name);
+    HASH_ADD_KEYPTR(hh_name, *names, link->name, strlen(link->name), link);
+    return link;
+}
 
-    return dup_count;
+/**
+ * Get the name wanted by a file in the destination folder: the folder of the layout and its basename.
+ * @param linker The linker
+ * @param filename Path of the file
+ * @param name String to store the name, of IO_PATH_MAX_SIZE
+ */
+static void linker_wanted_name(linker_t *linker, char *filename, char *name) {
+    linker_link_dir(linker, filename, name);
+    strncat(name, linker_basename(filename), IO_PATH_MAX_SIZE - strlen(name) - 1);
 }
 
 /**
- * Delete all links in the destination folder that are no longer in the given list.
- * To determine whether a file is no longer here, it searchs the target of the link in the list.
- * If it is not found, the linker delete the link.
- * @param dst_path Where to put the links
- * @param files List of files to link
+ * Free a hashtable of basenames.
+ * @param basenames Hashtable of the basenames
  */
-void linker_purge(char *dst_path, finder_t *files) {
-    io_file_list_t *links = io_directory_get_all(dst_path);
-    bool found = false;
-    char link_del[IO_PATH_MAX_SIZE] = "";
-    char link_del_target[IO_PATH_MAX_SIZE] = "";
-    char real_dst_filepath[IO_PATH_MAX_SIZE] = "";
-    finder_t *file;
+static void linker_basenames_free(linker_basename_t *basenames) {
+    linker_basename_t *basename, *tmp;
+    HASH_ITER(hh, basenames, basename, tmp) {
+        HASH_DEL(basenames, basename);
+        free(basename->basename);
+        free(basename);
+    }
+}
 
-    io_file_list_t *workinglink = links;
-    while (workinglink) {
-        found = false;
-        snprintf(link_del, IO_PATH_MAX_SIZE, "%s%c%s", dst_path, IO_PATH_SEP, workinglink->file);
-        realpath(link_del, link_del_target);
+/**
+ * Name the new files of the update in progress, and add them to the expected links.
+ * The new files are named in the order of their path, a duplicate getting the lowest number not used by
+ * another link with the same basename.
+ * @param linker The linker, with the expected links of the already linked files
+ */
+static void linker_name_new_files(linker_t *linker) {
+    linker_basename_t *basenames = NULL, *basename;
+    linker_link_t *other;
+    char dir[IO_PATH_MAX_SIZE] = "";
 
-        file = files;
-        while (file && !found) {
-            realpath(file->filename, real_dst_filepath);
-            found = (strncmp(link_del_target, real_dst_filepath, IO_PATH_MAX_SIZE) == 0);
+    // New files are named in a deterministic order
+    linker_new_file_t *files = malloc(sizeof(linker_new_file_t) * linker->new_count);
+    for (size_t i = 0; i < linker->new_count; i++) {
+        files[i].path = linker_target_path(linker, linker->new_files[i]);
+        files[i].target = linker->new_files[i];
+    }
+    qsort(files, linker->new_count, sizeof(linker_new_file_t), linker_compare_files);
+
+    for (size_t i = 0; i < linker->new_count; i++) {
+        linker_wanted_name(linker, files[i].path, dir);
+        size_t name_len = strlen(dir);
+
+        HASH_FIND(hh, basenames, dir, name_len, basename);
+        if (!basename) {
+            basename = malloc(sizeof(linker_basename_t));
+            basename->basename = strdup(dir);
+            basename->dup_count = 0;
+            HASH_ADD_KEYPTR(hh, basenames, basename->basename, name_len, basename);
+        }
 
-            // If found, don't do next because we need this reference for duplicate count
-            if (!found) {
-                file = file->next;
+        char *link_name = malloc(sizeof(char) * (name_len + 12));
+        do {
+            if (basename->dup_count > 0) {
+                sprintf(link_name, "%s.%u", dir, basename->dup_count);
+            } else {
+                strcpy(link_name, dir);
+            }
+            basename->dup_count++;
+            HASH_FIND(hh_name, linker->names, link_name, strlen(link_name), other);
+            if (!other && linker->delta) {
+                // The links not given by a delta update are kept
+                HASH_FIND(hh_name, linker->applied_names, link_name, strlen(link_name), other);
             }
+        } while (other);
+
+        linker_expected_add(&linker->expected, &linker->names, files[i].target, link_name);
+        free(files[i].path);
+    }
+
+    free(files);
+    linker_basenames_free(basenames);
+}
+
+/**
+ * Record a sub-folder as existing.
+ * @param dirs Hashtable of the existing sub-folders
+ * @param path Path of the sub-folder, copied
+ */
+static void linker_dir_add(linker_dir_t **dirs, char *path) {
+    linker_dir_t *dir = malloc(sizeof(linker_dir_t));
+    dir->path = strdup(path);
+    HASH_ADD_KEYPTR(hh, *dirs, dir->path, strlen(dir->path), dir);
+}
+
+/**
+ * Free a hashtable of sub-folders.
+ * @param dirs Hashtable of the sub-folders
+ */
+static void linker_dirs_free(linker_dir_t *dirs) {
+    linker_dir_t *dir, *tmp;
+    HASH_ITER(hh, dirs, dir, tmp) {
+        HASH_DEL(dirs, dir);
+        free(dir->path);
+        free(dir);
+    }
+}
+
+/**
+ * Create the sub-folders containing a link, if they are not known to exist.
+ * @param dir_fd Folder containing the link
+ * @param dirs Hashtable of the existing sub-folders, receiving the created ones
+ * @param name Path of the link relative to `dir_fd`
+ */
+static void linker_dir_ensure(int dir_fd, linker_dir_t **dirs, char *name) {
+    char path[IO_PATH_MAX_SIZE] = "";
+    linker_dir_t *dir;
+
+    for (char *sep = strchr(name, IO_PATH_SEP); sep; sep = strchr(sep + 1, IO_PATH_SEP)) {
+        snprintf(path, IO_PATH_MAX_SIZE, "%.*s", (int)(sep - name), name);
+        HASH_FIND(hh, *dirs, path, strlen(path), dir);
+        if (dir) {
+            continue;
         }
-        // Avoid crash if the current file is not found
-        if (!found) {
-            file = files;
+
+        if (io_mkdir(dir_fd, path, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH) != 0 && errno != EEXIST) {
+            logger_perror("Linker: error: cannot create sub-folder");
+            return;
         }
+        linker_dir_add(dirs, path);
+    }
+}
+
+/**
+ * Record a link as applied, a new link appearing in the generation of the update in progress.
+ * @param linker The linker
+ * @param link The expected link, copied
+ */
+static void linker_applied_add(linker_t *linker, linker_link_t *link) {
+    linker_link_t *applied = linker_link_add(&linker->applied, link->target, strdup(link->name));
+    HASH_ADD_KEYPTR(hh_name, linker->applied_names, applied->name, strlen(applied->name), applied);
+    applied->generation = link->generation ? link->generation : linker->generation + 1;
+    linker->added += link->generation == 0;
+}
+
+/**
+ * Remove a link from the applied links, its name being kept.
+ * @param linker The linker
+ * @param link The applied link, freed
+ */
+static void linker_applied_remove(linker_t *linker, linker_link_t *link) {
+    HASH_DEL(linker->applied, link);
+    HASH_DELETE(hh_name, linker->applied_names, link);
+    free(link);
+}
 
-        if ((!found) || (linker_get_count_from_filename(link_del) != linker_get_count(file, files))) {
-            logger_debug("Purge: %s | %u | %u\n", link_del, linker_get_count_from_filename(link_del),
-                         linker_get_count(file, files));
-            if (io_file_delete(link_del) != 0) {
-                logger_error("Linker error: cannot purge '%s'\n", link_del);
+/**
+ * Free the applied links.
+ * @param linker The linker
+ */
+static void linker_applied_clear(linker_t *linker) {
+    HASH_CLEAR(hh_name, linker->applied_names);
+    linker_links_free(linker->applied);
+    linker->applied = NULL;
+}
+
+/**
+ * Free the journal of the removed links.
+ * @param linker The linker
+ */
+static void linker_journal_clear(linker_t *linker) {
+    for (size_t i = 0; i < linker->removed_count; i++) {
+        free(linker->removed[i].name);
+    }
+    linker->removed_count = 0;
+}
+
+/**
+ * Journal an applied link as removed by the generation of the update in progress.
+ * @param linker The linker
+ * @param link The applied link
+ */
+static void linker_journal_add(linker_t *linker, linker_link_t *link) {
+    if (linker->removed_count == linker->removed_size) {
+        linker->removed_size = linker->removed_size ? linker->removed_size * 2 : 64;
+        linker->removed = realloc(linker->removed, sizeof(linker_removal_t) * linker->removed_size);
+    }
+    linker_removal_t *removal = &linker->removed[linker->removed_count++];
+    removal->target = link->target;
+    removal->name = strdup(link->name);
+    removal->generation = linker->generation + 1;
+}
+
+/**
+ * Journal the applied links that are not expected anymore, or under another name,
+ * as removed by the generation of the update in progress.
+ * @param linker The linker, with the expected links of the update in progress
+ * @return Number of links journaled
+ */
+static size_t linker_journal_removals(linker_t *linker) {
+    linker_link_t *link, *tmp, *expected;
+    size_t count = 0;
+
+    HASH_ITER(hh, linker->applied, link, tmp) {
+        expected = linker_link_find(linker->expected, link->target);
+        if (expected && strcmp(expected->name, link->name) == 0) {
+            continue;
+        }
+        linker_journal_add(linker, link);
+        count++;
+    }
+
+    return count;
+}
+
+/**
+ * End the generation of the update in progress, if it changed the applied links.
+ * @param linker The linker, with the links applied by the update
+ * @param applied_count Number of links applied before the update
+ * @param removed Number of links journaled as removed by the update
+ */
+static void linker_journal_commit(linker_t *linker, size_t applied_count, size_t removed) {
+    // Links that could not be applied make the journal incomplete
+    bool complete = HASH_CNT(hh, linker->applied) + removed == applied_count + linker->added;
+    if (complete && removed == 0 && linker->added == 0) {
+        return;
+    }
+
+    linker->generation++;
+    if (!complete || linker->removed_count > LINKER_JOURNAL_SIZE) {
+        linker_journal_clear(linker);
+        linker->journal_base = linker->generation;
+    }
+}
+
+/**
+ * Add a link operation to a list.
+ * @param ops List of operations
+ * @param type Type of the operation
+ * @param target Target of the link to create, or name of the entry to hard link, NULL to delete the link
+ * @param name Name of the link
+ * @param data Data associated to the operation
+ */
+static void linker_ops_add(linker_ops_t *ops, io_batch_type_t type, char *target, char *name, void *data) {
+    if (ops->count == ops->size) {
+        ops->size = ops->size ? ops->size * 2 : 64;
+        ops->ops = realloc(ops->ops, sizeof(io_batch_op_t) * ops->size);
+    }
+
+    io_batch_op_t *op = &ops->ops[ops->count++];
+    op->type = type;
+    op->target = target;
+    op->src_dir_fd = -1;
+    op->name = name;
+    op->data = data;
+    op->result = 0;
+
+    if (type == IO_BATCH_SYMLINK) {
+        logger_debug("Create link '%s' | %s\n", target, name);
+    } else if (type == IO_BATCH_UNLINK) {
+        logger_debug("Purge: %s\n", name);
+    }
+}
+
+/**
+ * Free the targets of the link creations of a list, rebuilt from the table of paths.
+ * @param ops List of operations
+ */
+static void linker_ops_free_targets(linker_ops_t *ops) {
+    for (size_t i = 0; i < ops->count; i++) {
+        if (ops->ops[i].type == IO_BATCH_SYMLINK) {
+            free(ops->ops[i].target);
+        }
+    }
+}
+
+/**
+ * Count the operations of a list applied, in the counters of a linker.
+ * @param linker The linker
+ * @param ops List of operations, with their results
+ */
+static void linker_ops_count(linker_t *linker, linker_ops_t *ops) {
+    for (size_t i = 0; i < ops->count; i++) {
+        io_batch_op_t *op = &ops->ops[i];
+        if (op->result != 0) {
+            linker->stats.failed++;
+        } else if (op->type == IO_BATCH_SYMLINK) {
+            linker->stats.created++;
+        } else if (op->type == IO_BATCH_UNLINK) {
+            linker->stats.deleted++;
+        } else {
+            linker->stats.hard_linked++;
+        }
+    }
+}
+
+/**
+ * Apply a list of link operations to a folder, and report the failed ones.
+ * @param linker The linker
+ * @param dir_fd Folder where to apply the operations
+ * @param ops List of operations, receiving their results
+ * @return Number of successful operations
+ */
+static unsigned int linker_ops_apply(linker_t *linker, int dir_fd, linker_ops_t *ops) {
+    size_t failed = io_batch_apply(linker->batch, dir_fd, ops->ops, ops->count);
+    linker_ops_count(linker, ops);
+
+    for (size_t i = 0; failed > 0 && i < ops->count; i++) {
+        io_batch_op_t *op = &ops->ops[i];
+        if (op->result != 0 && op->type != IO_BATCH_LINK) {
+            logger_error("Linker error: cannot %s '%s': %s\n", op->type == IO_BATCH_SYMLINK ? "create link" : "purge",
+                         op->name, strerror(op->result));
+        }
+    }
+
+    return ops->count - failed;
+}
+
+/**
+ * Apply the eager link creations not applied yet, forgetting the links that could not be created.
+ * @param linker The linker
+ */
+static void linker_eager_flush(linker_t *linker) {
+    linker_ops_t *ops = &linker->eager_ops;
+    if (ops->count == 0) {
+        return;
+    }
+
+    // Failures are expected when a foreign entry has the name, they are handled by the normal update
+    uint64_t span = trace_begin();
+    size_t failed = io_batch_apply(linker->batch, linker->dir_fd, ops->ops, ops->count);
+    trace_end("linker", "link", span, linker->dst_path);
+    linker->eager_count += ops->count - failed;
+    linker->stats.created += ops->count - failed;
+
+    for (size_t i = 0; failed > 0 && i < ops->count; i++) {
+        if (ops->ops[i].result != 0) {
+            linker_link_t *link = ops->ops[i].data;
+            HASH_DEL(linker->eager, link);
+            free(link->name);
+            free(link);
+        }
+    }
+    linker_ops_free_targets(ops);
+    ops->count = 0;
+}
+
+/**
+ * Reconcile the eager links with the expected links, when the destination folder is not read.
+ * An eager link that got its final name is present and applied, the others are stale.
+ * @param linker The linker
+ * @param stale Receives the deletion of the stale eager links, their names being allocated
+ */
+static void linker_eager_reconcile(linker_t *linker, linker_ops_t *stale) {
+    linker_link_t *link, *tmp, *expected;
+
+    HASH_ITER(hh, linker->eager, link, tmp) {
+        expected = linker_link_find(linker->expected, link->target);
+        if (expected && strcmp(expected->name, link->name) == 0) {
+            expected->present = true;
+            linker_applied_add(linker, expected);
+        } else {
+            linker_ops_add(stale, IO_BATCH_UNLINK, NULL, strdup(link->name), NULL);
+        }
+    }
+}
+
+/**
+ * Create the expected links not present in the destination folder, and record them as applied.
+ * @param linker The linker
+ * @param expected Hashtable of the expected links
+ * @return Number of links created
+ */
+static unsigned int linker_create_missing(linker_t *linker, linker_link_t *expected) {
+    linker_ops_t ops = {NULL, 0, 0};
+    linker_link_t *link, *tmp;
+
+    HASH_ITER(hh, expected, link, tmp) {
+        if (!link->present) {
+            linker_dir_ensure(linker->dir_fd, &linker->dirs, link->name);
+            linker_ops_add(&ops, IO_BATCH_SYMLINK, linker_target_path(linker, link->target), link->name, link);
+        }
+    }
+
+    uint64_t span = trace_begin();
+    unsigned int created = linker_ops_apply(linker, linker->dir_fd, &ops);
+    trace_end("linker", "link", span, linker->dst_path);
+
+    for (size_t i = 0; i < ops.count; i++) {
+        if (ops.ops[i].result == 0) {
+            linker_applied_add(linker, ops.ops[i].data);
+        }
+    }
+
+    linker_ops_free_targets(&ops);
+    free(ops.ops);
+    return created;
+}
+
+/**
+ * Open the destination folder, kept opened for the next updates.
+ * @param linker The linker
+ * @return 0 if opened, 1 if error
+ */
+static int linker_open_dst(linker_t *linker) {
+    if (linker->dir_fd == -1) {
+        linker->dir_fd = io_open(AT_FDCWD, linker->dst_path);
+        if (linker->dir_fd == -1) {
+            logger_perror("Linker: error: failed to open destination folder");
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Find the links in a folder of the destination folder that are not expected, recursively.
+ * The target of each link is read and looked up in the expected links: if it is not found,
+ * or if it is expected under another name, the link is stale and must be deleted.
+ * Otherwise the expected link is marked as present.
+ * The sub-folders found are recorded as existing.
+ * @param linker The linker
+ * @param prefix Path of the folder relative to the destination folder, empty or ending with a separator
+ * @param links Hashtable of the expected links
+ * @param stale Receives the deletion of the stale links, their names being allocated
+ * @param scanned Receives the sub-folders found, parents first, their names being allocated
+ */
+static void linker_scan(linker_t *linker, char *prefix, linker_link_t *links, linker_ops_t *stale,
+                        linker_ops_t *scanned) {
+    char link_target[IO_PATH_MAX_SIZE] = "";
+    char name[IO_PATH_MAX_SIZE] = "";
+    io_dirent_t entry;
+    struct stat entry_stat;
+    linker_link_t *link;
+
+    void *dir = io_opendir(linker->dir_fd, prefix[0] ? prefix : ".");
+    if (dir == NULL) {
+        logger_perror("Linker: error: failed to read destination folder");
+        return;
+    }
+
+    while (io_readdir(dir, &entry) == 1) {
+        if ((strncmp(entry.name, ".", 2) == 0) || (strncmp(entry.name, "..", 3) == 0)) {
+            continue;
+        }
+        snprintf(name, IO_PATH_MAX_SIZE, "%s%s", prefix, entry.name);
+
+        bool is_dir = entry.type == DT_DIR;
+        if (entry.type == DT_UNKNOWN && io_stat(linker->dir_fd, name, &entry_stat, false) == 0) {
+            is_dir = S_ISDIR(entry_stat.st_mode);
+        }
+        if (is_dir) {
+            linker_dir_add(&linker->dirs, name);
+            linker_ops_add(scanned, IO_BATCH_UNLINK, NULL, strdup(name), NULL);
+            strncat(name, "/", IO_PATH_MAX_SIZE - strlen(name) - 1);
+            linker_scan(linker, name, links, stale, scanned);
+            continue;
+        }
+
+        link = NULL;
+        ssize_t target_len = io_readlink(linker->dir_fd, name, link_target, IO_PATH_MAX_SIZE - 1);
+        if (target_len >= 0) {
+            link_target[target_len] = '\0';
+            pathtab_id_t target = pathtab_find(linker->paths, link_target);
+            link = target != PATHTAB_NONE ? linker_link_find(links, target) : NULL;
+        }
+
+        if (link && !link->present && strcmp(link->name, name) == 0) {
+            link->present = true;
+            continue;
+        }
+
+        linker_ops_add(stale, IO_BATCH_UNLINK, NULL, strdup(name), NULL);
+    }
+
+    io_closedir(dir);
+}
+
+/**
+ * Compare the destination folder itself with the expected links.
+ * The applied links are replaced by the expected links present in the destination folder.
+ * @param linker The linker
+ * @param expected Hashtable of the expected links, receiving which ones are present
+ * @param stale Receives the deletion of the stale links, their names being allocated
+ * @param scanned Receives the sub-folders of the destination folder, parents first, their names being allocated
+ */
+static void linker_compare_verify(linker_t *linker, linker_link_t *expected, linker_ops_t *stale,
+                                  linker_ops_t *scanned) {
+    linker_dirs_free(linker->dirs);
+    linker->dirs = NULL;
+    linker_scan(linker, "", expected, stale, scanned);
+    linker_applied_clear(linker);
+
+    linker_link_t *link, *tmp;
+    HASH_ITER(hh, expected, link, tmp) {
+        if (link->present) {
+            linker_applied_add(linker, link);
+        }
+    }
+}
+
+/**
+ * Compare the applied links with the expected links, the destination folder is not read.
+ * The stale links are removed from the applied links.
+ * @param linker The linker
+ * @param expected Hashtable of the expected links, receiving which ones are present
+ * @param stale Receives the deletion of the stale links, their names being allocated
+ */
+static void linker_compare_delta(linker_t *linker, linker_link_t *expected, linker_ops_t *stale) {
+    linker_link_t *link, *tmp, *other;
+
+    HASH_ITER(hh, linker->applied, link, tmp) {
+        other = linker_link_find(expected, link->target);
+        if (other && strcmp(other->name, link->name) == 0) {
+            other->present = true;
+            continue;
+        }
+
+        linker_ops_add(stale, IO_BATCH_UNLINK, NULL, link->name, NULL);
+        linker_applied_remove(linker, link);
+    }
+}
+
+/**
+ * Update the destination folder in place: delete the stale links and the empty sub-folders,
+ * then create the missing links.
+ * @param linker The linker
+ * @param expected Hashtable of the expected links
+ * @param stale Deletion of the stale links
+ * @param scanned Sub-folders of the destination folder to delete if empty, parents first
+ * @return Number of links created or deleted
+ */
+static unsigned int linker_publish_inplace(linker_t *linker, linker_link_t *expected, linker_ops_t *stale,
+                                           linker_ops_t *scanned) {
+    linker_dir_t *dir;
+
+    // Deletions first, as a name may be reused by another target
+    uint64_t span = trace_begin();
+    unsigned int changes = linker_ops_apply(linker, linker->dir_fd, stale);
+
+    for (size_t i = scanned->count; i > 0; i--) {
+        char *path = scanned->ops[i - 1].name;
+        if (io_unlink(linker->dir_fd, path, true) == 0) {
+            HASH_FIND(hh, linker->dirs, path, strlen(path), dir);
+            if (dir) {
+                HASH_DEL(linker->dirs, dir);
+                free(dir->path);
+                free(dir);
             }
+        }
+    }
+    trace_end("linker", "purge", span, linker->dst_path);
+
+    return changes + linker_create_missing(linker, expected);
+}
+
+/**
+ * Delete a previous generation of the destination folder, run in a background thread.
+ * @param path Path of the previous generation, freed once deleted
+ * @return NULL
+ */
+static void *linker_teardown(void *path) {
+    if (io_directory_delete(path) != 0) {
+        logger_error("Linker error: cannot delete previous generation '%s'\n", (char *)path);
+    }
+    free(path);
+    return NULL;
+}
+
+/**
+ * Wait for the deletion of the previous generation of the destination folder, if any.
+ * @param linker The linker
+ */
+static void linker_teardown_wait(linker_t *linker) {
+    if (linker->tearing_down) {
+        pthread_join(linker->teardown, NULL);
+        linker->tearing_down = false;
+    }
+}
+
+/**
+ * Update the destination folder by building its next generation in a staging folder, then exchanging them.
+ * The links present are hard linked from the current generation, the missing ones are created.
+ * The previous generation is deleted in the background.
+ * If the folders cannot be exchanged, the destination folder is updated in place.
+ * @param linker The linker
+ * @param expected Hashtable of the expected links
+ * @param stale Deletion of the stale links
+ * @return Number of links created or deleted
+ */
+static unsigned int linker_publish_swap(linker_t *linker, linker_link_t *expected, linker_ops_t *stale) {
+    linker_ops_t no_dirs = {NULL, 0, 0};
+    linker_ops_t ops = {NULL, 0, 0};
+    linker_link_t *link, *tmp;
+    linker_dir_t *staging_dirs = NULL;
+    size_t i, missing = 0;
+
+    HASH_ITER(hh, expected, link, tmp) {
+        if (link->present) {
+            linker_ops_add(&ops, IO_BATCH_LINK, link->name, link->name, link);
+            ops.ops[ops.count - 1].src_dir_fd = linker->dir_fd;
         } else {
-            logger_debug("Don't purge: %s | %u | %u\n", link_del, linker_get_count_from_filename(link_del),
-                         linker_get_count(file, files));
+            linker_ops_add(&ops, IO_BATCH_SYMLINK, linker_target_path(linker, link->target), link->name, link);
+            missing++;
+        }
+    }
+
+    if (stale->count == 0 && missing == 0) {
+        free(ops.ops);
+        return 0;  // nothing changed
+    }
+
+    linker_teardown_wait(linker);
+    if (io_directory_exists(linker->staging_path)) {
+        io_directory_delete(linker->staging_path);  // left by an interrupted update
+    }
+    int staging_fd = -1;
+    if (io_directory_create(linker->staging_path) != 0 ||
+        (staging_fd = io_open(AT_FDCWD, linker->staging_path)) == -1) {
+        logger_error("Linker error: cannot create staging folder '%s'\n", linker->staging_path);
+        linker_ops_free_targets(&ops);
+        free(ops.ops);
+        return linker_publish_inplace(linker, expected, stale, &no_dirs);
+    }
+
+    for (i = 0; i < ops.count; i++) {
+        linker_dir_ensure(staging_fd, &staging_dirs, ops.ops[i].name);
+    }
+    linker_ops_apply(linker, staging_fd, &ops);
+
+    // Links that vanished from the current generation are created instead
+    linker_ops_t retry = {NULL, 0, 0};
+    for (i = 0; i < ops.count; i++) {
+        if (ops.ops[i].type == IO_BATCH_LINK && ops.ops[i].result != 0) {
+            link = ops.ops[i].data;
+            linker_ops_add(&retry, IO_BATCH_SYMLINK, linker_target_path(linker, link->target), link->name, link);
+            ops.ops[i].result = -1;
+        }
+    }
+    linker_ops_apply(linker, staging_fd, &retry);
+
+    if (io_rename(linker->staging_path, linker->dst_path, true) != 0) {
+        logger_perror("Linker: error: cannot exchange generations, updating in place");
+        io_close(staging_fd);
+        io_directory_delete(linker->staging_path);
+        linker_ops_free_targets(&ops);
+        linker_ops_free_targets(&retry);
+        free(ops.ops);
+        free(retry.ops);
+        linker_dirs_free(staging_dirs);
+        return linker_publish_inplace(linker, expected, stale, &no_dirs);
+    }
+
+    // The staging folder is now the destination folder, and the previous generation is at the staging path
+    io_close(linker->dir_fd);
+    linker->dir_fd = staging_fd;
+    linker_dirs_free(linker->dirs);
+    linker->dirs = staging_dirs;
+
+    char *old_path = malloc(sizeof(char) * IO_PATH_MAX_SIZE);
+    snprintf(old_path, IO_PATH_MAX_SIZE, "%s%s%u", linker->staging_path, LINKER_OLD_SUFFIX, linker->update_count);
+    if (io_rename(linker->staging_path, old_path, false) != 0) {
+        strncpy(old_path, linker->staging_path, IO_PATH_MAX_SIZE);  // deleted where it is
+    }
+    if (pthread_create(&linker->teardown, NULL, linker_teardown, old_path) == 0) {
+        linker->tearing_down = true;
+    } else {
+        linker_teardown(old_path);
+    }
+
+    // The applied links are the ones of the new generation
+    unsigned int changes = stale->count;
+    linker_applied_clear(linker);
+    for (i = 0; i < ops.count; i++) {
+        if (ops.ops[i].result == 0) {
+            linker_applied_add(linker, ops.ops[i].data);
+            changes += ops.ops[i].type == IO_BATCH_SYMLINK;
+        }
+    }
+    for (i = 0; i < retry.count; i++) {
+        if (retry.ops[i].result == 0) {
+            linker_applied_add(linker, retry.ops[i].data);
+            changes++;
         }
-        workinglink = workinglink->next;
     }
 
-    io_directory_get_all_free(links);
+    linker_ops_free_targets(&ops);
+    linker_ops_free_targets(&retry);
+    free(ops.ops);
+    free(retry.ops);
+    return changes;
 }
 
-void linker_update(char *dst_path, finder_t *files) {
-    char filename_final[IO_PATH_MAX_SIZE] = "";
-    char filepath_final[IO_PATH_MAX_SIZE] = "";
-    char real_dst_filepath[IO_PATH_MAX_SIZE] = "";
-    unsigned int dup_count = 0;
-    finder_t *file = files;
+/**
+ * Load the applied links from the state file.
+ * The state file contains, for each link, its name and its target, each terminated by a '\0'.
+ * @param linker The linker
+ */
+static void linker_state_load(linker_t *linker) {
+    FILE *state = fopen(linker->state_path, "r");
+    if (state == NULL) {
+        return;
+    }
 
-    linker_purge(dst_path, files);
+    char *name = NULL, *target = NULL;
+    size_t name_size = 0, target_size = 0;
+    while (getdelim(&name, &name_size, '\0', state) > 0 && getdelim(&target, &target_size, '\0', state) > 0) {
+        linker_link_t *link = linker_link_add(&linker->applied, pathtab_intern(linker->paths, target), strdup(name));
+        HASH_ADD_KEYPTR(hh_name, linker->applied_names, link->name, strlen(link->name), link);
+    }
 
-    while (file) {
-        logger_debug("File found '%s'\n", file->filename);
+    free(name);
+    free(target);
+    fclose(state);
+}
 
-        dup_count = linker_get_count(file, files);
-        strncpy(filename_final, basename(file->filename), IO_PATH_MAX_SIZE);
+/**
+ * Save the applied links to the state file, atomically replacing it.
+ * @param linker The linker
+ */
+static void linker_state_save(linker_t *linker) {
+    char tmp_path[IO_PATH_MAX_SIZE] = "";
+    snprintf(tmp_path, IO_PATH_MAX_SIZE, "%s%s", linker->state_path, LINKER_STATE_TMP_SUFFIX);
+
+    FILE *state = fopen(tmp_path, "w");
+    if (state == NULL) {
+        logger_perror("Linker: error: cannot write state file");
+        return;
+    }
+
+    char target[IO_PATH_MAX_SIZE];
+    linker_link_t *link, *tmp;
+    HASH_ITER(hh, linker->applied, link, tmp) {
+        size_t length = pathtab_path(linker->paths, link->target, target, IO_PATH_MAX_SIZE);
+        fwrite(link->name, sizeof(char), strlen(link->name) + 1, state);
+        fwrite(target, sizeof(char), length + 1, state);
+    }
+
+    if (fclose(state) != 0 || rename(tmp_path, linker->state_path) != 0) {
+        logger_perror("Linker: error: cannot write state file");
+    }
+}
+
+/**
+ * Rebuild the table of paths from the targets of the applied and journaled links, once it has doubled since it
+ * was last rebuilt, so that the paths of the files gone do not accumulate.
+ * @param linker The linker, between two updates
+ */
+static void linker_paths_compact(linker_t *linker) {
+    size_t count = pathtab_count(linker->paths);
+    if (count < LINKER_PATHS_MIN || count < 2 * linker->paths_base) {
+        return;
+    }
 
-        if (dup_count > 0) {
-            snprintf(filename_final, IO_PATH_MAX_SIZE, "%s.%d", basename(file->filename), dup_count);
+    pathtab_t *paths = pathtab_create();
+    char target[IO_PATH_MAX_SIZE];
+    linker_link_t *link, *tmp, *applied = NULL;
+    HASH_ITER(hh, linker->applied, link, tmp) {
+        HASH_DEL(linker->applied, link);
+        pathtab_path(linker->paths, link->target, target, IO_PATH_MAX_SIZE);
+        link->target = pathtab_intern(paths, target);
+        HASH_ADD(hh, applied, target, sizeof(pathtab_id_t), link);
+    }
+    for (size_t i = 0; i < linker->removed_count; i++) {
+        pathtab_path(linker->paths, linker->removed[i].target, target, IO_PATH_MAX_SIZE);
+        linker->removed[i].target = pathtab_intern(paths, target);
+    }
+
+    logger_debug("Linker: paths rebuilt, %zu nodes of %zu kept\n", pathtab_count(paths), count);
+    pathtab_free(linker->paths);
+    linker->paths = paths;
+    linker->applied = applied;
+    linker->paths_base = pathtab_count(paths);
+}
+
+void linker_options_init(linker_options_t *options) {
+    options->state_path = NULL;
+    options->publish = LINKER_PUBLISH_INPLACE;
+    options->layout = LINKER_LAYOUT_FLAT;
+    options->shards = 0;
+    options->search_path = "";
+}
+
+linker_t *linker_create(char *dst_path, linker_options_t *options) {
+    linker_t *linker = malloc(sizeof(linker_t));
+    linker->dst_path = dst_path;
+    linker->state_path = options->state_path;
+    linker->publish = options->publish;
+    linker->layout = options->layout;
+    linker->shards = options->shards > 0 ? options->shards : 1;
+    linker->search_path = options->search_path;
+    linker->dirs = NULL;
+    linker->expected = NULL;
+    linker->names = NULL;
+    linker->applied_names = NULL;
+    linker->new_files = NULL;
+    linker->new_count = 0;
+    linker->new_size = 0;
+    linker->delta = false;
+    linker->dropped = NULL;
+    linker->dropped_count = 0;
+    linker->dropped_size = 0;
+    linker->wanted = NULL;
+    linker->eager = NULL;
+    linker->eager_ops.ops = NULL;
+    linker->eager_ops.count = 0;
+    linker->eager_ops.size = 0;
+    linker->eager_count = 0;
+    linker->streaming = false;
+    linker->generation = 0;
+    linker->journal_base = 0;
+    linker->removed = NULL;
+    linker->removed_count = 0;
+    linker->removed_size = 0;
+    linker->added = 0;
+    linker->applied = NULL;
+    linker->paths = pathtab_create();
+    linker->update_count = 0;
+    linker->dir_fd = -1;
+    linker->batch = io_batch_create();
+    linker->tearing_down = false;
+    memset(&linker->stats, 0, sizeof(linker_stats_t));
+    pthread_mutex_init(&linker->lock, NULL);
+
+    // The staging folder is a hidden sibling, on the same file system
+    char *dst_name = strrchr(dst_path, IO_PATH_SEP);
+    int dir_len = dst_name ? dst_name - dst_path + 1 : 0;
+    linker->staging_path = malloc(sizeof(char) * IO_PATH_MAX_SIZE);
+    snprintf(linker->staging_path, IO_PATH_MAX_SIZE, "%.*s%s%s%s", dir_len, dst_path, LINKER_STAGING_PREFIX,
+             dst_path + dir_len, LINKER_STAGING_SUFFIX);
+
+    if (linker->state_path != NULL) {
+        linker_state_load(linker);
+    }
+    linker->paths_base = pathtab_count(linker->paths);
+
+    return linker;
+}
+
+/**
+ * Begin an update of the links.
+ * @param linker The linker
+ * @param streaming If the files are given while they are found, the links of new files being created right away
+ */
+static void linker_start(linker_t *linker, bool streaming) {
+    linker_open_dst(linker);
+    linker->streaming = streaming && linker->publish == LINKER_PUBLISH_INPLACE;
+    linker->delta = false;
+    linker->expected = NULL;
+    linker->names = NULL;
+    linker->new_count = 0;
+    linker->dropped_count = 0;
+    linker->wanted = NULL;
+    linker->eager = NULL;
+    linker->eager_count = 0;
+}
+
+void linker_begin(linker_t *linker) {
+    linker_start(linker, true);
+}
+
+void linker_begin_delta(linker_t *linker) {
+    linker_start(linker, false);
+    linker->delta = true;
+}
+
+/**
+ * Record a file whose link is removed by the delta update in progress.
+ * @param linker The linker
+ * @param target Path of the file, in the table of paths
+ */
+static void linker_drop(linker_t *linker, pathtab_id_t target) {
+    if (linker->dropped_count == linker->dropped_size) {
+        linker->dropped_size = linker->dropped_size ? linker->dropped_size * 2 : 64;
+        linker->dropped = realloc(linker->dropped, sizeof(pathtab_id_t) * linker->dropped_size);
+    }
+    linker->dropped[linker->dropped_count++] = target;
+}
+
+void linker_add(linker_t *linker, char *filename) {
+    linker_link_t *applied, *other;
+    linker_basename_t *wanted;
+    char name[IO_PATH_MAX_SIZE] = "";
+
+    // Only the paths added modify the table of paths, which the result set being listed reads
+    pathtab_id_t target = pathtab_find(linker->paths, filename);
+    if (target == PATHTAB_NONE) {
+        pthread_mutex_lock(&linker->lock);
+        target = pathtab_intern(linker->paths, filename);
+        pthread_mutex_unlock(&linker->lock);
+    }
+
+    // Already linked files keep their name, if still in the right folder of the layout
+    applied = linker_link_find(linker->applied, target);
+    linker_wanted_name(linker, filename, name);
+    if (applied) {
+        size_t dir_len = linker_basename(name) - name;
+        if (strncmp(applied->name, name, dir_len) == 0 && !strchr(applied->name + dir_len, IO_PATH_SEP)) {
+            if (!linker->delta) {
+                linker_expected_add(&linker->expected, &linker->names, target, strdup(applied->name))->generation =
+                    applied->generation;
+            }
+            return;
+        }
+        if (linker->delta) {
+            linker_drop(linker, target);  // linked again in the right folder
+        }
+    }
+
+    if (linker->new_count == linker->new_size) {
+        linker->new_size = linker->new_size ? linker->new_size * 2 : 64;
+        linker->new_files = realloc(linker->new_files, sizeof(pathtab_id_t) * linker->new_size);
+    }
+    linker->new_files[linker->new_count++] = target;
+
+    if (!linker->streaming) {
+        return;
+    }
+
+    // The first new file wanting a free name gets it right away
+    size_t name_len = strlen(name);
+    HASH_FIND(hh, linker->wanted, name, name_len, wanted);
+    if (wanted) {
+        return;
+    }
+    wanted = malloc(sizeof(linker_basename_t));
+    wanted->basename = strdup(name);
+    wanted->dup_count = 0;
+    HASH_ADD_KEYPTR(hh, linker->wanted, wanted->basename, name_len, wanted);
+
+    HASH_FIND(hh_name, linker->applied_names, name, name_len, other);
+    if (other || linker->dir_fd == -1) {
+        return;
+    }
+
+    linker_link_t *link = linker_link_add(&linker->eager, target, strdup(name));
+    linker_dir_ensure(linker->dir_fd, &linker->dirs, link->name);
+    linker_ops_add(&linker->eager_ops, IO_BATCH_SYMLINK, strdup(filename), link->name, link);
+    if (linker->eager_ops.count >= LINKER_EAGER_BATCH) {
+        linker_eager_flush(linker);
+    }
+}
+
+void linker_remove(linker_t *linker, char *filename) {
+    pathtab_id_t target = pathtab_find(linker->paths, filename);
+    if (target != PATHTAB_NONE) {
+        linker_drop(linker, target);
+    }
+}
+
+/**
+ * Expect the applied links kept by the delta update in progress, for a publication needing all the links.
+ * The update then goes on as one giving all the files.
+ * @param linker The linker, with the files of the update not named yet
+ */
+static void linker_delta_expect_applied(linker_t *linker) {
+    linker_link_t *link, *tmp, *expected;
+
+    HASH_ITER(hh, linker->applied, link, tmp) {
+        linker_expected_add(&linker->expected, &linker->names, link->target, strdup(link->name))->generation =
+            link->generation;
+    }
+    for (size_t i = 0; i < linker->dropped_count; i++) {
+        expected = linker_link_find(linker->expected, linker->dropped[i]);
+        if (expected) {
+            HASH_DEL(linker->expected, expected);
+            HASH_DELETE(hh_name, linker->names, expected);
+            free(expected->name);
+            free(expected);
+        }
+    }
+    linker->delta = false;
+}
+
+/**
+ * Apply the delta update in progress in place: delete the links of the files dropped, then create the links of the
+ * new files, without going through the applied links.
+ * @param linker The linker
+ * @return Number of links created or deleted
+ */
+static unsigned int linker_apply_delta(linker_t *linker) {
+    linker_ops_t stale = {NULL, 0, 0};
+    size_t applied_count = HASH_CNT(hh, linker->applied);
+    size_t removed = 0;
+    linker->added = 0;
+
+    // The names of the links deleted are free for the new files
+    for (size_t i = 0; i < linker->dropped_count; i++) {
+        linker_link_t *link = linker_link_find(linker->applied, linker->dropped[i]);
+        if (link) {
+            linker_journal_add(linker, link);
+            removed++;
+            linker_ops_add(&stale, IO_BATCH_UNLINK, NULL, link->name, NULL);
+            linker_applied_remove(linker, link);
+        }
+    }
+    linker_name_new_files(linker);
+
+    uint64_t span = trace_begin();
+    unsigned int changes = linker_ops_apply(linker, linker->dir_fd, &stale);
+    trace_end("linker", "purge", span, linker->dst_path);
+    changes += linker_create_missing(linker, linker->expected);
+    linker_journal_commit(linker, applied_count, removed);
+
+    for (size_t i = 0; i < stale.count; i++) {
+        free(stale.ops[i].name);
+    }
+    free(stale.ops);
+    return changes;
+}
+
+unsigned int linker_commit(linker_t *linker) {
+    linker_ops_t stale = {NULL, 0, 0}, scanned = {NULL, 0, 0};
+    unsigned int changes = 0;
+    size_t i;
+
+    uint64_t span = trace_begin();
+    pthread_mutex_lock(&linker->lock);
+    linker_basenames_free(linker->wanted);
+    linker->wanted = NULL;
+
+    if (linker->dir_fd != -1 && linker->delta && linker->publish == LINKER_PUBLISH_INPLACE) {
+        changes = linker_apply_delta(linker);
+        if (changes > 0 && linker->state_path != NULL) {
+            linker_state_save(linker);
+        }
+    } else if (linker->dir_fd != -1) {
+        linker_eager_flush(linker);
+        if (linker->delta) {
+            linker_delta_expect_applied(linker);
+        }
+        linker_name_new_files(linker);
+        bool verify = linker->update_count++ % LINKER_VERIFY_INTERVAL == 0;
+        size_t applied_count = HASH_CNT(hh, linker->applied);
+        size_t removed = linker_journal_removals(linker);
+        linker->added = 0;
+
+        uint64_t compare_span = trace_begin();
+        if (verify) {
+            // The eager links are found in the destination folder like the others
+            linker_compare_verify(linker, linker->expected, &stale, &scanned);
+        } else {
+            linker_compare_delta(linker, linker->expected, &stale);
+            linker_eager_reconcile(linker, &stale);
+        }
+        trace_end("linker", verify ? "verify" : "compare", compare_span, linker->dst_path);
+
+        if (linker->publish == LINKER_PUBLISH_SWAP) {
+            uint64_t swap_span = trace_begin();
+            changes = linker_publish_swap(linker, linker->expected, &stale);
+            trace_end("linker", "swap", swap_span, linker->dst_path);
+        } else {
+            changes = linker_publish_inplace(linker, linker->expected, &stale, &scanned);
         }
-        snprintf(filepath_final, IO_PATH_MAX_SIZE, "%s%c%s", dst_path, IO_PATH_SEP, filename_final);
+        changes += linker->eager_count;
+        linker_journal_commit(linker, applied_count, removed);
 
-        if (!io_link_exists(filepath_final)) {
-            logger_debug("Create link '%s' | %s | %d\n", file->filename, filename_final, dup_count);
-            realpath(file->filename, real_dst_filepath);
-            symlink(real_dst_filepath, filepath_final);
+        for (i = 0; i < stale.count; i++) {
+            free(stale.ops[i].name);
         }
+        free(stale.ops);
+        for (i = 0; i < scanned.count; i++) {
+            free(scanned.ops[i].name);
+        }
+        free(scanned.ops);
 
-        file = file->next;
+        if ((changes > 0 || verify) && linker->state_path != NULL) {
+            linker_state_save(linker);
+        }
     }
 
+    HASH_CLEAR(hh_name, linker->names);
+    linker_links_free(linker->expected);
+    linker_links_free(linker->eager);
+    linker->expected = NULL;
+    linker->eager = NULL;
+    linker->new_count = 0;
+    linker->dropped_count = 0;
+    linker->delta = false;
+    linker_paths_compact(linker);
+    pthread_mutex_unlock(&linker->lock);
+
+    trace_end("linker", "commit", span, linker->dst_path);
     logger_debug("====== ITERATION FINISHED =======\n");
+    return changes;
+}
+
+unsigned int linker_update(linker_t *linker, finder_t *files) {
+    linker_start(linker, false);
+    for (finder_t *file = files; file; file = file->next) {
+        linker_add(linker, file->filename);
+    }
+    return linker_commit(linker);
+}
+
+size_t linker_count(linker_t *linker) {
+    return HASH_CNT(hh, linker->applied);
+}
+
+unsigned long linker_generation(linker_t *linker) {
+    return linker->generation;
+}
+
+void linker_stats(linker_t *linker, linker_stats_t *stats) {
+    *stats = linker->stats;
+}
+
+bool linker_results(linker_t *linker, unsigned long since, linker_result_callback_t callback, void *data,
+                    unsigned long *generation) {
+    char target[IO_PATH_MAX_SIZE];
+    linker_link_t *link, *tmp;
+
+    pthread_mutex_lock(&linker->lock);
+    bool delta = since > 0 && since >= linker->journal_base && since <= linker->generation;
+
+    // Removals first, as a name may be reused by another target
+    for (size_t i = 0; delta && i < linker->removed_count; i++) {
+        if (linker->removed[i].generation > since) {
+            pathtab_path(linker->paths, linker->removed[i].target, target, IO_PATH_MAX_SIZE);
+            callback(false, linker->removed[i].name, target, data);
+        }
+    }
+    HASH_ITER(hh, linker->applied, link, tmp) {
+        if (!delta || link->generation > since) {
+            pathtab_path(linker->paths, link->target, target, IO_PATH_MAX_SIZE);
+            callback(true, link->name, target, data);
+        }
+    }
+    if (generation != NULL) {
+        *generation = linker->generation;
+    }
+    pthread_mutex_unlock(&linker->lock);
+
+    return delta;
+}
+
+void linker_free(linker_t *linker) {
+    linker_teardown_wait(linker);
+    free(linker->staging_path);
+    if (linker->dir_fd != -1) {
+        io_close(linker->dir_fd);
+    }
+    io_batch_free(linker->batch);
+    linker_dirs_free(linker->dirs);
+    linker_applied_clear(linker);
+    linker_journal_clear(linker);
+    pathtab_free(linker->paths);
+    free(linker->removed);
+    free(linker->new_files);
+    free(linker->dropped);
+    free(linker->eager_ops.ops);
+    pthread_mutex_destroy(&linker->lock);
+    free(linker);
 }
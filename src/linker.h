@@ -7,12 +7,42 @@
  *
  * In order to create the links, it simply take the base name of the target file
  * and create the link with this name in the destination folder.
- * But to manage duplicate, it count the number of files that has the same basename
- * in the list before the current one and if it is not 0, append the number to the name.
+ * But to manage duplicate, it appends to the name the lowest number not used by
+ * another link with the same basename. Once linked, a file keeps the name of its link
+ * as long as it is found, whatever the duplicates appearing or disappearing, and the
+ * new files are named in the order of their path: the names do not depend on the order
+ * of the list. The expected links are kept in a hashtable indexed by target path.
  *
- * To purge the destination folder, it gets all the links in it. Then, for each link,
- * it determines whether a file is no longer here by searching the target of the link in the list.
- * If it is not found, the linker deletes the link in the destination folder.
+ * The linker keeps the set of links it applied on the last update. An update compares
+ * the expected links with this set, and only creates and deletes the links that differ:
+ * when nothing changed, the destination folder is not touched at all.
+ * The set can be persisted to a state file, so that it survives the instance along with the names.
+ *
+ * Every few updates, and on the first one, the destination folder itself is verified in order to
+ * catch outside changes: it reads the target of each link in it (readlinkat) and
+ * searches it in the expected links. If it is not found, or is expected under another name,
+ * the linker deletes the link in the destination folder.
+ * The links expected but not found are then created, so an update is linear in the number
+ * of files plus the number of links.
+ *
+ * The links are created and deleted relative to the destination folder, kept opened, and the
+ * operations are submitted by large batches (io_uring when available, see io_batch_apply()).
+ *
+ * In the swap publication mode, the destination folder is not modified in place: the next generation
+ * is built in a hidden sibling staging folder, reusing the unchanged links by hard linking them,
+ * and then atomically exchanged with the destination folder (renameat2 RENAME_EXCHANGE).
+ * Readers always see a complete generation, and the previous one is deleted in the background.
+ *
+ * The links can be spread in sub-folders of the destination folder, so that no folder holds
+ * millions of entries: the hash layout puts each link in one of N sub-folders chosen by the hash
+ * of its basename, and the mirror layout reproduces the folders of the target relative to the
+ * search path. Duplicate names are then resolved per sub-folder, and the sub-folders left empty
+ * are deleted when the destination folder is verified.
+ *
+ * The files can also be given one by one while they are found (linker_begin(), linker_add(), linker_commit()).
+ * The link of a new file whose name is not wanted by any other file so far is then created right away,
+ * overlapping the search; if a file found later sorts before it for the same name, the link is replaced
+ * when the update is committed, so the names do not depend on the order of the files.
  *
  * @author Claudio Sousa, Gonzalez David
  * @file
@@ -25,10 +55,176 @@
 #include "finder.h"
 
 /**
- * Update the links in the destination folder (create new ones and purge older ones).
+ * How the updates of the destination folder are published
+ */
+typedef enum {
+    LINKER_PUBLISH_INPLACE, /**< The links are created and deleted in the destination folder */
+    LINKER_PUBLISH_SWAP     /**< A new generation of the destination folder is built and atomically swapped */
+} linker_publish_t;
+
+/**
+ * How the links are organized in the destination folder
+ */
+typedef enum {
+    LINKER_LAYOUT_FLAT,  /**< All the links are in the destination folder */
+    LINKER_LAYOUT_HASH,  /**< The links are spread in sub-folders by the hash of their basename */
+    LINKER_LAYOUT_MIRROR /**< The links are in sub-folders mirroring the folders of their target */
+} linker_layout_t;
+
+/**
+ * Options of a linker
+ * @see linker_options_init
+ */
+typedef struct linker_options_t {
+    /**
+     * File where the applied links are persisted, NULL to keep them in memory only
+     */
+    char *state_path;
+    /**
+     * How the updates are published
+     */
+    linker_publish_t publish;
+    /**
+     * How the links are organized in the destination folder
+     */
+    linker_layout_t layout;
+    /**
+     * Number of sub-folders of the hash layout
+     */
+    unsigned int shards;
+    /**
+     * Root of the target files for the mirror layout, kept by reference
+     */
+    char *search_path;
+} linker_options_t;
+
+/**
+ * Initialize the options of a linker with their default values
+ * @param options The options to initialize
+ */
+void linker_options_init(linker_options_t *options);
+
+/**
+ * Counters of the operations applied by a linker since its creation
+ */
+typedef struct linker_stats_t {
+    unsigned long created;     /**< Symbolic links created */
+    unsigned long deleted;     /**< Links deleted */
+    unsigned long hard_linked; /**< Links carried over to a new generation */
+    unsigned long failed;      /**< Operations that failed */
+} linker_stats_t;
+
+/**
+ * Receives a link of the result set
+ * @param added If the link is part of the result set, false if it was removed from it
+ * @param name Name of the link in the destination folder
+ * @param target Path of the target file, rebuilt for the callback and only valid during it
+ * @param data Data given along with the callback
+ */
+typedef void (*linker_result_callback_t)(bool added, char *name, char *target, void *data);
+
+struct linker_t;
+/**
+ * Contains the links applied to a destination folder.
+ * Can only be created by linker_create()
+ */
+typedef struct linker_t linker_t;
+
+/**
+ * Create a linker for a destination folder.
+ * If a state file is given and exists, the links it contains are loaded as the last applied ones.
  * @param dst_path Where to put the links
+ * @param options The options of the linker
+ * @return The created linker
+ */
+linker_t *linker_create(char *dst_path, linker_options_t *options);
+
+/**
+ * Begin an update of the links, the files to link are then given one by one by linker_add().
+ * @param linker The linker of the destination folder
+ */
+void linker_begin(linker_t *linker);
+
+/**
+ * Begin an update of the links only giving the files that changed: the files to link are given by linker_add(),
+ * the files to unlink by linker_remove(), and the links of the other files are kept.
+ * In the in place publication mode, the commit only deletes and creates the links of the files given.
+ * @param linker The linker of the destination folder
+ */
+void linker_begin_delta(linker_t *linker);
+
+/**
+ * Add a file to link to the update in progress.
+ * In the in place publication mode, the link of a new file is created right away if its name is free.
+ * @param linker The linker of the destination folder
+ * @param filename Path of the file, copied
+ */
+void linker_add(linker_t *linker, char *filename);
+
+/**
+ * Remove the link of a file by the delta update in progress, if it is linked.
+ * @param linker The linker of the destination folder
+ * @param filename Path of the file
+ */
+void linker_remove(linker_t *linker, char *filename);
+
+/**
+ * End the update in progress: purge the links of the files not added, or removed by a delta update, and create
+ * the missing ones.
+ * @param linker The linker of the destination folder
+ * @return Number of links created or deleted
+ */
+unsigned int linker_commit(linker_t *linker);
+
+/**
+ * Update the links in the destination folder (create new ones and purge older ones).
+ * @param linker The linker of the destination folder
  * @param files List of files to link
+ * @return Number of links created or deleted
+ */
+unsigned int linker_update(linker_t *linker, finder_t *files);
+
+/**
+ * Get the number of links applied by the last update.
+ * @param linker The linker of the destination folder
+ * @return Number of links
+ */
+size_t linker_count(linker_t *linker);
+
+/**
+ * Get the generation of the result set, incremented by each update changing the applied links.
+ * @param linker The linker of the destination folder
+ * @return The generation, 0 before the first change
+ */
+unsigned long linker_generation(linker_t *linker);
+
+/**
+ * Get the counters of the operations applied by a linker.
+ * @param linker The linker
+ * @param stats Receives the counters
+ */
+void linker_stats(linker_t *linker, linker_stats_t *stats);
+
+/**
+ * List the changes of the result set since a generation, or the whole result set if they are not known.
+ * The removed links are listed first.
+ * Can be called by another thread than the one updating the links: the result set of the last commit is listed,
+ * waiting for a commit in progress but not for the search feeding the update.
+ * @param linker The linker of the destination folder
+ * @param since Generation known by the caller, 0 for the whole result set
+ * @param callback Receives each link added or removed
+ * @param data Data given to the callback
+ * @param generation Receives the generation of the result set listed, NULL if not needed
+ * @return True if the changes were listed, false if the whole result set was
+ */
+bool linker_results(linker_t *linker, unsigned long since, linker_result_callback_t callback, void *data,
+                    unsigned long *generation);
+
+/**
+ * Free a linker, the destination folder and the state file are left untouched.
+ * Waits for the deletion of a previous generation of the destination folder, if any.
+ * @param linker The linker to free
  */
-void linker_update(char *dst_path, finder_t *files);
+void linker_free(linker_t *linker);
 
 #endif
@@ -1,14 +1,26 @@
 /**
  * Simple logger functions that allow logging of various informations and errors.
+ *
+ * In the background mode, each thread has its own ring buffer, written by the thread and read by the
+ * background thread only, so recording a message needs no lock. A message is recorded as its level,
+ * the pointer to its format and the values of its arguments, decoded from the format like printf()
+ * does. The background thread formats each conversion of the format with its value, and writes the
+ * messages of all the threads by batches. The ring of a thread that exited is freed once read.
+ *
  * @author Claudio Sousa, Gonzalez David
  * @file
  */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
 #include <unistd.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <errno.h>
 #include <string.h>
+#include <pthread.h>
 #include "logger.h"
 #include "io.h"
 
@@ -16,44 +28,690 @@
  * Maximum size of the message to display
  */
 #define LOGGER_MSG_MAX 256
+/**
+ * Size of the ring buffer of each thread, a power of two
+ */
+#define LOGGER_RING_SIZE (64 * 1024)
+/**
+ * Maximum size of a recorded message
+ */
+#define LOGGER_RECORD_MAX 1024
+/**
+ * Size of the batches written by the background thread
+ */
+#define LOGGER_BATCH_SIZE (64 * 1024)
+/**
+ * Maximum size of a conversion specification
+ */
+#define LOGGER_SPEC_MAX 32
+/**
+ * Size of the values in a record
+ */
+#define LOGGER_SLOT sizeof(uint64_t)
+
+/**
+ * Header of a recorded message, followed by the values of its arguments, each in a slot;
+ * a string takes a slot for its length, then its characters padded to a slot
+ */
+typedef struct logger_record_t {
+    uint32_t size;  /**< Size of the record with its values, a multiple of LOGGER_SLOT */
+    uint32_t level; /**< Level of the message */
+    char *fmt;      /**< Format of the message */
+} logger_record_t;
+
+/**
+ * Ring buffer of the messages of a thread
+ */
+typedef struct logger_ring_t {
+    char *data;                 /**< The records */
+    size_t head;                /**< Position of the next record to read, written by the background thread */
+    size_t tail;                /**< Position of the next record to write, written by the thread */
+    bool closed;                /**< If the thread exited */
+    struct logger_ring_t *next; /**< Next in the chain */
+} logger_ring_t;
+
+/**
+ * A conversion specification of a format
+ */
+typedef struct logger_spec_t {
+    char text[LOGGER_SPEC_MAX]; /**< The specification, the length modifier being normalized */
+    int stars;                  /**< Number of width and precision given as arguments */
+    int precision;              /**< Precision given in the specification, -1 if none */
+    char length;                /**< 0 for int, 'l' for a 64 bits integer, 'h' for char or short */
+    char conversion;            /**< The conversion character */
+    size_t consumed;            /**< Number of characters of the format */
+} logger_spec_t;
+
+/**
+ * Level of the messages logged, -1 until read from the environment
+ */
+static int g_level = -1;
+/**
+ * If the messages are written by the background thread
+ */
+static bool g_async = false;
+/**
+ * If the background thread must stop
+ */
+static bool g_stopping = false;
+/**
+ * The background thread
+ */
+static pthread_t g_thread;
+/**
+ * Protects the chain of rings
+ */
+static pthread_mutex_t g_rings_lock = PTHREAD_MUTEX_INITIALIZER;
+/**
+ * The rings of the threads
+ */
+static logger_ring_t *g_rings = NULL;
+/**
+ * If the background thread waits for messages on g_wake
+ */
+static bool g_sleeping = false;
+/**
+ * Protects the wait of the background thread
+ */
+static pthread_mutex_t g_wake_lock = PTHREAD_MUTEX_INITIALIZER;
+/**
+ * Signaled when a message is recorded while the background thread waits
+ */
+static pthread_cond_t g_wake = PTHREAD_COND_INITIALIZER;
+/**
+ * Marks the ring of a thread as closed when it exits
+ */
+static pthread_key_t g_ring_key;
+/**
+ * Creates g_ring_key once
+ */
+static pthread_once_t g_ring_key_once = PTHREAD_ONCE_INIT;
+/**
+ * The ring of the current thread
+ */
+static __thread logger_ring_t *t_ring = NULL;
+
+/**
+ * Get the level of the messages logged, reading it from the environment the first time.
+ * @return The level
+ */
+static logger_level_t logger_level(void) {
+    int level = __atomic_load_n(&g_level, __ATOMIC_RELAXED);
+    if (level == -1) {
+        logger_level_t parsed;
+        #ifdef DEBUG
+        level = LOGGER_DEBUG;
+        #else
+        level = LOGGER_INFO;
+        #endif
+        char *env = getenv(LOGGER_LEVEL_ENV);
+        if (env != NULL && logger_parse_level(env, &parsed) == 0) {
+            level = parsed;
+        }
+        __atomic_store_n(&g_level, level, __ATOMIC_RELAXED);
+    }
+    return level;
+}
+
+void logger_set_level(logger_level_t level) {
+    __atomic_store_n(&g_level, level, __ATOMIC_RELAXED);
+}
+
+int logger_parse_level(char *name, logger_level_t *level) {
+    if (strcmp(name, "debug") == 0) {
+        *level = LOGGER_DEBUG;
+    } else if (strcmp(name, "info") == 0) {
+        *level = LOGGER_INFO;
+    } else if (strcmp(name, "error") == 0) {
+        *level = LOGGER_ERROR;
+    } else {
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * Parse a conversion specification.
+ * @param fmt The format, at the character following the '%'
+ * @param spec Receives the specification
+ * @return Error indicator: 0 for OK, 1 for a conversion not supported
+ */
+static int logger_parse_spec(char *fmt, logger_spec_t *spec) {
+    char *c = fmt;
+    size_t len = 0;
+    spec->text[len++] = '%';
+    spec->stars = 0;
+    spec->precision = -1;
+    spec->length = 0;
+
+    while (*c && strchr("-+ #0", *c) && len < LOGGER_SPEC_MAX - 4) {
+        spec->text[len++] = *c++;
+    }
+    for (int part = 0; part < 2; part++) {
+        if (part == 1) {
+            if (*c != '.') {
+                break;
+            }
+            spec->text[len++] = *c++;
+            spec->precision = 0;
+        }
+        if (*c == '*') {
+            spec->stars++;
+            spec->text[len++] = *c++;
+            continue;
+        }
+        while (*c >= '0' && *c <= '9' && len < LOGGER_SPEC_MAX - 4) {
+            if (part == 1) {
+                spec->precision = spec->precision * 10 + (*c - '0');
+            }
+            spec->text[len++] = *c++;
+        }
+    }
+
+    // The integers of any length are recorded and formatted as long long
+    while (*c && strchr("hlLqjzt", *c)) {
+        spec->length = *c == 'h' ? 'h' : (*c == 'L' ? 0 : 'l');
+        c++;
+    }
+    spec->conversion = *c;
+    if (*c == '\0' || !strchr("diouxXcsp%eEfFgGaA", *c)) {
+        return 1;
+    }
+    bool integer = strchr("diouxX", *c) != NULL;
+    if (spec->length == 'l' && integer) {
+        spec->text[len++] = 'l';
+        spec->text[len++] = 'l';
+    } else if (spec->length == 'h' && integer) {
+        spec->length = 0;  // promoted to int
+    }
+    spec->text[len++] = *c++;
+    spec->text[len] = '\0';
+    spec->consumed = c - fmt;
+    return 0;
+}
+
+/**
+ * Record the arguments of a message.
+ * @param record Where to record the message, of LOGGER_RECORD_MAX
+ * @param level Level of the message
+ * @param fmt Format of the message
+ * @param args Arguments of the message
+ * @return Size of the record, 0 if the message cannot be recorded
+ */
+static size_t logger_capture(char *record, logger_level_t level, char *fmt, va_list args) {
+    logger_spec_t spec;
+    size_t size = sizeof(logger_record_t);
+    uint64_t value;
+
+    for (char *c = fmt; *c; c++) {
+        if (*c != '%') {
+            continue;
+        }
+        if (logger_parse_spec(c + 1, &spec) != 0) {
+            return 0;
+        }
+        c += spec.consumed;
+        if (size + (spec.stars + 1) * LOGGER_SLOT > LOGGER_RECORD_MAX) {
+            return 0;
+        }
+
+        for (int i = 0; i < spec.stars; i++) {
+            value = (int64_t)va_arg(args, int);
+            memcpy(record + size, &value, LOGGER_SLOT);
+            size += LOGGER_SLOT;
+        }
+
+        switch (spec.conversion) {
+            case '%':
+                continue;
+            case 'd':
+            case 'i':
+                value = spec.length == 'l' ? (uint64_t)va_arg(args, long long) : (uint64_t)(int64_t)va_arg(args, int);
+                break;
+            case 'o':
+            case 'u':
+            case 'x':
+            case 'X':
+                value = spec.length == 'l' ? va_arg(args, unsigned long long) : va_arg(args, unsigned int);
+                break;
+            case 'c':
+                value = va_arg(args, int);
+                break;
+            case 'p':
+                value = (uintptr_t)va_arg(args, void *);
+                break;
+            case 's': {
+                char *str = va_arg(args, char *);
+                str = str ? str : "(null)";
+                size_t max = spec.precision >= 0 && spec.precision < LOGGER_MSG_MAX ? spec.precision : LOGGER_MSG_MAX;
+                size_t len = strnlen(str, max);
+                size_t padded = (len + 1 + LOGGER_SLOT - 1) / LOGGER_SLOT * LOGGER_SLOT;
+                if (size + LOGGER_SLOT + padded > LOGGER_RECORD_MAX) {
+                    return 0;
+                }
+                value = len;
+                memcpy(record + size, &value, LOGGER_SLOT);
+                memcpy(record + size + LOGGER_SLOT, str, len);
+                memset(record + size + LOGGER_SLOT + len, 0, padded - len);
+                size += LOGGER_SLOT + padded;
+                continue;
+            }
+            default: {
+                double real = va_arg(args, double);
+                memcpy(&value, &real, LOGGER_SLOT);
+            }
+        }
+        memcpy(record + size, &value, LOGGER_SLOT);
+        size += LOGGER_SLOT;
+    }
+
+    logger_record_t header = {size, level, fmt};
+    memcpy(record, &header, sizeof(logger_record_t));
+    return size;
+}
+
+/**
+ * Format a recorded message.
+ * @param record The record
+ * @param msg Receives the message, of LOGGER_MSG_MAX
+ * @return Length of the message
+ */
+static size_t logger_format(char *record, char *msg) {
+    logger_record_t header;
+    logger_spec_t spec;
+    size_t len = 0, position = sizeof(logger_record_t);
+    int64_t stars[2] = {0, 0};
+    uint64_t value;
+
+    memcpy(&header, record, sizeof(logger_record_t));
+    for (char *c = header.fmt; *c && len < LOGGER_MSG_MAX - 1; c++) {
+        if (*c != '%') {
+            msg[len++] = *c;
+            continue;
+        }
+        logger_parse_spec(c + 1, &spec);
+        c += spec.consumed;
+        if (spec.conversion == '%') {
+            msg[len++] = '%';
+            continue;
+        }
+
+        for (int i = 0; i < spec.stars; i++) {
+            memcpy(&stars[i], record + position, LOGGER_SLOT);
+            position += LOGGER_SLOT;
+        }
+        memcpy(&value, record + position, LOGGER_SLOT);
+        position += LOGGER_SLOT;
+
+        char *out = msg + len;
+        size_t left = LOGGER_MSG_MAX - len;
+        int w = stars[0], p = stars[1];
+        int written;
+        #define LOGGER_FORMAT_VALUE(v)                                                                     \
+            (spec.stars == 0   ? snprintf(out, left, spec.text, v)                                        \
+             : spec.stars == 1 ? snprintf(out, left, spec.text, w, v)                                     \
+                               : snprintf(out, left, spec.text, w, p, v))
+        switch (spec.conversion) {
+            case 'd':
+            case 'i':
+                written = spec.length == 'l' ? LOGGER_FORMAT_VALUE((long long)value) : LOGGER_FORMAT_VALUE((int)value);
+                break;
+            case 'o':
+            case 'u':
+            case 'x':
+            case 'X':
+                written = spec.length == 'l' ? LOGGER_FORMAT_VALUE((unsigned long long)value)
+                                             : LOGGER_FORMAT_VALUE((unsigned int)value);
+                break;
+            case 'c':
+                written = LOGGER_FORMAT_VALUE((int)value);
+                break;
+            case 'p':
+                written = LOGGER_FORMAT_VALUE((void *)(uintptr_t)value);
+                break;
+            case 's':
+                written = LOGGER_FORMAT_VALUE(record + position);
+                position += (value + 1 + LOGGER_SLOT - 1) / LOGGER_SLOT * LOGGER_SLOT;
+                break;
+            default: {
+                double real;
+                memcpy(&real, &value, LOGGER_SLOT);
+                written = LOGGER_FORMAT_VALUE(real);
+            }
+        }
+        #undef LOGGER_FORMAT_VALUE
+        if (written > 0) {
+            len += (size_t)written < left ? (size_t)written : left - 1;
+        }
+    }
+
+    msg[len] = '\0';
+    return len;
+}
+
+/**
+ * Wake the background thread up if it waits for messages.
+ * Called after recording a message: either the background thread sees the message before waiting, or this sees it
+ * waiting (both accesses being sequentially consistent).
+ */
+static void logger_wake(void) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&g_sleeping, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&g_wake_lock);
+        pthread_cond_signal(&g_wake);
+        pthread_mutex_unlock(&g_wake_lock);
+    }
+}
+
+/**
+ * Mark the ring of an exiting thread as closed, so the background thread frees it.
+ * @param ring The ring
+ */
+static void logger_ring_close(void *ring) {
+    __atomic_store_n(&((logger_ring_t *)ring)->closed, true, __ATOMIC_RELEASE);
+    logger_wake();
+}
+
+/**
+ * Create the key marking the rings of the exiting threads.
+ */
+static void logger_ring_key_create(void) {
+    pthread_key_create(&g_ring_key, logger_ring_close);
+}
+
+/**
+ * Get the ring of the current thread, creating it on the first message.
+ * @return The ring
+ */
+static logger_ring_t *logger_ring(void) {
+    if (t_ring == NULL) {
+        pthread_once(&g_ring_key_once, logger_ring_key_create);
+        logger_ring_t *ring = malloc(sizeof(logger_ring_t));
+        ring->data = malloc(LOGGER_RING_SIZE);
+        ring->head = 0;
+        ring->tail = 0;
+        ring->closed = false;
+        pthread_mutex_lock(&g_rings_lock);
+        ring->next = g_rings;
+        g_rings = ring;
+        pthread_mutex_unlock(&g_rings_lock);
+        pthread_setspecific(g_ring_key, ring);
+        t_ring = ring;
+    }
+    return t_ring;
+}
+
+/**
+ * Copy bytes to a ring, at a position that may wrap.
+ */
+static void logger_ring_write(logger_ring_t *ring, size_t position, char *data, size_t size) {
+    size_t offset = position & (LOGGER_RING_SIZE - 1);
+    size_t first = size < LOGGER_RING_SIZE - offset ? size : LOGGER_RING_SIZE - offset;
+    memcpy(ring->data + offset, data, first);
+    memcpy(ring->data, data + first, size - first);
+}
+
+/**
+ * Copy bytes from a ring, at a position that may wrap.
+ */
+static void logger_ring_read(logger_ring_t *ring, size_t position, char *data, size_t size) {
+    size_t offset = position & (LOGGER_RING_SIZE - 1);
+    size_t first = size < LOGGER_RING_SIZE - offset ? size : LOGGER_RING_SIZE - offset;
+    memcpy(data, ring->data + offset, first);
+    memcpy(data + first, ring->data, size - first);
+}
+
+/**
+ * Record a message in the ring of the current thread.
+ * @param record The record
+ * @param size Size of the record
+ * @return True if recorded, false if the ring is full
+ */
+static bool logger_push(char *record, size_t size) {
+    logger_ring_t *ring = logger_ring();
+    size_t tail = ring->tail;
+    if (tail + size - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) > LOGGER_RING_SIZE) {
+        return false;
+    }
+    logger_ring_write(ring, tail, record, size);
+    __atomic_store_n(&ring->tail, tail + size, __ATOMIC_RELEASE);
+    logger_wake();
+    return true;
+}
+
+/**
+ * Write a whole buffer.
+ * @param fd Where to write
+ * @param data The buffer
+ * @param size Size of the buffer
+ */
+static void logger_write(int fd, char *data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written <= 0) {
+            return;
+        }
+        data += written;
+        size -= written;
+    }
+}
+
+static void logger_flush(void);
+
+/**
+ * Log a message, right away or by the background thread.
+ * @param level Level of the message
+ * @param fmt Format of the message
+ * @param args Arguments of the message
+ */
+static void logger_log(logger_level_t level, char *fmt, va_list args) {
+    if (__atomic_load_n(&g_async, __ATOMIC_ACQUIRE)) {
+        char record[LOGGER_RECORD_MAX];
+        va_list copy;
+        va_copy(copy, args);
+        size_t size = logger_capture(record, level, fmt, copy);
+        va_end(copy);
+        if (size > 0 && logger_push(record, size)) {
+            // Either logger_stop() drains the rings after this message is recorded, or this sees it stopped
+            if (!__atomic_load_n(&g_async, __ATOMIC_SEQ_CST)) {
+                logger_flush();
+            }
+            return;
+        }
+        logger_flush();  // the messages recorded before this one are written first
+    }
 
-void logger_debug(char * fmt, ...) {
-    #ifdef DEBUG
     char msg[LOGGER_MSG_MAX] = "";
+    vsnprintf(msg, LOGGER_MSG_MAX, fmt, args);
+    io_file_write_fd(level == LOGGER_ERROR ? STDERR_FILENO : STDOUT_FILENO, msg);
+}
 
+void logger_debug(char * fmt, ...) {
+    if (logger_level() > LOGGER_DEBUG) {
+        return;
+    }
     va_list argptr;
     va_start(argptr, fmt);
-    vsnprintf(msg, LOGGER_MSG_MAX, fmt, argptr);
+    logger_log(LOGGER_DEBUG, fmt, argptr);
     va_end(argptr);
-
-    io_file_write_fd(STDOUT_FILENO, msg);
-    #else
-    (void)fmt;
-    #endif
 }
 
 void logger_info(char * fmt, ...) {
-    char msg[LOGGER_MSG_MAX] = "";
-
+    if (logger_level() > LOGGER_INFO) {
+        return;
+    }
     va_list argptr;
     va_start(argptr, fmt);
-    vsnprintf(msg, LOGGER_MSG_MAX, fmt, argptr);
+    logger_log(LOGGER_INFO, fmt, argptr);
     va_end(argptr);
-
-    io_file_write_fd(STDOUT_FILENO, msg);
 }
 
 void logger_error(char * fmt, ...) {
-    char msg[LOGGER_MSG_MAX] = "";
-
     va_list argptr;
     va_start(argptr, fmt);
-    vsnprintf(msg, LOGGER_MSG_MAX, fmt, argptr);
+    logger_log(LOGGER_ERROR, fmt, argptr);
     va_end(argptr);
-
-    io_file_write_fd(STDERR_FILENO, msg);
 }
 
 void logger_perror(char * msg) {
-    perror(msg);
+    int errnum = errno;
+    logger_error("%s: %s\n", msg, strerror(errnum));
+}
+
+/**
+ * Format the messages recorded in a ring, adding them to the batches.
+ * @param ring The ring
+ * @param batches The batches of STDOUT and STDERR, of LOGGER_BATCH_SIZE
+ * @param used Bytes used in the batches
+ * @return Number of messages read
+ */
+static size_t logger_drain(logger_ring_t *ring, char *batches[2], size_t used[2]) {
+    char record[LOGGER_RECORD_MAX];
+    char msg[LOGGER_MSG_MAX];
+    logger_record_t header;
+    size_t count = 0;
+    size_t head = ring->head;
+    size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+    while (head != tail) {
+        logger_ring_read(ring, head, (char *)&header, sizeof(logger_record_t));
+        logger_ring_read(ring, head, record, header.size);
+        head += header.size;
+        __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+
+        int batch = header.level == LOGGER_ERROR;
+        size_t len = logger_format(record, msg);
+        if (used[batch] + len > LOGGER_BATCH_SIZE) {
+            logger_write(batch ? STDERR_FILENO : STDOUT_FILENO, batches[batch], used[batch]);
+            used[batch] = 0;
+        }
+        memcpy(batches[batch] + used[batch], msg, len);
+        used[batch] += len;
+        count++;
+    }
+
+    return count;
+}
+
+/**
+ * Format and write the messages recorded in all the rings, freeing the rings of the exited threads.
+ * The rings are read by a single thread at a time, holding the lock of the rings.
+ * @param batches The batches of STDOUT and STDERR, of LOGGER_BATCH_SIZE
+ * @param used Bytes used in the batches, written and emptied
+ * @return Number of messages read
+ */
+static size_t logger_drain_all(char *batches[2], size_t used[2]) {
+    size_t count = 0;
+
+    pthread_mutex_lock(&g_rings_lock);
+    for (logger_ring_t **ring = &g_rings; *ring;) {
+        // A closed ring gets no more messages: freed once read
+        bool closed = __atomic_load_n(&(*ring)->closed, __ATOMIC_ACQUIRE);
+        count += logger_drain(*ring, batches, used);
+        if (closed) {
+            logger_ring_t *next = (*ring)->next;
+            free((*ring)->data);
+            free(*ring);
+            *ring = next;
+            continue;
+        }
+        ring = &(*ring)->next;
+    }
+
+    // Written before another thread reads the rings, so the messages of a thread stay in order
+    for (int i = 0; i < 2; i++) {
+        logger_write(i ? STDERR_FILENO : STDOUT_FILENO, batches[i], used[i]);
+        used[i] = 0;
+    }
+    pthread_mutex_unlock(&g_rings_lock);
+
+    return count;
+}
+
+/**
+ * Format and write the messages recorded, from the calling thread.
+ */
+static void logger_flush(void) {
+    char *batches[2] = {malloc(LOGGER_BATCH_SIZE), malloc(LOGGER_BATCH_SIZE)};
+    size_t used[2] = {0, 0};
+    logger_drain_all(batches, used);
+    free(batches[0]);
+    free(batches[1]);
+}
+
+/**
+ * Wait until a message is recorded, a thread exits or the background thread must stop.
+ */
+static void logger_sleep(void) {
+    pthread_mutex_lock(&g_wake_lock);
+    __atomic_store_n(&g_sleeping, true, __ATOMIC_SEQ_CST);
+
+    bool pending = __atomic_load_n(&g_stopping, __ATOMIC_SEQ_CST);
+    pthread_mutex_lock(&g_rings_lock);
+    for (logger_ring_t *ring = g_rings; ring && !pending; ring = ring->next) {
+        pending = __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) != ring->head ||
+                  __atomic_load_n(&ring->closed, __ATOMIC_SEQ_CST);
+    }
+    pthread_mutex_unlock(&g_rings_lock);
+
+    if (!pending) {
+        pthread_cond_wait(&g_wake, &g_wake_lock);  // spurious wake-ups only cost a pass over the rings
+    }
+    __atomic_store_n(&g_sleeping, false, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&g_wake_lock);
+}
+
+/**
+ * Background thread: formats and writes the recorded messages until stopped.
+ * @param arg Unused
+ * @return NULL
+ */
+static void *logger_thread(void *arg) {
+    (void)arg;
+    char *batches[2] = {malloc(LOGGER_BATCH_SIZE), malloc(LOGGER_BATCH_SIZE)};
+    size_t used[2] = {0, 0};
+
+    while (true) {
+        bool stopping = __atomic_load_n(&g_stopping, __ATOMIC_ACQUIRE);
+        size_t count = logger_drain_all(batches, used);
+        if (stopping) {
+            break;
+        }
+        if (count == 0) {
+            logger_sleep();
+        }
+    }
+
+    free(batches[0]);
+    free(batches[1]);
+    return NULL;
+}
+
+int logger_start(void) {
+    if (g_async) {
+        return 0;
+    }
+    __atomic_store_n(&g_stopping, false, __ATOMIC_RELEASE);
+    if (pthread_create(&g_thread, NULL, logger_thread, NULL) != 0) {
+        return 1;
+    }
+    __atomic_store_n(&g_async, true, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void logger_stop(void) {
+    if (!g_async) {
+        return;
+    }
+    __atomic_store_n(&g_async, false, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&g_stopping, true, __ATOMIC_SEQ_CST);
+    logger_wake();
+    pthread_join(g_thread, NULL);
+
+    // Recorded by threads that saw the logger started, after the last reading of the background thread
+    logger_flush();
+}
+
+void logger_forked(void) {
+    __atomic_store_n(&g_async, false, __ATOMIC_RELEASE);
 }
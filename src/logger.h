@@ -1,5 +1,16 @@
 /**
  * Simple logger functions that allow logging of various informations and errors.
+ *
+ * The messages below the current level are dropped at the cost of a comparison; the level can be
+ * changed at runtime (logger_set_level()), its initial value being taken from the environment variable
+ * LOGGER_LEVEL_ENV, or debug when compiled with DEBUG.
+ *
+ * By default a message is formatted and written right away. Once logger_start() is called, the messages
+ * are instead recorded in a ring buffer of the calling thread, as the format and the values of its
+ * arguments (the strings being copied), and a background thread formats them and writes them by batches.
+ * A thread whose ring is full, or recording a message while the logger stops, writes the messages recorded itself
+ * before its own, so none is lost and the messages of a thread stay in order.
+ *
  * @author Claudio Sousa, Gonzalez David
  * @file
  */
@@ -8,13 +19,27 @@
 #define LOGGER_H
 
 /**
- * Log a message on STDOUT if debug mode is enabled.
+ * Environment variable giving the initial level: debug, info or error
+ */
+#define LOGGER_LEVEL_ENV "SEARCHFOLDER_LOG"
+
+/**
+ * Level of a message
+ */
+typedef enum {
+    LOGGER_DEBUG, /**< Details of the work done */
+    LOGGER_INFO,  /**< Informations for the user */
+    LOGGER_ERROR  /**< Errors */
+} logger_level_t;
+
+/**
+ * Log a message on STDOUT if debug level is enabled.
  * @param fmt Message to log with printf() format allowed
  * @param ... Format args
  */
 void logger_debug(char * fmt, ...);
 /**
- * Log a message on STDOUT.
+ * Log a message on STDOUT if info level is enabled.
  * @param fmt Message to log with printf() format allowed
  * @param ... Format args
  */
@@ -26,9 +51,40 @@ void logger_info(char * fmt, ...);
  */
 void logger_error(char * fmt, ...);
 /**
- * Log an error message on STDERR using perror (POSIX)
+ * Log an error message on STDERR followed by the description of errno, like perror (POSIX)
  * @param msg Message to log
  */
 void logger_perror(char * msg);
 
+/**
+ * Set the level of the messages logged, the ones of lower levels being dropped.
+ * @param level The lowest level logged
+ */
+void logger_set_level(logger_level_t level);
+
+/**
+ * Parse the name of a level.
+ * @param name Name of the level: debug, info or error
+ * @param level Receives the level
+ * @return Error indicator: 0 for OK, 1 for an unknown name
+ */
+int logger_parse_level(char *name, logger_level_t *level);
+
+/**
+ * Start formatting and writing the messages in a background thread.
+ * @return Error indicator: 0 for OK, 1 if the thread cannot be started
+ */
+int logger_start(void);
+
+/**
+ * Write the messages recorded and stop the background thread, the messages being written right away again.
+ */
+void logger_stop(void);
+
+/**
+ * Write the messages right away in a child process forked by a process writing them in the background,
+ * the background thread not being forked.
+ */
+void logger_forked(void);
+
 #endif
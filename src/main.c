@@ -1,25 +1,44 @@
 /**
- * Main program: deamonise, parse argument and launch the search.
+ * Main program: parse argument and hand the destination folders over to the daemon.
  * Its role is to parse command-line arguments and:
- *   - launch the parser to create the expression to validate against files;
- *   - set up the communication channel between instance;
- *   - launch the main searchfoler loop.
- * Also, it can run in two mode:
- *   - normal:    do what is above;
- *   - kill (-d): use the communication channel to stop the designated instance.
+ *   - launch the parser to check the expressions to validate against files;
+ *   - send the destination folders to the daemon, starting it if it is not running;
+ *   - query or stop the destination folders updated by the daemon.
+ * Also, it can run in several modes:
+ *   - normal:       do what is above, for one or several destination folders sharing the same search path;
+ *   - standalone:   update the destination folders in an instance of their own, as a background process;
+ *   - kill (-d):    stop the designated destination folder, hosted by the daemon or by a standalone instance;
+ *   - list (-l):    list the destination folders hosted by the daemon;
+ *   - status (-s):  same as list, with the state of their executions;
+ *   - metrics (-m): print the metrics of the daemon, in the Prometheus text format;
+ *   - query (-q):   print the result set of a destination folder hosted by the daemon, or its changes;
+ *   - log (-v):     change the level of the messages logged by the daemon.
  * @author Claudio Sousa, Gonzalez David
  * @file
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <inttypes.h>
 #include <string.h>
 #include <unistd.h>
 #include "ipc.h"
+#include "daemon.h"
 #include "parser.h"
 #include "searchfolder.h"
 #include "io.h"
 #include "logger.h"
+#include "trace.h"
+
+/**
+ * Separator between the destination folders sharing the same search path
+ */
+#define MAIN_DST_SEP "--"
+
+/**
+ * Option running the destination folders in an instance of their own
+ */
+#define MAIN_OPT_STANDALONE "--standalone"
 
 /**
  * Prints program usage.
@@ -29,8 +48,214 @@ void print_usage(char *prog_name) {
     logger_error("Error: incorrect arguments\n");
 
     logger_info("Usage");
-    logger_info("\t%s <dir_name> <search_path> [expression]\n", prog_name);
+    logger_info("\t%s [options] <dir_name> <search_path> [expression] [limit]"
+                " [-- <dir_name> [expression] [limit]]...\n", prog_name);
     logger_info("\t%s -d <dir_name>\n", prog_name);
+    logger_info("\t%s -l|-s|-m\n", prog_name);
+    logger_info("\t%s -q <dir_name> [generation]\n", prog_name);
+    logger_info("\t%s -v debug|info|error\n", prog_name);
+    logger_info("Options");
+    logger_info("\t--standalone\t\tupdate the destination folders in their own process instead of the daemon\n");
+    logger_info("\t--persist\t\tkeep the state of the destination folders to resume them after a crash\n");
+    logger_info("\t--publish=inplace|swap\tupdate the destination folders in place, or swap complete generations\n");
+    logger_info("\t--layout=flat|hash:N|mirror\tput the links in the destination folders, in N hashed sub-folders,\n");
+    logger_info("\t\t\t\tor in sub-folders mirroring the search path\n");
+    logger_info("\t--workers=N\t\tsplit the search path into N shards searched by worker processes\n");
+    logger_info("\t--interval-min=SECONDS\tshortest wait between two searches, used while links change (default 1)\n");
+    logger_info("\t--interval-max=SECONDS\tlongest wait between two searches, reached while nothing changes (default 60)\n");
+    logger_info("Limit");
+    logger_info("\t-limit N [-sort mtime|size|atime|name [asc|desc]]\tkeep the first N files, newest by default\n");
+}
+
+/**
+ * Get the number of arguments before the next destination separator.
+ * @param argv Arguments to scan
+ * @param argc Number of arguments to scan
+ * @return Number of arguments before the separator, or argc if there is none
+ */
+static int main_segment_length(char *argv[], int argc) {
+    int length = 0;
+    while (length < argc && strncmp(argv[length], MAIN_DST_SEP, 3) != 0) {
+        length++;
+    }
+    return length;
+}
+
+/**
+ * Free the expressions parsed so far.
+ * @param expressions Array of parsed expressions, may contain NULL
+ * @param count Number of expressions
+ */
+static void main_free_expressions(parser_t *expressions[], int count) {
+    for (int i = 0; i < count; i++) {
+        if (expressions[i] != NULL) {
+            parser_free(expressions[i]);
+        }
+    }
+}
+
+/**
+ * Parse the expressions of the destination folders, given after the search path.
+ * @param argc Number of arguments after the search path
+ * @param argv Arguments after the search path
+ * @param expressions Receives the expressions, NULL for the folders without one
+ * @param limits Receives the limits of the result sets, of count 0 for the folders without one
+ * @param dst_args Receives the index in argv of the other destination folders, the first one being -1
+ * @return Number of destination folders, -1 if the arguments are invalid
+ */
+static int main_parse_expressions(int argc, char *argv[], parser_t *expressions[], parser_limit_t limits[],
+                                  int dst_args[]) {
+    int count = 0;
+    int segment_start = 0;
+    while (true) {
+        int segment_length = main_segment_length(argv + segment_start, argc - segment_start);
+        // the first segment has no destination folder, it is given before the search path
+        int expression_start = segment_start + (count > 0);
+        if (count > 0 && segment_length == 0) {
+            main_free_expressions(expressions, count);
+            return -1;
+        }
+
+        dst_args[count] = count > 0 ? segment_start : -1;
+        expressions[count] = NULL;
+        size_t expression_size = segment_start + segment_length - expression_start;
+        if (parser_parse_limit(argv + expression_start, &expression_size, &limits[count])) {
+            main_free_expressions(expressions, count);
+            return -1;
+        }
+        if (expression_size > 0) {
+            expressions[count] = parser_parse(argv + expression_start, expression_size);
+            if (expressions[count] == NULL) {
+                main_free_expressions(expressions, count);
+                return -1;
+            }
+        }
+        count++;
+
+        if (segment_start + segment_length >= argc) {
+            return count;
+        }
+        segment_start += segment_length + 1;
+    }
+}
+
+/**
+ * Update the destination folders in a background instance of their own.
+ * @param options The options of the searchfolder
+ * @param dst_paths Absolute paths of the destination folders
+ * @param expressions Expressions of the destination folders
+ * @param limits Limits of the result sets of the destination folders
+ * @param count Number of destination folders
+ * @param search_path Absolute search path
+ * @return Exit code
+ */
+static int main_standalone(searchfolder_options_t *options, char *dst_paths[], parser_t *expressions[],
+                           parser_limit_t limits[], int count, char *search_path) {
+    // Fork
+    pid_t child_pid = fork();
+    if (child_pid == -1) {
+        logger_perror("Fork failed");
+        return EXIT_FAILURE;
+    } else if (child_pid != 0) {
+        return EXIT_SUCCESS;
+    }
+
+    // Start the search
+    searchfolder_t *searchfolder = searchfolder_create(dst_paths[0], search_path, expressions[0], &limits[0], options);
+    if (searchfolder == NULL) {
+        return EXIT_FAILURE;
+    }
+    // Other destination folders sharing the search path
+    for (int i = 1; i < count; i++) {
+        if (searchfolder_add(searchfolder, dst_paths[i], expressions[i], &limits[i])) {
+            searchfolder_free(searchfolder);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Setup watch
+    if (ipc_set_watch(dst_paths[0], (ipc_stop_callback)searchfolder_stop, searchfolder)) {
+        searchfolder_free(searchfolder);
+        return EXIT_FAILURE;
+    }
+    for (int i = 1; i < count; i++) {
+        if (ipc_add_watch(dst_paths[i])) {
+            searchfolder_free(searchfolder);
+            return EXIT_FAILURE;
+        }
+    }
+
+    logger_start();
+    trace_start();
+    searchfolder_start(searchfolder);
+    io_directory_delete_wait();
+    trace_stop();
+    logger_stop();
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Send a request to the daemon, starting it if it is not running.
+ * @param args The arguments of the request, the first one being the command
+ * @param count Number of arguments
+ * @return Result of the request
+ */
+static daemon_result_t main_request(char *args[], int count) {
+    daemon_result_t result = daemon_request(args, count, STDERR_FILENO);
+    if (result == DAEMON_UNREACHABLE && daemon_spawn() == 0) {
+        result = daemon_request(args, count, STDERR_FILENO);
+    }
+    return result;
+}
+
+/**
+ * Hand the destination folders over to the daemon.
+ * @param options_args The options, as given on the command line
+ * @param options_count Number of options
+ * @param dst_paths Absolute paths of the destination folders
+ * @param expressions_args Arguments after the search path
+ * @param expressions_count Number of arguments after the search path
+ * @param dst_args Index in expressions_args of the other destination folders
+ * @param count Number of destination folders
+ * @param search_path Absolute search path
+ * @return Exit code
+ */
+static int main_add(char *options_args[], int options_count, char *dst_paths[], char *expressions_args[],
+                    int expressions_count, int dst_args[], int count, char *search_path) {
+    char *args[options_count + expressions_count + 3];
+    for (int i = 0; i < count; i++) {
+        int expression_start = i == 0 ? 0 : dst_args[i] + 1;
+        int expression_end = i + 1 < count ? dst_args[i + 1] - 1 : expressions_count;
+
+        int arg_count = 0;
+        args[arg_count++] = "add";
+        for (int j = 0; j < options_count; j++) {
+            args[arg_count++] = options_args[j];
+        }
+        args[arg_count++] = dst_paths[i];
+        args[arg_count++] = search_path;
+        for (int j = expression_start; j < expression_end; j++) {
+            args[arg_count++] = expressions_args[j];
+        }
+
+        if (main_request(args, arg_count) != DAEMON_OK) {
+            logger_error("Error: cannot update destination '%s'\n", dst_paths[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Print a link of a result set, used as the callback of daemon_query().
+ * @param added If the link was added, false if removed
+ * @param name Name of the link
+ * @param target Path of the target file
+ * @param data Unused
+ */
+static void main_print_result(bool added, char *name, char *target, void *data) {
+    (void)data;
+    printf("%c\t%s\t%s\n", added ? RESULTS_ADDED : RESULTS_REMOVED, name, target);
 }
 
 /**
@@ -39,70 +264,120 @@ void print_usage(char *prog_name) {
  * @param argv Array of arguments
  */
 int main(int argc, char *argv[]) {
+    char *prog_name = argv[0];
     if (argc < 2) {
-        print_usage(argv[0]);
+        print_usage(prog_name);
         return EXIT_FAILURE;
     }
 
-    // Search mode
-    if (strncmp(argv[1], "-d", 3) != 0) {
-        char *dst_path = argv[1];
-        char *search_path = argv[2];
-        char dst_path_abs[IO_PATH_MAX_SIZE] = "";
-        char search_path_abs[IO_PATH_MAX_SIZE] = "";
-        realpath(dst_path, dst_path_abs);
-        realpath(search_path, search_path_abs);
-
-        // Fork
-        pid_t child_pid = fork();
-        if (child_pid == -1) {
-            logger_perror("Fork failed");
+    // Kill mode
+    if (strncmp(argv[1], "-d", 3) == 0) {
+        if (argc != 3) {
+            print_usage(prog_name);
             return EXIT_FAILURE;
-        } else if (child_pid != 0) {
+        }
+        char dst_path_abs[IO_PATH_MAX_SIZE] = "";
+        realpath(argv[2], dst_path_abs);
+
+        char *args[] = {"remove", dst_path_abs};
+        if (daemon_request(args, 2, -1) == DAEMON_OK) {
             return EXIT_SUCCESS;
         }
+        // not hosted by the daemon, may be a standalone instance
+        return ipc_stop_watch(dst_path_abs) ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
 
-        // Start the search
-        parser_t *expression = NULL;
-        if (argc > 3) {
-            expression = parser_parse(argv + 3, argc - 3);
-            if (expression == NULL) {
-                print_usage(argv[0]);
-                return EXIT_FAILURE;
-            }
+    // List, status and metrics modes
+    if (strncmp(argv[1], "-l", 3) == 0 || strncmp(argv[1], "-s", 3) == 0 || strncmp(argv[1], "-m", 3) == 0) {
+        char *args[] = {argv[1][1] == 'l' ? "list" : argv[1][1] == 's' ? "status" : "metrics"};
+        daemon_result_t result = daemon_request(args, 1, STDOUT_FILENO);
+        if (result == DAEMON_UNREACHABLE) {
+            logger_error("Error: the daemon is not running\n");
         }
-        searchfolder_t *searchfolder = searchfolder_create(dst_path_abs, search_path_abs, expression);
-        if (searchfolder == NULL) {
-            if (expression != NULL) {
-                parser_free(expression);
-            }
+        return result == DAEMON_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Log mode
+    if (strncmp(argv[1], "-v", 3) == 0) {
+        logger_level_t level;
+        if (argc != 3 || logger_parse_level(argv[2], &level) != 0) {
+            print_usage(prog_name);
             return EXIT_FAILURE;
         }
+        char *args[] = {"log", argv[2]};
+        daemon_result_t result = daemon_request(args, 2, STDERR_FILENO);
+        if (result == DAEMON_UNREACHABLE) {
+            logger_error("Error: the daemon is not running\n");
+        }
+        return result == DAEMON_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
 
-        // Setup watch
-        if (ipc_set_watch(dst_path_abs, (ipc_stop_callback)searchfolder_stop, searchfolder)) {
-            if (expression != NULL) {
-                parser_free(expression);
-            }
+    // Query mode
+    if (strncmp(argv[1], "-q", 3) == 0) {
+        uint64_t since = 0;
+        if (argc < 3 || argc > 4 || (argc == 4 && sscanf(argv[3], "%" SCNu64, &since) != 1)) {
+            print_usage(prog_name);
             return EXIT_FAILURE;
         }
+        char dst_path_abs[IO_PATH_MAX_SIZE] = "";
+        realpath(argv[2], dst_path_abs);
 
-        searchfolder_start(searchfolder);
+        results_header_t header;
+        daemon_result_t result = daemon_query(dst_path_abs, since, &header, main_print_result, NULL);
+        if (result != DAEMON_OK) {
+            logger_error("Error: destination '%s' is not updated by the daemon\n", dst_path_abs);
+            return EXIT_FAILURE;
+        }
+        printf("generation\t%" PRIu64 "\t%s\n", header.generation, header.flags & RESULTS_DELTA ? "delta" : "full");
+        return EXIT_SUCCESS;
+    }
 
-        if (expression != NULL)
-            parser_free(expression);
+    // Search mode
+    bool standalone = strncmp(argv[1], MAIN_OPT_STANDALONE, sizeof(MAIN_OPT_STANDALONE)) == 0;
+    char **options_args = argv + 1 + standalone;
+    searchfolder_options_t options;
+    int options_count = searchfolder_options_parse(argc - 1 - standalone, options_args, &options);
+    if (options_count == -1 || argc - 1 - standalone - options_count < 2) {
+        print_usage(prog_name);
+        return EXIT_FAILURE;
+    }
+    argv = options_args + options_count;
+    argc -= 1 + standalone + options_count;
 
+    char search_path_abs[IO_PATH_MAX_SIZE] = "";
+    if (realpath(argv[1], search_path_abs) == NULL) {
+        logger_error("Search path '%s' does not exist or is not a directory\n", argv[1]);
+        return EXIT_FAILURE;
     }
-    // Kill mode
-    else {
-        char *dst_path = argv[2];
-        char dst_path_abs[IO_PATH_MAX_SIZE] = "";
-        realpath(dst_path, dst_path_abs);
 
-        if (ipc_stop_watch(dst_path_abs)) {
-            return EXIT_FAILURE;
-        }
+    // Check the expressions before handing them over
+    char **expressions_args = argv + 2;
+    int expressions_count = argc - 2;
+    parser_t *expressions[argc];
+    parser_limit_t limits[argc];
+    int dst_args[argc];
+    int count = main_parse_expressions(expressions_count, expressions_args, expressions, limits, dst_args);
+    if (count == -1) {
+        print_usage(prog_name);
+        return EXIT_FAILURE;
     }
 
-    return EXIT_SUCCESS;
+    char dst_paths_abs[count][IO_PATH_MAX_SIZE];
+    char *dst_paths[count];
+    for (int i = 0; i < count; i++) {
+        dst_paths_abs[i][0] = '\0';
+        realpath(i == 0 ? argv[0] : expressions_args[dst_args[i]], dst_paths_abs[i]);
+        dst_paths[i] = dst_paths_abs[i];
+    }
+
+    int result;
+    if (standalone) {
+        result = main_standalone(&options, dst_paths, expressions, limits, count, search_path_abs);
+    } else {
+        result = main_add(options_args, options_count, dst_paths, expressions_args, expressions_count, dst_args,
+                          count, search_path_abs);
+    }
+
+    main_free_expressions(expressions, count);
+    return result;
 }
@@ -0,0 +1,820 @@
+/**
+ * In-memory file system, a backend of the file system operations of io.h.
+ *
+ * The entries are split into inodes, holding the attributes, and directory entries, naming an inode in a
+ * directory, so that a file can have several hard links. A directory has a single entry, its inode recording
+ * its name and its parent to build its path and resolve "..". An inode is freed once it has no entry and no
+ * descriptor left.
+ *
+ * The descriptors are indexes in a table of inodes, offset by MEMFS_FD_BASE so that they are not mistaken
+ * for system ones. The directories opened to read their entries get a copy of the entries, so that they can be
+ * read while the directory changes.
+ *
+ * @author Claudio Sousa, Gonzalez David
+ * @file
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include "memfs.h"
+#include "vendor/uthash.h"
+
+/**
+ * First descriptor of the file system
+ */
+#define MEMFS_FD_BASE 1000000
+/**
+ * Maximum number of symbolic links followed to resolve a path, as the system (ELOOP)
+ */
+#define MEMFS_MAX_LOOPS 40
+/**
+ * Device id reported for the entries
+ */
+#define MEMFS_DEVICE 0x6d656d
+/**
+ * Age of the oldest generated times, in seconds (365 days)
+ */
+#define MEMFS_MAX_AGE (365 * 24 * 3600)
+
+/**
+ * Words of the names of the generated files
+ */
+static char *MEMFS_WORDS[] = {"main", "util", "test", "report", "index", "notes", "data", "config", "image", "backup"};
+/**
+ * Extensions of the generated files
+ */
+static char *MEMFS_EXTENSIONS[] = {".c", ".h", ".txt", ".log", ".md", ".json", ".png", ".jpg", ".o", ".py", ""};
+
+struct memfs_dentry_t;
+
+/**
+ * An inode: a directory, a regular file or a symbolic link
+ */
+typedef struct memfs_inode_t {
+    ino_t ino;                       /**< Inode id */
+    mode_t mode;                     /**< Type and permissions */
+    off_t size;                      /**< Size, in bytes */
+    time_t atime;                    /**< Last access time */
+    time_t mtime;                    /**< Last modification time */
+    time_t ctime;                    /**< Last status change time */
+    unsigned int links;              /**< Number of directory entries of the inode */
+    unsigned int opened;             /**< Number of descriptors of the inode */
+    char *target;                    /**< Target of a symbolic link */
+    char *name;                      /**< Name of a directory in its parent */
+    struct memfs_inode_t *parent;    /**< Parent of a directory, itself for the root */
+    struct memfs_dentry_t *children; /**< Hashtable of the entries of a directory, by name */
+} memfs_inode_t;
+
+/**
+ * An entry of a directory
+ */
+typedef struct memfs_dentry_t {
+    char *name;           /**< Name of the entry */
+    memfs_inode_t *inode; /**< Inode of the entry */
+    UT_hash_handle hh;    /**< Makes this structure hashable */
+} memfs_dentry_t;
+
+/**
+ * A directory opened to read its entries, with a copy of them
+ */
+typedef struct memfs_dir_t {
+    size_t count;         /**< Number of entries */
+    size_t next;          /**< Index of the next entry to read */
+    io_dirent_t *entries; /**< The entries, "." and ".." first */
+} memfs_dir_t;
+
+/**
+ * The state of an in-memory file system
+ */
+typedef struct memfs_t {
+    io_backend_t backend;         /**< Operations of the backend, first so that the state is the backend */
+    pthread_mutex_t lock;         /**< Lock of the entries and of the descriptors */
+    memfs_inode_t *root;          /**< The root directory, also the current directory */
+    ino_t next_ino;               /**< Id of the next inode created */
+    memfs_inode_t **fds;          /**< Inodes of the descriptors, NULL for the free ones */
+    size_t fds_size;              /**< Size of the table of the descriptors */
+    long latency[MEMFS_OP_COUNT]; /**< Latency of each operation, in nanoseconds */
+    uid_t uid;                    /**< Owner of the entries */
+    gid_t gid;                    /**< Group of the entries */
+} memfs_t;
+
+/**
+ * Wait the latency of an operation.
+ * @param fs The file system
+ * @param op The operation
+ */
+static void memfs_wait(memfs_t *fs, memfs_op_t op) {
+    long latency = fs->latency[op];
+    if (latency > 0) {
+        struct timespec delay = {latency / 1000000000L, latency % 1000000000L};
+        while (nanosleep(&delay, &delay) != 0 && errno == EINTR) {
+        }
+    }
+}
+
+/**
+ * Create an inode.
+ * @param fs The file system
+ * @param mode Type and permissions
+ * @return The inode, without entry
+ */
+static memfs_inode_t *memfs_inode_new(memfs_t *fs, mode_t mode) {
+    memfs_inode_t *inode = calloc(1, sizeof(memfs_inode_t));
+    inode->ino = fs->next_ino++;
+    inode->mode = mode;
+    inode->atime = inode->mtime = inode->ctime = time(NULL);
+    return inode;
+}
+
+/**
+ * Free an inode if it has no entry and no descriptor left.
+ * @param inode The inode
+ */
+static void memfs_inode_release(memfs_inode_t *inode) {
+    if (inode->links == 0 && inode->opened == 0) {
+        free(inode->target);
+        free(inode->name);
+        free(inode);
+    }
+}
+
+/**
+ * Find an entry of a directory.
+ * @param dir The directory
+ * @param name Name of the entry
+ * @return The entry, NULL if not found
+ */
+static memfs_dentry_t *memfs_dentry_find(memfs_inode_t *dir, char *name) {
+    memfs_dentry_t *dentry;
+    HASH_FIND(hh, dir->children, name, strlen(name), dentry);
+    return dentry;
+}
+
+/**
+ * Add an entry to a directory, which must not have an entry of this name.
+ * @param dir The directory
+ * @param name Name of the entry, copied
+ * @param inode Inode of the entry, getting the directory as parent if it is a directory
+ */
+static void memfs_dentry_add(memfs_inode_t *dir, char *name, memfs_inode_t *inode) {
+    memfs_dentry_t *dentry = malloc(sizeof(memfs_dentry_t));
+    dentry->name = strdup(name);
+    dentry->inode = inode;
+    HASH_ADD_KEYPTR(hh, dir->children, dentry->name, strlen(dentry->name), dentry);
+    inode->links++;
+    if (S_ISDIR(inode->mode)) {
+        free(inode->name);
+        inode->name = strdup(name);
+        inode->parent = dir;
+    }
+    dir->mtime = dir->ctime = time(NULL);
+}
+
+/**
+ * Delete an entry from a directory, its inode being freed if it is not used anymore.
+ * @param dir The directory
+ * @param dentry The entry
+ * @param release If the inode is freed if not used anymore, rather than kept for another entry
+ */
+static void memfs_dentry_delete(memfs_inode_t *dir, memfs_dentry_t *dentry, bool release) {
+    HASH_DEL(dir->children, dentry);
+    dentry->inode->links--;
+    dentry->inode->ctime = dir->mtime = dir->ctime = time(NULL);
+    if (release) {
+        memfs_inode_release(dentry->inode);
+    }
+    free(dentry->name);
+    free(dentry);
+}
+
+/**
+ * Get the inode of a descriptor.
+ * @param fs The file system
+ * @param fd The descriptor, AT_FDCWD for the root
+ * @return The inode, NULL if the descriptor is not opened (errno EBADF)
+ */
+static memfs_inode_t *memfs_fd_inode(memfs_t *fs, int fd) {
+    if (fd == AT_FDCWD) {
+        return fs->root;
+    }
+    size_t index = (size_t)fd - MEMFS_FD_BASE;
+    if (fd < MEMFS_FD_BASE || index >= fs->fds_size || fs->fds[index] == NULL) {
+        errno = EBADF;
+        return NULL;
+    }
+    return fs->fds[index];
+}
+
+/**
+ * Resolve a path into an inode.
+ * @param fs The file system
+ * @param dir Directory the path is relative to, unless absolute
+ * @param path The path
+ * @param follow If the last component is followed when it is a symbolic link
+ * @param loops Number of symbolic links followed so far
+ * @param parent Receives the directory of the last entry resolved, NULL for a directory reached by "." or ".."
+ * @param name Receives the name of the last entry resolved, NULL for a directory reached by "." or ".."
+ * @return The inode, NULL if it cannot be resolved (errno ENOENT, ENOTDIR or ELOOP)
+ */
+static memfs_inode_t *memfs_resolve(memfs_t *fs, memfs_inode_t *dir, char *path, bool follow, int *loops,
+                                    memfs_inode_t **parent, char **name) {
+    char component[IO_PATH_MAX_SIZE];
+    memfs_inode_t *inode = path[0] == IO_PATH_SEP ? fs->root : dir;
+    *parent = NULL;
+    *name = NULL;
+
+    for (char *start = path; *start;) {
+        char *end = strchr(start, IO_PATH_SEP);
+        size_t length = end ? (size_t)(end - start) : strlen(start);
+        char *next = end ? end + 1 : start + length;
+        if (length == 0) {
+            start = next;
+            continue;
+        }
+        if (!S_ISDIR(inode->mode)) {
+            errno = ENOTDIR;
+            return NULL;
+        }
+        snprintf(component, IO_PATH_MAX_SIZE, "%.*s", (int)length, start);
+        start = next;
+
+        if (strcmp(component, ".") == 0 || strcmp(component, "..") == 0) {
+            inode = component[1] ? inode->parent : inode;
+            *parent = NULL;
+            *name = NULL;
+            continue;
+        }
+        memfs_dentry_t *dentry = memfs_dentry_find(inode, component);
+        if (dentry == NULL) {
+            errno = ENOENT;
+            return NULL;
+        }
+        *parent = inode;
+        *name = dentry->name;
+
+        if (S_ISLNK(dentry->inode->mode) && (follow || *start)) {
+            if (++*loops > MEMFS_MAX_LOOPS) {
+                errno = ELOOP;
+                return NULL;
+            }
+            inode = memfs_resolve(fs, inode, dentry->inode->target, true, loops, parent, name);
+            if (inode == NULL) {
+                return NULL;
+            }
+        } else {
+            inode = dentry->inode;
+        }
+    }
+    return inode;
+}
+
+/**
+ * Resolve a path into an inode, from a descriptor.
+ * @param fs The file system
+ * @param dir_fd Directory the path is relative to, AT_FDCWD for the root
+ * @param path The path
+ * @param follow If the last component is followed when it is a symbolic link
+ * @return The inode, NULL if it cannot be resolved
+ */
+static memfs_inode_t *memfs_lookup(memfs_t *fs, int dir_fd, char *path, bool follow) {
+    memfs_inode_t *dir = memfs_fd_inode(fs, dir_fd), *parent;
+    int loops = 0;
+    char *name;
+    return dir ? memfs_resolve(fs, dir, path, follow, &loops, &parent, &name) : NULL;
+}
+
+/**
+ * Resolve the directory of the last component of a path, to create, delete or rename it.
+ * @param fs The file system
+ * @param dir_fd Directory the path is relative to, AT_FDCWD for the root
+ * @param path The path
+ * @param name Receives the last component, of IO_PATH_MAX_SIZE bytes
+ * @return The directory, NULL if it cannot be resolved or if the last component is "." or ".."
+ */
+static memfs_inode_t *memfs_lookup_parent(memfs_t *fs, int dir_fd, char *path, char *name) {
+    char dir_path[IO_PATH_MAX_SIZE];
+    snprintf(dir_path, IO_PATH_MAX_SIZE, "%s", path);
+    size_t length = strlen(dir_path);
+    while (length > 1 && dir_path[length - 1] == IO_PATH_SEP) {
+        dir_path[--length] = '\0';
+    }
+
+    char *sep = strrchr(dir_path, IO_PATH_SEP);
+    snprintf(name, IO_PATH_MAX_SIZE, "%s", sep ? sep + 1 : dir_path);
+    if (sep) {
+        sep[sep == dir_path ? 1 : 0] = '\0';
+    } else {
+        strcpy(dir_path, ".");
+    }
+    if (name[0] == '\0' || strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+        errno = name[0] ? EINVAL : EEXIST;
+        return NULL;
+    }
+
+    memfs_inode_t *dir = memfs_lookup(fs, dir_fd, dir_path, true);
+    if (dir && !S_ISDIR(dir->mode)) {
+        errno = ENOTDIR;
+        return NULL;
+    }
+    return dir;
+}
+
+/**
+ * Write the absolute path of a directory.
+ * @param dir The directory
+ * @param path Receives the path, of IO_PATH_MAX_SIZE bytes
+ */
+static void memfs_path(memfs_inode_t *dir, char *path) {
+    if (dir->parent == dir) {
+        strcpy(path, "/");
+        return;
+    }
+    memfs_path(dir->parent, path);
+    size_t length = strlen(path);
+    snprintf(path + length, IO_PATH_MAX_SIZE - length, "%s%s", length > 1 ? "/" : "", dir->name);
+}
+
+/**
+ * Open a directory, for the in-memory file system.
+ */
+static int memfs_open(io_backend_t *backend, int dir_fd, char *path) {
+    memfs_t *fs = (memfs_t *)backend;
+    memfs_wait(fs, MEMFS_OP_OPEN);
+    pthread_mutex_lock(&fs->lock);
+    int fd = -1;
+    memfs_inode_t *inode = memfs_lookup(fs, dir_fd, path, true);
+    if (inode && !S_ISDIR(inode->mode)) {
+        errno = ENOTDIR;
+    } else if (inode) {
+        size_t index = 0;
+        while (index < fs->fds_size && fs->fds[index]) {
+            index++;
+        }
+        if (index == fs->fds_size) {
+            fs->fds_size = fs->fds_size ? fs->fds_size * 2 : 16;
+            fs->fds = realloc(fs->fds, fs->fds_size * sizeof(memfs_inode_t *));
+            memset(fs->fds + index, 0, (fs->fds_size - index) * sizeof(memfs_inode_t *));
+        }
+        fs->fds[index] = inode;
+        inode->opened++;
+        fd = MEMFS_FD_BASE + index;
+    }
+    pthread_mutex_unlock(&fs->lock);
+    return fd;
+}
+
+/**
+ * Close a directory, for the in-memory file system.
+ */
+static int memfs_close(io_backend_t *backend, int fd) {
+    memfs_t *fs = (memfs_t *)backend;
+    pthread_mutex_lock(&fs->lock);
+    memfs_inode_t *inode = fd == AT_FDCWD ? NULL : memfs_fd_inode(fs, fd);
+    if (inode) {
+        fs->fds[fd - MEMFS_FD_BASE] = NULL;
+        inode->opened--;
+        memfs_inode_release(inode);
+    } else {
+        errno = EBADF;
+    }
+    pthread_mutex_unlock(&fs->lock);
+    return inode ? 0 : -1;
+}
+
+/**
+ * Copy an entry read from a directory.
+ * @param entry Receives the entry
+ * @param name Name of the entry, copied
+ * @param inode Inode of the entry
+ */
+static void memfs_dirent_set(io_dirent_t *entry, char *name, memfs_inode_t *inode) {
+    entry->ino = inode->ino;
+    entry->type = IFTODT(inode->mode);
+    entry->name = strdup(name);
+}
+
+/**
+ * Open a directory to read its entries, for the in-memory file system.
+ */
+static void *memfs_opendir(io_backend_t *backend, int dir_fd, char *path) {
+    memfs_t *fs = (memfs_t *)backend;
+    memfs_wait(fs, MEMFS_OP_OPEN);
+    pthread_mutex_lock(&fs->lock);
+    memfs_dir_t *dir = NULL;
+    memfs_inode_t *inode = memfs_lookup(fs, dir_fd, path, true);
+    if (inode && !S_ISDIR(inode->mode)) {
+        errno = ENOTDIR;
+    } else if (inode) {
+        dir = malloc(sizeof(memfs_dir_t));
+        dir->count = 2 + HASH_COUNT(inode->children);
+        dir->next = 0;
+        dir->entries = malloc(dir->count * sizeof(io_dirent_t));
+        memfs_dirent_set(&dir->entries[0], ".", inode);
+        memfs_dirent_set(&dir->entries[1], "..", inode->parent);
+        size_t i = 2;
+        for (memfs_dentry_t *dentry = inode->children; dentry; dentry = dentry->hh.next) {
+            memfs_dirent_set(&dir->entries[i++], dentry->name, dentry->inode);
+        }
+        inode->atime = time(NULL);
+    }
+    pthread_mutex_unlock(&fs->lock);
+    return dir;
+}
+
+/**
+ * Read the next entry of a directory, for the in-memory file system.
+ */
+static int memfs_readdir(io_backend_t *backend, void *dir, io_dirent_t *entry) {
+    memfs_dir_t *memfs_dir = dir;
+    if (memfs_dir->next == memfs_dir->count) {
+        return 0;
+    }
+    memfs_wait((memfs_t *)backend, MEMFS_OP_READDIR);
+    *entry = memfs_dir->entries[memfs_dir->next++];
+    return 1;
+}
+
+/**
+ * Close a directory opened to read its entries, for the in-memory file system.
+ */
+static void memfs_closedir(io_backend_t *backend, void *dir) {
+    (void)backend;
+    memfs_dir_t *memfs_dir = dir;
+    for (size_t i = 0; i < memfs_dir->count; i++) {
+        free(memfs_dir->entries[i].name);
+    }
+    free(memfs_dir->entries);
+    free(memfs_dir);
+}
+
+/**
+ * Get the attributes of an entry, for the in-memory file system.
+ */
+static int memfs_stat(io_backend_t *backend, int dir_fd, char *path, struct stat *entry_stat, bool follow) {
+    memfs_t *fs = (memfs_t *)backend;
+    memfs_wait(fs, MEMFS_OP_STAT);
+    pthread_mutex_lock(&fs->lock);
+    memfs_inode_t *inode = memfs_lookup(fs, dir_fd, path, follow);
+    if (inode) {
+        memset(entry_stat, 0, sizeof(struct stat));
+        entry_stat->st_dev = MEMFS_DEVICE;
+        entry_stat->st_ino = inode->ino;
+        entry_stat->st_mode = inode->mode;
+        entry_stat->st_nlink = S_ISDIR(inode->mode) ? 2 : inode->links;
+        entry_stat->st_uid = fs->uid;
+        entry_stat->st_gid = fs->gid;
+        entry_stat->st_size = inode->size;
+        entry_stat->st_blksize = 4096;
+        entry_stat->st_blocks = (inode->size + 511) / 512;
+        entry_stat->st_atime = inode->atime;
+        entry_stat->st_mtime = inode->mtime;
+        entry_stat->st_ctime = inode->ctime;
+    }
+    pthread_mutex_unlock(&fs->lock);
+    return inode ? 0 : -1;
+}
+
+/**
+ * Resolve a path, for the in-memory file system.
+ */
+static char *memfs_realpath(io_backend_t *backend, char *path, char *resolved) {
+    memfs_t *fs = (memfs_t *)backend;
+    memfs_wait(fs, MEMFS_OP_REALPATH);
+    pthread_mutex_lock(&fs->lock);
+    memfs_inode_t *parent;
+    char *name;
+    int loops = 0;
+    memfs_inode_t *inode = memfs_resolve(fs, fs->root, path, true, &loops, &parent, &name);
+    if (inode && S_ISDIR(inode->mode)) {
+        memfs_path(inode, resolved);
+    } else if (inode) {
+        memfs_path(parent, resolved);
+        size_t length = strlen(resolved);
+        snprintf(resolved + length, IO_PATH_MAX_SIZE - length, "%s%s", length > 1 ? "/" : "", name);
+    }
+    pthread_mutex_unlock(&fs->lock);
+    return inode ? resolved : NULL;
+}
+
+/**
+ * Read the target of a symbolic link, for the in-memory file system.
+ */
+static ssize_t memfs_readlink(io_backend_t *backend, int dir_fd, char *path, char *buffer, size_t size) {
+    memfs_t *fs = (memfs_t *)backend;
+    memfs_wait(fs, MEMFS_OP_READLINK);
+    pthread_mutex_lock(&fs->lock);
+    ssize_t length = -1;
+    memfs_inode_t *inode = memfs_lookup(fs, dir_fd, path, false);
+    if (inode && !S_ISLNK(inode->mode)) {
+        errno = EINVAL;
+    } else if (inode) {
+        length = strlen(inode->target);
+        length = (size_t)length < size ? length : (ssize_t)size;
+        memcpy(buffer, inode->target, length);
+    }
+    pthread_mutex_unlock(&fs->lock);
+    return length;
+}
+
+/**
+ * Add an inode to a directory, under a name not used yet.
+ * @param fs The file system
+ * @param dir_fd Directory the path is relative to
+ * @param path Path of the new entry
+ * @param inode The inode, freed if not added
+ * @return 0 if added, -1 if error
+ */
+static int memfs_create_entry(memfs_t *fs, int dir_fd, char *path, memfs_inode_t *inode) {
+    char name[IO_PATH_MAX_SIZE];
+    memfs_inode_t *dir = memfs_lookup_parent(fs, dir_fd, path, name);
+    if (dir && memfs_dentry_find(dir, name)) {
+        errno = EEXIST;
+        dir = NULL;
+    }
+    if (dir == NULL) {
+        memfs_inode_release(inode);
+        return -1;
+    }
+    memfs_dentry_add(dir, name, inode);
+    return 0;
+}
+
+/**
+ * Create a symbolic link, for the in-memory file system.
+ */
+static int memfs_symlink(io_backend_t *backend, char *target, int dir_fd, char *name) {
+    memfs_t *fs = (memfs_t *)backend;
+    memfs_wait(fs, MEMFS_OP_WRITE);
+    pthread_mutex_lock(&fs->lock);
+    memfs_inode_t *inode = memfs_inode_new(fs, S_IFLNK | 0777);
+    inode->target = strdup(target);
+    inode->size = strlen(target);
+    int res = memfs_create_entry(fs, dir_fd, name, inode);
+    pthread_mutex_unlock(&fs->lock);
+    return res;
+}
+
+/**
+ * Create a hard link, for the in-memory file system.
+ */
+static int memfs_link(io_backend_t *backend, int src_dir_fd, char *src, int dir_fd, char *name) {
+    memfs_t *fs = (memfs_t *)backend;
+    memfs_wait(fs, MEMFS_OP_WRITE);
+    pthread_mutex_lock(&fs->lock);
+    int res = -1;
+    memfs_inode_t *inode = memfs_lookup(fs, src_dir_fd, src, false);
+    if (inode && S_ISDIR(inode->mode)) {
+        errno = EPERM;
+    } else if (inode) {
+        // Held while added, not to be freed if the name is taken
+        inode->opened++;
+        res = memfs_create_entry(fs, dir_fd, name, inode);
+        inode->opened--;
+        inode->ctime = time(NULL);
+    }
+    pthread_mutex_unlock(&fs->lock);
+    return res;
+}
+
+/**
+ * Delete an entry, for the in-memory file system.
+ */
+static int memfs_unlink(io_backend_t *backend, int dir_fd, char *path, bool directory) {
+    memfs_t *fs = (memfs_t *)backend;
+    memfs_wait(fs, MEMFS_OP_WRITE);
+    pthread_mutex_lock(&fs->lock);
+    char name[IO_PATH_MAX_SIZE];
+    memfs_dentry_t *dentry = NULL;
+    memfs_inode_t *dir = memfs_lookup_parent(fs, dir_fd, path, name);
+    if (dir && (dentry = memfs_dentry_find(dir, name)) == NULL) {
+        errno = ENOENT;
+    } else if (dentry && directory != (bool)S_ISDIR(dentry->inode->mode)) {
+        errno = directory ? ENOTDIR : EISDIR;
+        dentry = NULL;
+    } else if (dentry && dentry->inode->children) {
+        errno = ENOTEMPTY;
+        dentry = NULL;
+    }
+    if (dentry) {
+        memfs_dentry_delete(dir, dentry, true);
+    }
+    pthread_mutex_unlock(&fs->lock);
+    return dentry ? 0 : -1;
+}
+
+/**
+ * Create a directory, for the in-memory file system.
+ */
+static int memfs_mkdir(io_backend_t *backend, int dir_fd, char *path, mode_t mode) {
+    memfs_t *fs = (memfs_t *)backend;
+    memfs_wait(fs, MEMFS_OP_WRITE);
+    pthread_mutex_lock(&fs->lock);
+    int res = memfs_create_entry(fs, dir_fd, path, memfs_inode_new(fs, S_IFDIR | (mode & 07777)));
+    pthread_mutex_unlock(&fs->lock);
+    return res;
+}
+
+/**
+ * Check that a directory is not moved below itself.
+ * @param inode The inode moved
+ * @param dir Its new directory
+ * @return True if the inode is a directory and an ancestor of `dir`, or `dir` itself
+ */
+static bool memfs_is_ancestor(memfs_inode_t *inode, memfs_inode_t *dir) {
+    for (; S_ISDIR(inode->mode); dir = dir->parent) {
+        if (dir == inode) {
+            return true;
+        }
+        if (dir->parent == dir) {
+            break;
+        }
+    }
+    return false;
+}
+
+/**
+ * Rename or exchange entries, for the in-memory file system.
+ */
+static int memfs_rename(io_backend_t *backend, char *from, char *to, bool exchange) {
+    memfs_t *fs = (memfs_t *)backend;
+    memfs_wait(fs, MEMFS_OP_WRITE);
+    pthread_mutex_lock(&fs->lock);
+    char from_name[IO_PATH_MAX_SIZE], to_name[IO_PATH_MAX_SIZE];
+    memfs_dentry_t *source = NULL, *dest = NULL;
+    memfs_inode_t *from_dir = memfs_lookup_parent(fs, AT_FDCWD, from, from_name);
+    memfs_inode_t *to_dir = from_dir ? memfs_lookup_parent(fs, AT_FDCWD, to, to_name) : NULL;
+    int res = -1;
+
+    if (to_dir && (source = memfs_dentry_find(from_dir, from_name)) == NULL) {
+        errno = ENOENT;
+    } else if (source) {
+        dest = memfs_dentry_find(to_dir, to_name);
+        memfs_inode_t *moved = source->inode, *replaced = dest ? dest->inode : NULL;
+        if (exchange && dest == NULL) {
+            errno = ENOENT;
+        } else if (memfs_is_ancestor(moved, to_dir) || (exchange && memfs_is_ancestor(replaced, from_dir))) {
+            errno = EINVAL;
+        } else if (!exchange && replaced && S_ISDIR(moved->mode) != S_ISDIR(replaced->mode)) {
+            errno = S_ISDIR(moved->mode) ? ENOTDIR : EISDIR;
+        } else if (!exchange && replaced && replaced->children) {
+            errno = ENOTEMPTY;
+        } else if (moved == replaced) {
+            res = 0;  // the same entry, or two hard links of the same file
+        } else {
+            memfs_dentry_delete(from_dir, source, false);
+            if (dest) {
+                memfs_dentry_delete(to_dir, dest, !exchange);
+            }
+            memfs_dentry_add(to_dir, to_name, moved);
+            if (exchange) {
+                memfs_dentry_add(from_dir, from_name, replaced);
+            }
+            res = 0;
+        }
+    }
+    pthread_mutex_unlock(&fs->lock);
+    return res;
+}
+
+/**
+ * Operations of the in-memory file systems
+ */
+static const io_backend_t g_memfs_backend = {"memfs",        memfs_open,     memfs_close,    memfs_opendir,
+                                             memfs_readdir,  memfs_closedir, memfs_stat,     memfs_realpath,
+                                             memfs_readlink, memfs_symlink,  memfs_link,     memfs_unlink,
+                                             memfs_mkdir,    memfs_rename};
+
+io_backend_t *memfs_create(void) {
+    memfs_t *fs = calloc(1, sizeof(memfs_t));
+    fs->backend = g_memfs_backend;
+    pthread_mutex_init(&fs->lock, NULL);
+    fs->next_ino = 2;
+    fs->uid = getuid();
+    fs->gid = getgid();
+    fs->root = memfs_inode_new(fs, S_IFDIR | 0755);
+    fs->root->parent = fs->root;
+    fs->root->links = 1;
+    return &fs->backend;
+}
+
+/**
+ * Get the next deterministic random number (xorshift64*).
+ * @param state State of the generator, never 0
+ * @return The number
+ */
+static uint64_t memfs_random(uint64_t *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * Generate a directory of a synthetic tree and its descendants.
+ * @param fs The file system
+ * @param dir The directory, already added
+ * @param tree Shape of the tree
+ * @param depth Number of levels of directories below this one
+ * @param random State of the random generator
+ * @param now Time of the generation
+ * @return Number of files generated
+ */
+static long memfs_generate_dir(memfs_t *fs, memfs_inode_t *dir, memfs_tree_t *tree, unsigned int depth,
+                               uint64_t *random, time_t now) {
+    char name[IO_PATH_MAX_SIZE];
+    size_t word_count = sizeof(MEMFS_WORDS) / sizeof(MEMFS_WORDS[0]);
+    size_t extension_count = sizeof(MEMFS_EXTENSIONS) / sizeof(MEMFS_EXTENSIONS[0]);
+
+    for (unsigned int k = 0; k < tree->files; k++) {
+        snprintf(name, IO_PATH_MAX_SIZE, "f%u_%s%s", k, MEMFS_WORDS[memfs_random(random) % word_count],
+                 MEMFS_EXTENSIONS[memfs_random(random) % extension_count]);
+        memfs_inode_t *file = memfs_inode_new(fs, S_IFREG | 0644);
+        file->size = tree->max_size > 0 ? (off_t)(memfs_random(random) % (tree->max_size + 1)) : 0;
+        file->mtime = file->ctime = now - (time_t)(memfs_random(random) % MEMFS_MAX_AGE);
+        file->atime = file->mtime + (time_t)(memfs_random(random) % (now - file->mtime + 1));
+        memfs_dentry_add(dir, name, file);
+    }
+
+    long count = tree->files;
+    for (unsigned int k = 0; depth > 0 && k < tree->fanout; k++) {
+        snprintf(name, IO_PATH_MAX_SIZE, "d%u", k);
+        memfs_inode_t *sub_dir = memfs_inode_new(fs, S_IFDIR | 0755);
+        memfs_dentry_add(dir, name, sub_dir);
+        count += memfs_generate_dir(fs, sub_dir, tree, depth - 1, random, now);
+    }
+    return count;
+}
+
+long memfs_generate(io_backend_t *backend, char *path, memfs_tree_t *tree) {
+    memfs_t *fs = (memfs_t *)backend;
+    char dir_path[IO_PATH_MAX_SIZE];
+    snprintf(dir_path, IO_PATH_MAX_SIZE, "%s", path);
+
+    // The parents are created as needed, the root of the tree must be new
+    for (char *sep = strchr(dir_path + 1, IO_PATH_SEP); sep; sep = strchr(sep + 1, IO_PATH_SEP)) {
+        *sep = '\0';
+        int res = memfs_mkdir(backend, AT_FDCWD, dir_path, 0755);
+        *sep = IO_PATH_SEP;
+        if (res != 0 && errno != EEXIST) {
+            return -1;
+        }
+    }
+    if (memfs_mkdir(backend, AT_FDCWD, dir_path, 0755) != 0) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&fs->lock);
+    uint64_t random = tree->seed ? tree->seed : 1;
+    memfs_inode_t *root = memfs_lookup(fs, AT_FDCWD, dir_path, true);
+    long count = memfs_generate_dir(fs, root, tree, tree->depth, &random, time(NULL));
+    pthread_mutex_unlock(&fs->lock);
+    return count;
+}
+
+void memfs_set_latency(io_backend_t *backend, memfs_op_t op, long nanoseconds) {
+    ((memfs_t *)backend)->latency[op] = nanoseconds;
+}
+
+/**
+ * Free a directory and its descendants, whatever their descriptors.
+ * @param dir The directory
+ */
+static void memfs_free_dir(memfs_inode_t *dir) {
+    memfs_dentry_t *dentry, *tmp;
+    HASH_ITER(hh, dir->children, dentry, tmp) {
+        memfs_inode_t *inode = dentry->inode;
+        HASH_DEL(dir->children, dentry);
+        free(dentry->name);
+        free(dentry);
+        if (S_ISDIR(inode->mode)) {
+            memfs_free_dir(inode);
+        } else if (--inode->links == 0) {
+            free(inode->target);
+            free(inode);
+        }
+    }
+    free(dir->name);
+    free(dir);
+}
+
+void memfs_free(io_backend_t *backend) {
+    memfs_t *fs = (memfs_t *)backend;
+    // The deleted entries still opened are only reachable from their descriptors
+    for (size_t i = 0; i < fs->fds_size; i++) {
+        if (fs->fds[i]) {
+            fs->fds[i]->opened--;
+            memfs_inode_release(fs->fds[i]);
+        }
+    }
+    memfs_free_dir(fs->root);
+    free(fs->fds);
+    pthread_mutex_destroy(&fs->lock);
+    free(fs);
+}
@@ -0,0 +1,78 @@
+/**
+ * In-memory file system, a backend of the file system operations of io.h.
+ *
+ * It holds a tree of directories, regular files (without contents), symbolic links and hard links, rooted at
+ * "/" and also used as the current directory. Synthetic trees can be generated in it, deterministic for a seed,
+ * to run the traversals and the updates of the destination folders without a disk. Each operation can be
+ * slowed down by a latency, to reproduce a slow or remote file system.
+ *
+ * The tree is shared by all the threads, behind a lock. The latency is waited before taking the lock, so that
+ * the operations of several threads overlap as on a remote file system.
+ *
+ * @author Claudio Sousa, Gonzalez David
+ * @file
+ */
+
+#ifndef MEMFS_H
+#define MEMFS_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "io.h"
+
+/**
+ * Operations slowed down by a latency
+ */
+typedef enum memfs_op_t {
+    MEMFS_OP_OPEN,     /**< Opening a directory, by `open` or `opendir` */
+    MEMFS_OP_READDIR,  /**< Reading an entry of a directory */
+    MEMFS_OP_STAT,     /**< Getting the attributes of an entry */
+    MEMFS_OP_REALPATH, /**< Resolving a path */
+    MEMFS_OP_READLINK, /**< Reading the target of a symbolic link */
+    MEMFS_OP_WRITE,    /**< Creating, deleting or renaming an entry */
+    MEMFS_OP_COUNT     /**< Number of operations */
+} memfs_op_t;
+
+/**
+ * Shape of a synthetic tree
+ */
+typedef struct memfs_tree_t {
+    unsigned int depth;  /**< Number of levels of directories below the root of the tree */
+    unsigned int fanout; /**< Number of sub-directories of each directory above the last level */
+    unsigned int files;  /**< Number of files of each directory */
+    uint64_t seed;       /**< Seed of the names, sizes and times of the files */
+    off_t max_size;      /**< Maximum size of the files, in bytes */
+} memfs_tree_t;
+
+/**
+ * Create an in-memory file system, only holding its root directory.
+ * @return The backend of the file system, to give to io_backend_set()
+ */
+io_backend_t *memfs_create(void);
+
+/**
+ * Generate a synthetic tree. Its directories are named "d<k>" and its files "f<k>_<word><extension>",
+ * k counting from 0 in each directory. The sizes are uniform up to the maximum size, and the times spread
+ * over the last year.
+ * @param backend The file system
+ * @param path Absolute path of the root of the tree, created with its parents, which must not exist
+ * @param tree Shape of the tree
+ * @return Number of files generated, -1 if the root cannot be created
+ */
+long memfs_generate(io_backend_t *backend, char *path, memfs_tree_t *tree);
+
+/**
+ * Set the latency of an operation, 0 by default.
+ * @param backend The file system
+ * @param op The operation
+ * @param nanoseconds The latency, in nanoseconds
+ */
+void memfs_set_latency(io_backend_t *backend, memfs_op_t op, long nanoseconds);
+
+/**
+ * Free an in-memory file system, with its entries. It must not be the backend in use anymore.
+ * @param backend The file system
+ */
+void memfs_free(io_backend_t *backend);
+
+#endif
@@ -0,0 +1,215 @@
+/**
+ * Counters and histograms of the searches, written in the Prometheus text exposition format.
+ *
+ * @author Claudio Sousa, Gonzalez David
+ * @file
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include "metrics.h"
+#include "ipc.h"
+#include "vendor/uthash.h"
+
+/**
+ * Upper bounds of the buckets of the histograms, in microseconds
+ */
+static const uint64_t METRICS_BOUNDS[METRICS_BUCKET_COUNT] = {1000,   10000,   100000,  500000,
+                                                              1000000, 5000000, 10000000, 60000000};
+/**
+ * Upper bounds of the buckets of the histograms, as written in the `le` label
+ */
+static char *METRICS_BOUNDS_LABELS[METRICS_BUCKET_COUNT] = {"0.001", "0.01", "0.1", "0.5", "1", "5", "10", "60"};
+/**
+ * Names of the phases, in the order of metrics_phase_t
+ */
+static char *METRICS_PHASES[METRICS_PHASE_COUNT] = {"scan", "commit", "publish", "execution"};
+
+/**
+ * Hashtable entry of a metric, with its samples collected so far
+ */
+typedef struct metrics_family_t {
+    char *name;        /**< Name of the metric (key) */
+    char *help;        /**< Description of the metric */
+    char *type;        /**< Type of the metric, as written in the TYPE line */
+    char *samples;     /**< Lines of the samples */
+    size_t used;       /**< Bytes used in `samples` */
+    size_t size;       /**< Allocated bytes of `samples` */
+    UT_hash_handle hh; /**< Makes this structure hashable */
+} metrics_family_t;
+
+/**
+ * Collects samples grouped by metric
+ */
+struct metrics_writer_t {
+    metrics_family_t *families; /**< Hashtable of the metrics, iterated in the order they were added */
+};
+
+uint64_t metrics_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+void metrics_add(uint64_t *value, uint64_t delta) {
+    __atomic_fetch_add(value, delta, __ATOMIC_RELAXED);
+}
+
+void metrics_set(uint64_t *value, uint64_t new_value) {
+    __atomic_store_n(value, new_value, __ATOMIC_RELAXED);
+}
+
+uint64_t metrics_get(uint64_t *value) {
+    return __atomic_load_n(value, __ATOMIC_RELAXED);
+}
+
+void metrics_observe(metrics_t *metrics, metrics_phase_t phase, uint64_t duration) {
+    metrics_histogram_t *histogram = &metrics->phases[phase];
+    int bucket = 0;
+    while (bucket < METRICS_BUCKET_COUNT && duration > METRICS_BOUNDS[bucket]) {
+        bucket++;
+    }
+    metrics_add(&histogram->buckets[bucket], 1);
+    metrics_add(&histogram->sum, duration);
+}
+
+char *metrics_phase_name(metrics_phase_t phase) {
+    return METRICS_PHASES[phase];
+}
+
+metrics_writer_t *metrics_writer_create(void) {
+    metrics_writer_t *writer = malloc(sizeof(metrics_writer_t));
+    writer->families = NULL;
+    return writer;
+}
+
+/**
+ * Append formatted text to the samples of a metric.
+ * @param family The metric
+ * @param fmt Text to append with printf() format allowed
+ * @param ... Format args
+ */
+static void metrics_append(metrics_family_t *family, char *fmt, ...) {
+    va_list args;
+    for (;;) {
+        va_start(args, fmt);
+        int length = vsnprintf(family->samples + family->used, family->size - family->used, fmt, args);
+        va_end(args);
+        if (length < 0) {
+            return;
+        }
+        if ((size_t)length < family->size - family->used) {
+            family->used += length;
+            return;
+        }
+        family->size = (family->used + length + 1) * 2;
+        family->samples = realloc(family->samples, family->size);
+    }
+}
+
+/**
+ * Append labels to the samples of a metric, with their values escaped.
+ * @param family The metric
+ * @param labels Names and values of the labels, alternated, terminated by NULL
+ * @param le Value of the `le` label of a histogram bucket, NULL if none
+ */
+static void metrics_append_labels(metrics_family_t *family, char **labels, char *le) {
+    char separator = '{';
+    for (; labels && labels[0]; labels += 2) {
+        metrics_append(family, "%c%s=\"", separator, labels[0]);
+        for (char *c = labels[1]; *c; c++) {
+            if (*c == '\\' || *c == '"') {
+                metrics_append(family, "\\%c", *c);
+            } else if (*c == '\n') {
+                metrics_append(family, "\\n");
+            } else {
+                metrics_append(family, "%c", *c);
+            }
+        }
+        metrics_append(family, "\"");
+        separator = ',';
+    }
+    if (le) {
+        metrics_append(family, "%cle=\"%s\"", separator, le);
+        separator = ',';
+    }
+    if (separator == ',') {
+        metrics_append(family, "}");
+    }
+}
+
+/**
+ * Find a metric, adding it if it has no samples yet.
+ * @param writer The writer
+ * @param name Name of the metric
+ * @param help Description of the metric
+ * @param type Type of the metric, as written in the TYPE line
+ * @return The metric
+ */
+static metrics_family_t *metrics_family(metrics_writer_t *writer, char *name, char *help, char *type) {
+    metrics_family_t *family;
+    HASH_FIND_STR(writer->families, name, family);
+    if (family == NULL) {
+        family = malloc(sizeof(metrics_family_t));
+        family->name = name;
+        family->help = help;
+        family->type = type;
+        family->size = 256;
+        family->samples = malloc(family->size);
+        family->used = 0;
+        HASH_ADD_KEYPTR(hh, writer->families, name, strlen(name), family);
+    }
+    return family;
+}
+
+void metrics_writer_value(metrics_writer_t *writer, metrics_type_t type, char *name, char *help, char **labels,
+                          double value) {
+    metrics_family_t *family = metrics_family(writer, name, help, type == METRICS_COUNTER ? "counter" : "gauge");
+    metrics_append(family, "%s", name);
+    metrics_append_labels(family, labels, NULL);
+    metrics_append(family, " %.15g\n", value);
+}
+
+void metrics_writer_histogram(metrics_writer_t *writer, char *name, char *help, char **labels,
+                              metrics_histogram_t *histogram) {
+    metrics_family_t *family = metrics_family(writer, name, help, "histogram");
+    uint64_t cumulated = 0;
+
+    for (int i = 0; i <= METRICS_BUCKET_COUNT; i++) {
+        cumulated += metrics_get(&histogram->buckets[i]);
+        metrics_append(family, "%s_bucket", name);
+        metrics_append_labels(family, labels, i < METRICS_BUCKET_COUNT ? METRICS_BOUNDS_LABELS[i] : "+Inf");
+        metrics_append(family, " %llu\n", (unsigned long long)cumulated);
+    }
+
+    // The count is the +Inf bucket, so both agree even while a duration is being recorded
+    metrics_append(family, "%s_sum", name);
+    metrics_append_labels(family, labels, NULL);
+    metrics_append(family, " %.6f\n", metrics_get(&histogram->sum) / 1e6);
+    metrics_append(family, "%s_count", name);
+    metrics_append_labels(family, labels, NULL);
+    metrics_append(family, " %llu\n", (unsigned long long)cumulated);
+}
+
+int metrics_writer_send(metrics_writer_t *writer, int fd) {
+    metrics_family_t *family, *tmp;
+    HASH_ITER(hh, writer->families, family, tmp) {
+        if (dprintf(fd, "# HELP %s %s\n# TYPE %s %s\n", family->name, family->help, family->name, family->type) < 0 ||
+            ipc_write_all(fd, family->samples, family->used) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void metrics_writer_free(metrics_writer_t *writer) {
+    metrics_family_t *family, *tmp;
+    HASH_ITER(hh, writer->families, family, tmp) {
+        HASH_DEL(writer->families, family);
+        free(family->samples);
+        free(family);
+    }
+    free(writer);
+}
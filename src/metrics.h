@@ -0,0 +1,162 @@
+/**
+ * Counters and histograms of the searches, written in the Prometheus text exposition format.
+ *
+ * The metrics of a searchfolder (metrics_t) are accumulated by the thread executing it at the end of
+ * each execution, and can be read at any time by another thread: each value is updated and read atomically,
+ * so reading them never waits for an execution.
+ *
+ * The text exposition format requires the samples of a metric to be contiguous, while they are
+ * produced searchfolder by searchfolder: a writer (metrics_writer_t) collects the samples of each metric,
+ * and writes them grouped, each metric preceded by its HELP and TYPE lines.
+ *
+ * @author Claudio Sousa, Gonzalez David
+ * @file
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+
+/**
+ * Number of bounded buckets of the histograms, the last one (+Inf) being implicit
+ */
+#define METRICS_BUCKET_COUNT 8
+
+/**
+ * Phase of an execution
+ */
+typedef enum {
+    METRICS_PHASE_SCAN,      /**< Traversal of the search path, the links being added while the files are found */
+    METRICS_PHASE_COMMIT,    /**< Update of the destination folders */
+    METRICS_PHASE_PUBLISH,   /**< Publication of the result sets in shared memory */
+    METRICS_PHASE_EXECUTION, /**< Whole execution */
+    METRICS_PHASE_COUNT      /**< Number of phases */
+} metrics_phase_t;
+
+/**
+ * Distribution of durations
+ */
+typedef struct metrics_histogram_t {
+    uint64_t buckets[METRICS_BUCKET_COUNT + 1]; /**< Number of durations per bucket, not cumulated, +Inf last */
+    uint64_t sum;                               /**< Sum of the durations, in microseconds */
+} metrics_histogram_t;
+
+/**
+ * Metrics of a searchfolder, cumulated over its executions
+ */
+typedef struct metrics_t {
+    uint64_t executions;                             /**< Executions done */
+    uint64_t directories;                            /**< Directories opened */
+    uint64_t entries;                                /**< Directory entries read */
+    uint64_t stats;                                  /**< Calls to stat */
+    uint64_t files;                                  /**< Files validated against the expressions */
+    uint64_t evaluations;                            /**< Criteria evaluated */
+    uint64_t reused;                                 /**< Criteria results reused from another expression */
+    uint64_t matches;                                /**< Files matching an expression */
+    uint64_t allocated;                              /**< Bytes allocated by the traversals */
+    uint64_t expired;                                /**< Results flipped at their deadline, without traversal */
+    metrics_histogram_t phases[METRICS_PHASE_COUNT]; /**< Durations of the phases */
+} metrics_t;
+
+/**
+ * Get the current time of the monotonic clock.
+ * @return The time, in microseconds
+ */
+uint64_t metrics_now(void);
+
+/**
+ * Add to a value of the metrics.
+ * @param value The value
+ * @param delta What to add
+ */
+void metrics_add(uint64_t *value, uint64_t delta);
+
+/**
+ * Set a value of the metrics.
+ * @param value The value
+ * @param new_value Its new value
+ */
+void metrics_set(uint64_t *value, uint64_t new_value);
+
+/**
+ * Read a value of the metrics.
+ * @param value The value
+ * @return The value read
+ */
+uint64_t metrics_get(uint64_t *value);
+
+/**
+ * Record the duration of a phase.
+ * @param metrics The metrics
+ * @param phase The phase
+ * @param duration Duration, in microseconds
+ */
+void metrics_observe(metrics_t *metrics, metrics_phase_t phase, uint64_t duration);
+
+/**
+ * Get the name of a phase, as written in the `phase` label.
+ * @param phase The phase
+ * @return The name
+ */
+char *metrics_phase_name(metrics_phase_t phase);
+
+struct metrics_writer_t;
+/**
+ * Collects samples grouped by metric.
+ * Can only be created by metrics_writer_create()
+ */
+typedef struct metrics_writer_t metrics_writer_t;
+
+/**
+ * Type of a metric
+ */
+typedef enum {
+    METRICS_COUNTER, /**< Value that only increases */
+    METRICS_GAUGE    /**< Value that can go up and down */
+} metrics_type_t;
+
+/**
+ * Create a writer.
+ * @return The created writer
+ */
+metrics_writer_t *metrics_writer_create(void);
+
+/**
+ * Add a sample of a counter or a gauge.
+ * @param writer The writer
+ * @param type Type of the metric
+ * @param name Name of the metric, a constant string
+ * @param help Description of the metric, a constant string
+ * @param labels Names and values of the labels, alternated, terminated by NULL
+ * @param value Value of the sample
+ */
+void metrics_writer_value(metrics_writer_t *writer, metrics_type_t type, char *name, char *help, char **labels,
+                          double value);
+
+/**
+ * Add the samples of a histogram of durations, in seconds.
+ * @param writer The writer
+ * @param name Name of the metric, a constant string
+ * @param help Description of the metric, a constant string
+ * @param labels Names and values of the labels, alternated, terminated by NULL
+ * @param histogram The histogram, read atomically
+ */
+void metrics_writer_histogram(metrics_writer_t *writer, char *name, char *help, char **labels,
+                              metrics_histogram_t *histogram);
+
+/**
+ * Write the metrics collected.
+ * @param writer The writer
+ * @param fd Where to write
+ * @return Error indicator: 0 for OK, 1 for an error
+ */
+int metrics_writer_send(metrics_writer_t *writer, int fd);
+
+/**
+ * Free a writer.
+ * @param writer The writer to free
+ */
+void metrics_writer_free(metrics_writer_t *writer);
+
+#endif
@@ -24,6 +24,14 @@
  */
 #define OPERATORS_COUNT 5
 
+/** Number of keys the files of a limited result set can be sorted by
+    @see parser_sort_t
+ */
+#define SORT_COUNT 4
+
+/** Maximum number of files kept by a limited result set */
+#define LIMIT_MAX 10000000
+
 /** Symbol for MIN comparison operator. @see parser_comp_t*/
 #define MIN_OP '-'
 /** Symbol for MAX comparison operator. @see parser_comp_t*/
@@ -364,6 +372,120 @@ parser_t *parser_parse(char *expression[], size_t size) {
     return parser_infix_notation(res);
 }
 
+/** List of sort keys string tokens, in the order of `parser_sort_t`
+    @see parser_sort_t
+*/
+static char *sort_keys[SORT_COUNT] = {"mtime", "size", "atime", "name"};
+
+/** Parses the clauses of a limit, `-limit N` and `-sort KEY [asc|desc]`, up to the end of the expression.
+    @param expression The tokens of the clauses
+    @param size The number of tokens
+    @param limit Receives the limit
+    @returns If all the tokens are valid clauses
+*/
+static bool parse_limit_clauses(char *expression[], size_t size, parser_limit_t *limit) {
+    bool sorted = false;
+    char *end;
+    limit->count = 0;
+    limit->sort = SORT_MTIME;
+    limit->descending = true;
+
+    for (size_t i = 0; i < size;) {
+        if (strcmp(expression[i], "-limit") == 0 && i + 1 < size && limit->count == 0) {
+            unsigned long count = strtoul(expression[i + 1], &end, 10);
+            if (*end != '\0' || expression[i + 1][0] == '-' || count < 1 || count > LIMIT_MAX)
+                return false;
+            limit->count = count;
+            i += 2;
+        } else if (strcmp(expression[i], "-sort") == 0 && i + 1 < size && !sorted) {
+            int key = 0;
+            while (key < SORT_COUNT && strcmp(expression[i + 1], sort_keys[key]) != 0) key++;
+            if (key == SORT_COUNT)
+                return false;
+            limit->sort = key;
+            limit->descending = key != SORT_NAME;
+            sorted = true;
+            i += 2;
+            if (i < size && (strcmp(expression[i], "asc") == 0 || strcmp(expression[i], "desc") == 0)) {
+                limit->descending = expression[i][0] == 'd';
+                i++;
+            }
+        } else {
+            return false;
+        }
+    }
+    return limit->count > 0;
+}
+
+int parser_parse_limit(char *expression[], size_t *size, parser_limit_t *limit) {
+    limit->count = 0;
+    for (size_t i = 0; i < *size; i++) {
+        if (strcmp(expression[i], "-limit") != 0 && strcmp(expression[i], "-sort") != 0)
+            continue;
+
+        bool is_value = false;  // e.g. `-name -limit`, searching for names containing "limit"
+        for (int c = 0; i > 0 && c < CRITERIA_COUNT; c++)
+            is_value |= strcmp(expression[i - 1], criteria[c]) == 0;
+        if (is_value)
+            continue;
+
+        if (!parse_limit_clauses(expression + i, *size - i, limit)) {
+            logger_error("Parser: error: invalid limit, expected -limit N [-sort mtime|size|atime|name [asc|desc]] "
+                         "at the end of the expression\n");
+            limit->count = 0;
+            return 1;
+        }
+        *size = i;
+        return 0;
+    }
+    return 0;
+}
+
+/** Adds bytes to a fingerprint (FNV-1a).
+    @param hash The fingerprint so far
+    @param data The bytes
+    @param size Number of bytes
+    @returns The fingerprint
+ */
+static uint64_t fingerprint_add(uint64_t hash, const void *data, size_t size) {
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ ((const unsigned char *)data)[i]) * 1099511628211ull;
+    return hash;
+}
+
+uint64_t parser_fingerprint(parser_t *expression, parser_limit_t *limit) {
+    uint64_t hash = 14695981039346656037ull;
+    for (parser_t *token = expression; token; token = token->next) {
+        hash = fingerprint_add(hash, &token->crit, sizeof(parser_crit_t));
+        if (!(token->crit & CRITERIA))
+            continue;  // operators and parenthesis have no value
+
+        hash = fingerprint_add(hash, &token->comp, sizeof(parser_comp_t));
+        switch (token->crit) {
+            case NAME:
+                hash = fingerprint_add(hash, token->value, strlen(token->value) + 1);
+                break;
+            case USER:
+            case GROUP:
+                hash = fingerprint_add(hash, token->value, sizeof(unsigned int));
+                break;
+            case PERM:
+                hash = fingerprint_add(hash, token->value, sizeof(int));
+                break;
+            default:
+                hash = fingerprint_add(hash, token->value, sizeof(long));
+        }
+    }
+
+    size_t count = limit ? limit->count : 0;
+    hash = fingerprint_add(hash, &count, sizeof(size_t));
+    if (count > 0) {
+        hash = fingerprint_add(hash, &limit->sort, sizeof(parser_sort_t));
+        hash = fingerprint_add(hash, &limit->descending, sizeof(bool));
+    }
+    return hash;
+}
+
 void parser_free(parser_t *expression) {
     parser_t *previous;
     while (expression) {
@@ -8,6 +8,8 @@
 #define PARSER_H
 
 #include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
 
 /** Type of expression token
 
@@ -92,6 +94,23 @@ typedef struct parser_t {
     struct parser_t *next;
 } parser_t;
 
+/** Key ordering the files of a limited result set
+    @see parser_limit_t
+ */
+typedef enum { SORT_MTIME, SORT_SIZE, SORT_ATIME, SORT_NAME } parser_sort_t;
+
+/** Limit of the result set of an expression: only the first `count` files in the order of `sort` are kept.
+
+    Given by `-limit N` and `-sort mtime|size|atime|name [asc|desc]` at the end of the expression, e.g.
+    `-name -.pdf -limit 500 -sort mtime` keeps the 500 most recently modified PDF files.
+    @see parser_parse_limit
+ */
+typedef struct parser_limit_t {
+    size_t count;       /**< Number of files kept, 0 for all the files */
+    parser_sort_t sort; /**< Key the files are ordered by */
+    bool descending;    /**< If the files are ordered by decreasing key: the newest or largest ones first */
+} parser_limit_t;
+
 /** Parses the string expression, converting it to a `parser_t` representation.
 
     This is done in multiple steps:
@@ -110,6 +129,30 @@ typedef struct parser_t {
 */
 parser_t *parser_parse(char *expression[], size_t size);
 
+/** Parses the limit of the result set given at the end of an expression, and removes it from the expression.
+
+    The limit is given by `-limit N` and optionally `-sort KEY [asc|desc]`, in any order. Without `-sort`, the
+    most recently modified files are kept. The files are ordered by decreasing key by default, except by
+    increasing name. `-sort` without `-limit` is invalid.
+
+    @param expression The list of tokens forming the expression (space splitted)
+    @param size The number of elements in `expression`, receives the number of elements before the limit
+    @param limit Receives the limit, a `count` of 0 if the expression has none
+    @returns Error indicator: 0 for OK, 1 if the limit is invalid
+*/
+int parser_parse_limit(char *expression[], size_t *size, parser_limit_t *limit);
+
+/** Computes a fingerprint of an expression and its limit, telling whether a saved search was made for them.
+
+    The tokens are hashed with their values, so two expressions selecting the same files in the same way get the
+    same fingerprint, and any change of a criterion, a value, an operator or the limit changes it.
+
+    @param expression The `parser_t` instance
+    @param limit The limit of its result set, *NULL* for none
+    @returns The fingerprint
+*/
+uint64_t parser_fingerprint(parser_t *expression, parser_limit_t *limit);
+
 /** Frees the memory allocated for a `parser_t` instance.
     @see parser_t
     @param expression The `parser_t instance to free
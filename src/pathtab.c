@@ -0,0 +1,305 @@
+/**
+ * Table of paths stored as a trie of their components, the nodes and the interned names being indexed by open
+ * addressing hash tables with linear probing.
+ *
+ * @author Claudio Sousa, Gonzalez David
+ * @file
+ */
+
+#include <string.h>
+#include "pathtab.h"
+
+/**
+ * Separator of the components of a path
+ */
+#define PATHTAB_SEP '/'
+/**
+ * Initial number of nodes and of slots of the hash tables, a power of two
+ */
+#define PATHTAB_INITIAL_CAPACITY 1024
+/**
+ * Initial size of the names
+ */
+#define PATHTAB_INITIAL_NAMES (16 * 1024)
+
+/**
+ * A component of a path
+ */
+typedef struct pathtab_node_t {
+    pathtab_id_t parent; /**< The node of the previous component, PATHTAB_NONE for the first one */
+    uint32_t name;       /**< Offset of the name of the component in the names */
+} pathtab_node_t;
+
+/**
+ * An open addressing hash table of indexes, 0 marking an empty slot
+ */
+typedef struct pathtab_index_t {
+    uint32_t *slots; /**< The indexes */
+    size_t capacity; /**< Number of slots, a power of two kept at least twice the number of indexes */
+} pathtab_index_t;
+
+/**
+ * Contains a table of paths
+ */
+struct pathtab_t {
+    pathtab_node_t *nodes;   /**< The nodes, by id, the first one being unused as PATHTAB_NONE */
+    size_t count;            /**< Number of nodes, including the unused one */
+    size_t capacity;         /**< Allocated number of nodes */
+    char *names;             /**< The interned names, each terminated by a '\0', after an unused empty one */
+    size_t names_used;       /**< Bytes of the names used */
+    size_t names_size;       /**< Allocated bytes of the names */
+    size_t names_count;      /**< Number of names interned */
+    pathtab_index_t by_key;  /**< Nodes by parent and name */
+    pathtab_index_t by_name; /**< Offsets of the names by name */
+};
+
+/**
+ * Hash a name (FNV-1a).
+ * @param name The name
+ * @param length Length of the name
+ * @return The hash
+ */
+static uint32_t pathtab_hash_name(char *name, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Hash a node by its parent and its interned name.
+ * @param parent The parent node
+ * @param name Offset of the name
+ * @return The hash
+ */
+static uint32_t pathtab_hash_node(pathtab_id_t parent, uint32_t name) {
+    uint64_t key = ((uint64_t)parent << 32 | name) * 0x9e3779b97f4a7c15ull;
+    return key >> 32;
+}
+
+/**
+ * Initialize an empty hash table.
+ * @param index The hash table
+ */
+static void pathtab_index_init(pathtab_index_t *index) {
+    index->capacity = PATHTAB_INITIAL_CAPACITY;
+    index->slots = calloc(index->capacity, sizeof(uint32_t));
+}
+
+/**
+ * Put an index in the first empty slot from its hash.
+ * @param index The hash table
+ * @param hash Hash of the index
+ * @param value The index, not 0
+ */
+static void pathtab_index_put(pathtab_index_t *index, uint32_t hash, uint32_t value) {
+    size_t mask = index->capacity - 1;
+    size_t slot = hash & mask;
+    while (index->slots[slot] != 0) {
+        slot = (slot + 1) & mask;
+    }
+    index->slots[slot] = value;
+}
+
+pathtab_t *pathtab_create(void) {
+    pathtab_t *tab = malloc(sizeof(pathtab_t));
+    tab->capacity = PATHTAB_INITIAL_CAPACITY;
+    tab->nodes = malloc(sizeof(pathtab_node_t) * tab->capacity);
+    tab->count = 1;
+    tab->names_size = PATHTAB_INITIAL_NAMES;
+    tab->names = malloc(tab->names_size);
+    tab->names[0] = '\0';
+    tab->names_used = 1;
+    tab->names_count = 0;
+    pathtab_index_init(&tab->by_key);
+    pathtab_index_init(&tab->by_name);
+    return tab;
+}
+
+/**
+ * Find the slot of a name in the hash table of the names.
+ * @param tab The table
+ * @param name The name, not terminated
+ * @param length Length of the name
+ * @return The slot, holding the offset of the name or empty if not interned
+ */
+static size_t pathtab_name_slot(pathtab_t *tab, char *name, size_t length) {
+    size_t mask = tab->by_name.capacity - 1;
+    size_t slot = pathtab_hash_name(name, length) & mask;
+    for (uint32_t offset; (offset = tab->by_name.slots[slot]) != 0; slot = (slot + 1) & mask) {
+        if (strncmp(tab->names + offset, name, length) == 0 && tab->names[offset + length] == '\0') {
+            break;
+        }
+    }
+    return slot;
+}
+
+/**
+ * Find the slot of a node in the hash table of the nodes.
+ * @param tab The table
+ * @param parent The parent node
+ * @param name Offset of the name
+ * @return The slot, holding the id of the node or empty if not in the table
+ */
+static size_t pathtab_node_slot(pathtab_t *tab, pathtab_id_t parent, uint32_t name) {
+    size_t mask = tab->by_key.capacity - 1;
+    size_t slot = pathtab_hash_node(parent, name) & mask;
+    for (pathtab_id_t id; (id = tab->by_key.slots[slot]) != 0; slot = (slot + 1) & mask) {
+        if (tab->nodes[id].parent == parent && tab->nodes[id].name == name) {
+            break;
+        }
+    }
+    return slot;
+}
+
+/**
+ * Intern a name, unless already interned.
+ * @param tab The table
+ * @param name The name, not terminated
+ * @param length Length of the name
+ * @return Offset of the name
+ */
+static uint32_t pathtab_intern_name(pathtab_t *tab, char *name, size_t length) {
+    size_t slot = pathtab_name_slot(tab, name, length);
+    if (tab->by_name.slots[slot] != 0) {
+        return tab->by_name.slots[slot];
+    }
+
+    while (tab->names_used + length + 1 > tab->names_size) {
+        tab->names_size *= 2;
+        tab->names = realloc(tab->names, tab->names_size);
+    }
+    uint32_t offset = tab->names_used;
+    memcpy(tab->names + offset, name, length);
+    tab->names[offset + length] = '\0';
+    tab->names_used += length + 1;
+    tab->by_name.slots[slot] = offset;
+
+    if (++tab->names_count * 2 > tab->by_name.capacity) {
+        pathtab_index_t grown = {calloc(tab->by_name.capacity * 2, sizeof(uint32_t)), tab->by_name.capacity * 2};
+        for (size_t i = 0; i < tab->by_name.capacity; i++) {
+            uint32_t old = tab->by_name.slots[i];
+            if (old != 0) {
+                pathtab_index_put(&grown, pathtab_hash_name(tab->names + old, strlen(tab->names + old)), old);
+            }
+        }
+        free(tab->by_name.slots);
+        tab->by_name = grown;
+    }
+    return offset;
+}
+
+/**
+ * Add a node, unless already in the table.
+ * @param tab The table
+ * @param parent The parent node
+ * @param name Offset of the name
+ * @return The id of the node
+ */
+static pathtab_id_t pathtab_intern_node(pathtab_t *tab, pathtab_id_t parent, uint32_t name) {
+    size_t slot = pathtab_node_slot(tab, parent, name);
+    if (tab->by_key.slots[slot] != 0) {
+        return tab->by_key.slots[slot];
+    }
+
+    if (tab->count == tab->capacity) {
+        tab->capacity *= 2;
+        tab->nodes = realloc(tab->nodes, sizeof(pathtab_node_t) * tab->capacity);
+    }
+    pathtab_id_t id = tab->count++;
+    tab->nodes[id].parent = parent;
+    tab->nodes[id].name = name;
+    tab->by_key.slots[slot] = id;
+
+    if (tab->count * 2 > tab->by_key.capacity) {
+        pathtab_index_t grown = {calloc(tab->by_key.capacity * 2, sizeof(uint32_t)), tab->by_key.capacity * 2};
+        for (pathtab_id_t node = 1; node < tab->count; node++) {
+            pathtab_index_put(&grown, pathtab_hash_node(tab->nodes[node].parent, tab->nodes[node].name), node);
+        }
+        free(tab->by_key.slots);
+        tab->by_key = grown;
+    }
+    return id;
+}
+
+pathtab_id_t pathtab_intern(pathtab_t *tab, char *path) {
+    pathtab_id_t id = PATHTAB_NONE;
+    for (char *component = path;; ) {
+        char *sep = strchr(component, PATHTAB_SEP);
+        size_t length = sep ? (size_t)(sep - component) : strlen(component);
+        id = pathtab_intern_node(tab, id, pathtab_intern_name(tab, component, length));
+        if (!sep) {
+            return id;
+        }
+        component = sep + 1;
+    }
+}
+
+pathtab_id_t pathtab_find(pathtab_t *tab, char *path) {
+    pathtab_id_t id = PATHTAB_NONE;
+    for (char *component = path;; ) {
+        char *sep = strchr(component, PATHTAB_SEP);
+        size_t length = sep ? (size_t)(sep - component) : strlen(component);
+        uint32_t name = tab->by_name.slots[pathtab_name_slot(tab, component, length)];
+        if (name == 0) {
+            return PATHTAB_NONE;
+        }
+        id = tab->by_key.slots[pathtab_node_slot(tab, id, name)];
+        if (id == PATHTAB_NONE || !sep) {
+            return id;
+        }
+        component = sep + 1;
+    }
+}
+
+size_t pathtab_path(pathtab_t *tab, pathtab_id_t id, char *path, size_t size) {
+    // the length first, then the components from the last one, at their place
+    size_t length = 0;
+    for (pathtab_id_t node = id; node != PATHTAB_NONE; node = tab->nodes[node].parent) {
+        length += strlen(tab->names + tab->nodes[node].name) + (tab->nodes[node].parent != PATHTAB_NONE);
+    }
+    if (size == 0) {
+        return length;
+    }
+
+    size_t end = length;
+    for (pathtab_id_t node = id; node != PATHTAB_NONE; node = tab->nodes[node].parent) {
+        char *name = tab->names + tab->nodes[node].name;
+        size_t name_length = strlen(name);
+        end -= name_length;
+        for (size_t i = 0; i < name_length && end + i < size - 1; i++) {
+            path[end + i] = name[i];
+        }
+        if (tab->nodes[node].parent != PATHTAB_NONE && --end < size - 1) {
+            path[end] = PATHTAB_SEP;
+        }
+    }
+    path[length < size - 1 ? length : size - 1] = '\0';
+    return length;
+}
+
+char *pathtab_name(pathtab_t *tab, pathtab_id_t id) {
+    return tab->names + tab->nodes[id].name;
+}
+
+pathtab_id_t pathtab_parent(pathtab_t *tab, pathtab_id_t id) {
+    return tab->nodes[id].parent;
+}
+
+size_t pathtab_count(pathtab_t *tab) {
+    return tab->count - 1;
+}
+
+size_t pathtab_size(pathtab_t *tab) {
+    return sizeof(pathtab_node_t) * tab->capacity + tab->names_size +
+           sizeof(uint32_t) * (tab->by_key.capacity + tab->by_name.capacity);
+}
+
+void pathtab_free(pathtab_t *tab) {
+    free(tab->nodes);
+    free(tab->names);
+    free(tab->by_key.slots);
+    free(tab->by_name.slots);
+    free(tab);
+}
@@ -0,0 +1,110 @@
+/**
+ * Table of paths stored as a trie of their components, each path being identified by an integer.
+ *
+ * A path is split at each separator into components, each stored as a node made of its parent node and its name,
+ * so that the paths sharing a prefix share its nodes: the files of a folder only cost their names. The names are
+ * interned, the files with the same name in different folders sharing it. Two paths are equal if and only if
+ * their ids are, and the full path of an id is only rebuilt when needed, see pathtab_path().
+ *
+ * The nodes and the names are kept in arrays indexed by open addressing hash tables, with no allocation per path.
+ * Paths are never removed: a table holding paths that come and go is rebuilt from the paths still used.
+ *
+ * Any string is stored as is: an absolute path starts with an empty component, and the path rebuilt from its id
+ * is identical to the path interned.
+ *
+ * @author Claudio Sousa, Gonzalez David
+ * @file
+ */
+
+#ifndef PATHTAB_H
+#define PATHTAB_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * Identifier of a path in a table
+ */
+typedef uint32_t pathtab_id_t;
+
+/**
+ * Identifier of no path, the parent of the first component of the paths
+ */
+#define PATHTAB_NONE 0
+
+struct pathtab_t;
+/**
+ * Contains a table of paths.
+ * Can only be created by pathtab_create()
+ */
+typedef struct pathtab_t pathtab_t;
+
+/**
+ * Create an empty table of paths.
+ * @return The created table
+ */
+pathtab_t *pathtab_create(void);
+
+/**
+ * Add a path to a table, unless already in it.
+ * @param tab The table
+ * @param path The path
+ * @return The id of the path
+ */
+pathtab_id_t pathtab_intern(pathtab_t *tab, char *path);
+
+/**
+ * Find a path in a table, without adding it.
+ * @param tab The table
+ * @param path The path
+ * @return The id of the path, PATHTAB_NONE if not in the table
+ */
+pathtab_id_t pathtab_find(pathtab_t *tab, char *path);
+
+/**
+ * Rebuild the full path of an id.
+ * @param tab The table
+ * @param id The id of the path
+ * @param path Receives the path, truncated to `size` bytes with its terminating '\0'
+ * @param size Size of `path`
+ * @return Length of the full path, without its terminating '\0'
+ */
+size_t pathtab_path(pathtab_t *tab, pathtab_id_t id, char *path, size_t size);
+
+/**
+ * Get the last component of a path, its basename.
+ * @param tab The table
+ * @param id The id of the path
+ * @return The name, owned by the table
+ */
+char *pathtab_name(pathtab_t *tab, pathtab_id_t id);
+
+/**
+ * Get the parent of a path, its folder.
+ * @param tab The table
+ * @param id The id of the path
+ * @return The id of its folder, PATHTAB_NONE for a path of a single component
+ */
+pathtab_id_t pathtab_parent(pathtab_t *tab, pathtab_id_t id);
+
+/**
+ * Get the number of nodes of a table, the paths interned and their folders.
+ * @param tab The table
+ * @return The number of nodes
+ */
+size_t pathtab_count(pathtab_t *tab);
+
+/**
+ * Get the memory used by a table.
+ * @param tab The table
+ * @return The size of its arrays, in bytes
+ */
+size_t pathtab_size(pathtab_t *tab);
+
+/**
+ * Free a table of paths, the ids becoming invalid.
+ * @param tab The table to free
+ */
+void pathtab_free(pathtab_t *tab);
+
+#endif
@@ -0,0 +1,322 @@
+/**
+ * Binary encoding of the result set of a destination folder, as sent by the daemon to its clients.
+ *
+ * The records are encoded in a buffer while the result set is listed. Once the buffer exceeds
+ * RESULTS_INLINE_MAX, the records are moved to a memory file and the buffer only batches the writes:
+ * the reply is then passed as a file descriptor instead of being copied through the socket.
+ *
+ * @author Claudio Sousa, Gonzalez David
+ * @file
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include "results.h"
+#include "ipc.h"
+#include "logger.h"
+
+/**
+ * Size of the records beyond which they are passed in a memory file
+ */
+#define RESULTS_INLINE_MAX (256 * 1024)
+/**
+ * Name of the memory files, shown in /proc/<pid>/fd
+ */
+#define RESULTS_MEMFD_NAME "searchfolder-results"
+/**
+ * Seals of the memory files: their content cannot change anymore
+ */
+#define RESULTS_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL)
+/**
+ * Size of the fixed part of a record: operation and lengths
+ */
+#define RESULTS_RECORD_HEADER (sizeof(uint8_t) + 2 * sizeof(uint32_t))
+
+/**
+ * Contains the records of a reply being encoded
+ */
+struct results_writer_t {
+    char *buffer;   /**< Records not written in the memory file yet */
+    size_t used;    /**< Bytes used in the buffer */
+    size_t size;    /**< Allocated bytes of the buffer */
+    int memfd;      /**< Memory file receiving the records, -1 while they are in the buffer */
+    uint64_t count; /**< Number of records */
+    uint64_t total; /**< Size of the records */
+    bool failed;    /**< If the records could not be written in the memory file */
+};
+
+/**
+ * Write the buffered records in the memory file.
+ * @param writer The writer, with a memory file
+ */
+static void results_flush(results_writer_t *writer) {
+    if (writer->used > 0 && ipc_write_all(writer->memfd, writer->buffer, writer->used) != 0) {
+        writer->failed = true;
+    }
+    writer->used = 0;
+}
+
+/**
+ * Move the buffered records to a memory file, if possible.
+ * @param writer The writer, without a memory file
+ */
+static void results_spill(results_writer_t *writer) {
+    writer->memfd = memfd_create(RESULTS_MEMFD_NAME, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (writer->memfd != -1) {
+        results_flush(writer);
+    }
+}
+
+results_writer_t *results_writer_create(void) {
+    results_writer_t *writer = malloc(sizeof(results_writer_t));
+    writer->size = 4096;
+    writer->buffer = malloc(writer->size);
+    writer->used = 0;
+    writer->memfd = -1;
+    writer->count = 0;
+    writer->total = 0;
+    writer->failed = false;
+    return writer;
+}
+
+void results_writer_add(bool added, char *name, char *target, void *data) {
+    results_writer_t *writer = data;
+    uint32_t name_len = strlen(name);
+    uint32_t target_len = strlen(target);
+    size_t record_size = RESULTS_RECORD_HEADER + name_len + target_len;
+
+    if (writer->used + record_size > writer->size) {
+        if (writer->memfd == -1 && writer->used + record_size > RESULTS_INLINE_MAX) {
+            results_spill(writer);
+        } else if (writer->memfd != -1) {
+            results_flush(writer);
+        }
+        while (writer->used + record_size > writer->size) {
+            writer->size *= 2;
+            writer->buffer = realloc(writer->buffer, writer->size);
+        }
+    }
+
+    char *record = writer->buffer + writer->used;
+    record[0] = added ? RESULTS_ADDED : RESULTS_REMOVED;
+    memcpy(record + sizeof(uint8_t), &name_len, sizeof(uint32_t));
+    memcpy(record + sizeof(uint8_t) + sizeof(uint32_t), &target_len, sizeof(uint32_t));
+    memcpy(record + RESULTS_RECORD_HEADER, name, name_len);
+    memcpy(record + RESULTS_RECORD_HEADER + name_len, target, target_len);
+
+    writer->used += record_size;
+    writer->total += record_size;
+    writer->count++;
+}
+
+/**
+ * Send a header, along with a file descriptor.
+ * @param fd The connected socket
+ * @param header The header
+ * @param passed_fd The file descriptor to pass, -1 for none
+ * @return Error indicator: 0 for OK, 1 for an error
+ */
+static int results_send_header(int fd, results_header_t *header, int passed_fd) {
+    if (passed_fd == -1) {
+        return ipc_write_all(fd, header, sizeof(results_header_t));
+    }
+
+    char control[CMSG_SPACE(sizeof(int))];
+    memset(control, 0, sizeof(control));
+    struct iovec iov = {header, sizeof(results_header_t)};
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &passed_fd, sizeof(int));
+
+    if (sendmsg(fd, &msg, MSG_NOSIGNAL) != sizeof(results_header_t)) {
+        logger_perror("Results: error: cannot send reply");
+        return 1;
+    }
+    return 0;
+}
+
+int results_writer_send(results_writer_t *writer, int fd, uint64_t generation, bool delta) {
+    results_header_t header = {0, delta ? RESULTS_DELTA : 0, generation, writer->count, writer->total};
+
+    if (writer->memfd != -1) {
+        results_flush(writer);
+        if (writer->failed || fcntl(writer->memfd, F_ADD_SEALS, RESULTS_SEALS) != 0) {
+            logger_perror("Results: error: cannot write memory file");
+            return results_send_error(fd);
+        }
+        header.flags |= RESULTS_MEMFD;
+        return results_send_header(fd, &header, writer->memfd);
+    }
+
+    if (results_send_header(fd, &header, -1) != 0) {
+        return 1;
+    }
+    return ipc_write_all(fd, writer->buffer, writer->used);
+}
+
+void results_writer_free(results_writer_t *writer) {
+    if (writer->memfd != -1) {
+        close(writer->memfd);
+    }
+    free(writer->buffer);
+    free(writer);
+}
+
+int results_send_error(int fd) {
+    results_header_t header = {1, 0, 0, 0, 0};
+    return results_send_header(fd, &header, -1);
+}
+
+/**
+ * Read exactly a number of bytes.
+ * @param fd Where to read
+ * @param data Receives the bytes
+ * @param size Number of bytes
+ * @return Error indicator: 0 for OK, 1 for an error or an early end
+ */
+static int results_read_all(int fd, void *data, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t received = read(fd, (char *)data + done, size - done);
+        if (received <= 0) {
+            return 1;
+        }
+        done += received;
+    }
+    return 0;
+}
+
+/**
+ * Receive a header, along with a file descriptor.
+ * @param fd The connected socket
+ * @param header Receives the header
+ * @param passed_fd Receives the file descriptor passed, -1 if none
+ * @return Error indicator: 0 for OK, 1 for an error
+ */
+static int results_receive_header(int fd, results_header_t *header, int *passed_fd) {
+    char control[CMSG_SPACE(sizeof(int))];
+    struct iovec iov = {header, sizeof(results_header_t)};
+    struct msghdr msg = {0};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    *passed_fd = -1;
+    ssize_t received = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    if (received <= 0) {
+        return 1;
+    }
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            memcpy(passed_fd, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+
+    return results_read_all(fd, (char *)header + received, sizeof(results_header_t) - received);
+}
+
+/**
+ * Decode records.
+ * @param records The records
+ * @param size Size of the records
+ * @param callback Receives each record
+ * @param data Data given to the callback
+ * @return Error indicator: 0 for OK, 1 for malformed records
+ */
+static int results_decode(char *records, size_t size, results_callback_t callback, void *data) {
+    char *name = NULL;
+    size_t name_size = 0;
+    uint32_t name_len, target_len;
+
+    for (size_t offset = 0; offset < size;) {
+        if (size - offset < RESULTS_RECORD_HEADER) {
+            free(name);
+            return 1;
+        }
+        char *record = records + offset;
+        memcpy(&name_len, record + sizeof(uint8_t), sizeof(uint32_t));
+        memcpy(&target_len, record + sizeof(uint8_t) + sizeof(uint32_t), sizeof(uint32_t));
+        size_t record_size = RESULTS_RECORD_HEADER + (size_t)name_len + target_len;
+        if (size - offset < record_size) {
+            free(name);
+            return 1;
+        }
+
+        // The name and the target are copied to be terminated
+        if (name_size < (size_t)name_len + target_len + 2) {
+            name_size = (size_t)name_len + target_len + 2;
+            name = realloc(name, name_size);
+        }
+        char *target = name + name_len + 1;
+        memcpy(name, record + RESULTS_RECORD_HEADER, name_len);
+        name[name_len] = '\0';
+        memcpy(target, record + RESULTS_RECORD_HEADER + name_len, target_len);
+        target[target_len] = '\0';
+        callback(record[0] == RESULTS_ADDED, name, target, data);
+
+        offset += record_size;
+    }
+
+    free(name);
+    return 0;
+}
+
+int results_receive(int fd, results_header_t *header, results_callback_t callback, void *data) {
+    int passed_fd;
+    if (results_receive_header(fd, header, &passed_fd) != 0) {
+        logger_error("Results: error: cannot receive reply\n");
+        return 1;
+    }
+    if (header->status != 0) {
+        if (passed_fd != -1) {
+            close(passed_fd);
+        }
+        return 1;
+    }
+
+    int error = 0;
+    if (header->flags & RESULTS_MEMFD) {
+        // Only a sealed file is mapped, its size cannot change under the mapping
+        struct stat memfd_stat;
+        if (passed_fd == -1 || (fcntl(passed_fd, F_GET_SEALS) & RESULTS_SEALS) != RESULTS_SEALS ||
+            fstat(passed_fd, &memfd_stat) != 0 || (uint64_t)memfd_stat.st_size < header->size) {
+            logger_error("Results: error: invalid memory file\n");
+            error = 1;
+        } else if (header->size > 0) {
+            char *records = mmap(NULL, header->size, PROT_READ, MAP_PRIVATE, passed_fd, 0);
+            if (records == MAP_FAILED) {
+                logger_perror("Results: error: cannot map memory file");
+                error = 1;
+            } else {
+                error = results_decode(records, header->size, callback, data);
+                munmap(records, header->size);
+            }
+        }
+    } else {
+        char *records = malloc(header->size > 0 ? header->size : 1);
+        error = results_read_all(fd, records, header->size) ||
+                results_decode(records, header->size, callback, data);
+        free(records);
+    }
+
+    if (passed_fd != -1) {
+        close(passed_fd);
+    }
+    if (error) {
+        logger_error("Results: error: malformed reply\n");
+    }
+    return error;
+}
@@ -0,0 +1,119 @@
+/**
+ * Binary encoding of the result set of a destination folder, as sent by the daemon to its clients.
+ *
+ * A reply starts with a header (results_header_t), giving the generation of the result set and
+ * the number and size of the records. The records follow, each made of:
+ *   - the operation, one byte: RESULTS_ADDED or RESULTS_REMOVED;
+ *   - the length of the link name and the length of the target path, 4 bytes each (host order);
+ *   - the link name and the target path, without terminating '\0'.
+ * A whole result set only contains additions; the changes since a generation (RESULTS_DELTA)
+ * list the removals first.
+ *
+ * Small replies are streamed after the header on the socket. Large ones are written in a memory
+ * file (memfd), sealed against any modification and passed along with the header (SCM_RIGHTS):
+ * the client maps the records instead of receiving them through the socket (RESULTS_MEMFD).
+ *
+ * @author Claudio Sousa, Gonzalez David
+ * @file
+ */
+
+#ifndef RESULTS_H
+#define RESULTS_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Operation of an added link
+ */
+#define RESULTS_ADDED '+'
+/**
+ * Operation of a removed link
+ */
+#define RESULTS_REMOVED '-'
+/**
+ * Flag of a reply listing the changes since a generation, instead of the whole result set
+ */
+#define RESULTS_DELTA 0x1
+/**
+ * Flag of a reply whose records are in a memory file passed with the header
+ */
+#define RESULTS_MEMFD 0x2
+
+/**
+ * Header of a reply
+ */
+typedef struct results_header_t {
+    uint32_t status;     /**< 0 for OK, 1 for an error, without records */
+    uint32_t flags;      /**< RESULTS_DELTA, RESULTS_MEMFD */
+    uint64_t generation; /**< Generation of the result set */
+    uint64_t count;      /**< Number of records */
+    uint64_t size;       /**< Size of the records, in bytes */
+} results_header_t;
+
+/**
+ * Receives a record of a reply
+ * @param added If the link was added, false if removed
+ * @param name Name of the link, '\0' terminated
+ * @param target Path of the target file, '\0' terminated
+ * @param data Data given along with the callback
+ */
+typedef void (*results_callback_t)(bool added, char *name, char *target, void *data);
+
+struct results_writer_t;
+/**
+ * Encodes the records of a reply.
+ * Can only be created by results_writer_create()
+ */
+typedef struct results_writer_t results_writer_t;
+
+/**
+ * Create a writer of records.
+ * @return The created writer
+ */
+results_writer_t *results_writer_create(void);
+
+/**
+ * Add a record, with the signature of linker_result_callback_t.
+ * @param added If the link was added, false if removed
+ * @param name Name of the link
+ * @param target Path of the target file
+ * @param writer The writer
+ */
+void results_writer_add(bool added, char *name, char *target, void *writer);
+
+/**
+ * Send the header and the records of a reply.
+ * @param writer The writer
+ * @param fd The connected socket
+ * @param generation Generation of the result set
+ * @param delta If the records are the changes since a generation
+ * @return Error indicator: 0 for OK, 1 for an error
+ */
+int results_writer_send(results_writer_t *writer, int fd, uint64_t generation, bool delta);
+
+/**
+ * Free a writer.
+ * @param writer The writer to free
+ */
+void results_writer_free(results_writer_t *writer);
+
+/**
+ * Send a reply without records, reporting an error.
+ * @param fd The connected socket
+ * @return Error indicator: 0 for OK, 1 for an error
+ */
+int results_send_error(int fd);
+
+/**
+ * Receive a reply, and decode its records.
+ * @param fd The connected socket
+ * @param header Receives the header of the reply
+ * @param callback Receives each record
+ * @param data Data given to the callback
+ * @return Error indicator: 0 for OK, 1 for an error or a reply reporting an error
+ */
+int results_receive(int fd, results_header_t *header, results_callback_t callback, void *data);
+
+#endif
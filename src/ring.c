@@ -0,0 +1,162 @@
+/**
+ * Bounded queue between a single producer thread and a single consumer thread.
+ *
+ * The items are stored in a ring buffer whose positions are only written by one side:
+ * the producer advances the tail and the consumer advances the head, so no lock is needed.
+ * When the ring is full, the producer waits for the consumer (backpressure), and when it is
+ * empty, the consumer waits for the producer. Waiting spins briefly, yields the processor, then parks the thread
+ * on a condition variable until the other side moves.
+ *
+ * @author Claudio Sousa, Gonzalez David
+ * @file
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include "ring.h"
+
+/**
+ * Number of checks of the other side before yielding the processor
+ */
+#define RING_SPIN_COUNT 128
+/**
+ * Number of yields before parking the thread
+ */
+#define RING_YIELD_COUNT 64
+
+/**
+ * Contains a ring buffer
+ */
+struct ring_t {
+    ring_item_t *items;   /**< The items */
+    size_t mask;          /**< Capacity - 1, the capacity being a power of two */
+    size_t head;          /**< Position of the next item to remove, written by the consumer */
+    size_t tail;          /**< Position of the next item to add, written by the producer */
+    bool closed;          /**< If the producer will not add items anymore */
+    bool push_parked;     /**< If the producer is parked until the consumer removes an item */
+    bool pop_parked;      /**< If the consumer is parked until the producer adds an item or closes the ring */
+    pthread_mutex_t lock; /**< Protects the parking of the threads */
+    pthread_cond_t moved; /**< Signaled when a parked thread may go on */
+};
+
+/**
+ * Check if the producer can add an item.
+ * @param ring The ring
+ * @param tail Position of the item to add
+ * @return If the ring is not full
+ */
+static bool ring_can_push(ring_t *ring, size_t tail) {
+    return tail - __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) <= ring->mask;
+}
+
+/**
+ * Check if the consumer can go on, removing an item or finding the ring closed.
+ * @param ring The ring
+ * @param head Position of the item to remove
+ * @return If the ring is not empty or is closed
+ */
+static bool ring_can_pop(ring_t *ring, size_t head) {
+    return __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) != head || __atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Wait for the other side of the ring, a little longer on each call, parking the thread once the spins and yields
+ * are exhausted.
+ * @param ring The ring
+ * @param attempt Number of times the other side was already waited for
+ * @param parked Flag of the waiting side, telling the other side to wake it
+ * @param ready Checks if the waiting side can go on
+ * @param position Position of the item to add or remove
+ */
+static void ring_wait(ring_t *ring, unsigned int attempt, bool *parked, bool (*ready)(ring_t *, size_t),
+                      size_t position) {
+    if (attempt < RING_SPIN_COUNT) {
+        return;
+    }
+    if (attempt < RING_SPIN_COUNT + RING_YIELD_COUNT) {
+        sched_yield();
+        return;
+    }
+
+    pthread_mutex_lock(&ring->lock);
+    // The flag is set before checking again, and the other side reads it after moving: one of them sees the other
+    __atomic_store_n(parked, true, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    while (!ready(ring, position)) {
+        pthread_cond_wait(&ring->moved, &ring->lock);
+    }
+    __atomic_store_n(parked, false, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+/**
+ * Wake the other side of the ring if it is parked, after moving.
+ * @param ring The ring
+ * @param parked Flag of the other side
+ */
+static void ring_wake(ring_t *ring, bool *parked) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(parked, __ATOMIC_RELAXED)) {
+        pthread_mutex_lock(&ring->lock);
+        pthread_cond_broadcast(&ring->moved);
+        pthread_mutex_unlock(&ring->lock);
+    }
+}
+
+ring_t *ring_create(size_t capacity) {
+    ring_t *ring = malloc(sizeof(ring_t));
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    ring->items = malloc(sizeof(ring_item_t) * size);
+    ring->mask = size - 1;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->closed = false;
+    ring->push_parked = false;
+    ring->pop_parked = false;
+    pthread_mutex_init(&ring->lock, NULL);
+    pthread_cond_init(&ring->moved, NULL);
+    return ring;
+}
+
+void ring_push(ring_t *ring, ring_item_t item) {
+    size_t tail = ring->tail;
+    for (unsigned int attempt = 0; !ring_can_push(ring, tail); attempt++) {
+        ring_wait(ring, attempt, &ring->push_parked, ring_can_push, tail);
+    }
+
+    ring->items[tail & ring->mask] = item;
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+    ring_wake(ring, &ring->pop_parked);
+}
+
+void ring_close(ring_t *ring) {
+    __atomic_store_n(&ring->closed, true, __ATOMIC_RELEASE);
+    ring_wake(ring, &ring->pop_parked);
+}
+
+bool ring_pop(ring_t *ring, ring_item_t *item) {
+    size_t head = ring->head;
+    for (unsigned int attempt = 0; __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == head; attempt++) {
+        // The tail is checked again after the close, as items may have been added just before it
+        if (__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE) &&
+            __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == head) {
+            return false;
+        }
+        ring_wait(ring, attempt, &ring->pop_parked, ring_can_pop, head);
+    }
+
+    *item = ring->items[head & ring->mask];
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    ring_wake(ring, &ring->push_parked);
+    return true;
+}
+
+void ring_free(ring_t *ring) {
+    pthread_mutex_destroy(&ring->lock);
+    pthread_cond_destroy(&ring->moved);
+    free(ring->items);
+    free(ring);
+}
@@ -0,0 +1,69 @@
+/**
+ * Bounded queue between a single producer thread and a single consumer thread.
+ *
+ * The items are stored in a ring buffer whose positions are only written by one side:
+ * the producer advances the tail and the consumer advances the head, so no lock is needed.
+ * When the ring is full, the producer waits for the consumer (backpressure), and when it is
+ * empty, the consumer waits for the producer. Waiting spins briefly, yields the processor, then parks the thread
+ * on a condition variable until the other side moves.
+ *
+ * @author Claudio Sousa, Gonzalez David
+ * @file
+ */
+
+#ifndef RING_H
+#define RING_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+/**
+ * An item of the ring
+ */
+typedef struct ring_item_t {
+    size_t tag; /**< Value associated to the data */
+    void *data; /**< Data of the item */
+} ring_item_t;
+
+struct ring_t;
+/**
+ * Contains a ring buffer.
+ * Can only be created by ring_create()
+ */
+typedef struct ring_t ring_t;
+
+/**
+ * Create a ring.
+ * @param capacity Number of items the ring can hold, rounded up to a power of two
+ * @return The created ring
+ */
+ring_t *ring_create(size_t capacity);
+
+/**
+ * Add an item to the ring, waiting while the ring is full. Only called by the producer.
+ * @param ring The ring
+ * @param item The item to add
+ */
+void ring_push(ring_t *ring, ring_item_t item);
+
+/**
+ * Signal that no more items will be added. Only called by the producer.
+ * @param ring The ring
+ */
+void ring_close(ring_t *ring);
+
+/**
+ * Remove the oldest item of the ring, waiting while the ring is empty. Only called by the consumer.
+ * @param ring The ring
+ * @param item Receives the item removed
+ * @return True if an item was removed, false if the ring is empty and closed
+ */
+bool ring_pop(ring_t *ring, ring_item_t *item);
+
+/**
+ * Free a ring, the remaining items are not freed.
+ * @param ring The ring to free
+ */
+void ring_free(ring_t *ring);
+
+#endif
@@ -0,0 +1,149 @@
+/**
+ * Schedules the executions of a searchfolder.
+ *
+ * Instead of waiting a fixed time between two executions, the scheduler adapts the interval
+ * to what the executions cost and find:
+ *   - when an execution changed nothing, the interval is doubled (exponential backoff);
+ *   - when an execution changed links, the interval is halved, so changes are caught quickly;
+ *   - the interval is never shorter than the average duration of an execution, so that
+ *     a long traversal does not run back to back.
+ * The interval always stays between the configured minimum and maximum, the maximum
+ * being the worst freshness of the destination folders.
+ *
+ * The wait until the next execution is cut short by a deadline coming before it.
+ *
+ * @author Claudio Sousa, Gonzalez David
+ * @file
+ */
+
+#include <stdlib.h>
+#include <time.h>
+#include "scheduler.h"
+#include "logger.h"
+
+/**
+ * Factor applied to the interval after an execution without changes
+ */
+#define SCHEDULER_BACKOFF_FACTOR 2
+/**
+ * Factor dividing the interval after an execution with changes
+ */
+#define SCHEDULER_TIGHTEN_FACTOR 2
+/**
+ * Weight of the previous average in the average duration of the executions
+ */
+#define SCHEDULER_COST_WEIGHT 3
+
+/**
+ * Contains the state of a scheduler
+ */
+struct scheduler_t {
+    unsigned int interval_min; /**< Minimum interval, in milliseconds */
+    unsigned int interval_max; /**< Maximum interval, in milliseconds */
+    unsigned int interval;     /**< Interval before the next execution, in milliseconds */
+    unsigned int cost;         /**< Average duration of the executions, in milliseconds, 0 if unknown */
+    unsigned int wait;         /**< Wait computed by scheduler_next(), in milliseconds */
+    struct timespec begin;     /**< When the current execution began */
+    struct timespec due;       /**< When the next execution is due */
+};
+
+/**
+ * Get the milliseconds elapsed since a time of the monotonic clock.
+ * @param since The time
+ * @return Milliseconds elapsed
+ */
+static unsigned int scheduler_elapsed(struct timespec *since) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) * 1000 + (now.tv_nsec - since->tv_nsec) / 1000000;
+}
+
+scheduler_t *scheduler_create(unsigned int interval_min, unsigned int interval_max) {
+    scheduler_t *scheduler = malloc(sizeof(scheduler_t));
+    scheduler->interval_min = interval_min;
+    scheduler->interval_max = interval_max > interval_min ? interval_max : interval_min;
+    scheduler->interval = scheduler->interval_min;
+    scheduler->cost = 0;
+    scheduler->wait = scheduler->interval;
+    clock_gettime(CLOCK_MONOTONIC, &scheduler->begin);
+    scheduler->due = scheduler->begin;
+    return scheduler;
+}
+
+void scheduler_begin(scheduler_t *scheduler) {
+    clock_gettime(CLOCK_MONOTONIC, &scheduler->begin);
+}
+
+unsigned int scheduler_end(scheduler_t *scheduler, unsigned int changes) {
+    unsigned int duration = scheduler_elapsed(&scheduler->begin);
+    if (scheduler->cost == 0) {
+        scheduler->cost = duration;
+    } else {
+        scheduler->cost = (scheduler->cost * SCHEDULER_COST_WEIGHT + duration) / (SCHEDULER_COST_WEIGHT + 1);
+    }
+
+    unsigned long interval = scheduler->interval;
+    if (changes > 0) {
+        interval /= SCHEDULER_TIGHTEN_FACTOR;
+    } else {
+        interval *= SCHEDULER_BACKOFF_FACTOR;
+    }
+
+    if (interval < scheduler->cost) {
+        interval = scheduler->cost;
+    }
+    if (interval < scheduler->interval_min) {
+        interval = scheduler->interval_min;
+    }
+    if (interval > scheduler->interval_max) {
+        interval = scheduler->interval_max;
+    }
+    scheduler->interval = interval;
+    clock_gettime(CLOCK_MONOTONIC, &scheduler->due);
+    scheduler->due.tv_sec += interval / 1000;
+    scheduler->due.tv_nsec += (interval % 1000) * 1000000L;
+    if (scheduler->due.tv_nsec >= 1000000000L) {
+        scheduler->due.tv_sec++;
+        scheduler->due.tv_nsec -= 1000000000L;
+    }
+
+    logger_debug("Scheduler: execution took %ums with %u changes, next in %ums\n", duration, changes,
+                 scheduler->interval);
+    return scheduler->interval;
+}
+
+bool scheduler_due(scheduler_t *scheduler) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec > scheduler->due.tv_sec ||
+           (now.tv_sec == scheduler->due.tv_sec && now.tv_nsec >= scheduler->due.tv_nsec);
+}
+
+unsigned int scheduler_next(scheduler_t *scheduler, time_t deadline) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long wait = (scheduler->due.tv_sec - now.tv_sec) * 1000 + (scheduler->due.tv_nsec - now.tv_nsec) / 1000000;
+
+    if (deadline) {
+        // deadlines are given in the time of the calendar, their wait is rounded up to reach them
+        clock_gettime(CLOCK_REALTIME, &now);
+        long until = (deadline - now.tv_sec) * 1000 - now.tv_nsec / 1000000;
+        if (until < wait) {
+            wait = until;
+        }
+    }
+
+    scheduler->wait = wait > 0 ? wait : 0;
+    return scheduler->wait;
+}
+
+void scheduler_wait(scheduler_t *scheduler) {
+    struct timespec interval;
+    interval.tv_sec = scheduler->wait / 1000;
+    interval.tv_nsec = (scheduler->wait % 1000) * 1000000L;
+    nanosleep(&interval, NULL);  // interrupted by the stop signal
+}
+
+void scheduler_free(scheduler_t *scheduler) {
+    free(scheduler);
+}
@@ -0,0 +1,82 @@
+/**
+ * Schedules the executions of a searchfolder.
+ *
+ * Instead of waiting a fixed time between two executions, the scheduler adapts the interval
+ * to what the executions cost and find:
+ *   - when an execution changed nothing, the interval is doubled (exponential backoff);
+ *   - when an execution changed links, the interval is halved, so changes are caught quickly;
+ *   - the interval is never shorter than the average duration of an execution, so that
+ *     a long traversal does not run back to back.
+ * The interval always stays between the configured minimum and maximum, the maximum
+ * being the worst freshness of the destination folders.
+ *
+ * Between two executions, the wait can be cut short by a deadline, e.g. when a result flips as time passes:
+ * the next execution stays due at the end of the interval.
+ *
+ * @author Claudio Sousa, Gonzalez David
+ * @file
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdbool.h>
+#include <time.h>
+
+struct scheduler_t;
+/**
+ * Contains the state of a scheduler.
+ * Can only be created by scheduler_create()
+ */
+typedef struct scheduler_t scheduler_t;
+
+/**
+ * Create a scheduler, starting at the minimum interval.
+ * @param interval_min Minimum interval between two executions, in milliseconds
+ * @param interval_max Maximum interval between two executions, in milliseconds
+ * @return The created scheduler
+ */
+scheduler_t *scheduler_create(unsigned int interval_min, unsigned int interval_max);
+
+/**
+ * Mark the beginning of an execution.
+ * @param scheduler The scheduler
+ */
+void scheduler_begin(scheduler_t *scheduler);
+
+/**
+ * Mark the end of an execution and compute the interval before the next one.
+ * @param scheduler The scheduler
+ * @param changes Number of changes done by the execution
+ * @return Interval before the next execution, in milliseconds
+ */
+unsigned int scheduler_end(scheduler_t *scheduler, unsigned int changes);
+
+/**
+ * Check if the interval computed by scheduler_end() is over, and the next execution is due.
+ * @param scheduler The scheduler
+ * @return If the next execution is due
+ */
+bool scheduler_due(scheduler_t *scheduler);
+
+/**
+ * Compute the wait until the next execution is due, or until a deadline if it comes first.
+ * @param scheduler The scheduler
+ * @param deadline Time to wake up at, 0 for none
+ * @return The wait, in milliseconds
+ */
+unsigned int scheduler_next(scheduler_t *scheduler, time_t deadline);
+
+/**
+ * Wait for the wait computed by scheduler_next(), or until a signal is received.
+ * @param scheduler The scheduler
+ */
+void scheduler_wait(scheduler_t *scheduler);
+
+/**
+ * Free a scheduler.
+ * @param scheduler The scheduler to free
+ */
+void scheduler_free(scheduler_t *scheduler);
+
+#endif
@@ -3,35 +3,254 @@
     This is the main module.
 
     Once started it runs continously. It uses the `finder` module to get the files matching the `expression` within `search_path`.
-    The resulting list is past to the `linker` module to update the `dst_path`
-    It will wait a few seconds, and it will start over.
+    The resulting list is past to the `linker` module to update the `dst_path`: the search runs in its own thread
+    and hands each found file over a bounded `ring`, so the links are updated while the tree is traversed.
+    It will wait a few seconds, and it will start over: the `scheduler` module adapts the wait between the
+    `interval_min` and `interval_max` options, waiting longer while nothing changes.
+
+    Several destination folders, each with its own expression, can share the same `search_path`:
+    the tree is then traversed once per execution for all of them.
+
+    With time criteria (e.g. `-mtime -1d`), files enter and leave the result sets only because time passes: the
+    finder records the deadlines at which their results flip (see `expiry`). When a deadline comes before the next
+    execution, the searchfolder wakes up to update the output folders with the files whose result flipped, without
+    traversing the tree again.
+
+    The result set of a destination folder can be limited to the first files in the order of a key, e.g. the newest
+    ones: the finder keeps only them during the traversal, so the linker only handles them.
+
+    With the `persist` option, the links applied to each destination folder are kept in a state file,
+    so that a destination folder left behind by an instance that did not stop properly is resumed. The traversal
+    of the first execution is checkpointed next to the state file of the first output folder, so that a long
+    initial search interrupted the same way is resumed where it was left too.
+
+    With the `workers` option, the tree is split into shards searched by worker processes (see `shard`), unless
+    an output folder has a limit, whose result set cannot be merged from the shards.
+
+    With the `snapshot` option, the result set of each destination folder is published in shared memory
+    by the `snapshot` module after each execution changing it.
 
     @file
  */
+#include <stdio.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <pthread.h>
 #include "searchfolder.h"
 #include "linker.h"
 #include "finder.h"
 #include "io.h"
+#include "ipc.h"
+#include "scheduler.h"
+#include "ring.h"
+#include "shard.h"
+#include "snapshot.h"
 #include "logger.h"
+#include "trace.h"
+#include "vendor/uthash.h"
+
+/** The default minimum time in milliseconds to wait between two executions */
+#define LOOP_INTERVAL_MIN 1000
+/** The default maximum time in milliseconds to wait between two executions */
+#define LOOP_INTERVAL_MAX 60000
+/** The number of found files that can wait between the search and the linkers */
+#define PIPELINE_SIZE 4096
+/** The prefix of the options */
+#define OPTION_PREFIX "--"
+/** The option selecting the hash layout, followed by the number of sub-folders */
+#define OPTION_LAYOUT_HASH "layout=hash:"
+/** The option setting the minimum interval between two executions, followed by seconds */
+#define OPTION_INTERVAL_MIN "interval-min="
+/** The option setting the maximum interval between two executions, followed by seconds */
+#define OPTION_INTERVAL_MAX "interval-max="
+/** The option setting the number of worker processes searching the tree */
+#define OPTION_WORKERS "workers="
+/** The maximum number of sub-folders of the hash layout */
+#define MAX_SHARDS 65536
+/** The maximum number of worker processes */
+#define MAX_WORKERS 256
+/** The maximum interval between two executions, in seconds */
+#define MAX_INTERVAL 86400
+/** The generation published before the first result set */
+#define SNAPSHOT_NONE ((unsigned long)-1)
 
-/** The time in seconds to wait between to executions */
-#define LOOP_INTERVAL 5  // seconds
+/** A destination folder updated by a searchfolder */
+typedef struct searchfolder_target_t {
+    char* dst_path;                     /**< The output folder */
+    parser_t* expression;               /**< The file filtering expression */
+    parser_limit_t limit;               /**< The limit of the result set, a count of 0 for none */
+    linker_t* linker;                   /**< The links applied to the output folder */
+    expiry_t* expiry;                   /**< The files whose result flips at a deadline, NULL before the first scan */
+    char* state_path;                   /**< Where the links applied are persisted, NULL if not persisted */
+    snapshot_t* snapshot;               /**< Publishes the result set, NULL if not published */
+    unsigned long published;            /**< Generation of the result set published, SNAPSHOT_NONE if none */
+    bool created;                       /**< If the output folder exists */
+    uint64_t links;                     /**< Number of links after the last execution, for the metrics */
+    uint64_t generation;                /**< Generation after the last execution, for the metrics */
+    uint64_t created_links;             /**< Links created until the last execution, for the metrics */
+    uint64_t deleted_links;             /**< Links deleted until the last execution, for the metrics */
+    uint64_t failed_links;              /**< Link operations failed until the last execution, for the metrics */
+    struct searchfolder_target_t* next; /**< Next in the chain */
+} searchfolder_target_t;
 
 /** Contains the information about a searchfolder instance */
 struct searchfolder_t {
-    bool running;          /**< If it is running */
-    char* dst_path;        /**< The output folder */
-    char* search_path;     /**< The search folder */
-    parser_t* expression;  /**< The file filtering expression */
+    bool running;                    /**< If it is running */
+    char* search_path;               /**< The search folder */
+    char* search_root;               /**< The absolute search folder, mirrored by the mirror layout */
+    searchfolder_options_t options;  /**< The options */
+    searchfolder_target_t* targets;  /**< The output folders and their expressions */
+    size_t count;                    /**< Number of output folders */
+    scheduler_t* scheduler;          /**< Adapts the interval between the executions */
+    unsigned int interval;           /**< The interval before the next execution, in milliseconds */
+    unsigned int executions;         /**< Number of executions done */
+    unsigned int last_changes;       /**< Number of links created or deleted by the last execution */
+    time_t deadline;                 /**< When a result not recorded in the deadlines flips, 0 for never */
+    shard_set_t* shards;             /**< The shards of the tree searched by worker processes, NULL if none */
+    metrics_t metrics;               /**< Counters and durations of the executions */
 };
 
-searchfolder_t* searchfolder_create(char* dst_path, char* search_path, parser_t* expression) {
+/** Suffix of the checkpoint of the initial search, appended to the state file of the first output folder */
+#define SEARCHFOLDER_CHECKPOINT_SUFFIX ".scan"
+
+/** The search of an execution, run in its own thread */
+typedef struct searchfolder_scan_t {
+    char* search_path;      /**< The search folder */
+    parser_t** expressions; /**< The expressions of the output folders */
+    parser_limit_t* limits; /**< The limits of the result sets of the output folders */
+    expiry_t** expiries;    /**< Receive the files whose result flips at a deadline */
+    char* checkpoint;       /**< Where the state of the traversal is saved, NULL if not saved */
+    shard_set_t* shards;    /**< Searched by worker processes, NULL to search in the thread */
+    size_t count;           /**< Number of expressions */
+    ring_t* ring;           /**< Receives the found files, tagged with the index of their expression */
+    finder_stats_t stats;   /**< Counters of the traversal */
+    uint64_t duration;      /**< Duration of the traversal, in microseconds */
+} searchfolder_scan_t;
+
+void searchfolder_options_init(searchfolder_options_t* options) {
+    options->persist = false;
+    options->snapshot = false;
+    options->publish = LINKER_PUBLISH_INPLACE;
+    options->layout = LINKER_LAYOUT_FLAT;
+    options->shards = 0;
+    options->workers = 0;
+    options->interval_min = LOOP_INTERVAL_MIN;
+    options->interval_max = LOOP_INTERVAL_MAX;
+}
+
+/** Parses an interval given in seconds, possibly decimal
+    @param value The interval to parse
+    @param interval Receives the interval in milliseconds
+    @returns Error indicator: 0 for OK, 1 for an invalid interval
+*/
+static int searchfolder_parse_interval(char* value, unsigned int* interval) {
+    char* end;
+    double seconds = strtod(value, &end);
+    if (end == value || *end != '\0' || seconds < 0 || seconds > MAX_INTERVAL) {
+        return 1;
+    }
+    *interval = (unsigned int)(seconds * 1000);
+    return 0;
+}
+
+/** Parses an option, without its prefix
+    @param option The option to parse
+    @param options The options to fill
+    @returns Error indicator: 0 for OK, 1 for an invalid option
+*/
+static int searchfolder_parse_option(char* option, searchfolder_options_t* options) {
+    if (strcmp(option, "persist") == 0) {
+        options->persist = true;
+    } else if (strcmp(option, "snapshot") == 0) {
+        options->snapshot = true;
+    } else if (strcmp(option, "publish=inplace") == 0) {
+        options->publish = LINKER_PUBLISH_INPLACE;
+    } else if (strcmp(option, "publish=swap") == 0) {
+        options->publish = LINKER_PUBLISH_SWAP;
+    } else if (strcmp(option, "layout=flat") == 0) {
+        options->layout = LINKER_LAYOUT_FLAT;
+    } else if (strcmp(option, "layout=mirror") == 0) {
+        options->layout = LINKER_LAYOUT_MIRROR;
+    } else if (strncmp(option, OPTION_LAYOUT_HASH, strlen(OPTION_LAYOUT_HASH)) == 0) {
+        char* end;
+        unsigned long shards = strtoul(option + strlen(OPTION_LAYOUT_HASH), &end, 10);
+        if (*end != '\0' || shards < 1 || shards > MAX_SHARDS) {
+            return 1;
+        }
+        options->layout = LINKER_LAYOUT_HASH;
+        options->shards = shards;
+    } else if (strncmp(option, OPTION_WORKERS, strlen(OPTION_WORKERS)) == 0) {
+        char* end;
+        unsigned long workers = strtoul(option + strlen(OPTION_WORKERS), &end, 10);
+        if (*end != '\0' || end == option + strlen(OPTION_WORKERS) || workers > MAX_WORKERS) {
+            return 1;
+        }
+        options->workers = workers;
+    } else if (strncmp(option, OPTION_INTERVAL_MIN, strlen(OPTION_INTERVAL_MIN)) == 0) {
+        return searchfolder_parse_interval(option + strlen(OPTION_INTERVAL_MIN), &options->interval_min);
+    } else if (strncmp(option, OPTION_INTERVAL_MAX, strlen(OPTION_INTERVAL_MAX)) == 0) {
+        return searchfolder_parse_interval(option + strlen(OPTION_INTERVAL_MAX), &options->interval_max);
+    } else {
+        return 1;
+    }
+
+    return 0;
+}
+
+int searchfolder_options_parse(int argc, char** argv, searchfolder_options_t* options) {
+    int i = 0;
+    searchfolder_options_init(options);
+
+    for (; i < argc && strncmp(argv[i], OPTION_PREFIX, 2) == 0 && argv[i][2] != '\0'; i++) {
+        if (searchfolder_parse_option(argv[i] + 2, options) != 0) {
+            return -1;
+        }
+    }
+
+    if (options->interval_min > options->interval_max) {
+        return -1;
+    }
+
+    return i;
+}
+
+bool searchfolder_options_equal(searchfolder_options_t* a, searchfolder_options_t* b) {
+    return a->persist == b->persist && a->snapshot == b->snapshot && a->publish == b->publish && a->layout == b->layout &&
+           a->shards == b->shards && a->workers == b->workers && a->interval_min == b->interval_min &&
+           a->interval_max == b->interval_max;
+}
+
+/** Verifies that a destination folder can be used by a searchfolder
+    An existing destination folder is resumed if it has been persisted by a previous instance.
+    @param searchfolder The searchfolder
+    @param dst_path The output folder
+    @param state_path Where the output folder is persisted, NULL if not persisted
+    @param resumed Receives if the output folder already exists and is resumed
+    @returns If the output folder can be used
+*/
+static bool searchfolder_check_dst(searchfolder_t* searchfolder, char* dst_path, char* state_path, bool* resumed) {
+    *resumed = false;
     if (io_directory_exists(dst_path)) {
-        logger_error("Destination '%s' already exists\n", dst_path);
-        return NULL;
+        if (state_path == NULL || !io_file_exists(state_path)) {
+            logger_error("Destination '%s' already exists\n", dst_path);
+            return false;
+        }
+        *resumed = true;
     }
+
+    for (searchfolder_target_t* target = searchfolder->targets; target; target = target->next) {
+        if (strncmp(target->dst_path, dst_path, IO_PATH_MAX_SIZE) == 0) {
+            logger_error("Destination '%s' given more than once\n", dst_path);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+searchfolder_t* searchfolder_create(char* dst_path, char* search_path, parser_t* expression, parser_limit_t* limit,
+                                    searchfolder_options_t* options) {
     if (!io_directory_exists(search_path)) {
         logger_error("Search path '%s' does not exist or is not a directory\n", search_path);
         return NULL;
@@ -39,35 +258,598 @@ searchfolder_t* searchfolder_create(char* dst_path, char* search_path, parser_t*
 
     searchfolder_t* searchfolder = (searchfolder_t*)malloc(sizeof(searchfolder_t));
     searchfolder->running = false;
-    searchfolder->dst_path = dst_path;
     searchfolder->search_path = search_path;
-    searchfolder->expression = expression;
+    searchfolder->search_root = malloc(sizeof(char) * IO_PATH_MAX_SIZE);
+    if (io_realpath(search_path, searchfolder->search_root) == NULL) {
+        free(searchfolder->search_root);
+        searchfolder->search_root = NULL;
+    }
+    searchfolder->targets = NULL;
+    searchfolder->count = 0;
+    if (options != NULL) {
+        searchfolder->options = *options;
+    } else {
+        searchfolder_options_init(&searchfolder->options);
+    }
+    searchfolder->scheduler = scheduler_create(searchfolder->options.interval_min, searchfolder->options.interval_max);
+    searchfolder->interval = 0;
+    searchfolder->executions = 0;
+    searchfolder->last_changes = 0;
+    searchfolder->deadline = 0;
+    searchfolder->shards = NULL;
+    if (searchfolder->options.workers > 0) {
+        searchfolder->shards = shard_set_create(searchfolder->options.workers);
+    }
+    memset(&searchfolder->metrics, 0, sizeof(metrics_t));
+
+    if (searchfolder_add(searchfolder, dst_path, expression, limit) != 0) {
+        searchfolder_free(searchfolder);
+        return NULL;
+    }
 
     return searchfolder;
 }
 
-void searchfolder_start(searchfolder_t* searchfolder) {
-    if (io_directory_create(searchfolder->dst_path) != 0) {
-        logger_error("Impossible to create destination path '%s'\n", searchfolder->dst_path);
+/** Builds the path of the checkpoint of the initial search, kept next to the state file of a target
+    @param target The target
+    @param checkpoint Receives the path, of IO_PATH_MAX_SIZE bytes
+    @returns If the target is persisted, and so the search is checkpointed
+*/
+static bool searchfolder_checkpoint_path(searchfolder_target_t* target, char* checkpoint) {
+    if (target->state_path == NULL) {
+        return false;
+    }
+    snprintf(checkpoint, IO_PATH_MAX_SIZE, "%s%s", target->state_path, SEARCHFOLDER_CHECKPOINT_SUFFIX);
+    return true;
+}
+
+/** Deletes the checkpoint of the initial search kept next to the state file of a target, if any
+    @param target The target
+*/
+static void searchfolder_checkpoint_delete(searchfolder_target_t* target) {
+    char checkpoint[IO_PATH_MAX_SIZE];
+    if (!searchfolder_checkpoint_path(target, checkpoint)) {
         return;
     }
+    if (io_file_exists(checkpoint)) {
+        io_file_delete(checkpoint);
+    }
+    strcat(checkpoint, FINDER_RESULTS_SUFFIX);
+    if (io_file_exists(checkpoint)) {
+        io_file_delete(checkpoint);
+    }
+}
 
-    searchfolder->running = true;
+int searchfolder_add(searchfolder_t* searchfolder, char* dst_path, parser_t* expression, parser_limit_t* limit) {
+    char* state_path = NULL;
+    if (searchfolder->options.persist) {
+        state_path = (char*)malloc(sizeof(char) * IO_PATH_MAX_SIZE);
+        if (ipc_get_state_file_path(dst_path, state_path) != 0) {
+            free(state_path);
+            return 1;
+        }
+    }
 
-    while (searchfolder->running) {
-        finder_t* found_files = finder_find(searchfolder->search_path, searchfolder->expression);
-        linker_update(searchfolder->dst_path, found_files);
+    bool resumed;
+    if (!searchfolder_check_dst(searchfolder, dst_path, state_path, &resumed)) {
+        free(state_path);
+        return 1;
+    }
+
+    // appended, so the targets keep the order in which they were given
+    searchfolder_target_t** last = &searchfolder->targets;
+    while (*last) last = &(*last)->next;
 
-        finder_free(found_files);
-        sleep(LOOP_INTERVAL);
+    searchfolder_target_t* target = (searchfolder_target_t*)malloc(sizeof(searchfolder_target_t));
+    target->dst_path = dst_path;
+    target->expression = expression;
+    target->limit.count = 0;
+    if (limit != NULL) {
+        target->limit = *limit;
+    }
+    target->expiry = NULL;
+    target->state_path = state_path;
+    target->created = resumed;
+    target->links = 0;
+    target->generation = 0;
+    target->created_links = 0;
+    target->deleted_links = 0;
+    target->failed_links = 0;
+    if (resumed) {
+        logger_info("Resuming destination path '%s'\n", dst_path);
+    }
+    if (!resumed && state_path != NULL && io_file_exists(state_path)) {
+        io_file_delete(state_path);  // stale state of a destination folder that no longer exists
     }
+    if (!resumed) {
+        searchfolder_checkpoint_delete(target);
+    }
+    linker_options_t linker_options;
+    linker_options_init(&linker_options);
+    linker_options.state_path = state_path;
+    linker_options.publish = searchfolder->options.publish;
+    linker_options.layout = searchfolder->options.layout;
+    linker_options.shards = searchfolder->options.shards;
+    if (searchfolder->search_root != NULL) {
+        linker_options.search_path = searchfolder->search_root;
+    }
+    target->linker = linker_create(dst_path, &linker_options);
+    target->snapshot = NULL;
+    target->published = SNAPSHOT_NONE;
+    char snapshot_path[IO_PATH_MAX_SIZE];
+    if (searchfolder->options.snapshot && ipc_get_snapshot_path(dst_path, snapshot_path) == 0) {
+        target->snapshot = snapshot_create(snapshot_path);
+    }
+    target->next = NULL;
+    *last = target;
+    searchfolder->count++;
 
-    if (io_directory_delete(searchfolder->dst_path) != 0) {
-        logger_error("Impossible to delete destination path '%s'\n", searchfolder->dst_path);
+    return 0;
+}
+
+/** Deletes the output folder of a target if created and its state, and frees the target
+    The output folder is moved aside and deleted in the background, see `io_directory_delete_wait`.
+    @param target The target to free
+*/
+static void searchfolder_target_free(searchfolder_target_t* target) {
+    if (target->created && io_directory_delete_async(target->dst_path) != 0) {
+        logger_error("Impossible to delete destination path '%s'\n", target->dst_path);
+    }
+    if (target->state_path != NULL && io_file_exists(target->state_path)) {
+        io_file_delete(target->state_path);
+    }
+    searchfolder_checkpoint_delete(target);
+
+    if (target->snapshot != NULL) {
+        snapshot_free(target->snapshot);
+    }
+    if (target->expiry != NULL) {
+        expiry_free(target->expiry);
+    }
+    linker_free(target->linker);
+    free(target->state_path);
+    free(target);
+}
+
+int searchfolder_remove(searchfolder_t* searchfolder, char* dst_path) {
+    for (searchfolder_target_t** target = &searchfolder->targets; *target; target = &(*target)->next) {
+        if (strncmp((*target)->dst_path, dst_path, IO_PATH_MAX_SIZE) == 0) {
+            searchfolder_target_t* removed = *target;
+            *target = removed->next;
+            searchfolder->count--;
+            searchfolder_target_free(removed);
+            return 0;
+        }
+    }
+
+    logger_error("Destination '%s' is not updated by this search\n", dst_path);
+    return 1;
+}
+
+void searchfolder_free(searchfolder_t* searchfolder) {
+    searchfolder_target_t* target = searchfolder->targets;
+    while (target) {
+        searchfolder_target_t* next = target->next;
+        searchfolder_target_free(target);
+        target = next;
     }
+    scheduler_free(searchfolder->scheduler);
+    if (searchfolder->shards != NULL) {
+        shard_set_free(searchfolder->shards);
+    }
+    free(searchfolder->search_root);
     free(searchfolder);
 }
 
+/** Passes a found file to the linkers through the ring, used as the callback of `finder_find_stream`
+    @param expression Index of the expression matched
+    @param filename Found file's real path
+    @param ring The ring
+*/
+static void searchfolder_scan_found(size_t expression, char* filename, void* ring) {
+    ring_item_t item = {expression, filename};
+    ring_push(ring, item);
+}
+
+/** Searches the files of an execution, then closes the ring
+    @param scan The search
+    @returns NULL
+*/
+static void* searchfolder_scan(void* scan) {
+    searchfolder_scan_t* s = scan;
+    trace_thread("scan");
+    uint64_t span = trace_begin();
+    uint64_t begin = metrics_now();
+    if (s->shards != NULL) {
+        shard_find_stream(s->shards, s->search_path, s->expressions, s->count, searchfolder_scan_found, s->ring,
+                          &s->stats);
+    } else {
+        finder_find_stream(s->search_path, s->expressions, s->limits, s->expiries, s->checkpoint, s->count,
+                           searchfolder_scan_found, s->ring, &s->stats);
+    }
+    s->duration = metrics_now() - begin;
+    trace_end("searchfolder", "scan", span, s->search_path);
+    ring_close(s->ring);
+    return NULL;
+}
+
+/** Executes a search and updates the output folders
+    The search runs in its own thread and passes the found files to the linkers through a bounded ring,
+    so that the links are updated while the tree is traversed.
+    The linkers copy the found files, which are freed as soon as they are added.
+    @param searchfolder The searchfolder
+    @param scan The search, with the expressions of the output folders
+    @param linkers The linkers of the output folders
+    @returns The number of links created or deleted
+*/
+static unsigned int searchfolder_execute(searchfolder_t* searchfolder, searchfolder_scan_t* scan, linker_t** linkers) {
+    unsigned int changes = 0;
+    size_t i;
+    pthread_t thread;
+
+    for (i = 0; i < scan->count; i++) {
+        linker_begin(linkers[i]);
+    }
+    scan->ring = ring_create(PIPELINE_SIZE);
+
+    if (pthread_create(&thread, NULL, searchfolder_scan, scan) != 0) {
+        logger_perror("Searchfolder: error: cannot start the search thread");
+        uint64_t begin = metrics_now();
+        memset(&scan->stats, 0, sizeof(finder_stats_t));
+        finder_t** found_files = (finder_t**)malloc(sizeof(finder_t*) * scan->count);
+        finder_find_multi(searchfolder->search_path, scan->expressions, scan->limits, scan->count, found_files);
+        scan->duration = metrics_now() - begin;
+        for (i = 0; i < scan->count; i++) {
+            for (finder_t* file = found_files[i]; file; file = file->next) linker_add(linkers[i], file->filename);
+            finder_free(found_files[i]);
+        }
+        free(found_files);
+    } else {
+        ring_item_t item;
+        while (ring_pop(scan->ring, &item)) {
+            linker_add(linkers[item.tag], item.data);
+            free(item.data);
+        }
+        pthread_join(thread, NULL);
+    }
+    ring_free(scan->ring);
+    metrics_observe(&searchfolder->metrics, METRICS_PHASE_SCAN, scan->duration);
+
+    uint64_t begin = metrics_now();
+    for (i = 0; i < scan->count; i++) {
+        changes += linker_commit(linkers[i]);
+    }
+    metrics_observe(&searchfolder->metrics, METRICS_PHASE_COMMIT, metrics_now() - begin);
+
+    return changes;
+}
+
+/** Records the counters of an execution in the metrics
+    @param searchfolder The searchfolder, just executed
+    @param stats The counters of the traversal, NULL if the tree was not traversed
+*/
+static void searchfolder_record(searchfolder_t* searchfolder, finder_stats_t* stats) {
+    metrics_t* metrics = &searchfolder->metrics;
+    if (stats != NULL) {
+        metrics_add(&metrics->executions, 1);
+        metrics_add(&metrics->directories, stats->directories);
+        metrics_add(&metrics->entries, stats->entries);
+        metrics_add(&metrics->stats, stats->stats);
+        metrics_add(&metrics->files, stats->files);
+        metrics_add(&metrics->evaluations, stats->evaluations);
+        metrics_add(&metrics->reused, stats->reused);
+        metrics_add(&metrics->matches, stats->matches);
+        metrics_add(&metrics->allocated, stats->allocated);
+    }
+
+    for (searchfolder_target_t* target = searchfolder->targets; target; target = target->next) {
+        linker_stats_t counts;
+        linker_stats(target->linker, &counts);
+        metrics_set(&target->links, linker_count(target->linker));
+        metrics_set(&target->generation, linker_generation(target->linker));
+        metrics_set(&target->created_links, counts.created);
+        metrics_set(&target->deleted_links, counts.deleted);
+        metrics_set(&target->failed_links, counts.failed);
+    }
+}
+
+int searchfolder_prepare(searchfolder_t* searchfolder) {
+    for (searchfolder_target_t* target = searchfolder->targets; target; target = target->next) {
+        if (target->created) {
+            continue;
+        }
+        if (io_directory_create(target->dst_path) != 0) {
+            logger_error("Impossible to create destination path '%s'\n", target->dst_path);
+            return 1;
+        }
+        target->created = true;
+        if (target->state_path != NULL && !io_file_exists(target->state_path)) {
+            // resumable from now on, even if killed before the first update
+            io_file_write(target->state_path, "");
+        }
+    }
+
+    return 0;
+}
+
+/** Traverses the tree for all the output folders and updates them
+    The deadlines of the results of the output folders are replaced by those found by the traversal.
+    @param searchfolder The searchfolder
+    @param stats Receives the counters of the traversal
+    @returns The number of links created or deleted
+*/
+static unsigned int searchfolder_rescan(searchfolder_t* searchfolder, finder_stats_t* stats) {
+    size_t count = searchfolder->count;
+    searchfolder_target_t* target;
+
+    searchfolder_scan_t scan = {searchfolder->search_path, NULL, NULL, NULL, NULL, searchfolder->shards, count, NULL,
+                                {0}, 0};
+    scan.expressions = (parser_t**)malloc(sizeof(parser_t*) * count);
+    scan.limits = (parser_limit_t*)malloc(sizeof(parser_limit_t) * count);
+    scan.expiries = (expiry_t**)malloc(sizeof(expiry_t*) * count);
+    linker_t** linkers = (linker_t**)malloc(sizeof(linker_t*) * count);
+    size_t i = 0;
+    for (target = searchfolder->targets; target; target = target->next, i++) {
+        scan.expressions[i] = target->expression;
+        scan.limits[i] = target->limit;
+        scan.expiries[i] = expiry_create(target->expression);
+        linkers[i] = target->linker;
+        if (target->limit.count > 0) {
+            scan.shards = NULL;  // the first files of the shards cannot be merged into the first ones of the tree
+        }
+    }
+    char checkpoint[IO_PATH_MAX_SIZE];
+    if (scan.shards == NULL && searchfolder->executions == 0 &&
+        searchfolder_checkpoint_path(searchfolder->targets, checkpoint)) {
+        scan.checkpoint = checkpoint;  // only the initial search is long enough to be worth resuming
+    }
+
+    scheduler_begin(searchfolder->scheduler);
+    unsigned int changes = searchfolder_execute(searchfolder, &scan, linkers);
+    scheduler_end(searchfolder->scheduler, changes);
+    searchfolder->last_changes = changes;
+    searchfolder->executions++;
+    searchfolder->deadline = scan.stats.deadline;
+
+    for (target = searchfolder->targets, i = 0; target; target = target->next, i++) {
+        if (target->expiry != NULL) {
+            expiry_free(target->expiry);
+        }
+        target->expiry = scan.expiries[i];
+    }
+    *stats = scan.stats;
+
+    free(scan.expressions);
+    free(scan.limits);
+    free(scan.expiries);
+    free(linkers);
+    return changes;
+}
+
+/** A file whose result flipped at its deadline */
+typedef struct searchfolder_flip_t {
+    char* path;        /**< Real path of the file (key) */
+    bool matched;      /**< If the file matches the expression since its deadline */
+    UT_hash_handle hh; /**< Makes this structure hashable */
+} searchfolder_flip_t;
+
+/** Gathers the files whose result flipped, used as the callback of `expiry_run`
+    @param matched If the file now matches the expression
+    @param path Real path of the file
+    @param flips Hashtable of the files whose result flipped
+*/
+static void searchfolder_flip(bool matched, char* path, void* flips) {
+    searchfolder_flip_t** table = flips;
+    searchfolder_flip_t* flip;
+    HASH_FIND_STR(*table, path, flip);
+    if (flip == NULL) {
+        flip = (searchfolder_flip_t*)malloc(sizeof(searchfolder_flip_t));
+        flip->path = strdup(path);
+        HASH_ADD_KEYPTR(hh, *table, flip->path, strlen(flip->path), flip);
+    }
+    flip->matched = matched;
+}
+
+/** Updates an output folder with the files whose deadline is reached, without traversing the tree
+    @param searchfolder The searchfolder
+    @param target The output folder
+    @param now The current time
+    @returns The number of links created or deleted
+*/
+static unsigned int searchfolder_expire_target(searchfolder_t* searchfolder, searchfolder_target_t* target,
+                                               time_t now) {
+    searchfolder_flip_t* flips = NULL;
+    unsigned int flipped = expiry_run(target->expiry, now, searchfolder_flip, &flips);
+    if (flipped == 0) {
+        return 0;
+    }
+    metrics_add(&searchfolder->metrics.expired, flipped);
+    logger_debug("Searchfolder: %u results of '%s' flipped at their deadline\n", flipped, target->dst_path);
+
+    // only the files whose result flipped are given, the other links are kept
+    linker_begin_delta(target->linker);
+    searchfolder_flip_t *flip, *tmp;
+    HASH_ITER(hh, flips, flip, tmp) {
+        HASH_DEL(flips, flip);
+        if (flip->matched) {
+            linker_add(target->linker, flip->path);
+        } else {
+            linker_remove(target->linker, flip->path);
+        }
+        free(flip->path);
+        free(flip);
+    }
+    return linker_commit(target->linker);
+}
+
+/** Checks if the tree must be traversed: the interval is over, an output folder was not searched yet,
+    or a result of a limited output folder flipped
+    @param searchfolder The searchfolder
+    @returns If the tree must be traversed
+*/
+static bool searchfolder_scan_due(searchfolder_t* searchfolder) {
+    if (scheduler_due(searchfolder->scheduler) || (searchfolder->deadline && searchfolder->deadline <= time(NULL))) {
+        return true;
+    }
+    for (searchfolder_target_t* target = searchfolder->targets; target; target = target->next) {
+        if (target->expiry == NULL) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/** Gets the earliest deadline of the results of the output folders
+    @param searchfolder The searchfolder
+    @returns The earliest deadline, 0 for none
+*/
+static time_t searchfolder_deadline(searchfolder_t* searchfolder) {
+    time_t deadline = searchfolder->deadline;
+    for (searchfolder_target_t* target = searchfolder->targets; target; target = target->next) {
+        time_t next = target->expiry != NULL ? expiry_next(target->expiry) : 0;
+        if (next && (!deadline || next < deadline)) {
+            deadline = next;
+        }
+    }
+    return deadline;
+}
+
+unsigned int searchfolder_run(searchfolder_t* searchfolder) {
+    searchfolder_target_t* target;
+    uint64_t span = trace_begin();
+    uint64_t begin = metrics_now();
+    finder_stats_t stats;
+    unsigned int changes = 0;
+    bool scanned = searchfolder_scan_due(searchfolder);
+    if (scanned) {
+        changes = searchfolder_rescan(searchfolder, &stats);
+    } else {
+        time_t now = time(NULL);
+        for (target = searchfolder->targets; target; target = target->next) {
+            changes += searchfolder_expire_target(searchfolder, target, now);
+        }
+    }
+
+    // The result sets are published once complete
+    uint64_t publish_begin = metrics_now();
+    bool published = false;
+    for (target = searchfolder->targets; target; target = target->next) {
+        unsigned long generation = linker_generation(target->linker);
+        if (target->snapshot != NULL && generation != target->published) {
+            uint64_t snapshot_span = trace_begin();
+            linker_results(target->linker, 0, snapshot_add, target->snapshot, NULL);
+            snapshot_publish(target->snapshot, generation);
+            trace_end("searchfolder", "snapshot", snapshot_span, target->dst_path);
+            target->published = generation;
+            published = true;
+        }
+    }
+    if (published) {
+        metrics_observe(&searchfolder->metrics, METRICS_PHASE_PUBLISH, metrics_now() - publish_begin);
+    }
+    searchfolder_record(searchfolder, scanned ? &stats : NULL);
+    if (scanned) {
+        metrics_observe(&searchfolder->metrics, METRICS_PHASE_EXECUTION, metrics_now() - begin);
+    }
+    trace_end("searchfolder", scanned ? "execution" : "expiry", span, searchfolder->search_path);
+
+    searchfolder->interval = scheduler_next(searchfolder->scheduler, searchfolder_deadline(searchfolder));
+    return searchfolder->interval;
+}
+
+void searchfolder_start(searchfolder_t* searchfolder) {
+    if (searchfolder_prepare(searchfolder) != 0) {
+        searchfolder_free(searchfolder);
+        return;
+    }
+
+    searchfolder->running = true;
+
+    while (searchfolder->running) {
+        searchfolder_run(searchfolder);
+        if (searchfolder->running) {
+            scheduler_wait(searchfolder->scheduler);
+        }
+    }
+
+    searchfolder_free(searchfolder);
+}
+
 void searchfolder_stop(searchfolder_t* searchfolder) {
     searchfolder->running = false;
 }
+
+linker_t* searchfolder_linker(searchfolder_t* searchfolder, char* dst_path) {
+    for (searchfolder_target_t* target = searchfolder->targets; target; target = target->next) {
+        if (strncmp(target->dst_path, dst_path, IO_PATH_MAX_SIZE) == 0) {
+            return target->linker;
+        }
+    }
+    return NULL;
+}
+
+void searchfolder_print(searchfolder_t* searchfolder, int fd, bool status) {
+    for (searchfolder_target_t* target = searchfolder->targets; target; target = target->next) {
+        if (status) {
+            dprintf(fd, "%s\t%s\tlinks=%zu executions=%u changes=%u next=%ums\n", target->dst_path,
+                    searchfolder->search_path, linker_count(target->linker), searchfolder->executions,
+                    searchfolder->last_changes, searchfolder->interval);
+        } else {
+            dprintf(fd, "%s\t%s\n", target->dst_path, searchfolder->search_path);
+        }
+    }
+}
+
+void searchfolder_metrics(searchfolder_t* searchfolder, metrics_writer_t* writer) {
+    metrics_t* metrics = &searchfolder->metrics;
+    char* labels[] = {"search_path", searchfolder->search_path, NULL, NULL, NULL};
+
+    metrics_writer_value(writer, METRICS_COUNTER, "searchfolder_executions_total", "Executions of the search.",
+                         labels, metrics_get(&metrics->executions));
+    metrics_writer_value(writer, METRICS_COUNTER, "searchfolder_directories_opened_total",
+                         "Directories opened by the traversals.", labels, metrics_get(&metrics->directories));
+    metrics_writer_value(writer, METRICS_COUNTER, "searchfolder_entries_read_total",
+                         "Directory entries read by the traversals.", labels, metrics_get(&metrics->entries));
+    metrics_writer_value(writer, METRICS_COUNTER, "searchfolder_stats_total", "Calls to stat by the traversals.",
+                         labels, metrics_get(&metrics->stats));
+    metrics_writer_value(writer, METRICS_COUNTER, "searchfolder_files_validated_total",
+                         "Files validated against the expressions.", labels, metrics_get(&metrics->files));
+    metrics_writer_value(writer, METRICS_COUNTER, "searchfolder_criteria_evaluated_total",
+                         "Criteria evaluated against the files.", labels, metrics_get(&metrics->evaluations));
+    metrics_writer_value(writer, METRICS_COUNTER, "searchfolder_criteria_reused_total",
+                         "Criteria results shared by several expressions instead of being evaluated.", labels,
+                         metrics_get(&metrics->reused));
+    metrics_writer_value(writer, METRICS_COUNTER, "searchfolder_matches_total",
+                         "Files matching an expression, once per expression.", labels, metrics_get(&metrics->matches));
+    metrics_writer_value(writer, METRICS_COUNTER, "searchfolder_allocated_bytes_total",
+                         "Bytes allocated by the traversals for their state and the found files.", labels,
+                         metrics_get(&metrics->allocated));
+    metrics_writer_value(writer, METRICS_COUNTER, "searchfolder_results_expired_total",
+                         "Results of files flipped by time passing, updated without a traversal.", labels,
+                         metrics_get(&metrics->expired));
+
+    labels[2] = "phase";
+    for (int phase = 0; phase < METRICS_PHASE_COUNT; phase++) {
+        labels[3] = metrics_phase_name(phase);
+        metrics_writer_histogram(writer, "searchfolder_phase_duration_seconds",
+                                 "Duration of the phases of the executions.", labels, &metrics->phases[phase]);
+    }
+
+    labels[0] = "destination";
+    labels[2] = NULL;
+    for (searchfolder_target_t* target = searchfolder->targets; target; target = target->next) {
+        labels[1] = target->dst_path;
+        metrics_writer_value(writer, METRICS_GAUGE, "searchfolder_links", "Links in the destination folder.", labels,
+                             metrics_get(&target->links));
+        metrics_writer_value(writer, METRICS_GAUGE, "searchfolder_generation",
+                             "Generation of the result set of the destination folder.", labels,
+                             metrics_get(&target->generation));
+        metrics_writer_value(writer, METRICS_COUNTER, "searchfolder_links_created_total",
+                             "Links created in the destination folder.", labels, metrics_get(&target->created_links));
+        metrics_writer_value(writer, METRICS_COUNTER, "searchfolder_links_deleted_total",
+                             "Links deleted from the destination folder.", labels, metrics_get(&target->deleted_links));
+        metrics_writer_value(writer, METRICS_COUNTER, "searchfolder_link_failures_total",
+                             "Link operations that failed in the destination folder.", labels,
+                             metrics_get(&target->failed_links));
+    }
+}
@@ -3,8 +3,19 @@
     This is the main module.
 
     Once started it runs continously. It uses the `finder` module to get the files matching the `expression` within `search_path`.
-    The resulting list is past to the `linker` module to update the `dst_path`
-    It will wait a few seconds, and it will start over.
+    The resulting list is past to the `linker` module to update the `dst_path`: the search runs in its own thread
+    and hands each found file over a bounded `ring`, so the links are updated while the tree is traversed.
+    It will wait a few seconds, and it will start over: the `scheduler` module adapts the wait between the
+    `interval_min` and `interval_max` options, waiting longer while nothing changes.
+
+    Several destination folders, each with its own expression, can share the same `search_path`:
+    the tree is then traversed once per execution for all of them.
+
+    With the `persist` option, the links applied to each destination folder are kept in a state file,
+    so that a destination folder left behind by an instance that did not stop properly is resumed.
+
+    With the `snapshot` option, the result set of each destination folder is published in shared memory
+    by the `snapshot` module after each execution changing it.
 
     @file
  */
@@ -12,7 +23,43 @@
 #define SEARCHFOLDER_H
 
 #include "validator.h"
+#include "linker.h"
+#include "metrics.h"
+
+/** Options of a searchfolder
+    @see searchfolder_options_init
+*/
+typedef struct searchfolder_options_t {
+    bool persist;              /**< Persist the links applied to the destination folders, to resume them */
+    bool snapshot;             /**< Publish the result sets of the destination folders in shared memory */
+    linker_publish_t publish;  /**< How the updates of the destination folders are published */
+    linker_layout_t layout;    /**< How the links are organized in the destination folders */
+    unsigned int shards;       /**< Number of sub-folders of the hash layout */
+    unsigned int workers;      /**< Number of worker processes searching the shards of the tree, 0 for none */
+    unsigned int interval_min; /**< Minimum time in milliseconds between two executions */
+    unsigned int interval_max; /**< Maximum time in milliseconds between two executions */
+} searchfolder_options_t;
 
+/** Initializes the options of a searchfolder with their default values
+    @param options The options to initialize
+*/
+void searchfolder_options_init(searchfolder_options_t *options);
+
+/** Parses the options at the beginning of a list of arguments, each prefixed by `--`
+    (`--persist`, `--snapshot`, `--publish=inplace|swap`, `--layout=flat|hash:N|mirror`, `--interval-min=S`, `--interval-max=S`)
+    @param argc Number of arguments
+    @param argv The arguments
+    @param options Receives the options, the others keeping their default values
+    @returns Index of the first argument that is not an option, -1 if an option is invalid
+*/
+int searchfolder_options_parse(int argc, char **argv, searchfolder_options_t *options);
+
+/** Compares two sets of options
+    @param a The first options
+    @param b The second options
+    @returns If all the options are equal
+*/
+bool searchfolder_options_equal(searchfolder_options_t *a, searchfolder_options_t *b);
 
 struct searchfolder_t;
 /** Contains an instance of `searchfolder`.
@@ -25,9 +72,52 @@ typedef struct searchfolder_t searchfolder_t;
     @param dst_path The folder to be created with the symbolic links to the found files
     @param search_path The folder where to looks for files
     @param expression The expression to be matched by the files
+    @param limit The limit of the result set (copied), NULL for none
+    @param options The options of the searchfolder (copied), NULL for the default ones
     @returns The created searchfolder
 */
-searchfolder_t *searchfolder_create(char *dst_path, char *search_path, parser_t *expression);
+searchfolder_t *searchfolder_create(char *dst_path, char *search_path, parser_t *expression, parser_limit_t *limit,
+                                    searchfolder_options_t *options);
+
+/** Adds another destination folder to a searchfolder
+
+    The destination shares the `search_path` of the searchfolder: each execution traverses the tree once
+    and updates all the destination folders.
+
+    @param searchfolder The searchfolder to extend
+    @param dst_path The folder to be created with the symbolic links to the files matching `expression`
+    @param expression The expression to be matched by the files
+    @param limit The limit of the result set (copied), NULL for none
+    @returns Error indicator: 0 for OK, 1 for an error
+*/
+int searchfolder_add(searchfolder_t *searchfolder, char *dst_path, parser_t *expression, parser_limit_t *limit);
+
+/** Removes a destination folder from a searchfolder, deleting it and its state
+
+    @param searchfolder The searchfolder
+    @param dst_path The folder to remove
+    @returns Error indicator: 0 for OK, 1 if the folder is not updated by the searchfolder
+*/
+int searchfolder_remove(searchfolder_t *searchfolder, char *dst_path);
+
+/** Creates the destination folders not created yet
+
+    @param searchfolder The searchfolder
+    @returns Error indicator: 0 for OK, 1 if a folder cannot be created
+*/
+int searchfolder_prepare(searchfolder_t *searchfolder);
+
+/** Executes a search once and updates the destination folders, which must be prepared
+
+    Used to schedule the executions from outside, see `searchfolder_start` to run them in a loop.
+    When woken up by a deadline before the end of the interval, only the files whose result flipped with time
+    are updated, without searching the tree.
+
+    @see searchfolder_prepare
+    @param searchfolder The searchfolder
+    @returns The time in milliseconds to wait before the next execution
+*/
+unsigned int searchfolder_run(searchfolder_t *searchfolder);
 
 /** Starts a created searchfolder
     Once started, it will run until `searchfolder_stop` is called
@@ -42,4 +132,38 @@ void searchfolder_start(searchfolder_t *searchfolder);
 */
 void searchfolder_stop(searchfolder_t *searchfolder);
 
+/** Gets the linker of a destination folder, to read its result set
+    The linker must not be used while the searchfolder executes.
+
+    @param searchfolder The searchfolder
+    @param dst_path The destination folder
+    @returns The linker, NULL if the folder is not updated by the searchfolder
+*/
+linker_t *searchfolder_linker(searchfolder_t *searchfolder, char *dst_path);
+
+/** Writes a line per destination folder: its path and the search path, tab separated,
+    followed with the status of the executions if requested
+
+    @param searchfolder The searchfolder
+    @param fd Where to write
+    @param status If the status of the executions is written
+*/
+void searchfolder_print(searchfolder_t *searchfolder, int fd, bool status);
+
+/** Adds the metrics of a searchfolder to a writer: the counters of its traversals and the durations of
+    its phases, labelled by search path, and the counters of its links, labelled by destination folder
+
+    Can be called while the searchfolder is executed: the metrics are those of the last execution done.
+
+    @param searchfolder The searchfolder
+    @param writer Receives the metrics
+*/
+void searchfolder_metrics(searchfolder_t *searchfolder, metrics_writer_t *writer);
+
+/** Deletes the destination folders and their state, and frees a searchfolder that is not started
+
+    @param searchfolder The searchfolder to free
+*/
+void searchfolder_free(searchfolder_t *searchfolder);
+
 #endif
@@ -0,0 +1,620 @@
+/**
+ * Search of a tree split into shards searched by worker processes, their records being merged by polling them.
+ *
+ * @author Claudio Sousa, Gonzalez David
+ * @file
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "shard.h"
+#include "io.h"
+#include "logger.h"
+#include "metrics.h"
+#include "trace.h"
+#include "vendor/uthash.h"
+
+/**
+ * Size of the buffer receiving the records of a worker, holding at least a record of the largest payload
+ */
+#define SHARD_BUFFER_SIZE (64 * 1024)
+/**
+ * Largest payload of a record
+ */
+#define SHARD_PAYLOAD_MAX IO_PATH_MAX_SIZE
+
+/**
+ * Cost of a unit measured by the last search, kept for the next one
+ */
+typedef struct shard_measure_t {
+    char *name;        /**< Name of the unit in the search path */
+    uint64_t cost;     /**< Duration of its search, in microseconds, at least 1 */
+    UT_hash_handle hh; /**< Makes this structure hashable */
+} shard_measure_t;
+
+/**
+ * Contains the shards of a search path and the costs of its units
+ */
+struct shard_set_t {
+    size_t workers;            /**< Maximum number of shards */
+    shard_measure_t *measures; /**< Costs of the units, by name */
+};
+
+/**
+ * A unit of a search, a top-level entry of the search path
+ */
+typedef struct shard_unit_t {
+    char *path;    /**< Path of the unit */
+    char *name;    /**< Name of the unit in the search path, within `path` */
+    uint64_t cost; /**< Measured or estimated duration of its search */
+    bool done;     /**< If its search was reported complete */
+} shard_unit_t;
+
+/**
+ * A worker process searching a shard
+ */
+typedef struct shard_worker_t {
+    pid_t pid;     /**< Process id, 0 if not started */
+    int fd;        /**< Socket to the worker, -1 once closed */
+    size_t *units; /**< Indexes of the units of the shard */
+    size_t count;  /**< Number of units of the shard */
+    uint64_t load; /**< Sum of the costs of the units */
+    char *buffer;  /**< Records received and not handled yet */
+    size_t used;   /**< Bytes of the buffer used */
+    bool done;     /**< If the worker reported the end of its search */
+    uint64_t span; /**< Beginning of the trace span of the worker */
+} shard_worker_t;
+
+/**
+ * A file found, to pass a file found by several workers once
+ */
+typedef struct shard_found_t {
+    char *path;        /**< Real path of the file */
+    bool *matched;     /**< Expressions the file was passed for */
+    UT_hash_handle hh; /**< Makes this structure hashable */
+} shard_found_t;
+
+/**
+ * State of a single search
+ */
+typedef struct shard_search_t {
+    parser_t **expressions;     /**< The expressions */
+    size_t count;               /**< Number of expressions */
+    shard_unit_t *units;        /**< The units */
+    size_t unit_count;          /**< Number of units */
+    shard_worker_t *workers;    /**< The workers, one per shard */
+    size_t worker_count;        /**< Number of workers */
+    shard_found_t *found;       /**< Files passed to the callback, by real path */
+    finder_callback_t callback; /**< Receives the found files */
+    void *data;                 /**< Data passed to `callback` */
+    finder_stats_t stats;       /**< Counters of the search */
+} shard_search_t;
+
+shard_set_t *shard_set_create(size_t workers) {
+    shard_set_t *set = malloc(sizeof(shard_set_t));
+    set->workers = workers > 0 ? workers : 1;
+    set->measures = NULL;
+    return set;
+}
+
+/**
+ * Free the costs of the units measured.
+ * @param set The shards
+ */
+static void shard_measures_clear(shard_set_t *set) {
+    shard_measure_t *measure, *tmp;
+    HASH_ITER(hh, set->measures, measure, tmp) {
+        HASH_DEL(set->measures, measure);
+        free(measure->name);
+        free(measure);
+    }
+}
+
+/**
+ * List the units of a search path, with their cost measured by the previous search, or the mean of those
+ * measured if none.
+ * @param search The search
+ * @param set The shards
+ * @param search_path The search path
+ * @return Error indicator: 0 for OK, 1 if the search path cannot be read
+ */
+static int shard_list_units(shard_search_t *search, shard_set_t *set, char *search_path) {
+    void *dir = io_opendir(AT_FDCWD, search_path);
+    if (dir == NULL) {
+        logger_perror("Shard: error: failed to open directory");
+        return 1;
+    }
+
+    size_t capacity = 16, measured = 0;
+    uint64_t total = 0;
+    search->units = malloc(sizeof(shard_unit_t) * capacity);
+    io_dirent_t dent;
+    while (io_readdir(dir, &dent) == 1) {
+        if (strcmp(dent.name, ".") == 0 || strcmp(dent.name, "..") == 0) {
+            continue;
+        }
+        if (search->unit_count == capacity) {
+            capacity *= 2;
+            search->units = realloc(search->units, sizeof(shard_unit_t) * capacity);
+        }
+        shard_unit_t *unit = &search->units[search->unit_count++];
+        size_t length = strlen(search_path);
+        unit->path = malloc(length + strlen(dent.name) + 2);
+        sprintf(unit->path, "%s/%s", search_path, dent.name);
+        unit->name = unit->path + length + 1;
+        unit->done = false;
+
+        shard_measure_t *measure;
+        HASH_FIND_STR(set->measures, unit->name, measure);
+        unit->cost = measure ? measure->cost : 0;
+        if (measure) {
+            total += measure->cost;
+            measured++;
+        }
+    }
+    io_closedir(dir);
+
+    uint64_t mean = measured > 0 ? total / measured : 1;
+    for (size_t i = 0; i < search->unit_count; i++) {
+        shard_measure_t *measure;
+        HASH_FIND_STR(set->measures, search->units[i].name, measure);
+        if (measure == NULL) {
+            search->units[i].cost = mean;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Order the units by decreasing cost, then by name, used by qsort().
+ * @param a The first unit
+ * @param b The second unit
+ * @return Negative if `a` is costlier than `b`, positive if cheaper
+ */
+static int shard_compare_units(const void *a, const void *b) {
+    const shard_unit_t *x = *(shard_unit_t *const *)a, *y = *(shard_unit_t *const *)b;
+    if (x->cost != y->cost) {
+        return x->cost > y->cost ? -1 : 1;
+    }
+    return strcmp(x->name, y->name);
+}
+
+/**
+ * Spread the units over the shards, the costliest unit first, each to the shard with the lowest cost so far,
+ * or with the fewest units among those of the same cost.
+ * @param search The search, whose units are listed
+ * @param workers Maximum number of shards
+ */
+static void shard_partition(shard_search_t *search, size_t workers) {
+    search->worker_count = search->unit_count < workers ? search->unit_count : workers;
+    search->workers = calloc(search->worker_count, sizeof(shard_worker_t));
+    for (size_t i = 0; i < search->worker_count; i++) {
+        search->workers[i].fd = -1;
+        search->workers[i].units = malloc(sizeof(size_t) * search->unit_count);
+    }
+
+    shard_unit_t **sorted = malloc(sizeof(shard_unit_t *) * search->unit_count);
+    for (size_t i = 0; i < search->unit_count; i++) {
+        sorted[i] = &search->units[i];
+    }
+    qsort(sorted, search->unit_count, sizeof(shard_unit_t *), shard_compare_units);
+
+    for (size_t i = 0; i < search->unit_count; i++) {
+        shard_worker_t *lightest = &search->workers[0];
+        for (size_t k = 1; k < search->worker_count; k++) {
+            shard_worker_t *worker = &search->workers[k];
+            if (worker->load < lightest->load || (worker->load == lightest->load && worker->count < lightest->count)) {
+                lightest = &search->workers[k];
+            }
+        }
+        lightest->units[lightest->count++] = sorted[i] - search->units;
+        lightest->load += sorted[i]->cost;
+    }
+    free(sorted);
+}
+
+/**
+ * Write a whole buffer to a socket, without being killed if the peer is gone.
+ * @param fd The socket
+ * @param data The buffer
+ * @param size Size of the buffer
+ * @return Error indicator: 0 for OK, 1 if the buffer could not be written
+ */
+static int shard_send(int fd, char *data, size_t size) {
+    while (size > 0) {
+        ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return 1;
+        }
+        data += sent;
+        size -= sent;
+    }
+    return 0;
+}
+
+/**
+ * Start the worker of a shard and send it its units.
+ * The units of a worker that cannot be started are left to shard_recover().
+ * @param search The search
+ * @param worker The worker
+ */
+static void shard_spawn(shard_search_t *search, shard_worker_t *worker) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        logger_perror("Shard: error: cannot create the socket of a worker");
+        return;
+    }
+
+    worker->span = trace_begin();
+    worker->pid = fork();
+    if (worker->pid < 0) {
+        logger_perror("Shard: error: cannot start a worker");
+        worker->pid = 0;
+        close(fds[0]);
+        close(fds[1]);
+        return;
+    }
+
+    if (worker->pid == 0) {
+        // the background threads of the parent are not forked
+        logger_forked();
+        trace_forked();
+        close(fds[0]);
+        for (shard_worker_t *other = search->workers; other < worker; other++) {
+            if (other->fd >= 0) {
+                close(other->fd);
+            }
+        }
+        _exit(shard_serve(fds[1], fds[1], search->expressions, search->count));
+    }
+
+    close(fds[1]);
+    worker->fd = fds[0];
+    worker->buffer = malloc(SHARD_BUFFER_SIZE);
+    for (size_t i = 0; i < worker->count; i++) {
+        char *path = search->units[worker->units[i]].path;
+        if (shard_send(worker->fd, path, strlen(path) + 1) != 0) {
+            return;  // the worker is gone, noticed when reading its records
+        }
+    }
+    shard_send(worker->fd, "", 1);
+}
+
+/**
+ * Add the counters of a unit to those of a search.
+ * @param stats The counters of the search
+ * @param unit The counters of the unit
+ */
+static void shard_add_stats(finder_stats_t *stats, finder_stats_t *unit) {
+    stats->directories += unit->directories;
+    stats->entries += unit->entries;
+    stats->stats += unit->stats;
+    stats->files += unit->files;
+    stats->evaluations += unit->evaluations;
+    stats->reused += unit->reused;
+    stats->matches += unit->matches;
+    stats->allocated += unit->allocated;
+    if (unit->deadline && (!stats->deadline || unit->deadline < stats->deadline)) {
+        stats->deadline = unit->deadline;
+    }
+}
+
+/**
+ * Pass a found file to the callback of a search, unless already passed for the same expression.
+ * @param expression Index of the expression matched
+ * @param path Real path of the file, freed by the callback
+ * @param data The search
+ */
+static void shard_found(size_t expression, char *path, void *data) {
+    shard_search_t *search = data;
+    shard_found_t *found;
+    HASH_FIND_STR(search->found, path, found);
+    if (found == NULL) {
+        found = malloc(sizeof(shard_found_t));
+        found->path = strdup(path);
+        found->matched = calloc(search->count, sizeof(bool));
+        HASH_ADD_KEYPTR(hh, search->found, found->path, strlen(found->path), found);
+    } else if (found->matched[expression]) {
+        free(path);
+        return;
+    }
+    found->matched[expression] = true;
+    search->callback(expression, path, search->data);
+}
+
+/**
+ * Handle a record received from a worker.
+ * @param search The search
+ * @param worker The worker
+ * @param record The header of the record
+ * @param payload The payload of the record
+ * @return Error indicator: 0 for OK, 1 if the record is not valid
+ */
+static int shard_handle(shard_search_t *search, shard_worker_t *worker, shard_record_t *record, char *payload) {
+    switch (record->type) {
+        case SHARD_MATCH:
+            if (record->value >= search->count || record->size == 0 || payload[record->size - 1] != '\0') {
+                return 1;
+            }
+            shard_found(record->value, strdup(payload), search);
+            return 0;
+        case SHARD_UNIT: {
+            if (record->value >= worker->count || record->size != sizeof(shard_cost_t)) {
+                return 1;
+            }
+            shard_cost_t cost;
+            memcpy(&cost, payload, sizeof(shard_cost_t));
+            shard_unit_t *unit = &search->units[worker->units[record->value]];
+            unit->done = true;
+            unit->cost = cost.duration;
+            shard_add_stats(&search->stats, &cost.stats);
+            return 0;
+        }
+        case SHARD_DONE:
+            worker->done = true;
+            return 0;
+        default:
+            return 1;
+    }
+}
+
+/**
+ * Receive the records available from a worker, and handle them.
+ * @param search The search
+ * @param worker The worker
+ * @return If more records are expected, false once the worker is done, gone or broke the protocol
+ */
+static bool shard_receive(shard_search_t *search, shard_worker_t *worker) {
+    ssize_t received = read(worker->fd, worker->buffer + worker->used, SHARD_BUFFER_SIZE - worker->used);
+    if (received < 0 && errno == EINTR) {
+        return true;
+    }
+    if (received <= 0) {
+        return false;
+    }
+    worker->used += received;
+
+    size_t offset = 0;
+    shard_record_t record;
+    while (worker->used - offset >= sizeof(shard_record_t)) {
+        memcpy(&record, worker->buffer + offset, sizeof(shard_record_t));
+        if (record.size > SHARD_PAYLOAD_MAX) {
+            return false;
+        }
+        if (worker->used - offset < sizeof(shard_record_t) + record.size) {
+            break;  // the rest of the record comes next
+        }
+        if (shard_handle(search, worker, &record, worker->buffer + offset + sizeof(shard_record_t)) != 0) {
+            return false;
+        }
+        offset += sizeof(shard_record_t) + record.size;
+        if (worker->done) {
+            return false;
+        }
+    }
+    memmove(worker->buffer, worker->buffer + offset, worker->used - offset);
+    worker->used -= offset;
+    return true;
+}
+
+/**
+ * Receive the records of the workers as they come, until they are all done or gone.
+ * @param search The search
+ */
+static void shard_merge(shard_search_t *search) {
+    struct pollfd *fds = malloc(sizeof(struct pollfd) * search->worker_count);
+    shard_worker_t **polled = malloc(sizeof(shard_worker_t *) * search->worker_count);
+    for (;;) {
+        size_t count = 0;
+        for (size_t i = 0; i < search->worker_count; i++) {
+            if (search->workers[i].fd >= 0) {
+                fds[count].fd = search->workers[i].fd;
+                fds[count].events = POLLIN;
+                polled[count++] = &search->workers[i];
+            }
+        }
+        if (count == 0) {
+            break;
+        }
+        if (poll(fds, count, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            logger_perror("Shard: error: cannot wait for the workers");
+            break;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            if (fds[i].revents != 0 && !shard_receive(search, polled[i])) {
+                close(polled[i]->fd);
+                polled[i]->fd = -1;
+                trace_end("shard", "worker", polled[i]->span, search->units[polled[i]->units[0]].path);
+            }
+        }
+    }
+    free(polled);
+    free(fds);
+}
+
+/**
+ * Wait for the workers to exit, then search again the units not reported complete.
+ * @param search The search
+ */
+static void shard_recover(shard_search_t *search) {
+    for (size_t i = 0; i < search->worker_count; i++) {
+        shard_worker_t *worker = &search->workers[i];
+        if (worker->fd >= 0) {
+            close(worker->fd);  // not polled, the merge failed
+        }
+        if (worker->pid > 0) {
+            int status;
+            while (waitpid(worker->pid, &status, 0) < 0 && errno == EINTR) {
+            }
+        }
+        if (!worker->done && worker->count > 0) {
+            logger_error("Shard: error: worker %d failed, searching its units again\n", (int)worker->pid);
+        }
+    }
+
+    for (size_t i = 0; i < search->unit_count; i++) {
+        shard_unit_t *unit = &search->units[i];
+        if (unit->done) {
+            continue;
+        }
+        finder_stats_t stats;
+        uint64_t begin = metrics_now();
+        finder_find_stream(unit->path, search->expressions, NULL, NULL, NULL, search->count, shard_found, search,
+                           &stats);
+        unit->cost = metrics_now() - begin;
+        unit->done = true;
+        shard_add_stats(&search->stats, &stats);
+    }
+}
+
+void shard_find_stream(shard_set_t *set, char *search_path, parser_t **expressions, size_t count,
+                       finder_callback_t callback, void *data, finder_stats_t *stats) {
+    shard_search_t search;
+    memset(&search, 0, sizeof(shard_search_t));
+    search.expressions = expressions;
+    search.count = count;
+    search.callback = callback;
+    search.data = data;
+
+    if (shard_list_units(&search, set, search_path) == 0) {
+        search.stats.directories++;
+        search.stats.entries += search.unit_count;
+        shard_partition(&search, set->workers);
+        logger_debug("Shard: %zu units of '%s' in %zu shards\n", search.unit_count, search_path,
+                     search.worker_count);
+
+        for (size_t i = 0; i < search.worker_count; i++) {
+            if (search.workers[i].count > 0) {
+                shard_spawn(&search, &search.workers[i]);
+            }
+        }
+        shard_merge(&search);
+        shard_recover(&search);
+    }
+
+    // the costs measured replace the previous ones, the units gone being forgotten, and a unit searched in less than
+    // a microsecond still costs one so that the units are spread over all the shards
+    shard_measures_clear(set);
+    for (size_t i = 0; i < search.unit_count; i++) {
+        shard_measure_t *measure = malloc(sizeof(shard_measure_t));
+        measure->name = strdup(search.units[i].name);
+        measure->cost = search.units[i].cost > 0 ? search.units[i].cost : 1;
+        HASH_ADD_KEYPTR(hh, set->measures, measure->name, strlen(measure->name), measure);
+        free(search.units[i].path);
+    }
+    free(search.units);
+    for (size_t i = 0; i < search.worker_count; i++) {
+        free(search.workers[i].units);
+        free(search.workers[i].buffer);
+    }
+    free(search.workers);
+
+    shard_found_t *found, *tmp;
+    HASH_ITER(hh, search.found, found, tmp) {
+        HASH_DEL(search.found, found);
+        free(found->path);
+        free(found->matched);
+        free(found);
+    }
+
+    if (stats) {
+        *stats = search.stats;
+    }
+}
+
+/**
+ * Send a record.
+ * @param output Where the record is sent
+ * @param type Type of the record
+ * @param value Value of the record
+ * @param payload Payload of the record
+ * @param size Size of the payload
+ */
+static void shard_send_record(FILE *output, uint32_t type, uint64_t value, void *payload, size_t size) {
+    shard_record_t record = {type, size, value};
+    fwrite(&record, sizeof(shard_record_t), 1, output);
+    if (size > 0) {
+        fwrite(payload, 1, size, output);
+    }
+}
+
+/**
+ * Send a found file as a record, used as the callback of finder_find_stream() by the workers.
+ * @param expression Index of the expression matched
+ * @param filename Real path of the file, freed
+ * @param output Where the record is sent
+ */
+static void shard_serve_found(size_t expression, char *filename, void *output) {
+    shard_send_record(output, SHARD_MATCH, expression, filename, strlen(filename) + 1);
+    free(filename);
+}
+
+int shard_serve(int in, int out, parser_t **expressions, size_t count) {
+    FILE *input = fdopen(dup(in), "r");
+    FILE *output = fdopen(dup(out), "w");
+    if (input == NULL || output == NULL) {
+        logger_perror("Shard: error: cannot open the streams of the worker");
+        if (input != NULL) {
+            fclose(input);
+        }
+        if (output != NULL) {
+            fclose(output);
+        }
+        return 1;
+    }
+
+    size_t capacity = 16, unit_count = 0;
+    char **units = malloc(sizeof(char *) * capacity);
+    char *unit = NULL;
+    size_t size = 0;
+    ssize_t length;
+    while ((length = getdelim(&unit, &size, '\0', input)) > 1) {
+        if (unit_count == capacity) {
+            capacity *= 2;
+            units = realloc(units, sizeof(char *) * capacity);
+        }
+        units[unit_count++] = strdup(unit);
+    }
+    bool received = length == 1;
+    free(unit);
+    fclose(input);
+
+    for (size_t i = 0; received && i < unit_count; i++) {
+        shard_cost_t cost;
+        uint64_t begin = metrics_now();
+        finder_find_stream(units[i], expressions, NULL, NULL, NULL, count, shard_serve_found, output, &cost.stats);
+        cost.duration = metrics_now() - begin;
+        shard_send_record(output, SHARD_UNIT, i, &cost, sizeof(shard_cost_t));
+    }
+    if (received) {
+        shard_send_record(output, SHARD_DONE, 0, NULL, 0);
+    }
+
+    bool failed = !received || ferror(output);
+    if (fclose(output) != 0) {
+        failed = true;
+    }
+    for (size_t i = 0; i < unit_count; i++) {
+        free(units[i]);
+    }
+    free(units);
+    return failed;
+}
+
+void shard_set_free(shard_set_t *set) {
+    shard_measures_clear(set);
+    free(set);
+}
@@ -0,0 +1,113 @@
+/**
+ * Search of a tree split into shards, each searched by a worker process, the files they find being merged.
+ *
+ * The search path is partitioned into units, its top-level entries, which are spread over the shards so that
+ * their costs are even: the costliest unit first, each unit given to the shard with the lowest cost so far.
+ * The cost of a unit is the duration of its last search, measured by the worker searching it, so the shards are
+ * rebalanced at each search as the tree changes; a unit never searched gets the mean cost of the others.
+ *
+ * Each shard is searched by a worker process, isolating the searcher from the crashes of the workers and letting
+ * the trees spanning several slow devices be read in parallel. A worker speaks the following protocol, over a
+ * stream in both directions (a socket):
+ *   - it receives the units to search, each a path terminated by a '\0', the list ending with an empty path;
+ *   - it replies a stream of records, each a header (shard_record_t) followed by its payload: a found file
+ *     (SHARD_MATCH), the end of the search of a unit with its cost (SHARD_UNIT), and the end of the search of
+ *     all the units (SHARD_DONE).
+ * The values are in host order. The workers are forked locally, and serve the protocol with shard_serve():
+ * a remote scan node given the same expressions could serve it the same way on a connected socket.
+ *
+ * The files found are passed to the callback as they are received from any worker, a file found by several
+ * workers (through symbolic links) being passed once. The units whose search is not reported complete by their
+ * worker, because it crashed or broke the protocol, are searched again by the calling thread.
+ *
+ * @author Claudio Sousa, Gonzalez David
+ * @file
+ */
+
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "finder.h"
+#include "parser.h"
+
+/**
+ * Record of a found file: the value is the index of the expression matched, the payload the real path of the
+ * file, terminated by a '\0'
+ */
+#define SHARD_MATCH 1
+/**
+ * Record of the end of the search of a unit: the value is the index of the unit in the list received,
+ * the payload its cost (shard_cost_t)
+ */
+#define SHARD_UNIT 2
+/**
+ * Record of the end of the search of all the units, without payload
+ */
+#define SHARD_DONE 3
+
+/**
+ * Header of a record sent by a worker
+ */
+typedef struct shard_record_t {
+    uint32_t type;  /**< SHARD_MATCH, SHARD_UNIT or SHARD_DONE */
+    uint32_t size;  /**< Size of the payload following the header */
+    uint64_t value; /**< Index of the expression or of the unit */
+} shard_record_t;
+
+/**
+ * Cost of the search of a unit, the payload of a SHARD_UNIT record
+ */
+typedef struct shard_cost_t {
+    uint64_t duration;    /**< Duration of the search, in microseconds */
+    finder_stats_t stats; /**< Counters of the search */
+} shard_cost_t;
+
+struct shard_set_t;
+/**
+ * Contains the shards of a search path and the costs of its units, measured from one search to the next.
+ * Can only be created by shard_set_create()
+ */
+typedef struct shard_set_t shard_set_t;
+
+/**
+ * Create the shards of a search, without any cost measured.
+ * @param workers Number of worker processes, the maximum number of shards
+ * @return The created shards
+ */
+shard_set_t *shard_set_create(size_t workers);
+
+/**
+ * Find the files of a search path matching each of the expressions, the shards being searched in parallel by
+ * worker processes, passing each found file to a callback as soon as it is received.
+ * The expressions cannot have a limit, and their deadlines are not recorded: the earliest one is given in the
+ * counters instead, see finder_find_stream().
+ * @param set The shards, whose costs are updated
+ * @param search_path Where to look for the files
+ * @param expressions The expressions
+ * @param count Number of expressions
+ * @param callback Receives the found files, from the calling thread
+ * @param data Data passed to `callback`
+ * @param stats Receives the counters of the search, summed over the units, NULL if not needed
+ */
+void shard_find_stream(shard_set_t *set, char *search_path, parser_t **expressions, size_t count,
+                       finder_callback_t callback, void *data, finder_stats_t *stats);
+
+/**
+ * Serve the protocol of a worker: receive the units to search, search them and reply the records.
+ * @param in Where the units are received
+ * @param out Where the records are sent, possibly `in`
+ * @param expressions The expressions
+ * @param count Number of expressions
+ * @return Error indicator: 0 for OK, 1 if the units could not be received or the records sent
+ */
+int shard_serve(int in, int out, parser_t **expressions, size_t count);
+
+/**
+ * Free the shards of a search.
+ * @param set The shards to free
+ */
+void shard_set_free(shard_set_t *set);
+
+#endif
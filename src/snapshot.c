@@ -0,0 +1,322 @@
+/**
+ * Publishes the result set of a destination folder in shared memory, readable without locks.
+ *
+ * The writer keeps two slots for the records in the file: the current result set is in one,
+ * and the next one is written in the other. A slot too small for a result set is moved to the
+ * end of the file with twice the capacity needed, so the file stays within a few times the size
+ * of the largest result set. The records are written with pwrite(), only the header is mapped.
+ *
+ * @author Claudio Sousa, Gonzalez David
+ * @file
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "snapshot.h"
+#include "logger.h"
+
+/**
+ * Alignment of the records and of the slots
+ */
+#define SNAPSHOT_ALIGN 8
+/**
+ * Size of the fixed part of a record: the lengths
+ */
+#define SNAPSHOT_RECORD_HEADER (2 * sizeof(uint32_t))
+/**
+ * Number of attempts to find the header unchanged before yielding the processor
+ */
+#define SNAPSHOT_SPIN_COUNT 1024
+
+/**
+ * Round a size up to the alignment.
+ */
+#define SNAPSHOT_ALIGNED(size) (((size) + SNAPSHOT_ALIGN - 1) & ~(uint64_t)(SNAPSHOT_ALIGN - 1))
+
+/**
+ * Contains the snapshot of a destination folder, on the writer side
+ */
+struct snapshot_t {
+    char *path;                 /**< Path of the file */
+    int fd;                     /**< The opened file */
+    snapshot_header_t *header;  /**< The mapped header */
+    uint64_t slot_offset[2];    /**< Offset of the slots in the file */
+    uint64_t slot_capacity[2];  /**< Capacity of the slots */
+    int active;                 /**< Slot of the current result set */
+    char *buffer;               /**< Records of the result set being built */
+    size_t used;                /**< Bytes used in the buffer */
+    size_t size;                /**< Allocated bytes of the buffer */
+    uint64_t count;             /**< Number of records in the buffer */
+};
+
+/**
+ * Contains a snapshot file, on the reader side
+ */
+struct snapshot_reader_t {
+    int fd;      /**< The opened file */
+    char *map;   /**< The mapped file */
+    size_t size; /**< Size of the mapping */
+};
+
+snapshot_t *snapshot_create(char *path) {
+    // A new file, so the readers of a previous one never see it shrink
+    unlink(path);
+    int fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd == -1 || ftruncate(fd, SNAPSHOT_HEADER_SIZE) != 0) {
+        logger_perror("Snapshot: error: cannot create snapshot file");
+        if (fd != -1) {
+            close(fd);
+            unlink(path);
+        }
+        return NULL;
+    }
+    snapshot_header_t *header = mmap(NULL, SNAPSHOT_HEADER_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (header == MAP_FAILED) {
+        logger_perror("Snapshot: error: cannot map snapshot file");
+        close(fd);
+        unlink(path);
+        return NULL;
+    }
+
+    header->closed = 0;
+    header->sequence = 0;
+    header->generation = 0;
+    header->offset = SNAPSHOT_HEADER_SIZE;
+    header->size = 0;
+    header->count = 0;
+    header->file_size = SNAPSHOT_HEADER_SIZE;
+    __atomic_store_n(&header->magic, SNAPSHOT_MAGIC, __ATOMIC_RELEASE);
+
+    snapshot_t *snapshot = malloc(sizeof(snapshot_t));
+    snapshot->path = strdup(path);
+    snapshot->fd = fd;
+    snapshot->header = header;
+    for (int i = 0; i < 2; i++) {
+        snapshot->slot_offset[i] = SNAPSHOT_HEADER_SIZE;
+        snapshot->slot_capacity[i] = 0;
+    }
+    snapshot->active = 0;
+    snapshot->size = 4096;
+    snapshot->buffer = malloc(snapshot->size);
+    snapshot->used = 0;
+    snapshot->count = 0;
+    return snapshot;
+}
+
+void snapshot_add(bool added, char *name, char *target, void *data) {
+    snapshot_t *snapshot = data;
+    if (!added) {
+        return;
+    }
+
+    uint32_t name_len = strlen(name);
+    uint32_t target_len = strlen(target);
+    size_t record_size = SNAPSHOT_ALIGNED(SNAPSHOT_RECORD_HEADER + name_len + 1 + target_len + 1);
+    while (snapshot->used + record_size > snapshot->size) {
+        snapshot->size *= 2;
+        snapshot->buffer = realloc(snapshot->buffer, snapshot->size);
+    }
+
+    char *record = snapshot->buffer + snapshot->used;
+    memset(record, 0, record_size);
+    memcpy(record, &name_len, sizeof(uint32_t));
+    memcpy(record + sizeof(uint32_t), &target_len, sizeof(uint32_t));
+    memcpy(record + SNAPSHOT_RECORD_HEADER, name, name_len);
+    memcpy(record + SNAPSHOT_RECORD_HEADER + name_len + 1, target, target_len);
+
+    snapshot->used += record_size;
+    snapshot->count++;
+}
+
+int snapshot_publish(snapshot_t *snapshot, uint64_t generation) {
+    snapshot_header_t *header = snapshot->header;
+    int slot = 1 - snapshot->active;
+    uint64_t file_size = header->file_size;
+
+    // A slot too small moves to the end of the file, the current result set staying in place
+    if (snapshot->slot_capacity[slot] < snapshot->used) {
+        snapshot->slot_offset[slot] = SNAPSHOT_ALIGNED(file_size);
+        snapshot->slot_capacity[slot] = SNAPSHOT_ALIGNED(snapshot->used * 2);
+        file_size = snapshot->slot_offset[slot] + snapshot->slot_capacity[slot];
+        if (ftruncate(snapshot->fd, file_size) != 0) {
+            logger_perror("Snapshot: error: cannot grow snapshot file");
+            snapshot->slot_capacity[slot] = 0;
+            snapshot->used = 0;
+            snapshot->count = 0;
+            return 1;
+        }
+    }
+
+    size_t written = 0;
+    while (written < snapshot->used) {
+        ssize_t done = pwrite(snapshot->fd, snapshot->buffer + written, snapshot->used - written,
+                              snapshot->slot_offset[slot] + written);
+        if (done <= 0) {
+            logger_perror("Snapshot: error: cannot write snapshot file");
+            snapshot->used = 0;
+            snapshot->count = 0;
+            return 1;
+        }
+        written += done;
+    }
+
+    // The readers of the current slot are not disturbed, only the header changes
+    uint64_t sequence = header->sequence;
+    __atomic_store_n(&header->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&header->generation, generation, __ATOMIC_RELAXED);
+    __atomic_store_n(&header->offset, snapshot->slot_offset[slot], __ATOMIC_RELAXED);
+    __atomic_store_n(&header->size, snapshot->used, __ATOMIC_RELAXED);
+    __atomic_store_n(&header->count, snapshot->count, __ATOMIC_RELAXED);
+    __atomic_store_n(&header->file_size, file_size, __ATOMIC_RELAXED);
+    __atomic_store_n(&header->sequence, sequence + 2, __ATOMIC_RELEASE);
+
+    snapshot->active = slot;
+    snapshot->used = 0;
+    snapshot->count = 0;
+    return 0;
+}
+
+void snapshot_free(snapshot_t *snapshot) {
+    snapshot_header_t *header = snapshot->header;
+    uint64_t sequence = header->sequence;
+    __atomic_store_n(&header->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&header->closed, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&header->sequence, sequence + 2, __ATOMIC_RELEASE);
+
+    munmap(snapshot->header, SNAPSHOT_HEADER_SIZE);
+    close(snapshot->fd);
+    unlink(snapshot->path);
+    free(snapshot->path);
+    free(snapshot->buffer);
+    free(snapshot);
+}
+
+/**
+ * Map a snapshot file, replacing the previous mapping.
+ * @param reader The reader
+ * @param size Size to map
+ * @return Error indicator: 0 for OK, 1 for an error
+ */
+static int snapshot_map(snapshot_reader_t *reader, size_t size) {
+    if (reader->map != NULL) {
+        munmap(reader->map, reader->size);
+        reader->map = NULL;
+    }
+    char *map = mmap(NULL, size, PROT_READ, MAP_SHARED, reader->fd, 0);
+    if (map == MAP_FAILED) {
+        logger_perror("Snapshot: error: cannot map snapshot file");
+        return 1;
+    }
+    reader->map = map;
+    reader->size = size;
+    return 0;
+}
+
+snapshot_reader_t *snapshot_open(char *path) {
+    struct stat file_stat;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1 || fstat(fd, &file_stat) != 0 || file_stat.st_size < SNAPSHOT_HEADER_SIZE) {
+        logger_error("Snapshot: error: cannot open snapshot file '%s'\n", path);
+        if (fd != -1) {
+            close(fd);
+        }
+        return NULL;
+    }
+
+    snapshot_reader_t *reader = malloc(sizeof(snapshot_reader_t));
+    reader->fd = fd;
+    reader->map = NULL;
+    if (snapshot_map(reader, file_stat.st_size) != 0 ||
+        __atomic_load_n(&((snapshot_header_t *)reader->map)->magic, __ATOMIC_ACQUIRE) != SNAPSHOT_MAGIC) {
+        logger_error("Snapshot: error: invalid snapshot file '%s'\n", path);
+        snapshot_close(reader);
+        return NULL;
+    }
+    return reader;
+}
+
+int snapshot_begin(snapshot_reader_t *reader, snapshot_view_t *view) {
+    for (unsigned int attempt = 0;; attempt++) {
+        snapshot_header_t *header = (snapshot_header_t *)reader->map;
+        uint64_t sequence = __atomic_load_n(&header->sequence, __ATOMIC_ACQUIRE);
+        if (sequence & 1) {
+            if (attempt >= SNAPSHOT_SPIN_COUNT) {
+                sched_yield();
+            }
+            continue;  // the writer is switching the header
+        }
+
+        bool closed = __atomic_load_n(&header->closed, __ATOMIC_RELAXED);
+        uint64_t offset = __atomic_load_n(&header->offset, __ATOMIC_RELAXED);
+        uint64_t file_size = __atomic_load_n(&header->file_size, __ATOMIC_RELAXED);
+        view->generation = __atomic_load_n(&header->generation, __ATOMIC_RELAXED);
+        view->size = __atomic_load_n(&header->size, __ATOMIC_RELAXED);
+        view->count = __atomic_load_n(&header->count, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&header->sequence, __ATOMIC_RELAXED) != sequence) {
+            continue;
+        }
+
+        if (closed) {
+            return 1;
+        }
+        if (file_size > reader->size) {
+            if (snapshot_map(reader, file_size) != 0) {
+                return 1;
+            }
+            continue;
+        }
+        if (offset + view->size > reader->size) {
+            return 1;  // not written by the writer
+        }
+
+        view->sequence = sequence;
+        view->records = reader->map + offset;
+        view->position = 0;
+        return 0;
+    }
+}
+
+bool snapshot_next(snapshot_view_t *view, char **name, char **target) {
+    uint32_t name_len, target_len;
+    if (view->size - view->position < SNAPSHOT_RECORD_HEADER) {
+        return false;
+    }
+
+    // The records may be changing if the view is invalid: nothing is trusted out of the bounds
+    char *record = view->records + view->position;
+    memcpy(&name_len, record, sizeof(uint32_t));
+    memcpy(&target_len, record + sizeof(uint32_t), sizeof(uint32_t));
+    uint64_t record_size = SNAPSHOT_ALIGNED(SNAPSHOT_RECORD_HEADER + (uint64_t)name_len + 1 + target_len + 1);
+    if (view->size - view->position < record_size) {
+        return false;
+    }
+    *name = record + SNAPSHOT_RECORD_HEADER;
+    *target = *name + name_len + 1;
+    if ((*name)[name_len] != '\0' || (*target)[target_len] != '\0') {
+        return false;
+    }
+
+    view->position += record_size;
+    return true;
+}
+
+bool snapshot_validate(snapshot_reader_t *reader, snapshot_view_t *view) {
+    snapshot_header_t *header = (snapshot_header_t *)reader->map;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&header->sequence, __ATOMIC_RELAXED) == view->sequence;
+}
+
+void snapshot_close(snapshot_reader_t *reader) {
+    if (reader->map != NULL) {
+        munmap(reader->map, reader->size);
+    }
+    close(reader->fd);
+    free(reader);
+}
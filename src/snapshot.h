@@ -0,0 +1,147 @@
+/**
+ * Publishes the result set of a destination folder in shared memory, readable without locks.
+ *
+ * The snapshot is a file in shared memory (see ipc_get_snapshot_path()) starting with a header
+ * (snapshot_header_t) that designates the records of the current result set, each made of:
+ *   - the length of the link name and the length of the target path, 4 bytes each (host order);
+ *   - the link name and the target path, each terminated by a '\0';
+ *   - padding to a multiple of 8 bytes.
+ *
+ * The records are double-buffered: a new result set is written where it does not overlap the
+ * current one, then the header is switched to it. The switch is protected by a sequence counter
+ * (seqlock), odd while the header is modified: a reader notes the counter, iterates the records
+ * in place, and checks that the counter did not change, retrying otherwise. The file only grows,
+ * a reader remapping it when the header announces a larger file than the one it mapped.
+ *
+ * The writer is the daemon (snapshot_create(), snapshot_add(), snapshot_publish()), the readers
+ * are any process of the user (snapshot_open(), snapshot_begin(), snapshot_next(), snapshot_validate()).
+ *
+ * @author Claudio Sousa, Gonzalez David
+ * @file
+ */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Magic number of a snapshot file
+ */
+#define SNAPSHOT_MAGIC 0x53465331u
+/**
+ * Size of the header, the records following it
+ */
+#define SNAPSHOT_HEADER_SIZE 4096
+
+/**
+ * Header of a snapshot file
+ */
+typedef struct snapshot_header_t {
+    uint32_t magic;      /**< SNAPSHOT_MAGIC */
+    uint32_t closed;     /**< 1 once the writer stopped, the file being deleted */
+    uint64_t sequence;   /**< Incremented before and after each change of the header, odd during it */
+    uint64_t generation; /**< Generation of the result set */
+    uint64_t offset;     /**< Offset of the records in the file */
+    uint64_t size;       /**< Size of the records, in bytes */
+    uint64_t count;      /**< Number of records */
+    uint64_t file_size;  /**< Size of the file */
+} snapshot_header_t;
+
+struct snapshot_t;
+/**
+ * Publishes the result set of a destination folder.
+ * Can only be created by snapshot_create()
+ */
+typedef struct snapshot_t snapshot_t;
+
+/**
+ * Create a snapshot file, replacing an existing one.
+ * @param path Path of the file, copied
+ * @return The created snapshot, NULL for an error
+ */
+snapshot_t *snapshot_create(char *path);
+
+/**
+ * Add a link to the result set being built, with the signature of linker_result_callback_t.
+ * @param added If the link is part of the result set, the removed links being ignored
+ * @param name Name of the link
+ * @param target Path of the target file
+ * @param snapshot The snapshot
+ */
+void snapshot_add(bool added, char *name, char *target, void *snapshot);
+
+/**
+ * Publish the result set built, which becomes the current one, and start building a new one.
+ * @param snapshot The snapshot
+ * @param generation Generation of the result set
+ * @return Error indicator: 0 for OK, 1 for an error
+ */
+int snapshot_publish(snapshot_t *snapshot, uint64_t generation);
+
+/**
+ * Free a snapshot, deleting its file.
+ * @param snapshot The snapshot to free
+ */
+void snapshot_free(snapshot_t *snapshot);
+
+struct snapshot_reader_t;
+/**
+ * Reads a snapshot file.
+ * Can only be created by snapshot_open()
+ */
+typedef struct snapshot_reader_t snapshot_reader_t;
+
+/**
+ * A consistent view of a snapshot, as long as snapshot_validate() confirms it
+ */
+typedef struct snapshot_view_t {
+    uint64_t sequence;   /**< Sequence counter when the view was taken */
+    uint64_t generation; /**< Generation of the result set */
+    uint64_t count;      /**< Number of records */
+    char *records;       /**< The records, in the mapping of the reader */
+    uint64_t size;       /**< Size of the records */
+    uint64_t position;   /**< Offset of the next record to iterate */
+} snapshot_view_t;
+
+/**
+ * Open a snapshot file.
+ * @param path Path of the file
+ * @return The reader, NULL for an error
+ */
+snapshot_reader_t *snapshot_open(char *path);
+
+/**
+ * Take a view of the current result set. Only remaps the file, when it grew.
+ * @param reader The reader
+ * @param view Receives the view
+ * @return Error indicator: 0 for OK, 1 for an error or a closed snapshot
+ */
+int snapshot_begin(snapshot_reader_t *reader, snapshot_view_t *view);
+
+/**
+ * Iterate the records of a view, in place. The records are only valid if the view is validated afterwards.
+ * @param view The view
+ * @param name Receives the name of the link
+ * @param target Receives the path of the target file
+ * @return True if a record was read, false at the end of the records
+ */
+bool snapshot_next(snapshot_view_t *view, char **name, char **target);
+
+/**
+ * Check that the result set did not change since a view was taken.
+ * @param reader The reader
+ * @param view The view
+ * @return True if everything read from the view is consistent, false to retry
+ */
+bool snapshot_validate(snapshot_reader_t *reader, snapshot_view_t *view);
+
+/**
+ * Close a snapshot file.
+ * @param reader The reader to close
+ */
+void snapshot_close(snapshot_reader_t *reader);
+
+#endif
@@ -0,0 +1,263 @@
+/**
+ * Records the phases of the executions as spans, written in the Chrome Trace Event format.
+ *
+ * Each thread records its spans in its own buffer, under a lock only contended while the spans are
+ * written. The file is protected by another lock, always taken before the lock of a buffer.
+ *
+ * @author Claudio Sousa, Gonzalez David
+ * @file
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "trace.h"
+#include "logger.h"
+
+/**
+ * Number of spans a buffer holds before being written
+ */
+#define TRACE_BUFFER_SPANS 1024
+/**
+ * Maximum size of the detail of a span, longer ones being truncated
+ */
+#define TRACE_DETAIL_MAX 256
+
+/**
+ * A recorded span
+ */
+typedef struct trace_span_t {
+    char *category;                /**< Category of the span */
+    char *name;                    /**< Name of the span */
+    uint64_t begin;                /**< When the span began, in nanoseconds */
+    uint64_t end;                  /**< When the span ended, in nanoseconds */
+    char detail[TRACE_DETAIL_MAX]; /**< What the span worked on, empty if nothing */
+} trace_span_t;
+
+/**
+ * Buffer of the spans of a thread
+ */
+typedef struct trace_buffer_t {
+    pthread_mutex_t lock;                   /**< Protects the spans */
+    pid_t tid;                              /**< Id of the thread */
+    trace_span_t spans[TRACE_BUFFER_SPANS]; /**< The spans not written yet */
+    size_t count;                           /**< Number of spans */
+    struct trace_buffer_t *next;            /**< Next in the chain */
+} trace_buffer_t;
+
+/**
+ * If the spans are recorded
+ */
+static bool g_enabled = false;
+/**
+ * Protects the file and the chain of buffers
+ */
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+/**
+ * Where the spans are written, NULL while tracing is disabled
+ */
+static FILE *g_file = NULL;
+/**
+ * The buffers of the threads
+ */
+static trace_buffer_t *g_buffers = NULL;
+/**
+ * Writes the buffer of a thread when it exits
+ */
+static pthread_key_t g_buffer_key;
+/**
+ * Creates g_buffer_key once
+ */
+static pthread_once_t g_buffer_key_once = PTHREAD_ONCE_INIT;
+/**
+ * The buffer of the current thread
+ */
+static __thread trace_buffer_t *t_buffer = NULL;
+
+/**
+ * Get the current time of the monotonic clock.
+ * @return The time, in nanoseconds
+ */
+static uint64_t trace_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * Write a string escaped for JSON. The file lock must be held.
+ * @param text The string
+ */
+static void trace_write_string(char *text) {
+    for (unsigned char *c = (unsigned char *)text; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(g_file, "\\%c", *c);
+        } else if (*c < 0x20) {
+            fprintf(g_file, "\\u%04x", *c);
+        } else {
+            fputc(*c, g_file);
+        }
+    }
+}
+
+/**
+ * Write the spans of a buffer and empty it. The file lock and the lock of the buffer must be held.
+ * @param buffer The buffer
+ */
+static void trace_write(trace_buffer_t *buffer) {
+    for (size_t i = 0; g_file && i < buffer->count; i++) {
+        trace_span_t *span = &buffer->spans[i];
+        fprintf(g_file, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d",
+                span->name, span->category, span->begin / 1e3, (span->end - span->begin) / 1e3, getpid(),
+                buffer->tid);
+        if (span->detail[0] != '\0') {
+            fprintf(g_file, ",\"args\":{\"detail\":\"");
+            trace_write_string(span->detail);
+            fprintf(g_file, "\"}");
+        }
+        fprintf(g_file, "},\n");
+    }
+    buffer->count = 0;
+}
+
+/**
+ * Write the spans of a thread that exits, and free its buffer.
+ * @param buffer The buffer of the thread
+ */
+static void trace_buffer_free(void *buffer) {
+    pthread_mutex_lock(&g_lock);
+    for (trace_buffer_t **b = &g_buffers; *b; b = &(*b)->next) {
+        if (*b == buffer) {
+            *b = (*b)->next;
+            break;
+        }
+    }
+    trace_write(buffer);
+    pthread_mutex_unlock(&g_lock);
+
+    pthread_mutex_destroy(&((trace_buffer_t *)buffer)->lock);
+    free(buffer);
+}
+
+/**
+ * Create the key of the buffers, called once.
+ */
+static void trace_buffer_key_create(void) {
+    pthread_key_create(&g_buffer_key, trace_buffer_free);
+}
+
+/**
+ * Get the buffer of the current thread, creating it the first time.
+ * @return The buffer
+ */
+static trace_buffer_t *trace_buffer(void) {
+    if (t_buffer == NULL) {
+        pthread_once(&g_buffer_key_once, trace_buffer_key_create);
+        t_buffer = malloc(sizeof(trace_buffer_t));
+        pthread_mutex_init(&t_buffer->lock, NULL);
+        t_buffer->tid = gettid();
+        t_buffer->count = 0;
+        pthread_setspecific(g_buffer_key, t_buffer);
+
+        pthread_mutex_lock(&g_lock);
+        t_buffer->next = g_buffers;
+        g_buffers = t_buffer;
+        pthread_mutex_unlock(&g_lock);
+    }
+    return t_buffer;
+}
+
+uint64_t trace_begin(void) {
+    return __atomic_load_n(&g_enabled, __ATOMIC_RELAXED) ? trace_now() : 0;
+}
+
+void trace_end(char *category, char *name, uint64_t begin, char *detail) {
+    if (begin == 0 || !__atomic_load_n(&g_enabled, __ATOMIC_RELAXED)) {
+        return;
+    }
+
+    uint64_t end = trace_now();
+    trace_buffer_t *buffer = trace_buffer();
+    pthread_mutex_lock(&buffer->lock);
+    if (buffer->count == TRACE_BUFFER_SPANS) {
+        // The file lock is taken first
+        pthread_mutex_unlock(&buffer->lock);
+        pthread_mutex_lock(&g_lock);
+        pthread_mutex_lock(&buffer->lock);
+        trace_write(buffer);
+        pthread_mutex_unlock(&g_lock);
+    }
+
+    trace_span_t *span = &buffer->spans[buffer->count++];
+    span->category = category;
+    span->name = name;
+    span->begin = begin;
+    span->end = end;
+    span->detail[0] = '\0';
+    if (detail != NULL) {
+        strncat(span->detail, detail, TRACE_DETAIL_MAX - 1);
+    }
+    pthread_mutex_unlock(&buffer->lock);
+}
+
+void trace_thread(char *name) {
+    if (!__atomic_load_n(&g_enabled, __ATOMIC_RELAXED)) {
+        return;
+    }
+
+    pthread_mutex_lock(&g_lock);
+    if (g_file != NULL) {
+        fprintf(g_file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}},\n",
+                getpid(), gettid(), name);
+    }
+    pthread_mutex_unlock(&g_lock);
+}
+
+int trace_start(void) {
+    char *path = getenv(TRACE_PATH_ENV);
+    if (path == NULL || path[0] == '\0') {
+        return 0;
+    }
+
+    pthread_mutex_lock(&g_lock);
+    g_file = fopen(path, "w");
+    if (g_file != NULL) {
+        fprintf(g_file, "[\n");
+        __atomic_store_n(&g_enabled, true, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&g_lock);
+
+    if (g_file == NULL) {
+        logger_perror("Trace: error: cannot create the trace file");
+        return 1;
+    }
+    return 0;
+}
+
+void trace_stop(void) {
+    if (!__atomic_load_n(&g_enabled, __ATOMIC_RELAXED)) {
+        return;
+    }
+    __atomic_store_n(&g_enabled, false, __ATOMIC_RELAXED);
+
+    pthread_mutex_lock(&g_lock);
+    for (trace_buffer_t *buffer = g_buffers; buffer; buffer = buffer->next) {
+        pthread_mutex_lock(&buffer->lock);
+        trace_write(buffer);
+        pthread_mutex_unlock(&buffer->lock);
+    }
+    // The last event has no trailing comma
+    fprintf(g_file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"searchfolder\"}}\n]\n",
+            getpid());
+    fclose(g_file);
+    g_file = NULL;
+    pthread_mutex_unlock(&g_lock);
+}
+
+void trace_forked(void) {
+    __atomic_store_n(&g_enabled, false, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,64 @@
+/**
+ * Records the phases of the executions as spans, written in the Chrome Trace Event format.
+ *
+ * Tracing is enabled by trace_start() when the environment variable TRACE_PATH_ENV names the file to write.
+ * The file is a JSON array of complete events ("ph":"X"), one per span, with the process and thread ids,
+ * which can be opened in Perfetto (https://ui.perfetto.dev) or chrome://tracing.
+ *
+ * A span is measured by trace_begin() and recorded by trace_end(). The spans are recorded in a buffer of
+ * the calling thread, written to the file when it is full, when the thread exits and by trace_stop().
+ * While tracing is disabled, trace_begin() only reads a flag and trace_end() returns right away.
+ *
+ * @author Claudio Sousa, Gonzalez David
+ * @file
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+/**
+ * Environment variable giving the file where the spans are written, tracing being disabled if not set
+ */
+#define TRACE_PATH_ENV "SEARCHFOLDER_TRACE"
+
+/**
+ * Begin a span.
+ * @return When the span begins, 0 if tracing is disabled
+ */
+uint64_t trace_begin(void);
+
+/**
+ * End a span and record it.
+ * @param category Category of the span, usually the module recording it, a constant string
+ * @param name Name of the span, a constant string
+ * @param begin What trace_begin() returned, the span being ignored if 0
+ * @param detail What the span worked on, copied, NULL if none
+ */
+void trace_end(char *category, char *name, uint64_t begin, char *detail);
+
+/**
+ * Name the calling thread in the trace.
+ * @param name Name of the thread, a constant string
+ */
+void trace_thread(char *name);
+
+/**
+ * Start tracing, if the environment variable TRACE_PATH_ENV is set.
+ * @return Error indicator: 0 for OK or if tracing is not requested, 1 if the file cannot be created
+ */
+int trace_start(void);
+
+/**
+ * Write the spans recorded and stop tracing.
+ */
+void trace_stop(void);
+
+/**
+ * Stop tracing in a child process forked by a traced process, without writing anything: the trace file and
+ * the spans recorded before the fork belong to the parent.
+ */
+void trace_forked(void);
+
+#endif
@@ -8,6 +8,7 @@
 #include <sys/types.h>
 #include "validator.h"
 #include "logger.h"
+#include "vendor/uthash.h"
 
 /** Number of criteria/operators */
 #define CRITERIA_COUNT 11
@@ -61,46 +62,81 @@ static int PERM_OPTIONS[PERM_OPTIONS_COUNT] = {R << U, W << U, X << U, R << G, W
 static int PERM_FLAGS[PERM_OPTIONS_COUNT] = {S_IRUSR, S_IWUSR, S_IXUSR, S_IRGRP, S_IWGRP,
                                              S_IXGRP, S_IROTH, S_IWOTH, S_IXOTH};
 
-static bool validate_exp_token(char *filename, struct stat *filestat, parser_t *exp);
+/** Hashtable entry mapping a criteria token to its shared result slot.
+    Equal criteria of different expressions share the same slot.
+    @see validator_memo_t
+ */
+typedef struct validator_leaf_t {
+    parser_t *exp;     /**< Criteria token (key) */
+    size_t slot;       /**< Index of the shared result in `validator_memo_t.results` */
+    UT_hash_handle hh; /**< Makes this structure hashable */
+} validator_leaf_t;
+
+/** Memoized criteria results of the file being validated.
+    Allows expressions of a `validator_set_t` to evaluate a common criteria only once per file.
+    @see validator_set_t
+ */
+typedef struct validator_memo_t {
+    validator_leaf_t *leaves;  /**< Hashtable of the criteria tokens */
+    signed char *results;      /**< Result per slot: -1 not evaluated yet, 0 invalid, 1 valid */
+    time_t *flips;             /**< Per slot, when the result flips as time passes, 0 never */
+    time_t deadline;           /**< Earliest flip of the criteria read by the expression being validated, 0 none */
+    size_t slot_count;         /**< Number of distinct criteria */
+    unsigned long evaluations; /**< Number of criteria evaluated */
+    unsigned long reused;      /**< Number of criteria results reused */
+} validator_memo_t;
+
+/** Contains the expressions of a set and their shared criteria results */
+struct validator_set_t {
+    parser_t **expressions; /**< Expressions of the set */
+    size_t count;           /**< Number of expressions */
+    validator_memo_t memo;  /**< Shared criteria results */
+};
+
+static bool validate_exp_token(char *filename, struct stat *filestat, parser_t *exp, validator_memo_t *memo);
 
 /** Validates OR operators. */
-static bool validate_or(char *filename, struct stat *filestat, parser_t *exp) {
-    return validate_exp_token(filename, filestat, exp->next) ||
-           validate_exp_token(filename, filestat, exp->next ? exp->next->next : NULL);
+static bool validate_or(char *filename, struct stat *filestat, parser_t *exp, validator_memo_t *memo) {
+    return validate_exp_token(filename, filestat, exp->next, memo) ||
+           validate_exp_token(filename, filestat, exp->next ? exp->next->next : NULL, memo);
 }
 
 /** Validates AND operators. */
-static bool validate_and(char *filename, struct stat *filestat, parser_t *exp) {
-    return validate_exp_token(filename, filestat, exp->next) &&
-           validate_exp_token(filename, filestat, exp->next ? exp->next->next : NULL);
+static bool validate_and(char *filename, struct stat *filestat, parser_t *exp, validator_memo_t *memo) {
+    return validate_exp_token(filename, filestat, exp->next, memo) &&
+           validate_exp_token(filename, filestat, exp->next ? exp->next->next : NULL, memo);
 }
 
 /** Validates NOT operators. */
-static bool validate_not(char *filename, struct stat *filestat, parser_t *exp) {
-    return !validate_exp_token(filename, filestat, exp->next);
+static bool validate_not(char *filename, struct stat *filestat, parser_t *exp, validator_memo_t *memo) {
+    return !validate_exp_token(filename, filestat, exp->next, memo);
 }
 
 /** Validates NAME criteria. */
-static bool validate_name(char *filename, struct stat *filestat, parser_t *exp) {
+static bool validate_name(char *filename, struct stat *filestat, parser_t *exp, validator_memo_t *memo) {
+    (void)memo;
     (void)filestat;
     return exp->comp == EXACT ? strcmp(filename, (char *)exp->value) == 0
                               : strstr(filename, (char *)exp->value) != NULL;
 }
 
 /** Validates USER criteria. */
-static bool validate_user(char *filename, struct stat *filestat, parser_t *exp) {
+static bool validate_user(char *filename, struct stat *filestat, parser_t *exp, validator_memo_t *memo) {
+    (void)memo;
     (void)filename;
     return filestat->st_uid == *(unsigned int *)exp->value;
 }
 
 /** Validates GROUP criteria. */
-static bool validate_group(char *filename, struct stat *filestat, parser_t *exp) {
+static bool validate_group(char *filename, struct stat *filestat, parser_t *exp, validator_memo_t *memo) {
+    (void)memo;
     (void)filename;
     return filestat->st_gid == *(unsigned int *)exp->value;
 }
 
 /** Validates PERM criteria. */
-static bool validate_perm(char *filename, struct stat *filestat, parser_t *exp) {
+static bool validate_perm(char *filename, struct stat *filestat, parser_t *exp, validator_memo_t *memo) {
+    (void)memo;
     (void)filename;
     mode_t filemode = filestat->st_mode;
     int refperm = *(int *)exp->value;
@@ -115,7 +151,8 @@ static bool validate_perm(char *filename, struct stat *filestat, parser_t *exp)
 }
 
 /** Validates SIZE criteria. */
-static bool validate_size(char *filename, struct stat *filestat, parser_t *exp) {
+static bool validate_size(char *filename, struct stat *filestat, parser_t *exp, validator_memo_t *memo) {
+    (void)memo;
     (void)filename;
     long refsize = *(long *)exp->value;
     return exp->comp == EXACT ? refsize == filestat->st_size : (exp->comp == MIN) ^ !!(refsize < filestat->st_size);
@@ -129,25 +166,45 @@ static bool validate_time(time_t comp_time, parser_comp_t comp, long refseconds)
 }
 
 /** Validates ATIME criteria. */
-static bool validate_atime(char *filename, struct stat *filestat, parser_t *exp) {
+static bool validate_atime(char *filename, struct stat *filestat, parser_t *exp, validator_memo_t *memo) {
+    (void)memo;
     (void)filename;
     return validate_time(filestat->st_atime, exp->comp, *(long *)exp->value);
 }
 
 /** Validates MTIME criteria. */
-static bool validate_mtime(char *filename, struct stat *filestat, parser_t *exp) {
+static bool validate_mtime(char *filename, struct stat *filestat, parser_t *exp, validator_memo_t *memo) {
+    (void)memo;
     (void)filename;
     return validate_time(filestat->st_mtime, exp->comp, *(long *)exp->value);
 }
 
 /** Validates CTIME criteria. */
-static bool validate_ctime(char *filename, struct stat *filestat, parser_t *exp) {
+static bool validate_ctime(char *filename, struct stat *filestat, parser_t *exp, validator_memo_t *memo) {
+    (void)memo;
     (void)filename;
     return validate_time(filestat->st_ctime, exp->comp, *(long *)exp->value);
 }
 
+/** Computes when the result of a time criteria flips for a file, as the file gets older.
+
+    Once the age of the file is past the reference age of the criteria, its result does not change anymore.
+    @returns The time of the flip, 0 if the result does not change anymore
+ */
+static time_t validate_time_flip(struct stat *filestat, parser_t *exp) {
+    time_t comp_time = exp->crit == ATIME ? filestat->st_atime
+                       : exp->crit == MTIME ? filestat->st_mtime
+                                            : filestat->st_ctime;
+    long refseconds = *(long *)exp->value;
+    long s_delta = (long)difftime(time(NULL), comp_time);
+    if (s_delta > refseconds)
+        return 0;
+    // exact ages match for one second, the others flip once older than the reference age
+    return comp_time + refseconds + (exp->comp != EXACT || s_delta == refseconds);
+}
+
 /** Function pointer for criteria validate functions*/
-typedef bool (*validate_fn_t)(char *, struct stat *, parser_t *);
+typedef bool (*validate_fn_t)(char *, struct stat *, parser_t *, validator_memo_t *);
 
 /** List of  criteria validate functions.
 
@@ -166,15 +223,120 @@ static validate_fn_t validators[CRITERIA_COUNT] = {&validate_or,    &validate_an
     Retrieves the validate function corresponding to the expression token,
     which can be a criteria or an operator
 */
-static bool validate_exp_token(char *filename, struct stat *filestat, parser_t *exp) {
+static bool validate_exp_token(char *filename, struct stat *filestat, parser_t *exp, validator_memo_t *memo) {
     if (!exp) {
         logger_error("Validator: error: expected expression but found NULL\n");
         return false;
     }
 
-    return validators[exp->crit & CRITERIA_ORDER_MASK](filename, filestat, exp);
+    validate_fn_t validate = validators[exp->crit & CRITERIA_ORDER_MASK];
+    if (!memo || !(exp->crit & CRITERIA))
+        return validate(filename, filestat, exp, NULL);
+
+    validator_leaf_t *leaf;
+    HASH_FIND_PTR(memo->leaves, &exp, leaf);
+    if (!leaf)
+        return validate(filename, filestat, exp, NULL);
+
+    if (memo->results[leaf->slot] < 0) {
+        memo->results[leaf->slot] = validate(filename, filestat, exp, NULL);
+        memo->flips[leaf->slot] =
+            exp->crit == ATIME || exp->crit == MTIME || exp->crit == CTIME ? validate_time_flip(filestat, exp) : 0;
+        memo->evaluations++;
+    } else {
+        memo->reused++;
+    }
+    // the result read can only change when one of the criteria read flips
+    time_t flip = memo->flips[leaf->slot];
+    if (flip && (!memo->deadline || flip < memo->deadline))
+        memo->deadline = flip;
+    return memo->results[leaf->slot];
 }
 
 bool validator_validate(char *filename, struct stat *filestat, parser_t *expression) {
-    return !expression || validate_exp_token(filename, filestat, expression);
+    return !expression || validate_exp_token(filename, filestat, expression, NULL);
+}
+
+/** Compares the values of two criteria tokens of the same type. */
+static bool validator_same_criteria(parser_t *a, parser_t *b) {
+    if (a->crit != b->crit || a->comp != b->comp)
+        return false;
+
+    switch (a->crit) {
+        case NAME:
+            return strcmp((char *)a->value, (char *)b->value) == 0;
+        case USER:
+        case GROUP:
+            return *(unsigned int *)a->value == *(unsigned int *)b->value;
+        case PERM:
+            return *(int *)a->value == *(int *)b->value;
+        default:  // size and times
+            return *(long *)a->value == *(long *)b->value;
+    }
+}
+
+/** Registers a criteria token in the memo, reusing the slot of an equal criteria if any. */
+static void validator_memo_add(validator_memo_t *memo, parser_t *exp) {
+    validator_leaf_t *leaf = malloc(sizeof(validator_leaf_t)), *other, *tmp;
+    leaf->exp = exp;
+    leaf->slot = memo->slot_count;
+
+    HASH_ITER(hh, memo->leaves, other, tmp) {
+        if (validator_same_criteria(other->exp, exp)) {
+            leaf->slot = other->slot;
+            break;
+        }
+    }
+
+    if (leaf->slot == memo->slot_count)
+        memo->slot_count++;
+    HASH_ADD_PTR(memo->leaves, exp, leaf);
+}
+
+validator_set_t *validator_set_create(parser_t **expressions, size_t count) {
+    validator_set_t *set = malloc(sizeof(validator_set_t));
+    set->expressions = expressions;
+    set->count = count;
+    set->memo.leaves = NULL;
+    set->memo.slot_count = 0;
+    set->memo.evaluations = 0;
+    set->memo.reused = 0;
+
+    for (size_t i = 0; i < count; i++)
+        for (parser_t *exp = expressions[i]; exp; exp = exp->next)
+            if (exp->crit & CRITERIA)
+                validator_memo_add(&set->memo, exp);
+
+    set->memo.results = malloc(sizeof(signed char) * (set->memo.slot_count + 1));
+    set->memo.flips = malloc(sizeof(time_t) * (set->memo.slot_count + 1));
+    return set;
+}
+
+void validator_set_validate(validator_set_t *set, char *filename, struct stat *filestat, bool *results,
+                            time_t *deadlines) {
+    memset(set->memo.results, -1, set->memo.slot_count);
+
+    for (size_t i = 0; i < set->count; i++) {
+        set->memo.deadline = 0;
+        results[i] = !set->expressions[i] ||
+                     validate_exp_token(filename, filestat, set->expressions[i], &set->memo);
+        if (deadlines)
+            deadlines[i] = set->memo.deadline;
+    }
+}
+
+void validator_set_counts(validator_set_t *set, unsigned long *evaluations, unsigned long *reused) {
+    *evaluations = set->memo.evaluations;
+    *reused = set->memo.reused;
+}
+
+void validator_set_free(validator_set_t *set) {
+    validator_leaf_t *leaf, *tmp;
+    HASH_ITER(hh, set->memo.leaves, leaf, tmp) {
+        HASH_DEL(set->memo.leaves, leaf);
+        free(leaf);
+    }
+    free(set->memo.results);
+    free(set->memo.flips);
+    free(set);
 }
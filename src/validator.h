@@ -6,6 +6,7 @@
 
 #include <stdbool.h>
 #include <sys/stat.h>
+#include <time.h>
 #include "parser.h"
 
 /** Validates a file against an expression
@@ -17,4 +18,48 @@
  */
 bool validator_validate(char *filename, struct stat *filestat, parser_t *expression);
 
+struct validator_set_t;
+/** A set of expressions validated together against the same files.
+
+    Criteria appearing in several expressions (e.g. the same `-user`) are evaluated only once per file.
+    Can only be created by `validator_set_create`
+ */
+typedef struct validator_set_t validator_set_t;
+
+/** Creates a set of expressions to be validated together
+
+    @param expressions The expressions of the set, a *NULL* expression validates all files
+    @param count The number of expressions
+    @returns The created set
+ */
+validator_set_t *validator_set_create(parser_t **expressions, size_t count);
+
+/** Validates a file against all the expressions of a set
+
+    The result of an expression with time criteria (e.g. `-mtime -1d`) can flip as time passes, without the file
+    changing: the earliest moment one of the criteria evaluated flips is then given as the deadline of the result.
+
+    @param set The set of expressions
+    @param filename The file's name
+    @param filestat The file's attributes
+    @param results Receives, for each expression of the set, if the file is valid
+    @param deadlines Receives, for each expression of the set, when its result may flip, 0 if it does not depend
+                     on time; *NULL* if not needed
+ */
+void validator_set_validate(validator_set_t *set, char *filename, struct stat *filestat, bool *results,
+                            time_t *deadlines);
+
+/** Retrieves the number of criteria evaluated by a set since its creation
+    @param set The set of expressions
+    @param evaluations Receives the number of criteria evaluated
+    @param reused Receives the number of criteria results reused from another expression instead of being evaluated
+ */
+void validator_set_counts(validator_set_t *set, unsigned long *evaluations, unsigned long *reused);
+
+/** Frees the memory allocated by `validator_set_create`
+    The expressions themselves are not freed.
+    @param set The set to be freed
+ */
+void validator_set_free(validator_set_t *set);
+
 #endif
@@ -0,0 +1,139 @@
+/** This files performs unit testing on the expiry module.
+
+    Are unit tested:
+     - order of the deadlines
+     - deadlines not reached
+     - files leaving and entering the result set once their deadline is reached
+     - files kept with their next deadline
+
+    The results are validated against the current time: the files are recorded as if by a traversal done earlier,
+    their deadline being already reached.
+
+    /!\ attention: to keep the code as concice and readable as possible, allocated memory is not freed
+*/
+
+#include <string.h>
+#include "../src/expiry.h"
+#include "vendor/cutest.h"
+
+/**
+ * Files whose result flipped, as received by the callback
+ */
+typedef struct flips_t {
+    unsigned int count; /**< Number of files */
+    bool matched;       /**< If the last file now matches */
+    char path[64];      /**< Path of the last file */
+} flips_t;
+
+void on_flip(bool matched, char *path, void *data) {
+    flips_t *flips = data;
+    flips->count++;
+    flips->matched = matched;
+    strcpy(flips->path, path);
+}
+
+/**
+ * Get the attributes of a file modified some time ago.
+ * @param mtime When the file was modified
+ * @return The attributes
+ */
+struct stat modified_at(time_t mtime) {
+    struct stat filestat;
+    memset(&filestat, 0, sizeof(filestat));
+    filestat.st_mtime = mtime;
+    return filestat;
+}
+
+void test_empty() {
+    char *test_argv[] = {"-mtime", "-60m"};
+    expiry_t *expiry = expiry_create(parser_parse(test_argv, 2));
+    flips_t flips = {0};
+    TEST_CHECK_(expiry_next(expiry) == 0, "should have no deadline");
+    TEST_CHECK_(expiry_run(expiry, time(NULL), on_flip, &flips) == 0, "should flip nothing");
+    TEST_CHECK_(flips.count == 0, "should not call the callback");
+}
+
+void test_next() {
+    char *test_argv[] = {"-mtime", "-60m"};
+    expiry_t *expiry = expiry_create(parser_parse(test_argv, 2));
+    struct stat filestat = modified_at(time(NULL));
+    expiry_add(expiry, "b", "/b", &filestat, true, 300);
+    expiry_add(expiry, "a", "/a", &filestat, true, 100);
+    expiry_add(expiry, "c", "/c", &filestat, true, 200);
+    TEST_CHECK_(expiry_count(expiry) == 3, "should count the files");
+    TEST_CHECK_(expiry_next(expiry) == 100, "should return the earliest deadline, got %ld", (long)expiry_next(expiry));
+}
+
+void test_not_reached() {
+    char *test_argv[] = {"-mtime", "-60m"};
+    expiry_t *expiry = expiry_create(parser_parse(test_argv, 2));
+    flips_t flips = {0};
+    time_t now = time(NULL);
+    struct stat filestat = modified_at(now - 3000);
+    expiry_add(expiry, "a", "/a", &filestat, true, now + 601);
+    TEST_CHECK_(expiry_run(expiry, now, on_flip, &flips) == 0, "should flip nothing");
+    TEST_CHECK_(flips.count == 0, "should not call the callback");
+    TEST_CHECK_(expiry_count(expiry) == 1, "should keep the file");
+}
+
+void test_leave() {
+    char *test_argv[] = {"-mtime", "-60m"};
+    expiry_t *expiry = expiry_create(parser_parse(test_argv, 2));
+    flips_t flips = {0};
+    time_t now = time(NULL);
+    struct stat filestat = modified_at(now - 3700);
+    expiry_add(expiry, "a", "/dir/a", &filestat, true, now - 3700 + 3601);
+    TEST_CHECK_(expiry_run(expiry, now, on_flip, &flips) == 1, "should flip the file");
+    TEST_CHECK_(flips.count == 1 && !flips.matched, "should report the file leaving the result set");
+    TEST_CHECK_(strcmp(flips.path, "/dir/a") == 0, "should report the path, got %s", flips.path);
+    TEST_CHECK_(expiry_count(expiry) == 0, "should drop the file, its result not flipping anymore");
+}
+
+void test_enter() {
+    char *test_argv[] = {"-mtime", "+60m"};
+    expiry_t *expiry = expiry_create(parser_parse(test_argv, 2));
+    flips_t flips = {0};
+    time_t now = time(NULL);
+    struct stat filestat = modified_at(now - 3700);
+    expiry_add(expiry, "a", "/dir/a", &filestat, false, now - 3700 + 3601);
+    TEST_CHECK_(expiry_run(expiry, now, on_flip, &flips) == 1, "should flip the file");
+    TEST_CHECK_(flips.count == 1 && flips.matched, "should report the file entering the result set");
+    TEST_CHECK_(expiry_count(expiry) == 0, "should drop the file, its result not flipping anymore");
+}
+
+void test_kept() {
+    char *test_argv[] = {"-mtime", "60m"};
+    expiry_t *expiry = expiry_create(parser_parse(test_argv, 2));
+    flips_t flips = {0};
+    time_t now = time(NULL);
+    struct stat filestat = modified_at(now - 3000);
+    expiry_add(expiry, "a", "/dir/a", &filestat, false, now - 100);
+    TEST_CHECK_(expiry_run(expiry, now, on_flip, &flips) == 0, "should not flip the file");
+    TEST_CHECK_(flips.count == 0, "should not call the callback");
+    TEST_CHECK_(expiry_count(expiry) == 1, "should keep the file");
+    TEST_CHECK_(expiry_next(expiry) == now - 3000 + 3600, "should keep the file until it has the exact age");
+}
+
+void test_only_reached() {
+    char *test_argv[] = {"-mtime", "-60m"};
+    expiry_t *expiry = expiry_create(parser_parse(test_argv, 2));
+    flips_t flips = {0};
+    time_t now = time(NULL);
+    struct stat old = modified_at(now - 3700);
+    struct stat recent = modified_at(now - 3000);
+    expiry_add(expiry, "recent", "/recent", &recent, true, now - 3000 + 3601);
+    expiry_add(expiry, "old", "/old", &old, true, now - 3700 + 3601);
+    TEST_CHECK_(expiry_run(expiry, now, on_flip, &flips) == 1, "should flip one file");
+    TEST_CHECK_(strcmp(flips.path, "/old") == 0, "should flip the file whose deadline is reached");
+    TEST_CHECK_(expiry_count(expiry) == 1, "should keep the other file");
+    TEST_CHECK_(expiry_next(expiry) == now - 3000 + 3601, "should keep the deadline of the other file");
+}
+
+TEST_LIST = {{"empty", test_empty},
+             {"next", test_next},
+             {"not reached", test_not_reached},
+             {"leave", test_leave},
+             {"enter", test_enter},
+             {"kept", test_kept},
+             {"only reached", test_only_reached},
+             {0}};
@@ -0,0 +1,113 @@
+/** This files performs unit testing on the heap module.
+
+    Are unit tested:
+     - order of the items pushed and popped
+     - empty heap
+     - growth of an unbounded heap
+     - eviction of the items by a bounded heap at its limit
+
+    /!\ attention: to keep the code as concice and readable as possible, allocated memory is not freed
+*/
+
+#include "../src/heap.h"
+#include "vendor/cutest.h"
+
+int compare_int(void *a, void *b) {
+    return *(int *)a - *(int *)b;
+}
+
+void test_empty() {
+    heap_t *heap = heap_create(compare_int, 0);
+    TEST_CHECK_(heap_count(heap) == 0, "should be empty");
+    TEST_CHECK_(heap_top(heap) == NULL, "should have no top");
+    TEST_CHECK_(heap_pop(heap) == NULL, "should pop nothing");
+}
+
+void test_push_pop() {
+    int values[] = {5, 3, 8, 1, 9, 2, 7};
+    heap_t *heap = heap_create(compare_int, 0);
+    for (int i = 0; i < 7; i++) {
+        heap_push(heap, &values[i]);
+    }
+    TEST_CHECK_(heap_count(heap) == 7, "should count the items");
+    TEST_CHECK_(*(int *)heap_top(heap) == 1, "should have the smallest item on top");
+
+    int last = 0;
+    for (int i = 0; i < 7; i++) {
+        int value = *(int *)heap_pop(heap);
+        TEST_CHECK_(value >= last, "should pop in order, got %d after %d", value, last);
+        last = value;
+    }
+    TEST_CHECK_(heap_count(heap) == 0, "should be empty");
+}
+
+void test_grow() {
+    static int values[1000];
+    heap_t *heap = heap_create(compare_int, 0);
+    for (int i = 0; i < 1000; i++) {
+        values[i] = (i * 7919) % 1000;
+        TEST_CHECK_(heap_offer(heap, &values[i]) == NULL, "should add without a limit");
+    }
+    TEST_CHECK_(heap_count(heap) == 1000, "should keep all the items, got %zu", heap_count(heap));
+    for (int i = 0; i < 1000; i++) {
+        int value = *(int *)heap_pop(heap);
+        if (!TEST_CHECK_(value == i, "should pop in order, got %d for %d", value, i)) {
+            break;
+        }
+    }
+}
+
+void test_offer_below_limit() {
+    int values[] = {4, 2, 6};
+    heap_t *heap = heap_create(compare_int, 3);
+    for (int i = 0; i < 3; i++) {
+        TEST_CHECK_(heap_offer(heap, &values[i]) == NULL, "should add below the limit");
+    }
+    TEST_CHECK_(heap_count(heap) == 3, "should keep the items");
+}
+
+void test_offer_replace_top() {
+    int values[] = {4, 2, 6, 5};
+    heap_t *heap = heap_create(compare_int, 3);
+    for (int i = 0; i < 3; i++) {
+        heap_offer(heap, &values[i]);
+    }
+    TEST_CHECK_(heap_offer(heap, &values[3]) == &values[1], "should replace the top");
+    TEST_CHECK_(heap_count(heap) == 3, "should stay at the limit");
+    TEST_CHECK_(*(int *)heap_top(heap) == 4, "should have the new smallest item on top");
+}
+
+void test_offer_reject() {
+    int values[] = {4, 2, 6, 1, 2};
+    heap_t *heap = heap_create(compare_int, 3);
+    for (int i = 0; i < 3; i++) {
+        heap_offer(heap, &values[i]);
+    }
+    TEST_CHECK_(heap_offer(heap, &values[3]) == &values[3], "should reject an item before the top");
+    TEST_CHECK_(heap_offer(heap, &values[4]) == &values[4], "should reject an item equal to the top");
+    TEST_CHECK_(heap_count(heap) == 3, "should stay at the limit");
+    TEST_CHECK_(heap_top(heap) == &values[1], "should keep the top");
+}
+
+void test_offer_keep_last() {
+    static int values[100];
+    heap_t *heap = heap_create(compare_int, 10);
+    for (int i = 0; i < 100; i++) {
+        values[i] = (i * 37) % 100;
+        heap_offer(heap, &values[i]);
+    }
+    TEST_CHECK_(heap_count(heap) == 10, "should keep the limit, got %zu", heap_count(heap));
+    for (int i = 90; i < 100; i++) {
+        int value = *(int *)heap_pop(heap);
+        TEST_CHECK_(value == i, "should keep the last items in order, got %d for %d", value, i);
+    }
+}
+
+TEST_LIST = {{"empty", test_empty},
+             {"push pop", test_push_pop},
+             {"grow", test_grow},
+             {"offer below limit", test_offer_below_limit},
+             {"offer replace top", test_offer_replace_top},
+             {"offer reject", test_offer_reject},
+             {"offer keep last", test_offer_keep_last},
+             {0}};
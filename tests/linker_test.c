@@ -0,0 +1,296 @@
+/** This files performs unit testing on the linker module.
+
+    Are unit tested:
+     - links created for the files given while they are found
+     - names of the duplicates, independent of the order of the files
+     - stability of the names of the duplicates across updates
+     - delta updates, only applying the files added and removed
+     - changes of the result set since a generation
+
+    The links are created in a temporary destination folder, with the flat layout and the in place publication.
+    Their targets do not need to exist.
+
+    /!\ attention: to keep the code as concice and readable as possible, allocated memory is not freed
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../src/linker.h"
+#include "vendor/cutest.h"
+
+/**
+ * Create an empty destination folder, unique to the test process.
+ * @return The path of the folder
+ */
+char *dst_create() {
+    static int count = 0;
+    char *path = malloc(64);
+    sprintf(path, "/tmp/linker_test.%d.%d", (int)getpid(), count++);
+    mkdir(path, S_IRWXU);
+    return path;
+}
+
+/**
+ * Delete a destination folder and its links.
+ * @param path The path of the folder
+ */
+void dst_delete(char *path) {
+    char link[512];
+    DIR *dir = opendir(path);
+    struct dirent *entry;
+    while (dir && (entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+            snprintf(link, sizeof(link), "%s/%s", path, entry->d_name);
+            unlink(link);
+        }
+    }
+    if (dir) {
+        closedir(dir);
+    }
+    rmdir(path);
+}
+
+/**
+ * Get the target of a link of a destination folder.
+ * @param dst The destination folder
+ * @param name Name of the link
+ * @return The target, overwritten by the next call, empty if the link does not exist
+ */
+char *target_of(char *dst, char *name) {
+    static char target[128];
+    char link[512];
+    snprintf(link, sizeof(link), "%s/%s", dst, name);
+    ssize_t length = readlink(link, target, sizeof(target) - 1);
+    target[length > 0 ? length : 0] = '\0';
+    return target;
+}
+
+/**
+ * Get the inode of a link of a destination folder, telling if it was created again.
+ * @param dst The destination folder
+ * @param name Name of the link
+ * @return The inode, 0 if the link does not exist
+ */
+ino_t inode_of(char *dst, char *name) {
+    struct stat link_stat;
+    char link[512];
+    snprintf(link, sizeof(link), "%s/%s", dst, name);
+    return lstat(link, &link_stat) == 0 ? link_stat.st_ino : 0;
+}
+
+/**
+ * Count the entries of a destination folder.
+ * @param dst The destination folder
+ * @return The number of entries
+ */
+int entries_of(char *dst) {
+    int count = 0;
+    DIR *dir = opendir(dst);
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        count += strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0;
+    }
+    closedir(dir);
+    return count;
+}
+
+/**
+ * Create a linker for a destination folder, with the default options.
+ * @param dst The destination folder
+ * @return The linker
+ */
+linker_t *create(char *dst) {
+    linker_options_t options;
+    linker_options_init(&options);
+    return linker_create(dst, &options);
+}
+
+/**
+ * Update the links with a full list of files.
+ * @param linker The linker
+ * @param files The files, terminated by NULL
+ * @return Number of links created or deleted
+ */
+unsigned int update(linker_t *linker, char **files) {
+    linker_begin(linker);
+    for (int i = 0; files[i] != NULL; i++) {
+        linker_add(linker, files[i]);
+    }
+    return linker_commit(linker);
+}
+
+/**
+ * Changes of the result set, as received by the callback
+ */
+typedef struct changes_t {
+    int added;       /**< Number of links added */
+    int removed;     /**< Number of links removed */
+    char last[64];   /**< Name of the last link added */
+    char target[64]; /**< Target of the last link added */
+} changes_t;
+
+void on_result(bool added, char *name, char *target, void *data) {
+    changes_t *changes = data;
+    if (added) {
+        changes->added++;
+        strcpy(changes->last, name);
+        strcpy(changes->target, target);
+    } else {
+        changes->removed++;
+    }
+}
+
+void test_update() {
+    char *dst = dst_create();
+    linker_t *linker = create(dst);
+    char *files[] = {"/src/a/a.c", "/src/b/a.c", "/src/c/x.c", NULL};
+    TEST_CHECK_(update(linker, files) == 3, "should create the links");
+    TEST_CHECK_(linker_count(linker) == 3 && entries_of(dst) == 3, "should count the links");
+    TEST_CHECK_(strcmp(target_of(dst, "a.c"), "/src/a/a.c") == 0, "should name the first path a.c, got %s",
+                target_of(dst, "a.c"));
+    TEST_CHECK_(strcmp(target_of(dst, "a.c.1"), "/src/b/a.c") == 0, "should name the next path a.c.1, got %s",
+                target_of(dst, "a.c.1"));
+    TEST_CHECK_(strcmp(target_of(dst, "x.c"), "/src/c/x.c") == 0, "should link x.c");
+    TEST_CHECK_(update(linker, files) == 0, "should not change anything");
+    linker_free(linker);
+    dst_delete(dst);
+}
+
+void test_order_independent() {
+    char *dst = dst_create();
+    linker_t *linker = create(dst);
+    char *files[] = {"/src/c/a.c", "/src/a/a.c", "/src/b/a.c", NULL};
+    update(linker, files);
+    TEST_CHECK_(strcmp(target_of(dst, "a.c"), "/src/a/a.c") == 0, "should name the first path a.c");
+    TEST_CHECK_(strcmp(target_of(dst, "a.c.1"), "/src/b/a.c") == 0, "should name the second path a.c.1");
+    TEST_CHECK_(strcmp(target_of(dst, "a.c.2"), "/src/c/a.c") == 0, "should name the third path a.c.2");
+    linker_free(linker);
+    dst_delete(dst);
+}
+
+void test_stable_names() {
+    char *dst = dst_create();
+    linker_t *linker = create(dst);
+    char *first[] = {"/src/b/a.c", "/src/c/a.c", NULL};
+    update(linker, first);
+    ino_t b = inode_of(dst, "a.c");
+    ino_t c = inode_of(dst, "a.c.1");
+
+    char *before[] = {"/src/a/a.c", "/src/b/a.c", "/src/c/a.c", NULL};
+    TEST_CHECK_(update(linker, before) == 1, "should only create the new link");
+    TEST_CHECK_(strcmp(target_of(dst, "a.c"), "/src/b/a.c") == 0, "should keep a.c for the linked file");
+    TEST_CHECK_(strcmp(target_of(dst, "a.c.1"), "/src/c/a.c") == 0, "should keep a.c.1 for the linked file");
+    TEST_CHECK_(strcmp(target_of(dst, "a.c.2"), "/src/a/a.c") == 0, "should name the new file a.c.2, got %s",
+                target_of(dst, "a.c.2"));
+    TEST_CHECK_(inode_of(dst, "a.c") == b && inode_of(dst, "a.c.1") == c, "should not create the links again");
+
+    char *without[] = {"/src/a/a.c", "/src/c/a.c", NULL};
+    TEST_CHECK_(update(linker, without) == 1, "should only delete the link of the file gone");
+    TEST_CHECK_(inode_of(dst, "a.c") == 0, "should delete a.c");
+    TEST_CHECK_(strcmp(target_of(dst, "a.c.1"), "/src/c/a.c") == 0, "should keep a.c.1");
+    TEST_CHECK_(strcmp(target_of(dst, "a.c.2"), "/src/a/a.c") == 0, "should keep a.c.2");
+
+    char *again[] = {"/src/a/a.c", "/src/c/a.c", "/src/d/a.c", NULL};
+    update(linker, again);
+    TEST_CHECK_(strcmp(target_of(dst, "a.c"), "/src/d/a.c") == 0, "should give the free name a.c to the new file");
+    TEST_CHECK_(strcmp(target_of(dst, "a.c.1"), "/src/c/a.c") == 0, "should keep a.c.1");
+    TEST_CHECK_(strcmp(target_of(dst, "a.c.2"), "/src/a/a.c") == 0, "should keep a.c.2");
+    TEST_CHECK_(entries_of(dst) == 3, "should have no other links");
+    linker_free(linker);
+    dst_delete(dst);
+}
+
+void test_delta() {
+    char *dst = dst_create();
+    linker_t *linker = create(dst);
+    char *files[] = {"/src/x.c", "/src/y.c", NULL};
+    update(linker, files);
+    ino_t y = inode_of(dst, "y.c");
+    linker_stats_t before, after;
+    linker_stats(linker, &before);
+
+    linker_begin_delta(linker);
+    linker_add(linker, "/src/z.c");
+    linker_remove(linker, "/src/x.c");
+    TEST_CHECK_(linker_commit(linker) == 2, "should only apply the changes");
+    linker_stats(linker, &after);
+    TEST_CHECK_(after.created - before.created == 1 && after.deleted - before.deleted == 1,
+                "should create one link and delete one");
+    TEST_CHECK_(inode_of(dst, "x.c") == 0, "should delete the link of the file removed");
+    TEST_CHECK_(inode_of(dst, "y.c") == y, "should keep the link of the file not given");
+    TEST_CHECK_(strcmp(target_of(dst, "z.c"), "/src/z.c") == 0, "should create the link of the file added");
+    TEST_CHECK_(linker_count(linker) == 2 && entries_of(dst) == 2, "should count the links");
+
+    linker_begin_delta(linker);
+    linker_remove(linker, "/src/unknown.c");
+    TEST_CHECK_(linker_commit(linker) == 0, "should ignore a file not linked");
+    linker_free(linker);
+    dst_delete(dst);
+}
+
+void test_delta_stable_names() {
+    char *dst = dst_create();
+    linker_t *linker = create(dst);
+    char *files[] = {"/src/b/a.c", NULL};
+    update(linker, files);
+
+    linker_begin_delta(linker);
+    linker_add(linker, "/src/a/a.c");
+    linker_commit(linker);
+    TEST_CHECK_(strcmp(target_of(dst, "a.c"), "/src/b/a.c") == 0, "should keep a.c for the linked file");
+    TEST_CHECK_(strcmp(target_of(dst, "a.c.1"), "/src/a/a.c") == 0, "should name the added file a.c.1");
+
+    linker_begin_delta(linker);
+    linker_remove(linker, "/src/b/a.c");
+    linker_commit(linker);
+    TEST_CHECK_(inode_of(dst, "a.c") == 0, "should delete a.c");
+    TEST_CHECK_(strcmp(target_of(dst, "a.c.1"), "/src/a/a.c") == 0, "should keep a.c.1");
+
+    linker_begin_delta(linker);
+    linker_add(linker, "/src/c/a.c");
+    linker_commit(linker);
+    TEST_CHECK_(strcmp(target_of(dst, "a.c"), "/src/c/a.c") == 0, "should give the free name a.c to the new file");
+    TEST_CHECK_(strcmp(target_of(dst, "a.c.1"), "/src/a/a.c") == 0, "should keep a.c.1");
+    linker_free(linker);
+    dst_delete(dst);
+}
+
+void test_results_since() {
+    char *dst = dst_create();
+    linker_t *linker = create(dst);
+    char *files[] = {"/src/x.c", "/src/y.c", NULL};
+    update(linker, files);
+    unsigned long generation = linker_generation(linker);
+    unsigned long listed = 0;
+
+    changes_t all = {0};
+    TEST_CHECK_(!linker_results(linker, 0, on_result, &all, &listed), "should list the whole result set");
+    TEST_CHECK_(all.added == 2 && all.removed == 0 && listed == generation, "should list the links");
+
+    linker_begin_delta(linker);
+    linker_add(linker, "/src/z.c");
+    linker_remove(linker, "/src/x.c");
+    linker_commit(linker);
+    TEST_CHECK_(linker_generation(linker) > generation, "should change the generation");
+
+    changes_t changes = {0};
+    TEST_CHECK_(linker_results(linker, generation, on_result, &changes, &listed), "should list the changes");
+    TEST_CHECK_(changes.added == 1 && changes.removed == 1, "should list one link added and one removed, got %d %d",
+                changes.added, changes.removed);
+    TEST_CHECK_(strcmp(changes.last, "z.c") == 0 && strcmp(changes.target, "/src/z.c") == 0,
+                "should list the link added");
+    TEST_CHECK_(listed == linker_generation(linker), "should return the generation listed");
+    linker_free(linker);
+    dst_delete(dst);
+}
+
+TEST_LIST = {{"update", test_update},
+             {"order independent", test_order_independent},
+             {"stable names", test_stable_names},
+             {"delta", test_delta},
+             {"delta stable names", test_delta_stable_names},
+             {"results since", test_results_since},
+             {0}};
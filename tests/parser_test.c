@@ -7,6 +7,8 @@
      - boolean operators priority
      - parentheses forced priority
      - combinations of all above
+     - limits of the result sets
+     - fingerprints of the expressions
 
     /!\ attention: to keep the code as concice and readable as possible, allocated memory is not freed
 */
@@ -318,6 +320,87 @@ void test_group_not_size_or_user_perm_p() {
                (parser_crit_t[]){AND, AND, PERM, NOT, OR, USER, SIZE, GROUP, 0});
 }
 
+void test_parse_no_limit() {
+    char *test_argv[] = {"-name", "test"};
+    size_t size = 2;
+    parser_limit_t limit;
+    TEST_CHECK_(parser_parse_limit(test_argv, &size, &limit) == 0, "should be valid");
+    TEST_CHECK_(size == 2, "size is %zu should be 2", size);
+    TEST_CHECK_(limit.count == 0, "count is %zu should be 0", limit.count);
+}
+
+void test_parse_limit() {
+    char *test_argv[] = {"-name", "-.pdf", "-limit", "500"};
+    size_t size = 4;
+    parser_limit_t limit;
+    TEST_CHECK_(parser_parse_limit(test_argv, &size, &limit) == 0, "should be valid");
+    TEST_CHECK_(size == 2, "size is %zu should be 2", size);
+    TEST_CHECK_(limit.count == 500, "count is %zu should be 500", limit.count);
+    TEST_CHECK_(limit.sort == SORT_MTIME, "sort is %d should be %d", limit.sort, SORT_MTIME);
+    TEST_CHECK_(limit.descending, "should be descending");
+}
+
+void test_parse_limit_sort() {
+    char *test_argv[] = {"-size", "+1k", "-sort", "name", "-limit", "10"};
+    size_t size = 6;
+    parser_limit_t limit;
+    TEST_CHECK_(parser_parse_limit(test_argv, &size, &limit) == 0, "should be valid");
+    TEST_CHECK_(size == 2, "size is %zu should be 2", size);
+    TEST_CHECK_(limit.count == 10, "count is %zu should be 10", limit.count);
+    TEST_CHECK_(limit.sort == SORT_NAME, "sort is %d should be %d", limit.sort, SORT_NAME);
+    TEST_CHECK_(!limit.descending, "should be ascending");
+}
+
+void test_parse_limit_sort_order() {
+    char *test_argv[] = {"-limit", "3", "-sort", "size", "asc"};
+    size_t size = 5;
+    parser_limit_t limit;
+    TEST_CHECK_(parser_parse_limit(test_argv, &size, &limit) == 0, "should be valid");
+    TEST_CHECK_(size == 0, "size is %zu should be 0", size);
+    TEST_CHECK_(limit.sort == SORT_SIZE, "sort is %d should be %d", limit.sort, SORT_SIZE);
+    TEST_CHECK_(!limit.descending, "should be ascending");
+}
+
+void test_parse_limit_name_value() {
+    char *test_argv[] = {"-name", "-limit"};
+    size_t size = 2;
+    parser_limit_t limit;
+    TEST_CHECK_(parser_parse_limit(test_argv, &size, &limit) == 0, "should be valid");
+    TEST_CHECK_(size == 2, "size is %zu should be 2", size);
+    TEST_CHECK_(limit.count == 0, "count is %zu should be 0", limit.count);
+}
+
+void test_parse_wrong_limit() {
+    char *test_argv[][4] = {{"-limit", "0"},           {"-limit", "ten"},  {"-limit", "5", "-name", "x"},
+                            {"-sort", "mtime"},        {"-limit"},         {"-limit", "5", "-sort", "owner"},
+                            {"-limit", "5", "-limit", "6"}};
+    size_t sizes[] = {2, 2, 4, 2, 1, 4, 4};
+    parser_limit_t limit;
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        size_t size = sizes[i];
+        TEST_CHECK_(parser_parse_limit(test_argv[i], &size, &limit) == 1, "limit %zu should be invalid", i);
+    }
+}
+
+void test_fingerprint() {
+    char *a_argv[] = {"-name", "-.pdf", "-size", "+1k"};
+    char *b_argv[] = {"-name", "-.pdf", "-size", "+1k"};
+    char *name_argv[] = {"-name", "-.txt", "-size", "+1k"};
+    char *comp_argv[] = {"-name", "-.pdf", "-size", "-1k"};
+    char *op_argv[] = {"-name", "-.pdf", "-or", "-size", "+1k"};
+    parser_limit_t limit = {10, SORT_MTIME, true};
+    parser_limit_t sorted = {10, SORT_SIZE, true};
+    uint64_t a = parser_fingerprint(parser_parse(a_argv, 4), NULL);
+    TEST_CHECK_(a == parser_fingerprint(parser_parse(b_argv, 4), NULL), "same expressions should be equal");
+    TEST_CHECK_(a != parser_fingerprint(parser_parse(name_argv, 4), NULL), "values should differ");
+    TEST_CHECK_(a != parser_fingerprint(parser_parse(comp_argv, 4), NULL), "comparisons should differ");
+    TEST_CHECK_(a != parser_fingerprint(parser_parse(op_argv, 5), NULL), "operators should differ");
+    TEST_CHECK_(a != parser_fingerprint(parser_parse(a_argv, 4), &limit), "limits should differ");
+    TEST_CHECK_(parser_fingerprint(parser_parse(a_argv, 4), &limit) !=
+                    parser_fingerprint(parser_parse(a_argv, 4), &sorted),
+                "sorts should differ");
+}
+
 // List of tests to be performed
 TEST_LIST = {{"parse empty", test_parse_empty},
              {"parse incomplete exp", test_parse_incomplete},
@@ -355,4 +438,11 @@ TEST_LIST = {{"parse empty", test_parse_empty},
              {"-group root -and -size 20 -or -not -user root -or -perm 777", test_group_size_not_user_or_perm},
              {"-group root -not -size 20 -or -user root -perm 777", test_group_not_size_or_user_perm},
              {"-group root -not ( -size 20 -or -user root ) -perm 777", test_group_not_size_or_user_perm_p},
+             {"parse no limit", test_parse_no_limit},
+             {"parse limit", test_parse_limit},
+             {"parse limit sort", test_parse_limit_sort},
+             {"parse limit sort order", test_parse_limit_sort_order},
+             {"parse limit as name value", test_parse_limit_name_value},
+             {"parse wrong limit", test_parse_wrong_limit},
+             {"fingerprint", test_fingerprint},
              {0}};
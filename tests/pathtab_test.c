@@ -0,0 +1,138 @@
+/** This files performs unit testing on the pathtab module.
+
+    Are unit tested:
+     - interning, finding and rebuilding relative and absolute paths
+     - sharing of the folders between paths
+     - names and parents of the paths
+     - truncation of the rebuilt paths
+     - growth of the table
+
+    /!\ attention: to keep the code as concice and readable as possible, allocated memory is not freed
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "../src/pathtab.h"
+#include "vendor/cutest.h"
+
+void test_intern_path() {
+    pathtab_t *tab = pathtab_create();
+    char path[64];
+    pathtab_id_t id = pathtab_intern(tab, "dir/sub/file.c");
+    TEST_CHECK_(id != PATHTAB_NONE, "should return an id");
+    TEST_CHECK_(pathtab_path(tab, id, path, sizeof(path)) == 14, "should return the length of the path");
+    TEST_CHECK_(strcmp(path, "dir/sub/file.c") == 0, "should rebuild the path, got %s", path);
+}
+
+void test_intern_absolute_path() {
+    pathtab_t *tab = pathtab_create();
+    char path[64];
+    pathtab_id_t id = pathtab_intern(tab, "/usr/include/stdio.h");
+    TEST_CHECK_(pathtab_path(tab, id, path, sizeof(path)) == 20, "should return the length of the path");
+    TEST_CHECK_(strcmp(path, "/usr/include/stdio.h") == 0, "should rebuild the path, got %s", path);
+    TEST_CHECK_(pathtab_find(tab, "usr/include/stdio.h") == PATHTAB_NONE, "should differ from the relative path");
+
+    pathtab_id_t usr = pathtab_find(tab, "/usr");
+    TEST_CHECK_(usr != PATHTAB_NONE, "should find the folder");
+    TEST_CHECK_(pathtab_path(tab, usr, path, sizeof(path)) == 4 && strcmp(path, "/usr") == 0,
+                "should rebuild the folder, got %s", path);
+    TEST_CHECK_(pathtab_find(tab, "") == pathtab_parent(tab, usr), "should start with an empty component");
+}
+
+void test_intern_twice() {
+    pathtab_t *tab = pathtab_create();
+    pathtab_id_t id = pathtab_intern(tab, "/a/b/c");
+    size_t count = pathtab_count(tab);
+    TEST_CHECK_(pathtab_intern(tab, "/a/b/c") == id, "should return the same id");
+    TEST_CHECK_(pathtab_count(tab) == count, "should not add nodes");
+}
+
+void test_find() {
+    pathtab_t *tab = pathtab_create();
+    pathtab_id_t id = pathtab_intern(tab, "a/b/c");
+    TEST_CHECK_(pathtab_find(tab, "a/b/c") == id, "should find the path");
+    TEST_CHECK_(pathtab_find(tab, "a/b") == pathtab_parent(tab, id), "should find the folder");
+    TEST_CHECK_(pathtab_find(tab, "a/b/d") == PATHTAB_NONE, "should not find an unknown name");
+    TEST_CHECK_(pathtab_find(tab, "a/c") == PATHTAB_NONE, "should not find a known name in another folder");
+    TEST_CHECK_(pathtab_find(tab, "a/b/c/d") == PATHTAB_NONE, "should not find a path below");
+    TEST_CHECK_(pathtab_count(tab) == 3, "should not add nodes, got %zu", pathtab_count(tab));
+}
+
+void test_shared_folders() {
+    pathtab_t *tab = pathtab_create();
+    pathtab_id_t a = pathtab_intern(tab, "/src/a.c");
+    pathtab_id_t b = pathtab_intern(tab, "/src/b.c");
+    TEST_CHECK_(a != b, "should return different ids");
+    TEST_CHECK_(pathtab_parent(tab, a) == pathtab_parent(tab, b), "should share the folder");
+    TEST_CHECK_(pathtab_count(tab) == 4, "should only add the names, got %zu", pathtab_count(tab));
+}
+
+void test_name_parent() {
+    pathtab_t *tab = pathtab_create();
+    pathtab_id_t id = pathtab_intern(tab, "/src/a.c");
+    TEST_CHECK_(strcmp(pathtab_name(tab, id), "a.c") == 0, "should return the basename");
+    pathtab_id_t folder = pathtab_parent(tab, id);
+    TEST_CHECK_(strcmp(pathtab_name(tab, folder), "src") == 0, "should return the folder");
+    pathtab_id_t root = pathtab_parent(tab, folder);
+    TEST_CHECK_(strcmp(pathtab_name(tab, root), "") == 0, "should start with an empty component");
+    TEST_CHECK_(pathtab_parent(tab, root) == PATHTAB_NONE, "should end at the first component");
+}
+
+void test_path_truncated() {
+    pathtab_t *tab = pathtab_create();
+    char path[8];
+    memset(path, 'x', sizeof(path));
+    pathtab_id_t id = pathtab_intern(tab, "/abc/defgh/ij");
+    TEST_CHECK_(pathtab_path(tab, id, path, sizeof(path)) == 13, "should return the length of the full path");
+    TEST_CHECK_(strcmp(path, "/abc/de") == 0, "should truncate the path, got %s", path);
+
+    memset(path, 'x', sizeof(path));
+    TEST_CHECK_(pathtab_path(tab, id, path, 5) == 13, "should return the length of the full path");
+    TEST_CHECK_(strcmp(path, "/abc") == 0 && path[5] == 'x', "should truncate before a separator, got %s", path);
+
+    memset(path, 'x', sizeof(path));
+    TEST_CHECK_(pathtab_path(tab, id, path, 1) == 13, "should return the length of the full path");
+    TEST_CHECK_(path[0] == '\0' && path[1] == 'x', "should only terminate the path");
+
+    TEST_CHECK_(pathtab_path(tab, id, path, 0) == 13, "should only return the length");
+    TEST_CHECK_(path[1] == 'x', "should not write the path");
+}
+
+void test_path_exact_size() {
+    pathtab_t *tab = pathtab_create();
+    char path[6];
+    pathtab_id_t id = pathtab_intern(tab, "ab/cd");
+    TEST_CHECK_(pathtab_path(tab, id, path, sizeof(path)) == 5, "should return the length of the path");
+    TEST_CHECK_(strcmp(path, "ab/cd") == 0, "should fit the path, got %s", path);
+}
+
+void test_grow() {
+    pathtab_t *tab = pathtab_create();
+    char name[64];
+    char path[64];
+    pathtab_id_t ids[10000];
+    for (int i = 0; i < 10000; i++) {
+        sprintf(name, "/root/dir%d/file%d", i % 100, i);
+        ids[i] = pathtab_intern(tab, name);
+    }
+    TEST_CHECK_(pathtab_count(tab) == 1 + 1 + 100 + 10000, "should count the nodes, got %zu", pathtab_count(tab));
+    for (int i = 0; i < 10000; i++) {
+        sprintf(name, "/root/dir%d/file%d", i % 100, i);
+        pathtab_path(tab, ids[i], path, sizeof(path));
+        if (!TEST_CHECK_(pathtab_find(tab, name) == ids[i] && strcmp(path, name) == 0,
+                         "should keep the path %s, got %s", name, path)) {
+            break;
+        }
+    }
+}
+
+TEST_LIST = {{"intern path", test_intern_path},
+             {"intern absolute path", test_intern_absolute_path},
+             {"intern twice", test_intern_twice},
+             {"find", test_find},
+             {"shared folders", test_shared_folders},
+             {"name parent", test_name_parent},
+             {"path truncated", test_path_truncated},
+             {"path exact size", test_path_exact_size},
+             {"grow", test_grow},
+             {0}};
@@ -0,0 +1,127 @@
+/** This files performs unit testing on the ring module.
+
+    Are unit tested:
+     - order of the items
+     - capacity rounded up to a power of two
+     - wrap-around of the positions
+     - closing of the ring, before and after the last items
+     - producer and consumer threads, with backpressure
+
+    /!\ attention: to keep the code as concice and readable as possible, allocated memory is not freed
+*/
+
+#include <pthread.h>
+#include "../src/ring.h"
+#include "vendor/cutest.h"
+
+/**
+ * Number of items sent by the producer thread
+ */
+#define RING_TEST_ITEMS 200000
+
+void test_order() {
+    ring_t *ring = ring_create(8);
+    ring_item_t item;
+    for (size_t i = 0; i < 8; i++) {
+        ring_push(ring, (ring_item_t){i, &item});
+    }
+    for (size_t i = 0; i < 8; i++) {
+        TEST_CHECK_(ring_pop(ring, &item) && item.tag == i && item.data == &item, "should pop item %zu", i);
+    }
+}
+
+void test_capacity_rounded() {
+    // pushing more items than the capacity asked without popping would block if it was not rounded up
+    ring_t *ring = ring_create(3);
+    ring_item_t item;
+    for (size_t i = 0; i < 4; i++) {
+        ring_push(ring, (ring_item_t){i, NULL});
+    }
+    for (size_t i = 0; i < 4; i++) {
+        TEST_CHECK_(ring_pop(ring, &item) && item.tag == i, "should pop item %zu", i);
+    }
+}
+
+void test_wrap_around() {
+    ring_t *ring = ring_create(4);
+    ring_item_t item;
+    size_t pushed = 0;
+    size_t popped = 0;
+    // one item stays in the ring, the others cross the end of the items at each round
+    ring_push(ring, (ring_item_t){pushed++, NULL});
+    for (int round = 0; round < 100; round++) {
+        for (int i = 0; i < 3; i++) {
+            ring_push(ring, (ring_item_t){pushed++, NULL});
+        }
+        for (int i = 0; i < 3; i++) {
+            if (!TEST_CHECK_(ring_pop(ring, &item) && item.tag == popped, "should pop item %zu, got %zu", popped,
+                             item.tag)) {
+                return;
+            }
+            popped++;
+        }
+    }
+    ring_close(ring);
+    while (ring_pop(ring, &item)) {
+        TEST_CHECK_(item.tag == popped, "should pop item %zu after the close, got %zu", popped, item.tag);
+        popped++;
+    }
+    TEST_CHECK_(popped == pushed, "should pop all the items, got %zu of %zu", popped, pushed);
+}
+
+void test_close_empty() {
+    ring_t *ring = ring_create(4);
+    ring_item_t item;
+    ring_close(ring);
+    TEST_CHECK_(!ring_pop(ring, &item), "should pop nothing");
+    TEST_CHECK_(!ring_pop(ring, &item), "should pop nothing again");
+}
+
+void test_close_items() {
+    ring_t *ring = ring_create(4);
+    ring_item_t item;
+    ring_push(ring, (ring_item_t){1, NULL});
+    ring_push(ring, (ring_item_t){2, NULL});
+    ring_close(ring);
+    TEST_CHECK_(ring_pop(ring, &item) && item.tag == 1, "should pop the first item");
+    TEST_CHECK_(ring_pop(ring, &item) && item.tag == 2, "should pop the second item");
+    TEST_CHECK_(!ring_pop(ring, &item), "should pop nothing after the items");
+}
+
+/**
+ * Push the items of the threaded test, then close the ring.
+ * @param ring The ring
+ * @return NULL
+ */
+void *produce(void *ring) {
+    for (size_t i = 0; i < RING_TEST_ITEMS; i++) {
+        ring_push(ring, (ring_item_t){i, NULL});
+    }
+    ring_close(ring);
+    return NULL;
+}
+
+void test_threads() {
+    ring_t *ring = ring_create(8);
+    ring_item_t item;
+    pthread_t producer;
+    pthread_create(&producer, NULL, produce, ring);
+
+    size_t popped = 0;
+    while (ring_pop(ring, &item)) {
+        if (!TEST_CHECK_(item.tag == popped, "should pop item %zu, got %zu", popped, item.tag)) {
+            break;
+        }
+        popped++;
+    }
+    pthread_join(producer, NULL);
+    TEST_CHECK_(popped == RING_TEST_ITEMS, "should pop all the items, got %zu", popped);
+}
+
+TEST_LIST = {{"order", test_order},
+             {"capacity rounded", test_capacity_rounded},
+             {"wrap around", test_wrap_around},
+             {"close empty", test_close_empty},
+             {"close items", test_close_items},
+             {"threads", test_threads},
+             {0}};
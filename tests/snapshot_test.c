@@ -0,0 +1,151 @@
+/** This files performs unit testing on the snapshot module.
+
+    Are unit tested:
+     - empty snapshot
+     - records published and read back, the removed links being ignored
+     - views invalidated by a new result set
+     - growth of the file and remapping by the reader
+     - closing of the snapshot, and invalid files
+
+    /!\ attention: to keep the code as concice and readable as possible, allocated memory is not freed
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "../src/snapshot.h"
+#include "vendor/cutest.h"
+
+/**
+ * Get a path for a snapshot file, unique to the test process.
+ * @return The path, overwritten by the next call
+ */
+char *snapshot_path() {
+    static char path[64];
+    sprintf(path, "/tmp/snapshot_test.%d", (int)getpid());
+    return path;
+}
+
+void test_empty() {
+    snapshot_t *snapshot = snapshot_create(snapshot_path());
+    snapshot_reader_t *reader = snapshot_open(snapshot_path());
+    snapshot_view_t view;
+    char *name, *target;
+    TEST_CHECK_(reader != NULL, "should open the snapshot");
+    TEST_CHECK_(snapshot_begin(reader, &view) == 0, "should take a view");
+    TEST_CHECK_(view.count == 0 && view.generation == 0, "should have no records");
+    TEST_CHECK_(!snapshot_next(&view, &name, &target), "should iterate no records");
+    TEST_CHECK_(snapshot_validate(reader, &view), "should validate the view");
+    snapshot_close(reader);
+    snapshot_free(snapshot);
+}
+
+void test_publish() {
+    snapshot_t *snapshot = snapshot_create(snapshot_path());
+    snapshot_reader_t *reader = snapshot_open(snapshot_path());
+    snapshot_view_t view;
+    char *name, *target;
+    snapshot_add(true, "a.c", "/src/a.c", snapshot);
+    snapshot_add(false, "old.c", "/src/old.c", snapshot);
+    snapshot_add(true, "a.c.1", "/lib/a.c", snapshot);
+    TEST_CHECK_(snapshot_publish(snapshot, 7) == 0, "should publish");
+
+    TEST_CHECK_(snapshot_begin(reader, &view) == 0, "should take a view");
+    TEST_CHECK_(view.count == 2 && view.generation == 7, "should have the records, got %lu",
+                (unsigned long)view.count);
+    TEST_CHECK_(snapshot_next(&view, &name, &target) && strcmp(name, "a.c") == 0 && strcmp(target, "/src/a.c") == 0,
+                "should read the first record");
+    TEST_CHECK_(snapshot_next(&view, &name, &target) && strcmp(name, "a.c.1") == 0 &&
+                    strcmp(target, "/lib/a.c") == 0,
+                "should read the second record");
+    TEST_CHECK_(!snapshot_next(&view, &name, &target), "should not read the removed link");
+    TEST_CHECK_(snapshot_validate(reader, &view), "should validate the view");
+    snapshot_close(reader);
+    snapshot_free(snapshot);
+}
+
+void test_invalidated() {
+    snapshot_t *snapshot = snapshot_create(snapshot_path());
+    snapshot_reader_t *reader = snapshot_open(snapshot_path());
+    snapshot_view_t view;
+    char *name, *target;
+    snapshot_add(true, "a", "/a", snapshot);
+    snapshot_publish(snapshot, 1);
+    TEST_CHECK_(snapshot_begin(reader, &view) == 0, "should take a view");
+
+    snapshot_add(true, "b", "/b", snapshot);
+    snapshot_publish(snapshot, 2);
+    TEST_CHECK_(snapshot_next(&view, &name, &target) && strcmp(name, "a") == 0,
+                "should keep the previous records in place");
+    TEST_CHECK_(!snapshot_validate(reader, &view), "should invalidate the view");
+
+    TEST_CHECK_(snapshot_begin(reader, &view) == 0, "should take a new view");
+    TEST_CHECK_(snapshot_next(&view, &name, &target) && strcmp(name, "b") == 0 && view.generation == 2,
+                "should read the new records");
+    TEST_CHECK_(snapshot_validate(reader, &view), "should validate the new view");
+    snapshot_close(reader);
+    snapshot_free(snapshot);
+}
+
+void test_grow() {
+    snapshot_t *snapshot = snapshot_create(snapshot_path());
+    snapshot_reader_t *reader = snapshot_open(snapshot_path());
+    snapshot_view_t view;
+    char name[32], target[64];
+    char *read_name, *read_target;
+    snapshot_add(true, "a", "/a", snapshot);
+    snapshot_publish(snapshot, 1);
+    TEST_CHECK_(snapshot_begin(reader, &view) == 0, "should take a view");
+
+    for (int i = 0; i < 10000; i++) {
+        sprintf(name, "file%d", i);
+        sprintf(target, "/folder%d/file%d", i % 10, i);
+        snapshot_add(true, name, target, snapshot);
+    }
+    TEST_CHECK_(snapshot_publish(snapshot, 2) == 0, "should publish");
+    TEST_CHECK_(snapshot_begin(reader, &view) == 0, "should take a view of the grown file");
+    TEST_CHECK_(view.count == 10000, "should have the records, got %lu", (unsigned long)view.count);
+
+    int count = 0;
+    while (snapshot_next(&view, &read_name, &read_target)) {
+        sprintf(name, "file%d", count);
+        sprintf(target, "/folder%d/file%d", count % 10, count);
+        if (!TEST_CHECK_(strcmp(read_name, name) == 0 && strcmp(read_target, target) == 0,
+                         "should read record %d, got %s", count, read_name)) {
+            break;
+        }
+        count++;
+    }
+    TEST_CHECK_(count == 10000, "should read all the records, got %d", count);
+    TEST_CHECK_(snapshot_validate(reader, &view), "should validate the view");
+    snapshot_close(reader);
+    snapshot_free(snapshot);
+}
+
+void test_closed() {
+    snapshot_t *snapshot = snapshot_create(snapshot_path());
+    snapshot_reader_t *reader = snapshot_open(snapshot_path());
+    snapshot_view_t view;
+    snapshot_free(snapshot);
+    TEST_CHECK_(access(snapshot_path(), F_OK) != 0, "should delete the file");
+    TEST_CHECK_(snapshot_begin(reader, &view) == 1, "should not take a view of a closed snapshot");
+    snapshot_close(reader);
+}
+
+void test_open_invalid() {
+    TEST_CHECK_(snapshot_open(snapshot_path()) == NULL, "should not open a missing file");
+
+    FILE *file = fopen(snapshot_path(), "w");
+    fputs("not a snapshot", file);
+    fclose(file);
+    TEST_CHECK_(snapshot_open(snapshot_path()) == NULL, "should not open a file too small");
+    unlink(snapshot_path());
+}
+
+TEST_LIST = {{"empty", test_empty},
+             {"publish", test_publish},
+             {"invalidated", test_invalidated},
+             {"grow", test_grow},
+             {"closed", test_closed},
+             {"open invalid", test_open_invalid},
+             {0}};